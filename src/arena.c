@@ -0,0 +1,75 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "arena.h"
+
+/* a new generation, with one reference held by the caller */
+arena_t *arena_new(void) {
+  return arena_sized(ARENA_CHUNK);
+}
+
+/* one whose strings are carved from smaller blocks, for a small text (an
+ * included file) whose strings are known to take about chunk bytes */
+arena_t *arena_sized(size_t chunk) {
+  arena_t *a = calloc(1, sizeof(*a));
+  if (a == NULL) return NULL;
+  a->refs = 1;
+  a->chunk = chunk;
+  return a;
+}
+
+arena_t *arena_ref(arena_t *a) {
+  if (a) a->refs++;
+  return a;
+}
+
+void arena_unref(arena_t *a) {
+  arena_block *b, *next;
+
+  if ((a == NULL) || (--a->refs > 0)) return;
+  for(b = a->head; b; b = next) {
+    next = b->next;
+    free(b);
+  }
+  free(a);
+}
+
+/* sz bytes, or NULL if out of memory. a request larger than a block gets
+ * a block of its own */
+void *arena_alloc(arena_t *a, size_t sz) {
+  arena_block *b = a->head;
+  size_t bsz;
+  char *p;
+
+  if ((b == NULL) || (b->size - b->used < sz)) {
+    bsz = (sz > a->chunk) ? sz : a->chunk;
+    b = malloc(sizeof(*b) + bsz);
+    if (b == NULL) return NULL;
+    b->size = bsz;
+    b->used = 0;
+    if (a->head && (bsz > a->chunk)) {
+      /* keep filling the current block after this one */
+      b->next = a->head->next;
+      a->head->next = b;
+    } else {
+      b->next = a->head;
+      a->head = b;
+    }
+  }
+  p = b->d + b->used;
+  b->used += sz;
+  a->bytes += sz;
+  return p;
+}
+
+char *arena_strndup(arena_t *a, const char *s, size_t n) {
+  char *p = arena_alloc(a, n + 1);
+  if (p == NULL) return NULL;
+  memcpy(p, s, n);
+  p[n] = '\0';
+  return p;
+}
+
+char *arena_strdup(arena_t *a, const char *s) {
+  return arena_strndup(a, s, strlen(s));
+}
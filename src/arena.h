@@ -0,0 +1,37 @@
+#ifndef _ARENA_H_
+#define _ARENA_H_
+
+#include <stddef.h>
+
+#define ARENA_CHUNK (64 * 1024)  /* strings are carved from blocks this big */
+
+typedef struct arena_block {
+  struct arena_block *next;    /* the block filled before this one */
+  size_t size;                 /* of d */
+  size_t used;
+  char d[];
+} arena_block;
+
+/* the strings of one parse of the config (a generation). they are carved
+ * from large blocks, not allocated one by one, and never freed singly.
+ * each job defined by the parse holds a reference; the generation is
+ * freed in one go when the last job that refers to it is */
+typedef struct {
+  arena_block *head;           /* the block being filled */
+  unsigned refs;
+  size_t bytes;                /* handed out, over all blocks */
+  size_t chunk;                /* the size of its blocks */
+} arena_t;
+
+/* arena_alloc'd bytes are not aligned: a generation holds strings */
+
+/* prototypes */
+arena_t *arena_new(void);
+arena_t *arena_sized(size_t chunk);
+arena_t *arena_ref(arena_t *a);
+void arena_unref(arena_t *a);
+void *arena_alloc(arena_t *a, size_t sz);
+char *arena_strndup(arena_t *a, const char *s, size_t n);
+char *arena_strdup(arena_t *a, const char *s);
+
+#endif /* _ARENA_H_ */
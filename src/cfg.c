@@ -15,8 +15,10 @@
 #line 5 "cfg.y"
 #include "net.h"
 #line 6 "cfg.y"
+#include "frag.h"
+#line 7 "cfg.y"
 #include "utarray.h"
-#line 20 "cfg.c"
+#line 22 "cfg.c"
 /* Next is all token values, in a form suitable for use by makeheaders.
 ** This section will be null unless lemon is run with the -m switch.
 */
@@ -67,7 +69,7 @@
 **                       defined, then do no error processing.
 */
 #define YYCODETYPE unsigned char
-#define YYNOCODE 42
+#define YYNOCODE 49
 #define YYACTIONTYPE unsigned char
 #define ParseTOKENTYPE char*
 typedef union {
@@ -81,8 +83,8 @@ typedef union {
 #define ParseARG_PDECL ,parse_t *ps
 #define ParseARG_FETCH parse_t *ps = yypParser->ps
 #define ParseARG_STORE yypParser->ps = ps
-#define YYNSTATE 65
-#define YYNRULE 38
+#define YYNSTATE 84
+#define YYNRULE 49
 #define YY_NO_ACTION      (YYNSTATE+YYNRULE+2)
 #define YY_ACCEPT_ACTION  (YYNSTATE+YYNRULE+1)
 #define YY_ERROR_ACTION   (YYNSTATE+YYNRULE)
@@ -152,49 +154,56 @@ static const YYMINORTYPE yyzerominor = { 0 };
 **  yy_default[]       Default action for each state.
 */
 static const YYACTIONTYPE yy_action[] = {
- /*     0 */    36,   21,    4,    9,   10,   11,   12,   22,   23,   24,
- /*    10 */    14,   55,   56,   57,   27,   28,   37,   30,   31,   21,
- /*    20 */     4,    9,   10,   11,   12,   22,   23,   24,   14,   55,
- /*    30 */    56,   57,   27,   28,   41,   30,   31,   65,   16,  104,
- /*    40 */     2,   18,   43,   20,    6,   64,   32,   33,    3,   62,
- /*    50 */    44,   44,    7,   25,   40,   60,   39,   13,   42,    8,
- /*    60 */    26,   61,   45,   46,   47,   53,   15,   48,   17,   19,
- /*    70 */    34,   35,    1,   38,   49,   50,   51,   52,   54,   58,
- /*    80 */    29,   59,   63,  105,    5,
+ /*     0 */    49,   23,    4,    9,   10,   11,   12,   24,   25,   26,
+ /*    10 */    15,   68,   69,   70,   29,   30,   57,   32,   13,   34,
+ /*    20 */    37,   38,   41,   42,   23,    4,    9,   10,   11,   12,
+ /*    30 */    24,   25,   26,   15,   68,   69,   70,   29,   30,   54,
+ /*    40 */    32,   13,   34,   37,   38,   41,   42,   84,   17,  134,
+ /*    50 */     2,   19,   56,   21,   22,   75,    6,   83,   44,   45,
+ /*    60 */     3,   57,   53,    7,   28,    8,   50,   73,   52,   55,
+ /*    70 */    66,   27,   74,   58,   59,   60,   14,   61,   77,   33,
+ /*    80 */    18,   20,   46,   47,   48,   16,   51,   62,   63,   64,
+ /*    90 */     1,   65,   67,   71,   31,   72,   76,   35,   36,    5,
+ /*   100 */    78,   79,   39,   40,   80,   81,   43,   82,
 };
 static const YYCODETYPE yy_lookahead[] = {
- /*     0 */     8,    9,   10,   11,   12,   13,   14,   15,   16,   17,
- /*    10 */    18,   19,   20,   21,   22,   23,   36,   25,   26,    9,
- /*    20 */    10,   11,   12,   13,   14,   15,   16,   17,   18,   19,
- /*    30 */    20,   21,   22,   23,    3,   25,   26,    0,    1,   31,
- /*    40 */    32,    4,   30,    6,   35,   36,   33,   34,   29,   29,
- /*    50 */     3,    3,   40,    3,   30,    8,   37,    7,   27,   39,
- /*    60 */     3,   29,   29,   29,   29,    8,   38,   29,    2,    5,
- /*    70 */     3,    3,    7,    3,    3,    3,    3,    3,    3,    3,
- /*    80 */    24,    3,    3,   41,    7,
+ /*     0 */     9,   10,   11,   12,   13,   14,   15,   16,   17,   18,
+ /*    10 */    19,   20,   21,   22,   23,   24,    3,   26,   27,   28,
+ /*    20 */    29,   30,   31,   32,   10,   11,   12,   13,   14,   15,
+ /*    30 */    16,   17,   18,   19,   20,   21,   22,   23,   24,    3,
+ /*    40 */    26,   27,   28,   29,   30,   31,   32,    0,    1,   37,
+ /*    50 */    38,    4,   36,    6,    7,   35,   41,   42,   39,   40,
+ /*    60 */    35,    3,   36,   47,    3,   45,   42,    9,   43,   33,
+ /*    70 */     9,    3,   35,   35,   35,   35,    8,   35,    3,   46,
+ /*    80 */     2,    5,    3,    3,    3,   44,    3,    3,    3,    3,
+ /*    90 */     8,    3,    3,    3,   25,    3,    3,    3,    3,    8,
+ /*   100 */     3,    3,    3,    3,    3,    3,    3,    3,
 };
-#define YY_SHIFT_USE_DFLT (-9)
-#define YY_SHIFT_MAX 31
+#define YY_SHIFT_USE_DFLT (-10)
+#define YY_SHIFT_MAX 43
 static const signed char yy_shift_ofst[] = {
- /*     0 */    -9,   10,   37,   31,   48,   48,   -8,   31,   47,   48,
- /*    10 */    48,   48,   48,   -9,   50,   57,   66,   67,   64,   68,
- /*    20 */    65,   70,   71,   72,   73,   74,   75,   76,   56,   78,
- /*    30 */    77,   79,
+ /*     0 */   -10,   14,   47,   36,   13,   13,   -9,   36,   58,   13,
+ /*    10 */    13,   13,   13,   75,  -10,   68,   61,   78,   79,   76,
+ /*    20 */    80,   81,   82,   83,   84,   85,   86,   88,   89,   90,
+ /*    30 */    69,   92,   91,   93,   94,   95,   97,   98,   99,  100,
+ /*    40 */   101,  102,  103,  104,
 };
-#define YY_REDUCE_USE_DFLT (-21)
-#define YY_REDUCE_MAX 13
+#define YY_REDUCE_USE_DFLT (-1)
+#define YY_REDUCE_MAX 14
 static const signed char yy_reduce_ofst[] = {
- /*     0 */     8,    9,   13,   12,   19,   20,  -20,   24,   32,   33,
- /*    10 */    34,   35,   38,   28,
+ /*     0 */    12,   15,   19,   16,   25,   20,   24,   26,   37,   38,
+ /*    10 */    39,   40,   42,   33,   41,
 };
 static const YYACTIONTYPE yy_default[] = {
- /*     0 */    68,  103,  103,   92,  103,  103,  103,   93,  103,  103,
- /*    10 */   103,  103,  103,  102,  103,  103,  103,  103,  103,  103,
- /*    20 */   103,  103,  103,  103,  103,  103,  103,  103,  103,  103,
- /*    30 */   103,  103,   66,   67,   69,   70,   71,   72,   74,   75,
- /*    40 */    95,   97,   98,   96,   94,   76,   77,   78,   79,   80,
- /*    50 */    81,   82,   83,   84,  101,   85,   86,   87,   88,   89,
- /*    60 */    90,   99,  100,   91,   73,
+ /*     0 */    87,  133,  133,  120,  133,  133,  133,  121,  133,  133,
+ /*    10 */   133,  133,  133,  133,  132,  133,  133,  133,  133,  133,
+ /*    20 */   133,  133,  133,  133,  133,  133,  133,  133,  133,  133,
+ /*    30 */   133,  133,  133,  111,  133,  112,  113,  133,  133,  133,
+ /*    40 */   116,  133,  133,  133,   85,   86,   88,   89,   90,   91,
+ /*    50 */    92,   94,   95,  123,  125,  126,  124,  122,   96,   97,
+ /*    60 */    98,   99,  100,  101,  102,  103,  104,  131,  105,  106,
+ /*    70 */   107,  108,  109,  110,  127,  128,  129,  130,  114,  115,
+ /*    80 */   117,  118,  119,   93,
 };
 #define YY_SZ_ACTTAB (int)(sizeof(yy_action)/sizeof(yy_action[0]))
 
@@ -289,16 +298,17 @@ void ParseTrace(FILE *TraceFILE, char *zTracePrompt){
 ** are required.  The following table supplies these names */
 static const char *const yyTokenName[] = { 
   "$",             "REPORT",        "TO",            "STR",         
-  "LISTEN",        "ON",            "JOB",           "LCURLY",      
-  "RCURLY",        "NAME",          "CMD",           "DIR",         
-  "OUT",           "IN",            "ERR",           "USER",        
-  "ORDER",         "ENV",           "ULIMIT",        "DISABLED",    
-  "WAIT",          "ONCE",          "NICE",          "BOUNCE",      
-  "EVERY",         "DEPENDS",       "CPUSET",        "QUOTEDSTR",   
-  "error",         "path",          "arg",           "file",        
-  "decls",         "job",           "decl",          "sbody",       
-  "kv",            "cmd",           "pairs",         "paths",       
-  "args",        
+  "LISTEN",        "ON",            "INCLUDE",       "JOB",         
+  "LCURLY",        "RCURLY",        "NAME",          "CMD",         
+  "DIR",           "OUT",           "IN",            "ERR",         
+  "USER",          "ORDER",         "ENV",           "ULIMIT",      
+  "DISABLED",      "WAIT",          "ONCE",          "NICE",        
+  "BOUNCE",        "EVERY",         "DEPENDS",       "AFTER",       
+  "CPUSET",        "INSTANCES",     "BACKOFF",       "JITTER",      
+  "BREAKER",       "QUOTEDSTR",     "error",         "path",        
+  "arg",           "file",          "decls",         "job",         
+  "decl",          "sbody",         "kv",            "cmd",         
+  "pairs",         "paths",         "names",         "args",        
 };
 #endif /* NDEBUG */
 
@@ -312,38 +322,49 @@ static const char *const yyRuleName[] = {
  /*   3 */ "decls ::=",
  /*   4 */ "decl ::= REPORT TO STR",
  /*   5 */ "decl ::= LISTEN ON STR",
- /*   6 */ "job ::= JOB LCURLY sbody RCURLY",
- /*   7 */ "sbody ::= sbody kv",
- /*   8 */ "sbody ::= kv",
- /*   9 */ "kv ::= NAME STR",
- /*  10 */ "kv ::= CMD cmd",
- /*  11 */ "kv ::= DIR path",
- /*  12 */ "kv ::= OUT path",
- /*  13 */ "kv ::= IN path",
- /*  14 */ "kv ::= ERR path",
- /*  15 */ "kv ::= USER STR",
- /*  16 */ "kv ::= ORDER STR",
- /*  17 */ "kv ::= ENV STR",
- /*  18 */ "kv ::= ULIMIT STR STR",
- /*  19 */ "kv ::= ULIMIT LCURLY pairs RCURLY",
- /*  20 */ "kv ::= DISABLED",
- /*  21 */ "kv ::= WAIT",
- /*  22 */ "kv ::= ONCE",
- /*  23 */ "kv ::= NICE STR",
- /*  24 */ "kv ::= BOUNCE EVERY STR",
- /*  25 */ "kv ::= DEPENDS LCURLY paths RCURLY",
- /*  26 */ "kv ::= CPUSET STR",
- /*  27 */ "cmd ::= path",
- /*  28 */ "cmd ::= path args",
- /*  29 */ "path ::= STR",
- /*  30 */ "args ::= args arg",
- /*  31 */ "args ::= arg",
- /*  32 */ "arg ::= STR",
- /*  33 */ "arg ::= QUOTEDSTR",
- /*  34 */ "paths ::= paths path",
- /*  35 */ "paths ::= path",
- /*  36 */ "pairs ::= pairs STR STR",
- /*  37 */ "pairs ::=",
+ /*   6 */ "decl ::= INCLUDE STR",
+ /*   7 */ "job ::= JOB LCURLY sbody RCURLY",
+ /*   8 */ "sbody ::= sbody kv",
+ /*   9 */ "sbody ::= kv",
+ /*  10 */ "kv ::= NAME STR",
+ /*  11 */ "kv ::= CMD cmd",
+ /*  12 */ "kv ::= DIR path",
+ /*  13 */ "kv ::= OUT path",
+ /*  14 */ "kv ::= IN path",
+ /*  15 */ "kv ::= ERR path",
+ /*  16 */ "kv ::= USER STR",
+ /*  17 */ "kv ::= ORDER STR",
+ /*  18 */ "kv ::= ENV STR",
+ /*  19 */ "kv ::= ULIMIT STR STR",
+ /*  20 */ "kv ::= ULIMIT LCURLY pairs RCURLY",
+ /*  21 */ "kv ::= DISABLED",
+ /*  22 */ "kv ::= WAIT",
+ /*  23 */ "kv ::= ONCE",
+ /*  24 */ "kv ::= NICE STR",
+ /*  25 */ "kv ::= BOUNCE EVERY STR",
+ /*  26 */ "kv ::= DEPENDS LCURLY paths RCURLY",
+ /*  27 */ "kv ::= AFTER names",
+ /*  28 */ "kv ::= CPUSET STR",
+ /*  29 */ "kv ::= CPUSET STR STR",
+ /*  30 */ "kv ::= CPUSET STR STR STR",
+ /*  31 */ "kv ::= INSTANCES STR",
+ /*  32 */ "kv ::= BACKOFF STR STR",
+ /*  33 */ "kv ::= BACKOFF STR STR STR",
+ /*  34 */ "kv ::= JITTER STR",
+ /*  35 */ "kv ::= BREAKER STR STR",
+ /*  36 */ "cmd ::= path",
+ /*  37 */ "cmd ::= path args",
+ /*  38 */ "path ::= STR",
+ /*  39 */ "args ::= args arg",
+ /*  40 */ "args ::= arg",
+ /*  41 */ "arg ::= STR",
+ /*  42 */ "arg ::= QUOTEDSTR",
+ /*  43 */ "paths ::= paths path",
+ /*  44 */ "paths ::= path",
+ /*  45 */ "names ::= names STR",
+ /*  46 */ "names ::= STR",
+ /*  47 */ "pairs ::= pairs STR STR",
+ /*  48 */ "pairs ::=",
 };
 #endif /* NDEBUG */
 
@@ -648,44 +669,55 @@ static const struct {
   YYCODETYPE lhs;         /* Symbol on the left-hand side of the rule */
   unsigned char nrhs;     /* Number of right-hand side symbols in the rule */
 } yyRuleInfo[] = {
-  { 31, 1 },
-  { 32, 2 },
-  { 32, 2 },
-  { 32, 0 },
-  { 34, 3 },
-  { 34, 3 },
-  { 33, 4 },
-  { 35, 2 },
+  { 37, 1 },
+  { 38, 2 },
+  { 38, 2 },
+  { 38, 0 },
+  { 40, 3 },
+  { 40, 3 },
+  { 40, 2 },
+  { 39, 4 },
+  { 41, 2 },
+  { 41, 1 },
+  { 42, 2 },
+  { 42, 2 },
+  { 42, 2 },
+  { 42, 2 },
+  { 42, 2 },
+  { 42, 2 },
+  { 42, 2 },
+  { 42, 2 },
+  { 42, 2 },
+  { 42, 3 },
+  { 42, 4 },
+  { 42, 1 },
+  { 42, 1 },
+  { 42, 1 },
+  { 42, 2 },
+  { 42, 3 },
+  { 42, 4 },
+  { 42, 2 },
+  { 42, 2 },
+  { 42, 3 },
+  { 42, 4 },
+  { 42, 2 },
+  { 42, 3 },
+  { 42, 4 },
+  { 42, 2 },
+  { 42, 3 },
+  { 43, 1 },
+  { 43, 2 },
   { 35, 1 },
-  { 36, 2 },
-  { 36, 2 },
-  { 36, 2 },
-  { 36, 2 },
-  { 36, 2 },
-  { 36, 2 },
-  { 36, 2 },
-  { 36, 2 },
-  { 36, 2 },
-  { 36, 3 },
-  { 36, 4 },
-  { 36, 1 },
+  { 47, 2 },
+  { 47, 1 },
   { 36, 1 },
   { 36, 1 },
-  { 36, 2 },
-  { 36, 3 },
-  { 36, 4 },
-  { 36, 2 },
-  { 37, 1 },
-  { 37, 2 },
-  { 29, 1 },
-  { 40, 2 },
-  { 40, 1 },
-  { 30, 1 },
-  { 30, 1 },
-  { 39, 2 },
-  { 39, 1 },
-  { 38, 3 },
-  { 38, 0 },
+  { 45, 2 },
+  { 45, 1 },
+  { 46, 2 },
+  { 46, 1 },
+  { 44, 3 },
+  { 44, 0 },
 };
 
 static void yy_accept(yyParser*);  /* Forward Declaration */
@@ -741,140 +773,187 @@ static void yy_reduce(
   **     break;
   */
       case 4: /* decl ::= REPORT TO STR */
-#line 22 "cfg.y"
-{set_report(ps,yymsp[0].minor.yy0);}
-#line 747 "cfg.c"
-        break;
-      case 5: /* decl ::= LISTEN ON STR */
 #line 23 "cfg.y"
-{set_listen(ps,yymsp[0].minor.yy0);}
-#line 752 "cfg.c"
+{if (top_level(ps,"report")) set_report(ps,yymsp[0].minor.yy0);}
+#line 779 "cfg.c"
         break;
-      case 6: /* job ::= JOB LCURLY sbody RCURLY */
+      case 5: /* decl ::= LISTEN ON STR */
 #line 24 "cfg.y"
+{if (top_level(ps,"listen")) set_listen(ps,yymsp[0].minor.yy0);}
+#line 784 "cfg.c"
+        break;
+      case 6: /* decl ::= INCLUDE STR */
+#line 25 "cfg.y"
+{set_include(ps,yymsp[0].minor.yy0);}
+#line 789 "cfg.c"
+        break;
+      case 7: /* job ::= JOB LCURLY sbody RCURLY */
+#line 26 "cfg.y"
 {push_job(ps);}
-#line 757 "cfg.c"
+#line 794 "cfg.c"
         break;
-      case 9: /* kv ::= NAME STR */
-#line 27 "cfg.y"
+      case 10: /* kv ::= NAME STR */
+#line 29 "cfg.y"
 {set_name(ps,yymsp[0].minor.yy0);}
-#line 762 "cfg.c"
+#line 799 "cfg.c"
         break;
-      case 11: /* kv ::= DIR path */
-#line 29 "cfg.y"
+      case 12: /* kv ::= DIR path */
+#line 31 "cfg.y"
 {set_dir(ps,yymsp[0].minor.yy0);}
-#line 767 "cfg.c"
+#line 804 "cfg.c"
         break;
-      case 12: /* kv ::= OUT path */
-#line 30 "cfg.y"
+      case 13: /* kv ::= OUT path */
+#line 32 "cfg.y"
 {set_out(ps,yymsp[0].minor.yy0);}
-#line 772 "cfg.c"
+#line 809 "cfg.c"
         break;
-      case 13: /* kv ::= IN path */
-#line 31 "cfg.y"
+      case 14: /* kv ::= IN path */
+#line 33 "cfg.y"
 {set_in(ps,yymsp[0].minor.yy0);}
-#line 777 "cfg.c"
+#line 814 "cfg.c"
         break;
-      case 14: /* kv ::= ERR path */
-#line 32 "cfg.y"
+      case 15: /* kv ::= ERR path */
+#line 34 "cfg.y"
 {set_err(ps,yymsp[0].minor.yy0);}
-#line 782 "cfg.c"
+#line 819 "cfg.c"
         break;
-      case 15: /* kv ::= USER STR */
-#line 33 "cfg.y"
+      case 16: /* kv ::= USER STR */
+#line 35 "cfg.y"
 {set_user(ps,yymsp[0].minor.yy0);}
-#line 787 "cfg.c"
+#line 824 "cfg.c"
         break;
-      case 16: /* kv ::= ORDER STR */
-#line 34 "cfg.y"
+      case 17: /* kv ::= ORDER STR */
+#line 36 "cfg.y"
 {set_ord(ps,yymsp[0].minor.yy0);}
-#line 792 "cfg.c"
+#line 829 "cfg.c"
         break;
-      case 17: /* kv ::= ENV STR */
-#line 35 "cfg.y"
+      case 18: /* kv ::= ENV STR */
+#line 37 "cfg.y"
 {set_env(ps,yymsp[0].minor.yy0);}
-#line 797 "cfg.c"
+#line 834 "cfg.c"
         break;
-      case 18: /* kv ::= ULIMIT STR STR */
-      case 36: /* pairs ::= pairs STR STR */ yytestcase(yyruleno==36);
-#line 36 "cfg.y"
+      case 19: /* kv ::= ULIMIT STR STR */
+      case 47: /* pairs ::= pairs STR STR */ yytestcase(yyruleno==47);
+#line 38 "cfg.y"
 {set_ulimit(ps,yymsp[-1].minor.yy0,yymsp[0].minor.yy0);}
-#line 803 "cfg.c"
+#line 840 "cfg.c"
         break;
-      case 20: /* kv ::= DISABLED */
-#line 38 "cfg.y"
+      case 21: /* kv ::= DISABLED */
+#line 40 "cfg.y"
 {set_dis(ps);  }
-#line 808 "cfg.c"
+#line 845 "cfg.c"
         break;
-      case 21: /* kv ::= WAIT */
-#line 39 "cfg.y"
+      case 22: /* kv ::= WAIT */
+#line 41 "cfg.y"
 {set_wait(ps); }
-#line 813 "cfg.c"
+#line 850 "cfg.c"
         break;
-      case 22: /* kv ::= ONCE */
-#line 40 "cfg.y"
+      case 23: /* kv ::= ONCE */
+#line 42 "cfg.y"
 {set_once(ps); }
-#line 818 "cfg.c"
+#line 855 "cfg.c"
         break;
-      case 23: /* kv ::= NICE STR */
-#line 41 "cfg.y"
+      case 24: /* kv ::= NICE STR */
+#line 43 "cfg.y"
 {set_nice(ps,yymsp[0].minor.yy0); }
-#line 823 "cfg.c"
+#line 860 "cfg.c"
         break;
-      case 24: /* kv ::= BOUNCE EVERY STR */
-#line 42 "cfg.y"
+      case 25: /* kv ::= BOUNCE EVERY STR */
+#line 44 "cfg.y"
 {set_bounce(ps,yymsp[0].minor.yy0);}
-#line 828 "cfg.c"
+#line 865 "cfg.c"
         break;
-      case 26: /* kv ::= CPUSET STR */
-#line 44 "cfg.y"
+      case 28: /* kv ::= CPUSET STR */
+#line 47 "cfg.y"
 {set_cpu(ps,yymsp[0].minor.yy0); }
-#line 833 "cfg.c"
+#line 870 "cfg.c"
+        break;
+      case 29: /* kv ::= CPUSET STR STR */
+#line 48 "cfg.y"
+{set_cpu_cores(ps,yymsp[-1].minor.yy0,yymsp[0].minor.yy0,NULL);}
+#line 875 "cfg.c"
+        break;
+      case 30: /* kv ::= CPUSET STR STR STR */
+#line 49 "cfg.y"
+{set_cpu_cores(ps,yymsp[-2].minor.yy0,yymsp[-1].minor.yy0,yymsp[0].minor.yy0);}
+#line 880 "cfg.c"
         break;
-      case 27: /* cmd ::= path */
-#line 45 "cfg.y"
+      case 31: /* kv ::= INSTANCES STR */
+#line 50 "cfg.y"
+{set_instances(ps,yymsp[0].minor.yy0);}
+#line 885 "cfg.c"
+        break;
+      case 32: /* kv ::= BACKOFF STR STR */
+#line 51 "cfg.y"
+{set_backoff(ps,yymsp[-1].minor.yy0,yymsp[0].minor.yy0,NULL);}
+#line 890 "cfg.c"
+        break;
+      case 33: /* kv ::= BACKOFF STR STR STR */
+#line 52 "cfg.y"
+{set_backoff(ps,yymsp[-2].minor.yy0,yymsp[-1].minor.yy0,yymsp[0].minor.yy0);}
+#line 895 "cfg.c"
+        break;
+      case 34: /* kv ::= JITTER STR */
+#line 53 "cfg.y"
+{set_jitter(ps,yymsp[0].minor.yy0);}
+#line 900 "cfg.c"
+        break;
+      case 35: /* kv ::= BREAKER STR STR */
+#line 54 "cfg.y"
+{set_breaker(ps,yymsp[-1].minor.yy0,yymsp[0].minor.yy0);}
+#line 905 "cfg.c"
+        break;
+      case 36: /* cmd ::= path */
+#line 55 "cfg.y"
 {set_cmd(ps,yymsp[0].minor.yy0);}
-#line 838 "cfg.c"
+#line 910 "cfg.c"
         break;
-      case 28: /* cmd ::= path args */
-#line 46 "cfg.y"
+      case 37: /* cmd ::= path args */
+#line 56 "cfg.y"
 {set_cmd(ps,yymsp[-1].minor.yy0);}
-#line 843 "cfg.c"
+#line 915 "cfg.c"
         break;
-      case 29: /* path ::= STR */
-      case 32: /* arg ::= STR */ yytestcase(yyruleno==32);
-#line 47 "cfg.y"
+      case 38: /* path ::= STR */
+      case 41: /* arg ::= STR */ yytestcase(yyruleno==41);
+#line 57 "cfg.y"
 {yygotominor.yy0=yymsp[0].minor.yy0;}
-#line 849 "cfg.c"
+#line 921 "cfg.c"
         break;
-      case 30: /* args ::= args arg */
-      case 31: /* args ::= arg */ yytestcase(yyruleno==31);
-#line 48 "cfg.y"
+      case 39: /* args ::= args arg */
+      case 40: /* args ::= arg */ yytestcase(yyruleno==40);
+#line 58 "cfg.y"
 {utarray_push_back(&ps->job->cmdv,&yymsp[0].minor.yy0);}
-#line 855 "cfg.c"
+#line 927 "cfg.c"
         break;
-      case 33: /* arg ::= QUOTEDSTR */
-#line 51 "cfg.y"
+      case 42: /* arg ::= QUOTEDSTR */
+#line 61 "cfg.y"
 {yygotominor.yy0=unquote(yymsp[0].minor.yy0);}
-#line 860 "cfg.c"
+#line 932 "cfg.c"
         break;
-      case 34: /* paths ::= paths path */
-      case 35: /* paths ::= path */ yytestcase(yyruleno==35);
-#line 52 "cfg.y"
+      case 43: /* paths ::= paths path */
+      case 44: /* paths ::= path */ yytestcase(yyruleno==44);
+#line 62 "cfg.y"
 {utarray_push_back(&ps->job->depv,&yymsp[0].minor.yy0);}
-#line 866 "cfg.c"
+#line 938 "cfg.c"
+        break;
+      case 45: /* names ::= names STR */
+      case 46: /* names ::= STR */ yytestcase(yyruleno==46);
+#line 64 "cfg.y"
+{set_after(ps,yymsp[0].minor.yy0);}
+#line 944 "cfg.c"
         break;
       default:
       /* (0) file ::= decls */ yytestcase(yyruleno==0);
       /* (1) decls ::= decls job */ yytestcase(yyruleno==1);
       /* (2) decls ::= decls decl */ yytestcase(yyruleno==2);
       /* (3) decls ::= */ yytestcase(yyruleno==3);
-      /* (7) sbody ::= sbody kv */ yytestcase(yyruleno==7);
-      /* (8) sbody ::= kv */ yytestcase(yyruleno==8);
-      /* (10) kv ::= CMD cmd */ yytestcase(yyruleno==10);
-      /* (19) kv ::= ULIMIT LCURLY pairs RCURLY */ yytestcase(yyruleno==19);
-      /* (25) kv ::= DEPENDS LCURLY paths RCURLY */ yytestcase(yyruleno==25);
-      /* (37) pairs ::= */ yytestcase(yyruleno==37);
+      /* (8) sbody ::= sbody kv */ yytestcase(yyruleno==8);
+      /* (9) sbody ::= kv */ yytestcase(yyruleno==9);
+      /* (11) kv ::= CMD cmd */ yytestcase(yyruleno==11);
+      /* (20) kv ::= ULIMIT LCURLY pairs RCURLY */ yytestcase(yyruleno==20);
+      /* (26) kv ::= DEPENDS LCURLY paths RCURLY */ yytestcase(yyruleno==26);
+      /* (27) kv ::= AFTER names */ yytestcase(yyruleno==27);
+      /* (48) pairs ::= */ yytestcase(yyruleno==48);
         break;
   };
   yygoto = yyRuleInfo[yyruleno].lhs;
@@ -920,9 +999,9 @@ static void yy_parse_failed(
   while( yypParser->yyidx>=0 ) yy_pop_parser_stack(yypParser);
   /* Here code is inserted which will be executed whenever the
   ** parser fails */
-#line 14 "cfg.y"
+#line 15 "cfg.y"
 ps->rc=-1;
-#line 926 "cfg.c"
+#line 1005 "cfg.c"
   ParseARG_STORE; /* Suppress warning about unused %extra_argument variable */
 }
 #endif /* YYNOERRORRECOVERY */
@@ -937,11 +1016,11 @@ static void yy_syntax_error(
 ){
   ParseARG_FETCH;
 #define TOKEN (yyminor.yy0)
-#line 10 "cfg.y"
+#line 11 "cfg.y"
 
-  utstring_printf(ps->em, "error in %s line %d ", ps->cfg->file, ps->line);
+  utstring_printf(ps->em, "error in %s line %d ", ps->file, ps->line);
   ps->rc=-1;
-#line 945 "cfg.c"
+#line 1024 "cfg.c"
   ParseARG_STORE; /* Suppress warning about unused %extra_argument variable */
 }
 
@@ -3,12 +3,13 @@
 %include {#include <string.h>}
 %include {#include "job.h"}
 %include {#include "net.h"}
+%include {#include "frag.h"}
 %include {#include "utarray.h"}
 %token_prefix TOK_
 %token_type {char*}
 %extra_argument {parse_t *ps}
 %syntax_error  {
-  utstring_printf(ps->em, "error in %s line %d ", ps->cfg->file, ps->line);
+  utstring_printf(ps->em, "error in %s line %d ", ps->file, ps->line);
   ps->rc=-1;
 }
 %parse_failure {ps->rc=-1;}
@@ -19,8 +20,9 @@ file ::= decls.
 decls ::= decls job.
 decls ::= decls decl.
 decls ::= .
-decl ::= REPORT TO STR(A).            {set_report(ps,A);}
-decl ::= LISTEN ON STR(A).            {set_listen(ps,A);}
+decl ::= REPORT TO STR(A).            {if (top_level(ps,"report")) set_report(ps,A);}
+decl ::= LISTEN ON STR(A).            {if (top_level(ps,"listen")) set_listen(ps,A);}
+decl ::= INCLUDE STR(A).              {set_include(ps,A);}
 job ::= JOB LCURLY sbody RCURLY.      {push_job(ps);}
 sbody ::= sbody kv.
 sbody ::= kv.
@@ -41,7 +43,15 @@ kv ::= ONCE.                          {set_once(ps); }
 kv ::= NICE STR(A).                   {set_nice(ps,A); }
 kv ::= BOUNCE EVERY STR(A).           {set_bounce(ps,A);}
 kv ::= DEPENDS LCURLY paths RCURLY.
+kv ::= AFTER names.
 kv ::= CPUSET STR(A).                 {set_cpu(ps,A); }
+kv ::= CPUSET STR(A) STR(B).          {set_cpu_cores(ps,A,B,NULL);}
+kv ::= CPUSET STR(A) STR(B) STR(C).   {set_cpu_cores(ps,A,B,C);}
+kv ::= INSTANCES STR(A).              {set_instances(ps,A);}
+kv ::= BACKOFF STR(A) STR(B).         {set_backoff(ps,A,B,NULL);}
+kv ::= BACKOFF STR(A) STR(B) STR(C).  {set_backoff(ps,A,B,C);}
+kv ::= JITTER STR(A).                 {set_jitter(ps,A);}
+kv ::= BREAKER STR(A) STR(B).         {set_breaker(ps,A,B);}
 cmd ::= path(A).                      {set_cmd(ps,A);}
 cmd ::= path(A) args.                 {set_cmd(ps,A);}
 path(A) ::= STR(B).                   {A=B;}
@@ -51,5 +61,7 @@ arg(A) ::= STR(B).                    {A=B;}
 arg(A) ::= QUOTEDSTR(B).              {A=unquote(B);}
 paths ::= paths path(A).              {utarray_push_back(&ps->job->depv,&A);}
 paths ::= path(A).                    {utarray_push_back(&ps->job->depv,&A);}
+names ::= names STR(A).               {set_after(ps,A);}
+names ::= STR(A).                     {set_after(ps,A);}
 pairs ::= pairs STR(A) STR(B).        {set_ulimit(ps,A,B);}
 pairs ::= .
@@ -0,0 +1,263 @@
+#define _GNU_SOURCE
+#include <sys/stat.h>
+#include <unistd.h>
+#include <string.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <time.h>
+
+#include "deps.h"
+
+#define P1 11400714785074694791ULL
+#define P2 14029467366897019727ULL
+#define P3  1609587929392839161ULL
+#define P4  9650029242287828579ULL
+#define P5  2870177450012600261ULL
+
+#define CHUNK (64 * 1024)      /* dependency files are read this much at once */
+
+static inline uint64_t rotl(uint64_t x, int r) {
+  return (x << r) | (x >> (64 - r));
+}
+static inline uint64_t read64(const unsigned char *p) {
+  uint64_t v;
+  memcpy(&v, p, sizeof(v));
+  return v;
+}
+static inline uint32_t read32(const unsigned char *p) {
+  uint32_t v;
+  memcpy(&v, p, sizeof(v));
+  return v;
+}
+static inline uint64_t round64(uint64_t acc, uint64_t input) {
+  acc += input * P2;
+  acc = rotl(acc, 31);
+  return acc * P1;
+}
+static inline uint64_t merge64(uint64_t acc, uint64_t v) {
+  acc ^= round64(0, v);
+  return acc * P1 + P4;
+}
+
+/* consume whole 32-byte stripes; returns the bytes consumed */
+static size_t stripes(hash64_t *h, const unsigned char *p, size_t len) {
+  uint64_t v0 = h->v[0], v1 = h->v[1], v2 = h->v[2], v3 = h->v[3];
+  size_t done = 0;
+
+  for( ; len - done >= 32; done += 32) {
+    v0 = round64(v0, read64(p + done));
+    v1 = round64(v1, read64(p + done + 8));
+    v2 = round64(v2, read64(p + done + 16));
+    v3 = round64(v3, read64(p + done + 24));
+  }
+  h->v[0] = v0; h->v[1] = v1; h->v[2] = v2; h->v[3] = v3;
+  return done;
+}
+
+void h64_init(hash64_t *h, uint64_t seed) {
+  memset(h, 0, sizeof(*h));
+  h->seed = seed;
+  h->v[0] = seed + P1 + P2;
+  h->v[1] = seed + P2;
+  h->v[2] = seed;
+  h->v[3] = seed - P1;
+}
+
+void h64_update(hash64_t *h, const void *data, size_t len) {
+  const unsigned char *p = data;
+  size_t k;
+
+  h->total += len;
+  if (h->n) {  /* top up the partial stripe first */
+    k = 32 - h->n;
+    if (k > len) k = len;
+    memcpy(h->buf + h->n, p, k);
+    h->n += k;
+    p += k;
+    len -= k;
+    if (h->n < 32) return;
+    stripes(h, h->buf, 32);
+    h->n = 0;
+  }
+  k = stripes(h, p, len);
+  memcpy(h->buf, p + k, len - k);
+  h->n = len - k;
+}
+
+uint64_t h64_final(hash64_t *h) {
+  const unsigned char *p = h->buf;
+  unsigned n = h->n;
+  uint64_t r;
+
+  if (h->total >= 32) {
+    r = rotl(h->v[0], 1) + rotl(h->v[1], 7) + rotl(h->v[2], 12) +
+        rotl(h->v[3], 18);
+    r = merge64(r, h->v[0]);
+    r = merge64(r, h->v[1]);
+    r = merge64(r, h->v[2]);
+    r = merge64(r, h->v[3]);
+  } else r = h->seed + P5;
+  r += h->total;
+
+  for( ; n >= 8; n -= 8, p += 8) {
+    r ^= round64(0, read64(p));
+    r = rotl(r, 27) * P1 + P4;
+  }
+  if (n >= 4) {
+    r ^= (uint64_t)read32(p) * P1;
+    r = rotl(r, 23) * P2 + P3;
+    n -= 4;
+    p += 4;
+  }
+  for( ; n; n--, p++) {
+    r ^= *p * P5;
+    r = rotl(r, 11) * P1;
+  }
+  r ^= r >> 33;
+  r *= P2;
+  r ^= r >> 29;
+  r *= P3;
+  r ^= r >> 32;
+  return r;
+}
+
+uint64_t hash64(const void *p, size_t len, uint64_t seed) {
+  hash64_t h;
+  h64_init(&h, seed);
+  h64_update(&h, p, len);
+  return h64_final(&h);
+}
+
+/* hash the content of an open file, a chunk at a time */
+static int hash_fd(int fd, uint64_t *hash) {
+  unsigned char buf[CHUNK];
+  uint64_t total = 0;
+  hash64_t h;
+  ssize_t nr;
+
+  h64_init(&h, 0);
+  while ( (nr = read(fd, buf, sizeof(buf))) != 0) {
+    if (nr < 0) {
+      if (errno == EINTR) continue;
+      return -1;
+    }
+    h64_update(&h, buf, nr);
+    total += nr;
+  }
+  *hash = total ? h64_final(&h) : 0;
+  return 0;
+}
+
+static int64_t ns_of(const struct timespec *ts) {
+  return (int64_t)ts->tv_sec * 1000000000 + ts->tv_nsec;
+}
+
+static dep_file *slot_of(dep_cache *dc, const char *path) {
+  unsigned i = hash64(path, strlen(path), 0) & (dc->size - 1);
+  while (dc->tab[i].path && strcmp(dc->tab[i].path, path)) {
+    i = (i + 1) & (dc->size - 1);
+  }
+  return &dc->tab[i];
+}
+
+/* keep the table at most half full */
+static int grow(dep_cache *dc) {
+  dep_cache old = *dc;
+  unsigned i;
+
+  if (2 * (dc->n + 1) <= dc->size) return 0;
+  dc->size = old.size ? 2 * old.size : 16;
+  dc->tab = calloc(dc->size, sizeof(dep_file));
+  if (dc->tab == NULL) { *dc = old; return -1; }
+  for(i = 0; i < old.size; i++) {
+    if (old.tab[i].path) *slot_of(dc, old.tab[i].path) = old.tab[i];
+  }
+  free(old.tab);
+  return 0;
+}
+
+/* get the hash of the content of a dependency file. if stat(2) shows the
+ * file as it was when it was last hashed, the hash is reused. a file that
+ * was modified within a second of being hashed might since have been
+ * modified again with an equal mtime, so it is read again to be sure.
+ * within a pass, a file already looked at is taken as it was then.
+ * returns 0, or -1 with errno set if the file can't be read */
+int dep_hash(dep_cache *dc, const char *path, uint64_t *hash) {
+  struct timespec now;
+  struct stat s;
+  dep_file *df;
+  int fd;
+
+  if (grow(dc) < 0) return -1;
+  df = slot_of(dc, path);
+
+  if (df->path && dc->gen && (df->gen == dc->gen)) goto done;
+  if (df->path == NULL) {
+    if ( (df->path = strdup(path)) == NULL) return -1;
+    dc->n++;
+  }
+  df->gen = dc->gen;
+
+  dc->stats++;
+  if ((df->err == 0) && (stat(path, &s) == 0) &&
+      (df->dev == s.st_dev) && (df->ino == s.st_ino) &&
+      (df->size == s.st_size) && (df->mtime_ns == ns_of(&s.st_mtim)) &&
+      (df->mtime_ns < df->hashed_ns - 1000000000)) goto done;
+
+  df->err = 0;
+  df->hashed_ns = 0;
+  fd = open(path, O_RDONLY|O_CLOEXEC);
+  if ((fd == -1) || (fstat(fd, &s) == -1)) {
+    df->err = errno;
+    if (fd != -1) close(fd);
+    goto done;
+  }
+  posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+  clock_gettime(CLOCK_REALTIME, &now);
+  if (hash_fd(fd, &df->hash) < 0) df->err = errno;
+  close(fd);
+  if (df->err) goto done;
+  dc->reads++;
+  df->dev = s.st_dev;
+  df->ino = s.st_ino;
+  df->size = s.st_size;
+  df->mtime_ns = ns_of(&s.st_mtim);
+  df->hashed_ns = ns_of(&now);
+
+ done:
+  if (df->err) { errno = df->err; return -1; }
+  *hash = df->hash;
+  return 0;
+}
+
+/* begin a pass over the dependencies of the jobs */
+void dep_pass(dep_cache *dc) {
+  if (++dc->gen == 0) dc->gen = 1;
+}
+
+/* at the end of a pass, forget the files that no job depends on now */
+void dep_prune(dep_cache *dc) {
+  dep_cache old = *dc;
+  unsigned i, size = 16;
+
+  while (size < 2 * old.n) size *= 2;
+  dc->tab = calloc(size, sizeof(dep_file));
+  if (dc->tab == NULL) { *dc = old; return; }  /* keep them all, then */
+  dc->size = size;
+  dc->n = 0;
+  for(i = 0; i < old.size; i++) {
+    if (old.tab[i].path == NULL) continue;
+    if (old.tab[i].gen != dc->gen) { free(old.tab[i].path); continue; }
+    *slot_of(dc, old.tab[i].path) = old.tab[i];
+    dc->n++;
+  }
+  free(old.tab);
+}
+
+void dep_clear(dep_cache *dc) {
+  unsigned i;
+  for(i = 0; i < dc->size; i++) free(dc->tab[i].path);
+  free(dc->tab);
+  memset(dc, 0, sizeof(*dc));
+}
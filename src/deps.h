@@ -0,0 +1,54 @@
+#ifndef _DEPS_H_
+#define _DEPS_H_
+
+#include <stdint.h>
+#include <sys/types.h>
+
+/* a 64-bit hash of four independent lanes, each taking 8 bytes of every
+ * 32 (the XXH64 algorithm). the lanes keep the multipliers busy in
+ * parallel, so it hashes many bytes per cycle; input can be fed in pieces */
+typedef struct {
+  uint64_t v[4];
+  uint64_t total;              /* bytes fed in */
+  unsigned char buf[32];       /* partial stripe */
+  unsigned n;                  /* bytes in buf */
+  uint64_t seed;
+} hash64_t;
+
+/* a dependency file, as it was when its content was last hashed */
+typedef struct {
+  char *path;                  /* NULL for an empty slot */
+  dev_t dev;
+  ino_t ino;
+  off_t size;
+  int64_t mtime_ns;
+  int64_t hashed_ns;           /* wall clock time of the hashing */
+  uint64_t hash;               /* of the content; 0 for an empty file */
+  int err;                     /* errno if it could not be read, or 0 */
+  unsigned gen;                /* the last pass that looked at it */
+} dep_file;
+
+/* the dependency files, in an open-addressing hash table by path. a file
+ * that stat(2) shows to be as it was is not read again. the jobs share
+ * it, and it is kept across reloads. within a pass over the jobs (see
+ * dep_pass) each file is looked at once, however many jobs depend on it */
+typedef struct {
+  dep_file *tab;
+  unsigned size;               /* slots, a power of two; or 0 */
+  unsigned n;                  /* slots in use */
+  unsigned gen;                /* the current pass, or 0 outside of one */
+  unsigned long reads;         /* files read to hash them, ever */
+  unsigned long stats;         /* files checked by stat(2), ever */
+} dep_cache;
+
+/* prototypes */
+void h64_init(hash64_t *h, uint64_t seed);
+void h64_update(hash64_t *h, const void *p, size_t len);
+uint64_t h64_final(hash64_t *h);
+uint64_t hash64(const void *p, size_t len, uint64_t seed);
+int dep_hash(dep_cache *dc, const char *path, uint64_t *hash);
+void dep_pass(dep_cache *dc);
+void dep_prune(dep_cache *dc);
+void dep_clear(dep_cache *dc);
+
+#endif /* _DEPS_H_ */
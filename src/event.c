@@ -0,0 +1,36 @@
+#include <sys/epoll.h>
+#include <string.h>
+#include <syslog.h>
+#include <errno.h>
+
+#include "event.h"
+
+/* add a descriptor to the main epoll set, tagged by kind and value */
+int add_epoll(pmtr_t *cfg, int fd, int kind, int val) {
+  struct epoll_event ev;
+  int rc;
+
+  if (cfg->epoll_fd == -1) return 0; /* not running the event loop */
+
+  memset(&ev,0,sizeof(ev)); /* placate valgrind */
+  ev.events = EPOLLIN;
+  ev.data.u64 = EV_TAG(kind,val);
+  rc = epoll_ctl(cfg->epoll_fd, EPOLL_CTL_ADD, fd, &ev);
+  if (rc == -1) syslog(LOG_ERR, "epoll_ctl: %s", strerror(errno));
+  return rc;
+}
+
+/* remove a descriptor from the epoll set. do this before closing it:
+ * a forked child may still hold the descriptor, keeping it registered */
+int del_epoll(pmtr_t *cfg, int fd) {
+  struct epoll_event ev;
+  int rc;
+
+  if (cfg->epoll_fd == -1) return 0;
+
+  memset(&ev,0,sizeof(ev));
+  rc = epoll_ctl(cfg->epoll_fd, EPOLL_CTL_DEL, fd, &ev);
+  if ((rc == -1) && (errno != ENOENT) && (errno != EBADF))
+    syslog(LOG_ERR, "epoll_ctl: %s", strerror(errno));
+  return rc;
+}
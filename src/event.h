@@ -0,0 +1,25 @@
+#ifndef _EVENT_H_
+#define _EVENT_H_
+
+#include <stdint.h>
+#include "pmtr.h"
+
+/* descriptors in the main epoll set are tagged with their kind and a
+ * kind-specific value, packed into the 64-bit epoll_data.u64 */
+enum {
+  EV_SIGNAL = 1,  /* the signalfd */
+  EV_LISTEN,      /* a UDP control listener; value is the fd */
+  EV_PIDFD,       /* a running job's pidfd; value is the pid */
+  EV_TIMER,       /* the timerfd */
+  EV_INOTIFY,     /* the inotify descriptor */
+};
+
+#define EV_TAG(kind,val) (((uint64_t)(kind) << 32) | (uint32_t)(val))
+#define EV_KIND(u64)     ((int)((u64) >> 32))
+#define EV_VAL(u64)      ((uint32_t)(u64))
+
+/* prototypes */
+int add_epoll(pmtr_t *cfg, int fd, int kind, int val);
+int del_epoll(pmtr_t *cfg, int fd);
+
+#endif /* _EVENT_H_ */
@@ -0,0 +1,442 @@
+#include <pthread.h>
+#include <dirent.h>
+#include <glob.h>
+
+#include "pmtr.h"
+#include "job.h"
+#include "frag.h"
+#include "topo.h"
+
+/* pmtr.conf can include other files, as "include /etc/pmtr.d" includes
+ * those in a directory; or those matching a glob(3) pattern. they have
+ * jobs and nothing else.
+ * each is tokenized and parsed on its own, on a few threads at once, into
+ * an arena of its own. what each was parsed into is kept, along with a
+ * hash of its text; when pmtr.conf is parsed again, a file that hashes the
+ * same is not parsed again, and its jobs are copied from the last parse,
+ * sharing their strings. the jobs of all the files join those of pmtr.conf
+ * in cfg->jobs, where they are ordered as one */
+
+/* lemon prototypes */
+void *ParseAlloc();
+void ParseFree();
+
+static void frag_fin(void *_f) {
+  frag_t *f = (frag_t*)_f;
+  if (f->path) free(f->path);
+  if (f->jobs) utarray_free(f->jobs);
+}
+static const UT_icd frag_icd = {sizeof(frag_t), NULL, NULL, frag_fin};
+
+/* an included file has only jobs. returns 1 if what may be used here; or
+ * 0, with the error set */
+int top_level(parse_t *ps, const char *what) {
+  if (!ps->include) return 1;
+  utstring_printf(ps->em, "%s near line %d in %s: only allowed in %s", what,
+                  ps->line, ps->file, ps->cfg->file);
+  ps->rc = -1;
+  return 0;
+}
+
+/* the patterns are kept, to be expanded once pmtr.conf is parsed */
+void set_include(parse_t *ps, char *spec) {
+  if (!top_level(ps, "include")) return;
+  if (ps->cfg->inc.specs == NULL) utarray_new(ps->cfg->inc.specs, &ut_str_icd);
+  utarray_push_back(ps->cfg->inc.specs, &spec);
+}
+
+static int str_cmp(const void *a, const void *b) {
+  return strcmp(*(char * const *)a, *(char * const *)b);
+}
+
+static void sort_uniq(UT_array *a) {
+  unsigned i;
+
+  if (utarray_len(a) == 0) return;
+  utarray_sort(a, str_cmp);
+  for(i = 1; i < utarray_len(a); ) {
+    if (str_cmp(utarray_eltptr(a, i - 1), utarray_eltptr(a, i))) i++;
+    else utarray_erase(a, i, 1);
+  }
+}
+
+static int is_pattern(const char *s, size_t n) {
+  size_t i;
+  for(i = 0; i < n; i++) {
+    if ((s[i] == '*') || (s[i] == '?') || (s[i] == '[')) return 1;
+  }
+  return 0;
+}
+
+static int is_file(const char *path) {
+  struct stat st;
+  return (stat(path, &st) == 0) && S_ISREG(st.st_mode);
+}
+
+static void push(UT_array *a, char *s) {
+  utarray_push_back(a, &s);
+}
+
+/* the files that an "include" names, put into paths: the files in it if
+ * it is a directory, except hidden ones; or else the files that match it
+ * as a glob(3) pattern, such as the one file it names. one that is not
+ * absolute is in the directory of pmtr.conf. where the files can come and
+ * go is put into watch: the directory, or the directory of the pattern
+ * unless that is a pattern too, or the path that is not there yet */
+static int expand(pmtr_t *cfg, char *spec, UT_array *paths, UT_array *watch,
+                  UT_string *em) {
+  char path[PATH_MAX], *slash, c;
+  size_t blen = 0, dlen;
+  struct dirent *de;
+  struct stat st;
+  glob_t g;
+  DIR *d;
+  int rc;
+  size_t i;
+
+  if ((*spec != '/') && (slash = strrchr(cfg->file, '/')))
+    blen = slash - cfg->file + 1;
+  if (blen + strlen(spec) + 2 > sizeof(path)) {
+    utstring_printf(em, "include %s: path too long", spec);
+    return -1;
+  }
+  memcpy(path, cfg->file, blen);
+  strcpy(path + blen, spec);
+
+  if ((stat(path, &st) == 0) && S_ISDIR(st.st_mode)) {
+    dlen = strlen(path);
+    if (path[dlen - 1] != '/') strcpy(path + dlen++, "/");
+    push(watch, path);
+    if ( (d = opendir(path)) == NULL) {
+      utstring_printf(em, "can't open %s: %s", path, strerror(errno));
+      return -1;
+    }
+    while ( (de = readdir(d))) {
+      if (de->d_name[0] == '.') continue;
+      if (dlen + strlen(de->d_name) + 1 > sizeof(path)) continue;
+      strcpy(path + dlen, de->d_name);
+      if (is_file(path)) push(paths, path);
+    }
+    closedir(d);
+    return 0;
+  }
+
+  slash = strrchr(path, '/');
+  dlen = slash ? (size_t)(slash - path + 1) : 0;
+  if (!is_pattern(path + dlen, strlen(path + dlen))) push(watch, path);
+  else if (dlen == 0) push(watch, "./");
+  else if (!is_pattern(path, dlen)) {
+    c = path[dlen];
+    path[dlen] = '\0';
+    push(watch, path);
+    path[dlen] = c;
+  }
+
+  rc = glob(path, 0, NULL, &g);
+  if (rc == GLOB_NOMATCH) return 0;
+  if (rc) {
+    utstring_printf(em, "include %s: %s", spec,
+                    (rc == GLOB_NOSPACE) ? "out of memory" : "read error");
+    globfree(&g);
+    return -1;
+  }
+  for(i = 0; i < g.gl_pathc; i++) {
+    if (is_file(g.gl_pathv[i])) push(paths, g.gl_pathv[i]);
+  }
+  globfree(&g);
+  return 0;
+}
+
+/* an included file, as it is taken care of on one of the threads */
+typedef struct {
+  char *path;
+  frag_t *was;         /* as it was parsed last, or NULL */
+  uint64_t hash;       /* of its text now */
+  size_t size;
+  UT_array *jobs;      /* as parsed now; NULL if it is used as it was */
+  uint64_t topo;       /* see frag_t */
+  UT_string *em;
+  int rc;
+} frag_work;
+
+typedef struct {
+  pmtr_t *cfg;
+  frag_work *w;
+  unsigned n;
+  unsigned next;       /* the next to be taken by a thread */
+  uint64_t topo;       /* topo_hash of this host, if a file needs it */
+} frag_pool;
+
+/* maps an included file, and parses it unless its text is as it was at
+ * the last parse, and any cpus it resolved from the topology (topo is the
+ * topo_hash of this host now) would come out the same. the arena of its
+ * strings is sized to its text: the tokens, each with a NUL, can't take
+ * more than half as much again */
+static void parse_frag(pmtr_t *cfg, frag_work *w, uint64_t topo) {
+  char *buf = NULL;
+  size_t len;
+  arena_t *arena;
+  parse_t ps;
+  job_t job;
+  void *p;
+
+  if (map_file(w->path, &buf, &len) < 0) {
+    utstring_printf(w->em, "can't read %s", w->path);
+    w->rc = -1;
+    return;
+  }
+  w->size = len;
+  arena = arena_sized(len + len / 2 + 1);
+  p = ParseAlloc(malloc);
+  if ((arena == NULL) || (p == NULL)) {
+    utstring_printf(w->em, "out of memory");
+    if (arena) arena_unref(arena);
+    if (p) ParseFree(p, free);
+    unmap_file(buf, w->size);
+    w->rc = -1;
+    return;
+  }
+  job_ini(&job);
+  job_arena(&job, arena);
+  arena_unref(arena); /* the jobs hold it from here */
+
+  memset(&ps, 0, sizeof(ps));
+  ps.job = &job;
+  ps.cfg = cfg;
+  ps.file = w->path;
+  ps.include = 1;
+  ps.line = 1;
+  ps.em = w->em;
+  utarray_new(w->jobs, &job_mm);
+  ps.jobs = w->jobs;
+
+  if (sigsetjmp(bus_jmp, 1)) {
+    utstring_printf(w->em, "%s changed while being read", w->path);
+    ps.rc = -1;
+    goto done;
+  }
+  w->hash = len ? hash64(buf, len, 0) : 0;
+  if (w->was && (w->was->hash == w->hash) && (w->was->size == len) &&
+      ((w->was->topo == 0) || (w->was->topo == topo))) {
+    utarray_free(w->jobs);
+    w->jobs = NULL;
+    w->topo = w->was->topo;
+    goto done;
+  }
+  parse_text(&ps, p, buf, len);
+  if (ps.topo) w->topo = topo ? topo : topo_hash(topo_root(cfg));
+
+ done:
+  w->rc = ps.rc;
+  unmap_file(buf, w->size);
+  ParseFree(p, free);
+  job_fin(&job);
+}
+
+static void *frag_thread(void *arg) {
+  frag_pool *fp = (frag_pool*)arg;
+  unsigned i;
+
+  while ( (i = __atomic_fetch_add(&fp->next, 1, __ATOMIC_RELAXED)) < fp->n) {
+    parse_frag(fp->cfg, &fp->w[i], fp->topo);
+  }
+  return NULL;
+}
+
+/* run the work on this thread and up to FRAG_THREADS - 1 others */
+static void run_pool(frag_pool *fp) {
+  pthread_t tid[FRAG_THREADS - 1];
+  long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+  unsigned i, n = fp->n;
+
+  if ((cpus > 0) && (n > (unsigned long)cpus)) n = cpus;
+  if (n > FRAG_THREADS) n = FRAG_THREADS;
+  for(i = 0; i + 1 < n; i++) {
+    if (pthread_create(&tid[i], NULL, frag_thread, fp)) break;
+  }
+  n = i;
+  frag_thread(fp);
+  for(i = 0; i < n; i++) pthread_join(tid[i], NULL);
+}
+
+/* the name of a job, and the file it is in */
+typedef struct {
+  char *name;
+  char *file;
+} job_name;
+
+static int name_cmp(const void *_a, const void *_b) {
+  const job_name *a = (const job_name*)_a, *b = (const job_name*)_b;
+  return strcmp(a->name, b->name);
+}
+
+static int check_names(pmtr_t *cfg, UT_array *frags, UT_string *em) {
+  static const UT_icd job_name_icd = {sizeof(job_name), NULL, NULL, NULL};
+  UT_array names;
+  job_name jn, *a, *b;
+  job_t *job = NULL;
+  frag_t *f = NULL;
+  int rc = 0;
+
+  utarray_init(&names, &job_name_icd);
+  jn.file = cfg->file;
+  while ( (job = (job_t*)utarray_next(cfg->jobs, job))) {
+    jn.name = job->name;
+    utarray_push_back(&names, &jn);
+  }
+  while ( (f = (frag_t*)utarray_next(frags, f))) {
+    jn.file = f->path;
+    job = NULL;
+    while ( (job = (job_t*)utarray_next(f->jobs, job))) {
+      jn.name = job->name;
+      utarray_push_back(&names, &jn);
+    }
+  }
+  if (utarray_len(&names)) utarray_sort(&names, name_cmp);
+  for(a = NULL, b = (job_name*)utarray_front(&names); b;
+      a = b, b = (job_name*)utarray_next(&names, b)) {
+    if ((a == NULL) || strcmp(a->name, b->name)) continue;
+    if ((a->file == cfg->file) && (b->file == cfg->file)) continue;
+    utstring_printf(em, "job %s is in both %s and %s", b->name, a->file, b->file);
+    rc = -1;
+    break;
+  }
+  utarray_done(&names);
+  return rc;
+}
+
+/* replace what was kept of the last parse */
+static void keep(pmtr_t *cfg, UT_array *frags, UT_array *watch) {
+  if (cfg->inc.frags) utarray_free(cfg->inc.frags);
+  if (cfg->inc.watch) utarray_free(cfg->inc.watch);
+  cfg->inc.frags = frags;
+  cfg->inc.watch = watch;
+}
+
+/* expands the "include" patterns of the parse, and parses the files they
+ * name that are new or have changed, on threads. then the jobs of all of
+ * them are copied to cfg->jobs, after those of pmtr.conf, and what each
+ * file was parsed into is kept for next time. on failure, nothing is kept,
+ * and the last parse is as it was. returns 0, or -1 with em set */
+int parse_includes(pmtr_t *cfg, UT_string *em) {
+  UT_array *paths, *watch, *frags = NULL;
+  unsigned i, parsed = 0;
+  frag_work *w = NULL;
+  frag_pool fp;
+  frag_t *f, key;
+  char **s;
+  int rc = -1;
+
+  if ((cfg->inc.specs == NULL) || (utarray_len(cfg->inc.specs) == 0)) {
+    keep(cfg, NULL, NULL);
+    return 0;
+  }
+
+  memset(&fp, 0, sizeof(fp));
+  fp.cfg = cfg;
+  utarray_new(paths, &ut_str_icd);
+  utarray_new(watch, &ut_str_icd);
+  s = NULL;
+  while ( (s = (char**)utarray_next(cfg->inc.specs, s))) {
+    if (expand(cfg, *s, paths, watch, em) < 0) goto done;
+  }
+  sort_uniq(paths);
+  sort_uniq(watch);
+
+  fp.n = utarray_len(paths);
+  if (fp.n && ((w = calloc(fp.n, sizeof(frag_work))) == NULL)) {
+    utstring_printf(em, "out of memory");
+    goto done;
+  }
+  fp.w = w;
+  for(i = 0; i < fp.n; i++) {
+    w[i].path = *(char**)utarray_eltptr(paths, i);
+    key.path = w[i].path;   /* the path is first in a frag_t */
+    if (cfg->inc.frags && utarray_len(cfg->inc.frags))
+      w[i].was = utarray_find(cfg->inc.frags, &key, str_cmp);
+    if (w[i].was && w[i].was->topo && (fp.topo == 0))
+      fp.topo = topo_hash(topo_root(cfg));
+    utstring_new(w[i].em);
+  }
+  run_pool(&fp);
+
+  /* the first error, in the order of the files */
+  for(i = 0; i < fp.n; i++) {
+    if (w[i].rc == 0) continue;
+    utstring_concat(em, w[i].em);
+    goto done;
+  }
+
+  /* the files as they are now; those unchanged take what was parsed before */
+  utarray_new(frags, &frag_icd);
+  for(i = 0; i < fp.n; i++) {
+    utarray_extend_back(frags);
+    f = (frag_t*)utarray_back(frags);
+    f->path = strdup(w[i].path);
+    f->hash = w[i].hash;
+    f->size = w[i].size;
+    f->topo = w[i].topo;
+    if (w[i].jobs) {
+      f->jobs = w[i].jobs;
+      w[i].jobs = NULL;
+      parsed++;
+    } else {
+      f->jobs = w[i].was->jobs;
+      w[i].was->jobs = NULL;
+    }
+    if (f->path == NULL) {
+      utstring_printf(em, "out of memory");
+      goto done;
+    }
+  }
+  if (check_names(cfg, frags, em) < 0) goto done;
+
+  f = NULL;
+  while ( (f = (frag_t*)utarray_next(frags, f))) utarray_concat(cfg->jobs, f->jobs);
+  syslog(LOG_INFO, "included %u files: %u parsed, %u unchanged", fp.n, parsed,
+         fp.n - parsed);
+  keep(cfg, frags, watch);
+  frags = NULL;
+  watch = NULL;
+  rc = 0;
+
+ done:
+  /* on failure, the jobs that were taken go back; they are used as is */
+  for(i = 0; frags && (i < utarray_len(frags)); i++) {
+    f = (frag_t*)utarray_eltptr(frags, i);
+    if (w[i].was && (w[i].was->jobs == NULL)) {
+      w[i].was->jobs = f->jobs;
+      f->jobs = NULL;
+    }
+  }
+  for(i = 0; w && (i < fp.n); i++) {
+    if (w[i].jobs) utarray_free(w[i].jobs);
+    utstring_free(w[i].em);
+  }
+  if (w) free(w);
+  if (frags) utarray_free(frags);
+  if (watch) utarray_free(watch);
+  utarray_free(paths);
+  return rc;
+}
+
+/* whether a change to path calls for pmtr.conf to be parsed again */
+int is_config(pmtr_t *cfg, const char *path) {
+  frag_t key;
+  char **s = NULL;
+
+  if (strcmp(path, cfg->file) == 0) return 1;
+  key.path = (char*)path;
+  if (cfg->inc.frags && utarray_len(cfg->inc.frags) &&
+      utarray_find(cfg->inc.frags, &key, str_cmp)) return 1;
+  while (cfg->inc.watch && (s = (char**)utarray_next(cfg->inc.watch, s))) {
+    if (strcmp(path, *s) == 0) return 1;
+  }
+  return 0;
+}
+
+void includes_free(pmtr_t *cfg) {
+  keep(cfg, NULL, NULL);
+  if (cfg->inc.specs) utarray_free(cfg->inc.specs);
+  cfg->inc.specs = NULL;
+}
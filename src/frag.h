@@ -0,0 +1,17 @@
+#ifndef _FRAG_H_
+#define _FRAG_H_
+
+#include "pmtr.h"
+#include "job.h"
+
+/* included files are parsed on up to this many threads at once */
+#define FRAG_THREADS 8
+
+/* prototypes */
+void set_include(parse_t *ps, char *spec);
+int top_level(parse_t *ps, const char *what);
+int parse_includes(pmtr_t *cfg, UT_string *em);
+int is_config(pmtr_t *cfg, const char *path);
+void includes_free(pmtr_t *cfg);
+
+#endif /* _FRAG_H_ */
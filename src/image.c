@@ -0,0 +1,392 @@
+#include <sys/mman.h>
+
+#include "pmtr.h"
+#include "job.h"
+#include "net.h"
+#include "image.h"
+#include "frag.h"
+#include "topo.h"
+
+/* the image is the header, then the jobs, ulimits, string references and
+ * text, each packed one after the other. the sizes of the first three are
+ * multiples of 8, so that in a mapping of the image they are aligned */
+
+static const UT_icd image_job_icd = {sizeof(image_job), NULL, NULL, NULL};
+static const UT_icd image_rlim_icd = {sizeof(image_rlim), NULL, NULL, NULL};
+static const UT_icd ref_icd = {sizeof(uint32_t), NULL, NULL, NULL};
+
+/* the image being put together */
+typedef struct {
+  UT_array *jobs;
+  UT_array *rlim;
+  UT_array *refs;
+  UT_string *text;
+} image_buf;
+
+static uint32_t put_str(image_buf *b, const char *s) {
+  uint32_t off = utstring_len(b->text);
+  if (s == NULL) return IMAGE_NONE;
+  utstring_bincpy(b->text, s, strlen(s) + 1);
+  return off;
+}
+
+static void put_strs(image_buf *b, UT_array *a, uint32_t *first, uint32_t *n) {
+  char **s = NULL;
+  uint32_t off;
+
+  *first = utarray_len(b->refs);
+  *n = 0;
+  while ( (s = (char**)utarray_next(a, s))) {
+    if (*s == NULL) continue;  /* the end of cmdv */
+    off = put_str(b, *s);
+    utarray_push_back(b->refs, &off);
+    (*n)++;
+  }
+}
+
+static void put_job(image_buf *b, job_t *job) {
+  resource_rlimit_t *r = NULL;
+  image_rlim ir;
+  image_job ij;
+
+  memset(&ij, 0, sizeof(ij));
+  ij.name = put_str(b, job->name);
+  ij.dir = put_str(b, job->dir);
+  ij.out = put_str(b, job->out);
+  ij.err = put_str(b, job->err);
+  ij.in = put_str(b, job->in);
+  ij.user = put_str(b, job->user);
+  put_strs(b, &job->cmdv, &ij.cmdv, &ij.ncmdv);
+  put_strs(b, &job->envv, &ij.envv, &ij.nenvv);
+  put_strs(b, &job->depv, &ij.depv, &ij.ndepv);
+  put_strs(b, &job->after, &ij.after, &ij.nafter);
+  ij.rlim = utarray_len(b->rlim);
+  ij.nrlim = utarray_len(&job->rlim);
+  while ( (r = (resource_rlimit_t*)utarray_next(&job->rlim, r))) {
+    memset(&ir, 0, sizeof(ir));
+    ir.id = r->id;
+    ir.cur = r->rlim.rlim_cur;
+    ir.max = r->rlim.rlim_max;
+    utarray_push_back(b->rlim, &ir);
+  }
+  ij.order = job->order;
+  ij.nice = job->nice;
+  ij.disabled = job->disabled;
+  ij.wait = job->wait;
+  ij.once = job->once;
+  ij.bounce_interval = job->bounce_interval;
+  ij.backoff_min = job->backoff_min;
+  ij.backoff_max = job->backoff_max;
+  ij.jitter = job->jitter;
+  ij.breaker_count = job->breaker_count;
+  ij.breaker_window = job->breaker_window;
+  ij.backoff_factor = job->backoff_factor;
+  ij.fp[0] = job->fp[0];
+  ij.fp[1] = job->fp[1];
+  memcpy(ij.cpuset, &job->cpuset, sizeof(ij.cpuset));
+  utarray_push_back(b->jobs, &ij);
+}
+
+static int write_all(int fd, const void *p, size_t len) {
+  const char *c = p;
+  ssize_t nr;
+
+  while (len) {
+    nr = write(fd, c, len);
+    if (nr < 0) {
+      if (errno == EINTR) continue;
+      return -1;
+    }
+    c += nr;
+    len -= nr;
+  }
+  return 0;
+}
+
+/* writes the image of the jobs just parsed from the text of pmtr.conf that
+ * has the given hash and size, to cfg->image. they are as parsed, before
+ * the jobs of included files are added to them and they are ordered. it
+ * is written aside and then renamed into place, so a pmtr starting
+ * meanwhile sees the old one or the new one. topo is set if cpus were
+ * resolved from the topology of this host; the image is then for hosts of
+ * the same. returns 0, or -1 with em set */
+int image_save(pmtr_t *cfg, uint64_t hash, size_t size, int topo,
+               UT_string *em) {
+  UT_string *tmp = NULL;
+  image_buf b;
+  image_hdr h;
+  hash64_t bh;
+  job_t *job = NULL;
+  int fd = -1, rc = -1;
+  size_t sz[4];
+  void *p[4];
+  unsigned i;
+
+  utarray_new(b.jobs, &image_job_icd);
+  utarray_new(b.rlim, &image_rlim_icd);
+  utarray_new(b.refs, &ref_icd);
+  utstring_new(b.text);
+  utstring_new(tmp);
+
+  while ( (job = (job_t*)utarray_next(cfg->jobs, job))) put_job(&b, job);
+
+  memset(&h, 0, sizeof(h));
+  memcpy(h.magic, IMAGE_MAGIC, sizeof(h.magic));
+  h.version = IMAGE_VERSION;
+  h.job_size = sizeof(image_job);
+  h.source_hash = hash;
+  h.source_size = size;
+  if (topo) h.topo_hash = topo_hash(topo_root(cfg));
+  if (cfg->listen_spec) put_strs(&b, cfg->listen_spec, &h.listen, &h.nlisten);
+  if (cfg->report_spec) put_strs(&b, cfg->report_spec, &h.report, &h.nreport);
+  if (cfg->inc.specs) put_strs(&b, cfg->inc.specs, &h.include, &h.ninclude);
+  if (utstring_len(b.text) >= IMAGE_NONE) {
+    utstring_printf(em, "%s: too large", cfg->image);
+    goto done;
+  }
+  h.njobs = utarray_len(b.jobs);
+  h.nrlim = utarray_len(b.rlim);
+  h.nrefs = utarray_len(b.refs);
+  h.nbytes = utstring_len(b.text);
+
+  p[0] = b.jobs->d; sz[0] = h.njobs * sizeof(image_job);
+  p[1] = b.rlim->d; sz[1] = h.nrlim * sizeof(image_rlim);
+  p[2] = b.refs->d; sz[2] = h.nrefs * sizeof(uint32_t);
+  p[3] = utstring_body(b.text); sz[3] = h.nbytes;
+  h64_init(&bh, 0);
+  h.size = sizeof(h);
+  for(i = 0; i < 4; i++) {
+    h64_update(&bh, p[i], sz[i]);
+    h.size += sz[i];
+  }
+  h.body_hash = h64_final(&bh);
+
+  utstring_printf(tmp, "%s.tmp", cfg->image);
+  fd = open(utstring_body(tmp), O_WRONLY|O_CREAT|O_TRUNC|O_CLOEXEC, 0644);
+  if (fd == -1) {
+    utstring_printf(em, "can't open %s: %s", utstring_body(tmp), strerror(errno));
+    goto done;
+  }
+  if (write_all(fd, &h, sizeof(h)) < 0) goto fail;
+  for(i = 0; i < 4; i++) {
+    if (sz[i] && (write_all(fd, p[i], sz[i]) < 0)) goto fail;
+  }
+  if (fsync(fd) < 0) goto fail;
+  close(fd);
+  fd = -1;
+  if (rename(utstring_body(tmp), cfg->image) < 0) goto fail;
+  syslog(LOG_INFO, "wrote %s: %u jobs", cfg->image, h.njobs);
+  rc = 0;
+  goto done;
+
+ fail:
+  utstring_printf(em, "can't write %s: %s", cfg->image, strerror(errno));
+  unlink(utstring_body(tmp));
+
+ done:
+  if (fd != -1) close(fd);
+  utarray_free(b.jobs);
+  utarray_free(b.rlim);
+  utarray_free(b.refs);
+  utstring_free(b.text);
+  utstring_free(tmp);
+  return rc;
+}
+
+/* where the sections are in a mapped image */
+typedef struct {
+  const image_hdr *h;
+  const image_job *jobs;
+  const image_rlim *rlim;
+  const uint32_t *refs;
+  const char *text;
+} image_map;
+
+static int ok_str(const image_map *im, uint32_t off) {
+  return (off == IMAGE_NONE) || (off < im->h->nbytes);
+}
+
+static int ok_strs(const image_map *im, uint32_t first, uint32_t n) {
+  uint32_t i;
+
+  if ((uint64_t)first + n > im->h->nrefs) return 0;
+  for(i = first; i < first + n; i++) {
+    if (im->refs[i] >= im->h->nbytes) return 0;
+  }
+  return 1;
+}
+
+/* finds the sections of the image m of len bytes, and checks that every
+ * offset in it is within them. returns NULL if it is fine, or what is
+ * wrong with it */
+static const char *check(image_map *im, const char *m, size_t len,
+                         uint64_t hash, size_t size) {
+  const image_hdr *h = (const image_hdr*)m;
+  const image_job *ij;
+  uint64_t off;
+  uint32_t i;
+
+  if (len < sizeof(*h)) return "truncated";
+  if (memcmp(h->magic, IMAGE_MAGIC, sizeof(h->magic))) return "not an image";
+  if ((h->version != IMAGE_VERSION) || (h->job_size != sizeof(image_job)))
+    return "from another version of pmtr";
+  if ((h->source_hash != hash) || (h->source_size != size))
+    return "not of the current config";
+  off = sizeof(*h) + (uint64_t)h->njobs * sizeof(image_job)
+                   + (uint64_t)h->nrlim * sizeof(image_rlim)
+                   + (uint64_t)h->nrefs * sizeof(uint32_t) + h->nbytes;
+  if ((h->size != len) || (off != len)) return "truncated";
+  if (hash64(m + sizeof(*h), len - sizeof(*h), 0) != h->body_hash)
+    return "damaged";
+
+  im->h = h;
+  im->jobs = (const image_job*)(m + sizeof(*h));
+  im->rlim = (const image_rlim*)(im->jobs + h->njobs);
+  im->refs = (const uint32_t*)(im->rlim + h->nrlim);
+  im->text = (const char*)(im->refs + h->nrefs);
+  if (h->nbytes && im->text[h->nbytes - 1]) return "damaged";
+  if (!ok_strs(im, h->listen, h->nlisten)) return "damaged";
+  if (!ok_strs(im, h->report, h->nreport)) return "damaged";
+  if (!ok_strs(im, h->include, h->ninclude)) return "damaged";
+  for(i = 0; i < h->njobs; i++) {
+    ij = &im->jobs[i];
+    if ((ij->name == IMAGE_NONE) || !ok_str(im, ij->name)) return "damaged";
+    if (!ok_str(im, ij->dir) || !ok_str(im, ij->out) || !ok_str(im, ij->err) ||
+        !ok_str(im, ij->in)) return "damaged";
+    if ((ij->user == IMAGE_NONE) || !ok_str(im, ij->user) ||
+        (strlen(im->text + ij->user) >= PMTR_MAX_USER)) return "damaged";
+    if (!ok_strs(im, ij->cmdv, ij->ncmdv) || !ok_strs(im, ij->envv, ij->nenvv) ||
+        !ok_strs(im, ij->depv, ij->ndepv) || !ok_strs(im, ij->after, ij->nafter))
+      return "damaged";
+    if ((uint64_t)ij->rlim + ij->nrlim > h->nrlim) return "damaged";
+  }
+  return NULL;
+}
+
+static char *get_str(char *text, uint32_t off) {
+  return (off == IMAGE_NONE) ? NULL : text + off;
+}
+
+static void get_strs(const image_map *im, char *text, UT_array *a,
+                     uint32_t first, uint32_t n) {
+  char *s;
+  uint32_t i;
+
+  for(i = first; i < first + n; i++) {
+    s = text + im->refs[i];
+    utarray_push_back(a, &s);
+  }
+}
+
+static void get_job(const image_map *im, char *text, const image_job *ij,
+                    job_t *job) {
+  resource_rlimit_t r;
+  uint32_t i;
+
+  job->name = get_str(text, ij->name);
+  job->dir = get_str(text, ij->dir);
+  job->out = get_str(text, ij->out);
+  job->err = get_str(text, ij->err);
+  job->in = get_str(text, ij->in);
+  strcpy(job->user, text + ij->user);
+  get_strs(im, text, &job->cmdv, ij->cmdv, ij->ncmdv);
+  utarray_extend_back(&job->cmdv); /* NULL on the end of argv */
+  get_strs(im, text, &job->envv, ij->envv, ij->nenvv);
+  get_strs(im, text, &job->depv, ij->depv, ij->ndepv);
+  get_strs(im, text, &job->after, ij->after, ij->nafter);
+  for(i = ij->rlim; i < ij->rlim + ij->nrlim; i++) {
+    r.id = im->rlim[i].id;
+    r.rlim.rlim_cur = im->rlim[i].cur;
+    r.rlim.rlim_max = im->rlim[i].max;
+    utarray_push_back(&job->rlim, &r);
+  }
+  job->order = ij->order;
+  job->nice = ij->nice;
+  job->disabled = ij->disabled;
+  job->wait = ij->wait;
+  job->once = ij->once;
+  job->bounce_interval = ij->bounce_interval;
+  job->backoff_min = ij->backoff_min;
+  job->backoff_max = ij->backoff_max;
+  job->jitter = ij->jitter;
+  job->breaker_count = ij->breaker_count;
+  job->breaker_window = ij->breaker_window;
+  job->backoff_factor = ij->backoff_factor;
+  job->fp[0] = ij->fp[0];
+  job->fp[1] = ij->fp[1];
+  memcpy(&job->cpuset, ij->cpuset, sizeof(job->cpuset));
+}
+
+/* loads the jobs from cfg->image, if it was compiled from the text of
+ * pmtr.conf that has the given hash and size, into the empty cfg->jobs.
+ * they are left as parsing the text leaves them, with the "include"
+ * patterns in cfg->inc. returns 0 if they were loaded; 1 if the image
+ * can't be used, with nothing changed; or -1 with em set if setting up
+ * the "listen on" or "report to" addresses failed */
+int image_load(pmtr_t *cfg, uint64_t hash, size_t size, UT_string *em) {
+  const char *why = NULL;
+  arena_t *arena = NULL;
+  struct stat st;
+  image_map im;
+  char *m = MAP_FAILED, *text;
+  parse_t ps;
+  job_t *job;
+  uint32_t i;
+  int fd, rc = 1;
+
+  if ( (fd = open(cfg->image, O_RDONLY|O_CLOEXEC)) == -1) {
+    if (errno != ENOENT) why = strerror(errno);
+    goto done;
+  }
+  if (fstat(fd, &st) == -1) { why = strerror(errno); goto done; }
+  if (st.st_size < (off_t)sizeof(image_hdr)) { why = "truncated"; goto done; }
+  /* it is all read at once, to check it */
+  m = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE|MAP_POPULATE, fd, 0);
+  if (m == MAP_FAILED) { why = strerror(errno); goto done; }
+  if ( (why = check(&im, m, st.st_size, hash, size)) != NULL) goto done;
+  if (im.h->topo_hash && (im.h->topo_hash != topo_hash(topo_root(cfg)))) {
+    why = "its cpus were resolved on other cpus";
+    goto done;
+  }
+
+  /* the text goes into an arena, which the jobs refer to as if parsed.
+   * they are planned (see spawn.c) when first started, which at startup
+   * is right away, so that the first of them starts sooner */
+  if ( (arena = arena_new()) == NULL) { why = "out of memory"; goto done; }
+  text = arena_alloc(arena, im.h->nbytes);
+  if (text == NULL) { why = "out of memory"; goto done; }
+  memcpy(text, im.text, im.h->nbytes);
+
+  for(i = 0; i < im.h->njobs; i++) {
+    utarray_extend_back(cfg->jobs);
+    job = (job_t*)utarray_back(cfg->jobs);
+    job_arena(job, arena);
+    get_job(&im, text, &im.jobs[i], job);
+  }
+  index_jobs(&cfg->jx, cfg->jobs);
+  syslog(LOG_INFO, "loaded %u jobs from %s", im.h->njobs, cfg->image);
+  rc = 0;
+
+  memset(&ps, 0, sizeof(ps));
+  ps.cfg = cfg;
+  ps.file = cfg->file;
+  ps.em = em;
+  for(i = im.h->include; i < im.h->include + im.h->ninclude; i++) {
+    set_include(&ps, text + im.refs[i]);
+  }
+  for(i = im.h->listen; (rc == 0) && (i < im.h->listen + im.h->nlisten); i++) {
+    set_listen(&ps, text + im.refs[i]);
+    if (ps.rc == -1) rc = -1;
+  }
+  for(i = im.h->report; (rc == 0) && (i < im.h->report + im.h->nreport); i++) {
+    set_report(&ps, text + im.refs[i]);
+    if (ps.rc == -1) rc = -1;
+  }
+
+ done:
+  if (why) syslog(LOG_INFO, "not using %s: %s", cfg->image, why);
+  if (arena) arena_unref(arena);
+  if (m != MAP_FAILED) munmap(m, st.st_size);
+  if (fd != -1) close(fd);
+  return rc;
+}
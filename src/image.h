@@ -0,0 +1,61 @@
+#ifndef _IMAGE_H_
+#define _IMAGE_H_
+
+#include "pmtr.h"
+#include "utstring.h"
+
+/* a compiled config: the jobs as parsed from pmtr.conf, laid out flat so
+ * that they are loaded without tokenizing or parsing. it is keyed by the
+ * text it was compiled from, so it is only used for that text. the files
+ * that text includes are not in it; they are parsed as usual. cpus named
+ * by where they are ("node0", "spread") are kept as they resolved on the
+ * host it was compiled on, so it is only used on a host alike. see image.c */
+#define IMAGE_MAGIC   "pmtrimg"
+#define IMAGE_VERSION 5            /* bump on any change to the grammar, the
+                                      fields of job_t, or the layout below */
+#define IMAGE_NONE    0xffffffffU  /* a NULL string */
+
+typedef struct {
+  char magic[8];               /* IMAGE_MAGIC */
+  uint32_t version;            /* IMAGE_VERSION */
+  uint32_t job_size;           /* sizeof(image_job) */
+  uint64_t source_hash;        /* of the text of pmtr.conf */
+  uint64_t source_size;
+  uint64_t topo_hash;          /* of the host the cpus were resolved on, or
+                                  0 if none were named by where they are */
+  uint64_t body_hash;          /* of everything after this header */
+  uint64_t size;               /* of the whole image */
+  uint32_t njobs;              /* then come the jobs, */
+  uint32_t nrlim;              /* the ulimits of the jobs, */
+  uint32_t nrefs;              /* the strings of the string arrays, */
+  uint32_t nbytes;             /* and the text of the strings */
+  uint32_t listen, nlisten;    /* "listen on" addresses, in refs */
+  uint32_t report, nreport;    /* "report to" addresses, in refs */
+  uint32_t include, ninclude;  /* "include" patterns, in refs */
+} image_hdr;
+
+/* strings are offsets into the text; arrays are a first and a count */
+typedef struct {
+  uint32_t name, dir, out, err, in, user;
+  uint32_t cmdv, ncmdv, envv, nenvv, depv, ndepv, after, nafter; /* refs */
+  uint32_t rlim, nrlim;
+  int32_t order, nice, disabled, wait, once, bounce_interval;
+  int32_t backoff_min, backoff_max, jitter, breaker_count, breaker_window;
+  int32_t pad;
+  double backoff_factor;
+  uint64_t fp[2];
+  unsigned char cpuset[sizeof(cpu_set_t)];
+} image_job;
+
+typedef struct {
+  int32_t id;
+  int32_t pad;
+  uint64_t cur, max;
+} image_rlim;
+
+/* prototypes */
+int image_save(pmtr_t *cfg, uint64_t hash, size_t size, int topo,
+               UT_string *em);
+int image_load(pmtr_t *cfg, uint64_t hash, size_t size, UT_string *em);
+
+#endif /* _IMAGE_H_ */
@@ -11,17 +11,28 @@
 #include <sys/stat.h>
 #include <sys/wait.h>
 #include <sys/resource.h>
+#include <sys/syscall.h>
 #include <errno.h>
 #include <assert.h>
 #include <fcntl.h>
 #include <limits.h>
 #include <pwd.h>
+#include <setjmp.h>
+#include <sys/mman.h>
+#include <ctype.h>
 
 //#define DEBUG 1
 
 #include "utarray.h"
 #include "pmtr.h"
+#include "event.h"
+#include "spawn.h"
 #include "job.h"
+#include "cfg.h"
+#include "net.h"
+#include "image.h"
+#include "frag.h"
+#include "topo.h"
 
 /* lemon prototypes */
 void *ParseAlloc();
@@ -34,35 +45,60 @@ void job_ini(job_t *job) {
   utarray_init(&job->envv, &ut_str_icd); 
   utarray_init(&job->depv, &ut_str_icd); 
   utarray_init(&job->rlim, &rlimit_icd); 
+  utarray_init(&job->after, &ut_str_icd); 
   CPU_ZERO(&job->cpuset);
   job->respawn=1;
+  job->pidfd=-1;
+  job->backoff_min=SHORT_DELAY;
+  job->backoff_max=SHORT_DELAY;
+  job->backoff_factor=1;
 }
 void job_fin(job_t *job) { 
-  if (job->name) free(job->name);
   utarray_done(&job->cmdv); 
   utarray_done(&job->envv); 
   utarray_done(&job->depv); 
   utarray_done(&job->rlim); 
+  utarray_done(&job->after); 
+  plan_fin(&job->plan);
+  if (job->arena) { arena_unref(job->arena); return; }
+  if (job->name) free(job->name);
   if (job->dir) free(job->dir);
   if (job->out) free(job->out);
   if (job->err) free(job->err);
   if (job->in) free(job->in);
 }
+/* make a newly initialized job keep its strings in arena a */
+void job_arena(job_t *job, arena_t *a) {
+  job->arena = arena_ref(a);
+  utarray_init(&job->cmdv, &ut_ptr_icd);
+  utarray_init(&job->envv, &ut_ptr_icd);
+  utarray_init(&job->depv, &ut_ptr_icd);
+  utarray_init(&job->after, &ut_ptr_icd);
+}
+/* a job in an arena shares its strings with the copy */
+static char *str_cpy(const job_t *src, char *s) {
+  if ((s == NULL) || src->arena) return s;
+  return strdup(s);
+}
 void job_cpy(job_t *dst, const job_t *src) {
   int i;
-  dst->name = src->name ? strdup(src->name) : NULL;
-  utarray_init(&dst->cmdv, &ut_str_icd); utarray_concat(&dst->cmdv, &src->cmdv);
-  utarray_init(&dst->envv, &ut_str_icd); utarray_concat(&dst->envv, &src->envv);
-  utarray_init(&dst->depv, &ut_str_icd); utarray_concat(&dst->depv, &src->depv);
+  dst->arena = arena_ref(src->arena);
+  dst->name = str_cpy(src, src->name);
+  utarray_init(&dst->cmdv, &src->cmdv.icd); utarray_concat(&dst->cmdv, &src->cmdv);
+  utarray_init(&dst->envv, &src->envv.icd); utarray_concat(&dst->envv, &src->envv);
+  utarray_init(&dst->depv, &src->depv.icd); utarray_concat(&dst->depv, &src->depv);
   utarray_init(&dst->rlim, &rlimit_icd); utarray_concat(&dst->rlim, &src->rlim);
-  dst->dir = src->dir ? strdup(src->dir) : NULL;
-  dst->out = src->out ? strdup(src->out) : NULL;
-  dst->err = src->err ? strdup(src->err) : NULL;
-  dst->in = src->in ? strdup(src->in) : NULL;
+  utarray_init(&dst->after, &src->after.icd); utarray_concat(&dst->after, &src->after);
+  dst->dir = str_cpy(src, src->dir);
+  dst->out = str_cpy(src, src->out);
+  dst->err = str_cpy(src, src->err);
+  dst->in = str_cpy(src, src->in);
   memcpy(dst->user, src->user, PMTR_MAX_USER);
   dst->pid = src->pid;
+  dst->pidfd = src->pidfd;
   dst->start_ts = src->start_ts;
   dst->start_at = src->start_at;
+  dst->timer_at = src->timer_at;
   dst->terminate = src->terminate;
   dst->delete_when_collected = src->delete_when_collected;
   dst->respawn = src->respawn;
@@ -71,30 +107,47 @@ void job_cpy(job_t *dst, const job_t *src) {
   dst->disabled = src->disabled;
   dst->wait = src->wait;
   dst->once = src->once;
+  dst->finished = src->finished;
+  dst->queued = 0;   /* the queues have the names of the jobs they hold */
   dst->bounce_interval = src->bounce_interval;
+  dst->backoff_min = src->backoff_min;
+  dst->backoff_max = src->backoff_max;
+  dst->backoff_factor = src->backoff_factor;
+  dst->jitter = src->jitter;
+  dst->breaker_count = src->breaker_count;
+  dst->breaker_window = src->breaker_window;
+  dst->backoff = src->backoff;
+  dst->fail_since = src->fail_since;
+  dst->fails = src->fails;
+  dst->parked = src->parked;
   dst->deps_hash = src->deps_hash;
+  dst->fp[0] = src->fp[0];
+  dst->fp[1] = src->fp[1];
+  dst->pinned = src->pinned;
   CPU_ZERO(&dst->cpuset);
   for(i = 0; i < CPU_SETSIZE; i++) {
     if (CPU_ISSET(i, &src->cpuset)) {
       CPU_SET(i, &dst->cpuset);
     }
   }
+  plan_cpy(dst, src);
 }
 const UT_icd job_mm={sizeof(job_t), (init_f*)job_ini, 
                     (ctor_f*)job_cpy, (dtor_f*)job_fin };
 
 /* these "set_" functions are called from the lemon-generated parser.  they
  * indicate an error by setting ps->rc to -1. the values they set are one of
- * the fields in ps->job. */
+ * the fields in ps->job. the strings they are given are tokens, which are
+ * in the arena of the job if it has one */
 #define mk_setter(n)                                                \
 void set_ ## n(parse_t *ps, char *v) {                              \
   if (ps->job->n) {                                                 \
     utstring_printf(ps->em, #n " respecified near line %d in %s ",  \
-                    ps->line, ps->cfg->file);                       \
+                    ps->line, ps->file);                            \
     ps->rc = -1;                                                    \
     return;                                                         \
   }                                                                 \
-  ps->job->n = strdup(v);                                           \
+  ps->job->n = ps->job->arena ? v : strdup(v);                      \
 }
 mk_setter(name);
 mk_setter(dir);
@@ -110,7 +163,7 @@ void set_cmd(parse_t *ps, char *cmd) {
  * or as a comma-delimited list of numbers and ranges
  * e.g. 1,3-5,8
  */
-void set_cpu(parse_t *ps, char *cpu_spec) { 
+static int cpu_mask(parse_t *ps, char *cpu_spec, cpu_set_t *set) {
   unsigned cpu, i, in_range, range_start, range_end, ndig;
   unsigned char *c, d, peek;
   size_t len;
@@ -124,7 +177,7 @@ void set_cpu(parse_t *ps, char *cpu_spec) {
     if (len == 0) {
       utstring_printf(ps->em, "parse error in cpuset");
       ps->rc = -1;
-      return;
+      return -1;
     }
 
     for(c=cpu_spec; *c != '\0'; c++) {
@@ -134,18 +187,18 @@ void set_cpu(parse_t *ps, char *cpu_spec) {
       else {
         utstring_printf(ps->em, "invalid hex in cpuset");
         ps->rc = -1;
-        return;
+        return -1;
       }
       /* parse one number in the range 0-15 into bits */
       for(i = 0; i < 4; i++) {
         if (d & (1 << i)) {
           cpu = i + (len-1)*4;
-          CPU_SET(cpu, &ps->job->cpuset);
+          CPU_SET(cpu, set);
         }
       }
       len--;
     }
-    return;
+    return 0;
   }
 
   /* parse numbers and ranges format e.g. "12,14-17" */
@@ -169,7 +222,7 @@ void set_cpu(parse_t *ps, char *cpu_spec) {
             range_end = d;
           }
           for(cpu = range_start; cpu <= range_end; cpu++) {
-            CPU_SET(cpu, &ps->job->cpuset);
+            CPU_SET(cpu, set);
           }
           d = 0;
       }
@@ -186,12 +239,93 @@ void set_cpu(parse_t *ps, char *cpu_spec) {
     } else goto fail;
   }
 
-  return;
+  return 0;
 
  fail:
   utstring_printf(ps->em, "syntax error in cpuset");
   ps->rc = -1;
-  return;
+  return -1;
+}
+
+/* a list that names cpus by where they are, such as "node0,isolated", is
+ * resolved from sysfs as it is parsed (see topo_select). it can have
+ * numbers and ranges in it too */
+static int cpu_sel(parse_t *ps, char *cpu_spec, cpu_set_t *set) {
+  char buf[256], *item, *save;
+  cpu_set_t sel;
+  size_t len;
+  int named = 0;
+
+  for(item = cpu_spec; *item; item++) if (isalpha((unsigned char)*item)) named = 1;
+  if (!named || (strncmp(cpu_spec, "0x", 2) == 0))
+    return cpu_mask(ps, cpu_spec, set);
+
+  len = strlen(cpu_spec);
+  if ((len >= sizeof(buf)) || (cpu_spec[0] == ',') ||
+      (cpu_spec[len-1] == ',') || strstr(cpu_spec, ",,")) goto fail;
+  memcpy(buf, cpu_spec, len+1);
+  for(item = strtok_r(buf, ",", &save); item; item = strtok_r(NULL, ",", &save)) {
+    if (isdigit((unsigned char)*item)) {
+      if (cpu_mask(ps, item, set) < 0) return -1;
+      continue;
+    }
+    if (topo_select(topo_root(ps->cfg), item, &sel) < 0) goto fail;
+    CPU_OR(set, set, &sel);
+    ps->topo = 1;
+  }
+  return 0;
+
+ fail:
+  utstring_printf(ps->em, "syntax error in cpuset %s", cpu_spec);
+  ps->rc = -1;
+  return -1;
+}
+
+/* a cpu with %i in it, or "spread", is that of each instance; see
+ * expand_job */
+void set_cpu(parse_t *ps, char *cpu_spec) {
+  ps->job->pinned = 1;
+  if (strstr(cpu_spec, "%i") || !strcmp(cpu_spec, "spread"))
+    ps->cpu_spec = cpu_spec;
+  else cpu_sel(ps, cpu_spec, &ps->job->cpuset);
+}
+
+/* "cpu cores-of <cpus>" is the whole of each core that has any of those
+ * cpus; "exclude-siblings" after the cpus keeps one thread of each core */
+void set_cpu_cores(parse_t *ps, char *a, char *b, char *c) {
+  int cores = 0, one = 0;
+  cpu_set_t set;
+
+  if (!strcmp(a, "cores-of")) { cores = 1; a = b; b = c; c = NULL; }
+  if (b && !strcmp(b, "exclude-siblings")) { one = 1; b = NULL; }
+  if (b || c) {
+    utstring_printf(ps->em, "syntax error in cpuset");
+    ps->rc = -1;
+    return;
+  }
+  ps->job->pinned = 1;
+  CPU_ZERO(&set);
+  if (cpu_sel(ps, a, &set) < 0) return;
+  if (cores) topo_cores(topo_root(ps->cfg), &set);
+  if (one) topo_one_thread(topo_root(ps->cfg), &set);
+  if (cores || one) ps->topo = 1;
+  CPU_OR(&ps->job->cpuset, &ps->job->cpuset, &set);
+}
+
+void set_instances(parse_t *ps, char *count) {
+  int n;
+  if ((sscanf(count, "%d", &n) != 1) || (n < 1) || (n > PMTR_MAX_INSTANCES)) {
+    utstring_printf(ps->em, "instances must be 1 to %d", PMTR_MAX_INSTANCES);
+    ps->rc = -1;
+    return;
+  }
+  ps->instances = n;
+}
+
+
+
+void set_after(parse_t *ps, char *name) { 
+  utarray_push_back(&ps->job->after,&name);
 }
 
 void set_env(parse_t *ps, char *env) { 
@@ -229,31 +363,86 @@ void set_dis(parse_t *ps) { ps->job->disabled = 1; }
 void set_wait(parse_t *ps) { ps->job->wait = 1; }
 void set_once(parse_t *ps) { ps->job->once = 1; }
 
-void set_bounce(parse_t *ps, char *timespec) { 
-  int l = strlen(timespec), interval;
+/* parse a time interval like 30s, 5m, 2h or 1d into seconds. on error,
+ * describes it for the given option and returns -1 */
+static int parse_interval(parse_t *ps, char *timespec, int *interval,
+                          char *option) {
+  int l = strlen(timespec), rc = -1;
   char *unit_ptr = &timespec[l-1];
   char unit = *unit_ptr;
   *unit_ptr = '\0';
-  if (sscanf(timespec, "%u", &interval) != 1) {
-    utstring_printf(ps->em, "invalid time interval in 'bounce every'");
-    ps->rc = -1;
-    return;
+  if (sscanf(timespec, "%u", interval) != 1) {
+    utstring_printf(ps->em, "invalid time interval in '%s'", option);
+    goto done;
   }
 
   switch (unit) {
     case 's': break;
-    case 'm': interval *= 60;       break;
-    case 'h': interval *= 60*60;    break;
-    case 'd': interval *= 60*60*24; break;
+    case 'm': *interval *= 60;       break;
+    case 'h': *interval *= 60*60;    break;
+    case 'd': *interval *= 60*60*24; break;
     default: 
-      utstring_printf(ps->em, "invalid time unit in 'bounce every'");
-      ps->rc = -1;
-      return;
+      utstring_printf(ps->em, "invalid time unit in '%s'", option);
+      goto done;
   }
+  rc = 0;
 
+ done:
+  *unit_ptr = unit;
+  if (rc < 0) ps->rc = -1;
+  return rc;
+}
+
+void set_bounce(parse_t *ps, char *timespec) { 
+  int interval;
+  if (parse_interval(ps, timespec, &interval, "bounce every") < 0) return;
   ps->job->bounce_interval = interval;
 }
 
+/* backoff <min> <max> [<factor>]: after each quick exit the restart delay
+ * starts at min, and is multiplied by the factor (default 2) up to max */
+void set_backoff(parse_t *ps, char *min, char *max, char *factor) {
+  double f = 2;
+  int lo, hi;
+
+  if (parse_interval(ps, min, &lo, "backoff") < 0) return;
+  if (parse_interval(ps, max, &hi, "backoff") < 0) return;
+  if ((lo == 0) || (lo > hi)) {
+    utstring_printf(ps->em, "backoff requires 0 < min <= max");
+    ps->rc = -1;
+    return;
+  }
+  if (factor && ((sscanf(factor, "%lf", &f) != 1) || (f < 1) || (f > 100))) {
+    utstring_printf(ps->em, "backoff factor must be from 1 to 100");
+    ps->rc = -1;
+    return;
+  }
+  ps->job->backoff_min = lo;
+  ps->job->backoff_max = hi;
+  ps->job->backoff_factor = f;
+}
+
+void set_jitter(parse_t *ps, char *pct) {
+  char c = '%';
+  int n = sscanf(pct, "%u%c", &ps->job->jitter, &c);
+  if ((n < 1) || (c != '%') || (ps->job->jitter > 100)) {
+    utstring_printf(ps->em, "jitter must be a percentage from 0 to 100");
+    ps->rc = -1;
+  }
+}
+
+/* breaker <count> <interval>: park the job after count failures within
+ * the interval */
+void set_breaker(parse_t *ps, char *count, char *window) {
+  if ((sscanf(count, "%u", &ps->job->breaker_count) != 1) ||
+      (ps->job->breaker_count == 0)) {
+    utstring_printf(ps->em, "breaker count must be a positive number");
+    ps->rc = -1;
+    return;
+  }
+  parse_interval(ps, window, &ps->job->breaker_window, "breaker");
+}
+
 void set_user(parse_t *ps, char *user) { 
   size_t len = strlen(user);
   if (len+1 > PMTR_MAX_USER) {
@@ -304,22 +493,224 @@ void set_ulimit(parse_t *ps, char *rname, char *value_a) {
 
 }
 
+/* the fingerprint of a job is a 128-bit FNV-1a hash of its definition,
+ * each string preceded by its length and each list by its count, so that
+ * equal fingerprints mean equal definitions. it is taken once, as the job
+ * is parsed; more can be hashed into it later, since the hash state is the
+ * fingerprint itself */
+typedef unsigned __int128 fp_t;
+#define FP_BASIS ((((fp_t)0x6c62272e07bb0142ULL) << 64) | 0x62b821756295c58dULL)
+#define FP_PRIME ((((fp_t)0x0000000001000000ULL) << 64) | 0x000000000000013bULL)
+
+static void fp_bytes(job_t *job, const void *p, size_t n) {
+  const unsigned char *c = p;
+  fp_t h = ((fp_t)job->fp[0] << 64) | job->fp[1];
+  while (n--) { h ^= *c++; h *= FP_PRIME; }
+  job->fp[0] = (uint64_t)(h >> 64);
+  job->fp[1] = (uint64_t)h;
+}
+#define fp_val(job,v) fp_bytes((job), &(v), sizeof(v))
+
+static void fp_str(job_t *job, const char *str) {
+  uint32_t n = str ? strlen(str) : UINT32_MAX;
+  fp_val(job, n);
+  if (str) fp_bytes(job, str, n);
+}
+
+static void fp_strs(job_t *job, UT_array *strs) {
+  uint32_t n = utarray_len(strs);
+  char **s = NULL;
+  fp_val(job, n);
+  while ( (s=(char**)utarray_next(strs,s))) fp_str(job, *s);
+}
+
+/* the fields that the instances of a template have in common come first,
+ * so that the part of the fingerprint for them is computed once for all
+ * of them. fp_own then takes it over the fields of an instance's own */
+static void fp_shared(job_t *job) {
+  resource_rlimit_t *r = NULL;
+  uint32_t n;
+
+  job->fp[0] = (uint64_t)(FP_BASIS >> 64);
+  job->fp[1] = (uint64_t)FP_BASIS;
+  fp_strs(job, &job->cmdv);
+  fp_strs(job, &job->depv);
+  n = utarray_len(&job->rlim);
+  fp_val(job, n);
+  while ( (r=(resource_rlimit_t*)utarray_next(&job->rlim,r))) {
+    fp_val(job, r->id);
+    fp_val(job, r->rlim.rlim_cur);
+    fp_val(job, r->rlim.rlim_max);
+  }
+  fp_strs(job, &job->after);
+  fp_str(job, job->dir);
+  fp_str(job, job->in);
+  fp_str(job, job->user);
+  fp_val(job, job->order);
+  fp_val(job, job->nice);
+  fp_val(job, job->disabled);
+  fp_val(job, job->wait);
+  fp_val(job, job->once);
+  fp_val(job, job->bounce_interval);
+  fp_val(job, job->backoff_min);
+  fp_val(job, job->backoff_max);
+  fp_val(job, job->backoff_factor);
+  fp_val(job, job->jitter);
+  fp_val(job, job->breaker_count);
+  fp_val(job, job->breaker_window);
+}
+
+static void fp_own(job_t *job) {
+  fp_str(job, job->name);
+  fp_strs(job, &job->envv);
+  fp_str(job, job->out);
+  fp_str(job, job->err);
+  fp_val(job, job->cpuset);
+}
+
+static void fingerprint_job(job_t *job) {
+  fp_shared(job);
+  fp_own(job);
+}
+
+/* s with each %i in it replaced by the number n, in the arena of the job,
+ * or malloc'd if it has none; s itself if there is no %i in it */
+static char *subst(job_t *job, char *s, unsigned n) {
+  char num[16], *c, *r, *d;
+  size_t len, nlen, k = 0;
+
+  for(c = s; (c = strstr(c, "%i")) != NULL; c += 2) k++;
+  if (k == 0) return s;
+  nlen = snprintf(num, sizeof(num), "%u", n);
+  len = strlen(s) + k*nlen - k*2 + 1;
+  r = job->arena ? arena_alloc(job->arena, len) : malloc(len);
+  if (r == NULL) return NULL;
+  for(c = s, d = r; *c != '\0'; ) {
+    if ((c[0] == '%') && (c[1] == 'i')) {
+      memcpy(d, num, nlen);
+      d += nlen;
+      c += 2;
+    } else *d++ = *c++;
+  }
+  *d = '\0';
+  return r;
+}
+
+/* replace the string at *s with its substitution for instance n */
+static int subst_at(job_t *job, char **s, unsigned n) {
+  char *r;
+  if (*s == NULL) return 0;
+  if ( (r = subst(job, *s, n)) == NULL) return -1;
+  if ((r != *s) && (job->arena == NULL)) free(*s);
+  *s = r;
+  return 0;
+}
+
+/* a job with "instances" in it is a template for that many jobs. each is
+ * a copy of it that shares its strings, but for those with %i in them,
+ * which have the number of the instance (from 0) put in place of the %i.
+ * those can be the name, the env values, out, err, and the cpu. with cpu
+ * "spread", each instance is put on a cpu of its own that pmtr may run
+ * on, a core at a time (see spread_cpus); and round again if there are
+ * more instances than cpus */
+static int expand_job(parse_t *ps) {
+  job_t *job, *t = ps->job;
+  int spread, order[CPU_SETSIZE], ncpu = 0;
+  cpu_set_t allowed;
+  uint64_t fp[2];
+  char **s, *c;
+  unsigned i;
+  int rc;
+
+  if ((ps->instances > 1) && !strstr(t->name, "%i")) {
+    utstring_printf(ps->em, "job %s: instances need %%i in the name", t->name);
+    return -1;
+  }
+  spread = ps->cpu_spec && !strcmp(ps->cpu_spec, "spread");
+  if (spread) {
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) < 0) CPU_ZERO(&allowed);
+    ncpu = spread_cpus(topo_root(ps->cfg), &allowed, order);
+    ps->topo = 1;
+    if (ncpu == 0) {
+      utstring_printf(ps->em, "job %s: no cpus to spread over", t->name);
+      return -1;
+    }
+  }
+  fp_shared(t);
+  fp[0] = t->fp[0];
+  fp[1] = t->fp[1];
+  utarray_reserve(ps->jobs, ps->instances);
+  for(i = 0; i < ps->instances; i++) {
+    utarray_push_back(ps->jobs, t);
+    job = (job_t*)utarray_back(ps->jobs);
+    if (subst_at(job, &job->name, i) < 0) goto oom;
+    if (subst_at(job, &job->out, i) < 0) goto oom;
+    if (subst_at(job, &job->err, i) < 0) goto oom;
+    s = NULL;
+    while ( (s=(char**)utarray_next(&job->envv,s))) {
+      if (subst_at(job, s, i) < 0) goto oom;
+    }
+    if (spread) CPU_SET(order[i % ncpu], &job->cpuset);
+    else if (ps->cpu_spec) {
+      if ( (c = subst(job, ps->cpu_spec, i)) == NULL) goto oom;
+      rc = cpu_sel(ps, c, &job->cpuset);
+      if (!job->arena) free(c);
+      if (rc < 0) return -1;
+    }
+    job->fp[0] = fp[0];
+    job->fp[1] = fp[1];
+    fp_own(job);
+    if (!ps->include) plan_job(job);
+  }
+  return 0;
+
+ oom:
+  utstring_printf(ps->em, "out of memory");
+  return -1;
+}
+
 void push_job(parse_t *ps) {
+  arena_t *a = ps->job->arena;
+  job_t *job;
+  int rc;
 
   /* final validation */
   if (!ps->job->name) {
       utstring_printf(ps->em, "job has no name");
       ps->rc = -1;
   }
+  if (ps->cpu_spec && !ps->instances) {
+      utstring_printf(ps->em, "cpu %s needs instances", ps->cpu_spec);
+      ps->rc = -1;
+  }
 
   if (ps->rc == -1) return;
 
-  /* okay. polish it off and copy it into the jobs */
+  /* okay. polish it off and move it into the jobs */
   utarray_extend_back(&ps->job->cmdv); /* put NULL on end of argv */
-  utarray_push_back(ps->cfg->jobs, ps->job);
-  /* reset job for another parse */
-  job_fin(ps->job); 
+  if (ps->instances) {
+    /* the template itself is not a job. it is let go, keeping its arena
+     * (which the instances hold too) for the next job */
+    rc = expand_job(ps);
+    arena_ref(a);
+    job_fin(ps->job);
+    if (rc < 0) ps->rc = -1;
+  } else {
+    fingerprint_job(ps->job);
+    utarray_extend_back(ps->jobs);
+    job = (job_t*)utarray_back(ps->jobs);
+    memcpy(job, ps->job, sizeof(*job));
+    /* prepare how it gets started. on failure, that is done when it starts;
+     * as it is for a job of an included file, since the lookups of plan_job
+     * are not safe on the threads those are parsed on */
+    if (!ps->include) plan_job(job);
+  }
+  /* reset job for another parse, in the same arena */
   job_ini(ps->job);
+  if (a) job_arena(ps->job, a);
+  if (ps->instances) arena_unref(a);
+  ps->instances = 0;
+  ps->cpu_spec = NULL;
 }
 char *unquote(char *str) {
   assert(*str == '"');
@@ -344,14 +735,13 @@ char *fpath(job_t *job, char *file) {
   return path;
 }
 
-/* this function reads a whole file into a malloc'd buffer */
-#define SLURP_MAX_SIZE (10 * 1024 * 1024)  /* 10 MB limit */
-int slurp(char *file, char **text, size_t *len) {
+/* maps a whole file read-only. the parse works on the mapping, so the
+ * config is not copied and need not fit in memory twice. an empty file
+ * gives a NULL text. unmap_file undoes it */
+int map_file(char *file, char **text, size_t *len) {
   struct stat s;
-  char *buf;
+  void *m;
   int fd = -1, rc=-1;
-  ssize_t nr;
-  size_t total = 0;
   *text=NULL; *len = 0;
 
   if ( (fd = open(file, O_RDONLY)) == -1) {
@@ -362,402 +752,693 @@ int slurp(char *file, char **text, size_t *len) {
     syslog(LOG_ERR,"can't stat %s: %s", file, strerror(errno));
     goto done;
   }
-  *len = s.st_size;
-  if (*len == 0) {rc=0; goto done;} // special case, empty file
-  if (*len > SLURP_MAX_SIZE) {
-    syslog(LOG_ERR,"%s: file too large (%zu bytes)", file, *len);
-    goto done;
-  }
-  if ( (*text = malloc(*len)) == NULL) {
-    syslog(LOG_ERR,"malloc failed for %s", file);
+  if (s.st_size == 0) {rc=0; goto done;} // special case, empty file
+  m = mmap(NULL, s.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  if (m == MAP_FAILED) {
+    syslog(LOG_ERR,"can't map %s: %s", file, strerror(errno));
     goto done;
   }
-  while (total < *len) {
-    nr = read(fd, *text + total, *len - total);
-    if (nr == -1) {
-      if (errno == EINTR) continue;
-      syslog(LOG_CRIT,"read %s failed: %s", file, strerror(errno));
-      goto done;
-    }
-    if (nr == 0) {
-      syslog(LOG_CRIT,"read %s failed: unexpected EOF (%zu/%zu)", file,
-         total, *len);
-      goto done;
-    }
-    total += nr;
-  }
+  madvise(m, s.st_size, MADV_SEQUENTIAL); /* read once, front to back */
+  *text = m;
+  *len = s.st_size;
   rc = 0;
 
  done:
-  if ((rc < 0) && *text) { free(*text); *text=NULL; }
   if (fd != -1) close(fd);
   return rc;
 }
 
-// record a hash of each job's dependencies; rehash later to detect changes
-int hash_deps(UT_array *jobs) {
-  char *text, *t;
-  size_t len, l;
-  int rc = -1;
+void unmap_file(char *text, size_t len) {
+  if (text) munmap(text, len);
+}
 
+/* hash the dependencies of one job into its deps_hash. a dependency that
+ * can't be read disables the job */
+static void hash_job_deps(pmtr_t *cfg, job_t *job) {
+  uint64_t h, seq[2];
+  char **dep=NULL, *path;
+
+  job->deps_hash=0;
+  while( (dep=(char**)utarray_next(&job->depv,dep))) {
+    path = fpath(job,*dep);
+    if (path == NULL) {
+      syslog(LOG_ERR,"job %s: dependency path too long: %s", job->name, *dep);
+      job->disabled = 1;
+      if (job->pid) job->terminate=1;
+      continue;
+    }
+    if (dep_hash(&cfg->dc, path, &h) < 0) {
+      syslog(LOG_ERR,"job %s: can't open dependency %s: %s", job->name,
+        *dep, strerror(errno));
+      job->disabled = 1; /* they need to fix pmtr.conf to trigger rescan */
+      if (job->pid) job->terminate=1;
+      continue;
+    }
+    if (h == 0) continue;  /* empty file */
+    seq[0] = job->deps_hash;
+    seq[1] = h;
+    job->deps_hash = hash64(seq, sizeof(seq), 0);
+  }
+}
+
+// record a hash of each job's dependencies; rehash later to detect changes.
+// only files that changed since they were last hashed are read again, and
+// a file that many jobs depend on is looked at once
+int hash_deps(pmtr_t *cfg) {
   job_t *job=NULL;
+
+  dep_pass(&cfg->dc);
+  while ( (job=(job_t*)utarray_next(cfg->jobs,job))) hash_job_deps(cfg, job);
+  dep_prune(&cfg->dc);
+  return 0;
+}
+
+// a dependency of the named jobs changed on disk. rehash just those jobs,
+// and restart the ones whose dependencies hash differently now, without
+// parsing pmtr.conf again. a job whose dependency is gone is disabled, as
+// on a rescan; returns the number of those
+int deps_changed(pmtr_t *cfg, UT_array *names) {
+  char **name=NULL;
+  job_t *job;
+  uint64_t was;
+  int disabled=0;
+
+  dep_pass(&cfg->dc);
+  while ( (name=(char**)utarray_next(names,name))) {
+    job = get_job_by_name(&cfg->jx, *name);
+    if ((job == NULL) || job->disabled) continue;
+    was = job->deps_hash;
+    hash_job_deps(cfg, job);
+    if ((job->deps_hash == was) && !job->disabled) continue;
+    if (job->disabled) disabled++;
+    else syslog(LOG_INFO,"job %s: dependency changed, restarting", job->name);
+    if (job->pid && (job->terminate == 0)) job->terminate = 1;
+    queue_job(cfg, job);
+  }
+  return disabled;
+}
+
+static int order_sort(const void *_a, const void *_b) {
+  job_t *a = (job_t*)_a, *b = (job_t*)_b;
+  return a->order - b->order;
+}
+
+/* state of the arrangement of jobs in order_jobs */
+typedef struct {
+  job_index *jx;
+  char *state;     /* per job: 0 to do, 1 placing its prerequisites, 2 done */
+  unsigned *seq;   /* job indices in the order they are to be started */
+  unsigned n;
+  UT_string *em;
+} order_t;
+
+/* place the jobs that job i starts after, then job i */
+static int place_job(order_t *o, unsigned i) {
+  job_t *job = (job_t*)utarray_eltptr(o->jx->jobs, i), *pre;
+  char **name = NULL;
+
+  if (o->state[i] == 2) return 0;
+  if (o->state[i] == 1) {
+    utstring_printf(o->em, "job %s: circular 'after'", job->name);
+    return -1;
+  }
+  o->state[i] = 1;
+  while ( (name=(char**)utarray_next(&job->after,name))) {
+    pre = get_job_by_name(o->jx, *name);
+    if (pre == NULL) {
+      utstring_printf(o->em, "job %s: after unknown job %s", job->name, *name);
+      return -1;
+    }
+    if (place_job(o, utarray_eltidx(o->jx->jobs, pre)) < 0) return -1;
+  }
+  o->state[i] = 2;
+  o->seq[o->n++] = i;
+  return 0;
+}
+
+/* adds to the 'after' of a job the wait jobs it does not already name,
+ * and folds them all into its fingerprint. a name is kept in the job's own
+ * strings: a reload can keep the job and drop the wait job's arena. a job
+ * in the same arena shares the name, as with the jobs it names itself */
+static int after_waits(job_t *job, UT_array *waits) {
+  uint32_t n = utarray_len(waits);
+  job_t **w = NULL;
+  char **name, *s;
+
+  fp_val(job, n);
+  while ( (w=(job_t**)utarray_next(waits,w))) {
+    fp_str(job, (*w)->name);
+    name = NULL;
+    while ( (name=(char**)utarray_next(&job->after,name))) {
+      if (strcmp(*name, (*w)->name) == 0) break;
+    }
+    if (name) continue;
+    s = (*w)->name;
+    if (job->arena && (job->arena != (*w)->arena)) {
+      if ( (s = arena_strdup(job->arena, s)) == NULL) return -1;
+    }
+    utarray_push_back(&job->after, &s);  /* strdup'd if the job has no arena */
+  }
+  return 0;
+}
+
+/* a job is started when the jobs it is 'after' are ready (see job_ready).
+ * besides those it names, each job is after the 'wait' jobs ordered
+ * before it, as when a 'wait' job paused the startup of the jobs that
+ * followed it. the jobs are arranged to follow those they are after, so
+ * that one pass over them starts every job that is ready */
+static int order_jobs(pmtr_t *cfg, UT_string *em) {
+  UT_array *jobs = cfg->jobs, waits;
+  unsigned i, len = utarray_len(jobs);
+  size_t sz = jobs->icd.sz;
+  char *d = NULL;
+  job_t *job;
+  order_t o;
+  int rc = -1;
+
+  utarray_sort(jobs, order_sort);
+  index_jobs(&cfg->jx, jobs);
+  if (len == 0) return 0;
+
+  utarray_init(&waits, &ut_ptr_icd); /* jobs in the array */
+  job = NULL;
   while ( (job=(job_t*)utarray_next(jobs,job))) {
-    job->deps_hash=0;
-    char **dep=NULL;
-    while( (dep=(char**)utarray_next(&job->depv,dep))) {
-      char *path = fpath(job,*dep);
-      if (path == NULL) {
-        syslog(LOG_ERR,"job %s: dependency path too long: %s", job->name, *dep);
-        job->disabled = 1;
-        if (job->pid) job->terminate=1;
-        continue;
-      }
-      if (slurp(path, &text, &len) < 0) {
-        syslog(LOG_ERR,"job %s: can't open dependency %s", job->name, *dep);
-        job->disabled = 1; /* they need to fix pmtr.conf to trigger rescan */
-        if (job->pid) job->terminate=1;
-        continue;
-      }
-      t=text; l=len;
-      while (l--) job->deps_hash = (job->deps_hash * 33) + *t++;
-      memset(text,0,len); // keep our address space free of random files :-)
-      free(text);
+    if (utarray_len(&waits) && (after_waits(job, &waits) < 0)) {
+      utstring_printf(em, "out of memory");
+      utarray_done(&waits);
+      return -1;
     }
+    if (job->wait) utarray_push_back(&waits, &job);
+  }
+  utarray_done(&waits);
+
+  memset(&o, 0, sizeof(o));
+  o.jx = &cfg->jx;
+  o.em = em;
+  o.state = calloc(len, sizeof(char));
+  o.seq = malloc(len * sizeof(unsigned));
+  d = malloc(len * sz);
+  if ((o.state == NULL) || (o.seq == NULL) || (d == NULL)) {
+    utstring_printf(em, "out of memory");
+    goto done;
+  }
+  for(i = 0; i < len; i++) {
+    if (place_job(&o, i) < 0) goto done;
   }
 
-  rc=0;
+  /* move the jobs into place, as utarray_sort does */
+  for(i = 0; i < len; i++) memcpy(d + i*sz, _utarray_eltptr(jobs, o.seq[i]), sz);
+  memcpy(jobs->d, d, len*sz);
+  index_jobs(&cfg->jx, jobs);
+  rc = 0;
 
  done:
+  if (o.state) free(o.state);
+  if (o.seq) free(o.seq);
+  if (d) free(d);
   return rc;
 }
+/* identifies the job config in status reports: a hash of the fingerprints
+ * of its jobs, in their order */
+static uint64_t config_version(UT_array *jobs) {
+  uint64_t h = 14695981039346656037ULL;  /* FNV-1a */
+  const unsigned char *c;
+  job_t *job = NULL;
+  size_t n;
 
-static int order_sort(const void *_a, const void *_b) {
-  job_t *a = (job_t*)_a, *b = (job_t*)_b;
-  return a->order - b->order;
+  while ( (job=(job_t*)utarray_next(jobs,job))) {
+    for(c = (unsigned char*)job->fp, n = sizeof(job->fp); n; n--, c++) {
+      h ^= *c;
+      h *= 1099511628211ULL;
+    }
+  }
+  return h;
+}
+
+/* a config file truncated while it is mapped faults (SIGBUS) on reading
+ * past its new end. that ends the parse, as an error; the watch sees the
+ * change and the file is parsed again. pmtr blocks all signals, and a
+ * blocked SIGBUS would kill it, so it is unblocked meanwhile. the fault
+ * is taken by the thread that read the file, so each has its own jump */
+__thread sigjmp_buf bus_jmp;
+static void on_bus(int signo) {
+  (void)signo;
+  siglongjmp(bus_jmp, 1);
+}
+
+/* tokenizes the len bytes of config text at buf in place, and feeds the
+ * tokens to the lemon parser, which puts the jobs into ps->jobs. the text
+ * of the tokens that have any goes into the arena of ps->job, where the
+ * jobs keep it. other tokens are keywords, whose text is not used.
+ * returns ps->rc */
+int parse_text(parse_t *ps, void *parser, char *buf, size_t len) {
+  size_t toklen;
+  char *c, *tok;
+  int id;
+
+  c = buf;
+  while ( (id=get_tok(buf,&c,&len,&toklen,&ps->line)) > 0) {
+    tok = NULL;
+    if ((id == TOK_STR) || (id == TOK_QUOTEDSTR)) {
+      tok = arena_strndup(ps->job->arena, c, toklen);
+      if (tok == NULL) {
+        utstring_printf(ps->em, "out of memory");
+        ps->rc = -1;
+        return -1;
+      }
+    }
+    if (ps->cfg->verbose >=2) printf("token [%.*s] id=%d line=%d\n",(int)toklen,c,id,ps->line);
+    Parse(parser, id, tok, ps);
+    if (ps->rc == -1) return -1;
+    len -= toklen;
+    c += toklen;
+  }
+  if (id == -1) {
+    utstring_printf(ps->em,"syntax error in %s line %d", ps->file, ps->line);
+    ps->rc = -1;
+    return -1;
+  }
+  Parse(parser, 0, NULL, ps);
+  return ps->rc;
 }
+
+/* the config is tokenized in place, in a mapping of the file. with an
+ * image (-C), the jobs are loaded from it instead if it is of the same
+ * text; and a test of the config (-t) writes it (see image.c). then the
+ * files it includes are parsed (see frag.c), and all the jobs ordered */
 int parse_jobs(pmtr_t *cfg, UT_string *em) {
-  char *buf, *c, *tok;
-  size_t len,toklen;
-  UT_array *toks;
+  struct sigaction sa, osa;
+  sigset_t bus, omask;
+  char *buf=NULL;
+  size_t len,mlen=0;
+  uint64_t key=0;
+  int loaded=1;  /* 0 if the jobs came from the image */
+  arena_t *arena;
   parse_t ps; /* our own parser state */ 
   void *p;    /* lemon parser */
-  int id;
 
-  utarray_new(toks,&ut_str_icd);
+  if ( (arena = arena_new()) == NULL) {
+    utstring_printf(em, "out of memory");
+    return -1;
+  }
   job_t job;  /* "scratch" space used when parsing a job */
   job_ini(&job);
+  job_arena(&job, arena);
+  arena_unref(arena); /* the jobs hold it from here */
   ps.job=&job; 
 
   ps.cfg=cfg;
+  ps.file=cfg->file;
+  ps.jobs=cfg->jobs;
+  ps.include=0;
+  ps.instances=0;
+  ps.cpu_spec=NULL;
+  ps.topo=0;
   ps.line=1; 
   ps.em=em;
   ps.rc=0;
+  if (cfg->inc.specs) utarray_clear(cfg->inc.specs);
 
   p = ParseAlloc(malloc);
 
-  if (slurp(ps.cfg->file, &buf, &len) < 0) {ps.rc=-1; goto done;}
-  c = buf;
-  while ( (id=get_tok(buf,&c,&len,&toklen,&ps.line)) > 0) {
-    tok = strndup(c,toklen); utarray_push_back(toks,&tok); free(tok); 
-    tok = *(char**)utarray_back(toks);
-    if (cfg->verbose >=2) printf("token [%s] id=%d line=%d\n",tok, id, ps.line);
-    Parse(p, id, tok, &ps);
-    if (ps.rc == -1) goto done;
-    len -= toklen;
-    c += toklen;
+  memset(&sa, 0, sizeof(sa));
+  sa.sa_handler = on_bus;
+  sigaction(SIGBUS, &sa, &osa);
+  sigemptyset(&bus);
+  sigaddset(&bus, SIGBUS);
+  sigprocmask(SIG_UNBLOCK, &bus, &omask);
+
+  if (map_file(ps.file, &buf, &len) < 0) {ps.rc=-1; goto restore;}
+  mlen = len;
+  if (sigsetjmp(bus_jmp, 1)) {
+    utstring_printf(em, "%s changed while being read", ps.file);
+    ps.rc = -1;
+    goto unmap;
   }
-  if (id == -1) {
-    utstring_printf(em,"syntax error in %s line %d", ps.cfg->file, ps.line);
+
+  /* the jobs may be had from an image compiled from this same text */
+  if (cfg->image) {
+    key = hash64(buf, mlen, 0);
+    if (!cfg->test_only) loaded = image_load(cfg, key, mlen, em);
+    if (loaded == -1) ps.rc = -1;
+    if (loaded <= 0) goto unmap;
+  }
+
+  parse_text(&ps, p, buf, len);
+
+ unmap:  /* the tokens that are kept were copied out */
+  unmap_file(buf, mlen);
+  if (ps.rc == -1) goto restore;
+  if (cfg->image && cfg->test_only &&
+      (image_save(cfg, key, mlen, ps.topo, em) < 0)) {
     ps.rc = -1;
-    goto done;
+    goto restore;
   }
-  Parse(p, 0, NULL, &ps);
+
+  /* the included files are parsed on threads, which inherit the mask */
+  if (parse_includes(cfg, em) < 0) ps.rc = -1;
+
+ restore:
+  sigprocmask(SIG_SETMASK, &omask, NULL);
+  sigaction(SIGBUS, &osa, NULL);
   if (ps.rc == -1) goto done;
 
   /* parsing succeeded */
-  utarray_sort(cfg->jobs, order_sort);
-  hash_deps(cfg->jobs);
+  if (order_jobs(cfg, em) < 0) {ps.rc = -1; goto done;}
+  hash_deps(cfg);
+  cfg->version = config_version(cfg->jobs);
 
  done:
-  utarray_free(toks);
   ParseFree(p, free);
-  if (buf) free(buf);
   job_fin(&job);
   return ps.rc;
 }
 
-void signal_job(job_t *job) {
+/* each job gets a pidfd when started. its exit makes the pidfd readable,
+ * which the main loop delivers to collect_job, and signals sent through
+ * it cannot hit an unrelated process that recycled the pid. kernels
+ * without pidfd support fall back to SIGCHLD and kill() */
+static int open_pidfd(pid_t pid) {
+#ifdef SYS_pidfd_open
+  return syscall(SYS_pidfd_open, pid, 0);
+#else
+  errno = ENOSYS;
+  return -1;
+#endif
+}
+
+static int signal_pid(job_t *job, int signo) {
+#ifdef SYS_pidfd_send_signal
+  if (job->pidfd != -1)
+    return syscall(SYS_pidfd_send_signal, job->pidfd, signo, NULL, 0);
+#endif
+  return kill(job->pid, signo);
+}
+
+static void track_pid(pmtr_t *cfg, job_t *job) {
+  job->pidfd = open_pidfd(job->pid);
+  if (job->pidfd == -1) return;
+  if (add_epoll(cfg, job->pidfd, EV_PIDFD, job->pid) < 0) {
+    close(job->pidfd);
+    job->pidfd = -1;
+  }
+}
+
+static void untrack_pid(pmtr_t *cfg, job_t *job) {
+  if (job->pidfd == -1) return;
+  del_epoll(cfg, job->pidfd);
+  close(job->pidfd);
+  job->pidfd = -1;
+}
+
+void signal_job(pmtr_t *cfg, job_t *job) {
   time_t now = time(NULL);
   assert(job->pid);
   switch(job->terminate) {
    case 0: /* should not be here */ break;
    case 1: /* initial termination request */
      syslog(LOG_INFO,"sending SIGTERM to job %s [%d]", job->name, job->pid);
-     if (kill(job->pid,SIGTERM)==-1)syslog(LOG_ERR,"error: %s",strerror(errno));
+     if (signal_pid(job,SIGTERM)==-1)syslog(LOG_ERR,"error: %s",strerror(errno));
      job->terminate = now+SHORT_DELAY;/* how long to wait before kill -9*/
+     timer_job(cfg, job, job->terminate);
      break;
    default: /* job didn't exit, use stronger signal if time has elapsed */
-     if (job->terminate > now) break;
+     if (job->terminate > now) {
+       timer_job(cfg, job, job->terminate);
+       break;
+     }
      syslog(LOG_INFO,"sending SIGKILL to job %s [%d]", job->name, job->pid);
-     if (kill(job->pid,SIGKILL)==-1)syslog(LOG_ERR,"error: %s",strerror(errno));
+     if (signal_pid(job,SIGKILL)==-1)syslog(LOG_ERR,"error: %s",strerror(errno));
      job->terminate = 0; /* don't repeatedly signal */
      break;
   }
 }
 
-/* open descriptor to the logger socket on given fd */
-int logger_on(pmtr_t *cfg, int dst_fd) {
-  struct sockaddr_un addr;
-  int sc, fd, rc = -1;
+/* a job that others start after is ready once it is running; or, if it
+ * is a 'wait' job, once it has run to completion. a disabled job holds
+ * up nothing */
+static int job_ready(job_t *job) {
+  if (job->disabled) return 1;
+  if (job->wait) return job->finished;
+  return job->pid || job->finished;
+}
+
+static int after_ready(pmtr_t *cfg, job_t *job) {
+  char **name = NULL;
+  job_t *pre;
+
+  while ( (name=(char**)utarray_next(&job->after,name))) {
+    pre = get_job_by_name(&cfg->jx, *name);
+    if (pre && !job_ready(pre)) return 0;
+  }
+  return 1;
+}
 
-  fd = socket(AF_UNIX, SOCK_STREAM, 0);
-  if (fd == -1) goto done;
+/* the job queues. rather than visit every job after each event, the main
+ * loop visits those that something happened to: they exited, were enabled
+ * or disabled, or the config was reloaded. (timers visit their jobs
+ * directly.) a queue holds job names, since job_t elements move; the
+ * queued flags of a job keep it from being queued twice. a job that is
+ * waiting on others to be ready is held in the blocked queue until one of
+ * them starts or changes state */
+static void enqueue(job_t *job, UT_array *q, int flag) {
+  if (job->queued & flag) return;
+  job->queued |= flag;
+  utarray_push_back(q, &job->name);
+}
 
-  memset(&addr, 0, sizeof(addr));
-  addr.sun_family = AF_UNIX;
-  assert(cfg->logger_namelen > 0);
-  memcpy(addr.sun_path, cfg->logger_socket, cfg->logger_namelen);
+static void block_job(pmtr_t *cfg, job_t *job) {
+  enqueue(job, cfg->blocked, Q_BLOCKED);
+}
 
-  socklen_t len = sizeof(sa_family_t) + cfg->logger_namelen;
-  sc = connect(fd, (struct sockaddr*)&addr, len);
-  if (sc == -1) goto done;
+static void ready_job(pmtr_t *cfg, job_t *job) {
+  if (job->terminate && job->pid) enqueue(job, cfg->stopping, Q_STOP);
+  else enqueue(job, cfg->ready, Q_READY);
+}
 
-  if (fd != dst_fd) {
-		sc = dup2(fd, dst_fd);
-		if (sc < 0) goto done;
-		sc = close(fd);
-		if (sc < 0) goto done;
+/* move the blocked jobs to the ready queue, to see if they still wait */
+static void wake_jobs(pmtr_t *cfg) {
+  char **name = NULL;
+  job_t *job;
+
+  while ( (name=(char**)utarray_next(cfg->blocked,name))) {
+    job = get_job_by_name(&cfg->jx, *name);
+    if (job == NULL) continue;  /* went away since */
+    job->queued &= ~Q_BLOCKED;
+    ready_job(cfg, job);
   }
+  utarray_clear(cfg->blocked);
+}
 
-  rc = 0;
+/* queue a job that something happened to. that may be what the blocked
+ * jobs are waiting for, so they are queued too */
+void queue_job(pmtr_t *cfg, job_t *job) {
+  ready_job(cfg, job);
+  wake_jobs(cfg);
+}
 
- done:
-  return rc;
+/* queue every job, as when the job array is new */
+void queue_jobs(pmtr_t *cfg) {
+  job_t *job = NULL;
+
+  utarray_clear(cfg->stopping);
+  utarray_clear(cfg->ready);
+  utarray_clear(cfg->blocked);
+  while ( (job = (job_t*)utarray_next(cfg->jobs,job))) {
+    job->queued = 0;
+    ready_job(cfg, job);
+  }
 }
 
-/* open filename and dup so fileno becomes attached to it */ 
-int redirect(pmtr_t *cfg, int fileno, char *filename, int flags, int mode) {
-  int rc = -1, fd, sc;
+static int run_queue(pmtr_t *cfg, UT_array *q, int flag) {
+  unsigned i, n = 0;
+  job_t *job;
 
-  if (filename == NULL) { /* nothing to do */
-    rc = 0;
-    goto done;
+  /* do_job may add to the queue as we go */
+  for(i = 0; i < utarray_len(q); i++) {
+    job = get_job_by_name(&cfg->jx, *(char**)utarray_eltptr(q,i));
+    if (job == NULL) continue;  /* went away since */
+    job->queued &= ~flag;
+    do_job(cfg, job);
+    n++;
   }
+  utarray_clear(q);
+  return n;
+}
 
-  /* handle reserved word - syslog */
-  if (!strcmp(filename, "syslog")) {
-    rc = logger_on(cfg, fileno);
-    goto done;
+/* visit the queued jobs: those to be signalled, then those to be started.
+ * returns the number of jobs visited */
+int run_jobs(pmtr_t *cfg) {
+  int n = 0;
+  while (utarray_len(cfg->stopping) || utarray_len(cfg->ready)) {
+    n += run_queue(cfg, cfg->stopping, Q_STOP);
+    n += run_queue(cfg, cfg->ready, Q_READY);
   }
+  return n;
+}
 
-  /* regular file */
-  fd = open(filename, flags, mode);
-  if (fd < 0) goto done;
+/* start up the job if it is not already running, or signal it if it is
+ * being terminated. when the job has a deadline in the future, a timer
+ * brings us back here for this job alone once it is due. a job waiting
+ * on others is held aside until one of them starts or changes state */
+void do_job(pmtr_t *cfg, job_t *job) {
+  time_t now = time(NULL);
+  pid_t pid;
 
-  if (fd != fileno) {
-    sc = dup2(fd, fileno);
-    if (sc < 0) goto done;
-    close(fd);
+  if (job->bounce_interval && job->pid) { 
+    if (now - job->start_ts >= job->bounce_interval) {
+      if (job->terminate==0) job->terminate=1;
+    } else timer_job(cfg, job, job->start_ts + job->bounce_interval);
+  }
+  if (job->terminate) {signal_job(cfg, job); return;}
+  if (job->disabled) return;
+  if (job->parked) return;  /* until enabled, or the config is reloaded */
+  if (job->pid) return;  /* running already */
+  if (job->respawn == 0) return;  /* don't respawn */
+  if (!after_ready(cfg, job)) {block_job(cfg, job); return;}
+  if (job->start_at > now) {  /* not yet */
+    timer_job(cfg, job, job->start_at);
+    return;
   }
 
-  rc = 0;
+  pid = spawn_job(cfg, job, SPAWN_VM);
+  if (pid == -1) {
+    syslog(LOG_ERR,"can't start job %s: %s", job->name, strerror(errno));
+    kill(getpid(), 15); /* induce graceful shutdown in main loop */
+    return;
+  }
 
- done:
-  return rc;
+  job->pid = pid;
+  job->start_ts = now;
+  syslog(LOG_INFO,"started job %s [%d]", job->name, (int)job->pid);
+  index_pid(&cfg->jx, job);
+  track_pid(cfg, job);
+  if (job->bounce_interval) {
+    timer_job(cfg, job, job->start_ts + job->bounce_interval);
+  }
+  wake_jobs(cfg);  /* jobs after this one may be ready now */
 }
 
-/* start up the jobs that are not already running */
+/* visit every job; see do_job */
 void do_jobs(pmtr_t *cfg) {
-  pid_t pid;
-  time_t now, elapsed;
-  int es, n, fo, fe, fi, rc=-1, ds;
-  char *pathname, *o, *e, *i, **argv, **env;
-
   job_t *job = NULL;
-  while ( (job = (job_t*)utarray_next(cfg->jobs,job))) {
-    if (job->bounce_interval && job->pid) { 
-      now = time(NULL);
-      elapsed = now - job->start_ts;
-      if (elapsed >= job->bounce_interval) {
-        if (job->terminate==0) job->terminate=1;
-      }
-    }
-    if (job->terminate) {signal_job(job); continue;}
-    if (job->disabled) continue;
-    if (job->pid) continue;  /* running already */
-    if (job->respawn == 0) continue;  /* don't respawn */
-    if (job->start_at > time(&now)) {  /* not yet */
-      alarm_within(cfg, job->start_at - now);
-      continue;
-    }
-
-    pid = fork();
+  while ( (job = (job_t*)utarray_next(cfg->jobs,job))) do_job(cfg, job);
+}
 
-    if (pid == -1) {
-      syslog(LOG_ERR,"fork error\n");
-      kill(getpid(), 15); /* induce graceful shutdown in main loop */
-      return;
-    }
+/* the delay before restarting a job that exited by itself after running
+ * for elapsed seconds. a job that ran for as long as its longest delay is
+ * taken to have been healthy, and is restarted at once. otherwise the
+ * delay grows by the backoff factor with each exit, up to the longest */
+static int restart_delay(job_t *job, int elapsed) {
+  static unsigned seed;
+  double d;
+
+  if (elapsed >= job->backoff_max) {
+    job->backoff = 0;
+    return 0;
+  }
+  d = job->backoff ? (job->backoff * job->backoff_factor) : job->backoff_min;
+  if (d > job->backoff_max) d = job->backoff_max;
+  job->backoff = d;
+  if (job->jitter) {
+    if (seed == 0) seed = getpid() ^ time(NULL);
+    d += d * job->jitter / 100.0 * (2.0 * rand_r(&seed) / RAND_MAX - 1);
+  }
+  return (int)(d + 0.5);
+}
 
-    if (pid > 0) {  /* parent */
-      job->pid = pid;
-      job->start_ts = time(NULL);
-      syslog(LOG_INFO,"started job %s [%d]", job->name, (int)job->pid);
-      /* support the 'wait' feature which pauses (blocks) for a job to finish.*/
-      if (job->wait) {
-        syslog(LOG_INFO,"pausing for job %s to finish",job->name);
-        if (waitpid(job->pid, &es, 0) != job->pid) {
-          syslog(LOG_ERR,"waitpid for job %s failed\n",job->name);
-          continue;
-        }
-        syslog(LOG_INFO,"job %s finished",job->name);
-        if (WIFEXITED(es) && (WEXITSTATUS(es) == PMTR_NO_RESTART)) job->respawn=0;
-        else if (job->once) job->respawn=0;
-        job->pid = 0;
-      }
-      continue;
-    }
+/* count a failure of the job. too many within its breaker window park it,
+ * so that a job in a crash loop stops being restarted */
+static void count_failure(pmtr_t *cfg, job_t *job, time_t now) {
+  if (job->breaker_count == 0) return;
+  if ((job->fails == 0) || (now - job->fail_since >= job->breaker_window)) {
+    job->fail_since = now;
+    job->fails = 0;
+  }
+  if (++job->fails < job->breaker_count) return;
+  job->parked = now;
+  syslog(LOG_ERR,"job %s failed %d times in %d sec: parked", job->name,
+    job->fails, (int)(now - job->fail_since));
+  report_within(cfg,1);    /* report soon if needed */
+}
 
-    /*********************************************************************
-     * child here 
-     ********************************************************************/
-    assert(pid == 0);
-
-    /* setup working dir */
-    if (job->dir && (chdir(job->dir) == -1))                 {rc=-1; goto fail;}
-
-    /* close inherited descriptors */
-    closelog(); 
-
-    /* set environment variables */
-    env=NULL;
-    while ( (env=(char**)utarray_next(&job->envv,env))) {
-      char *eq = strchr(*env, '=');
-      if (eq) {
-        *eq = '\0';
-        setenv(*env, eq+1, 1);
-        *eq = '=';  /* restore in case env is reused */
-      }
-    }
+/* give a parked job another chance */
+void unpark_job(job_t *job) {
+  job->parked = 0;
+  job->fails = 0;
+  job->backoff = 0;
+}
 
-    /* set process priority / nice */
-    if (setpriority(PRIO_PROCESS, 0, job->nice) < 0)         {rc=-5; goto fail;}
+/* record the exit of a job and decide if and when it should be restarted.
+ * an exit that we requested (as for a bounce or a changed config) is not
+ * a failure: the job is restarted without delay */
+static void reap_job(pmtr_t *cfg, job_t *job, int es, UT_string *sm) {
+  int ex, elapsed, requested;
+  pid_t pid = job->pid;
+  time_t now;
 
-    /* set cpu affinity, if any */
-    if ((CPU_COUNT(&job->cpuset) > 0) &&
-      sched_setaffinity(0, sizeof(cpu_set_t), &job->cpuset)) {rc=-12; goto fail;}
+  untrack_pid(cfg, job);
+  unindex_pid(&cfg->jx, job);
+  requested = job->terminate ? 1 : 0;
+  job->pid = 0;
+  job->terminate = 0; /* any termination request has succeeded */
+  job->finished = 1;
+  now = time(NULL);
+  elapsed = now - job->start_ts;
+  job->start_at = now + (requested ? 0 : restart_delay(job, elapsed));
+  if (job->once) job->respawn=0;
+
+  /* write a log message about how the job exited */
+  utstring_clear(sm);
+  utstring_printf(sm,"job %s [%d] exited after %d sec: ", job->name, 
+    (int)pid, elapsed);
+  if (WIFSIGNALED(es)) utstring_printf(sm, "signal %d", (int)WTERMSIG(es));
+  if (WIFEXITED(es)) {
+    if ( (ex = WEXITSTATUS(es)) == PMTR_NO_RESTART) job->respawn=0;
+    utstring_printf(sm,"exit status %d", ex);
+  }
+  syslog(LOG_INFO,"%s",utstring_body(sm));
+  if (!requested && job->respawn) count_failure(cfg, job, now);
+  queue_job(cfg, job);
 
-    /* set ulimits */
-    resource_rlimit_t *rt=NULL;
-    while ( (rt=(resource_rlimit_t*)utarray_next(&job->rlim,rt))) {
-      struct rlimit new_limit = {.rlim_cur=rt->rlim.rlim_cur,
-                                 .rlim_max=rt->rlim.rlim_max};
-      if (setrlimit(rt->id, &new_limit))                     {rc=-6; goto fail;}
-    }
+  /* is this a former job that was deleted from the config file? */
+  if (job->delete_when_collected) {
+    erase_job(&cfg->jx, job);
+  }
+}
 
-    /* restore/unblock default handlers so they're unblocked after exec */
-    for(n=0; n < sizeof(sigs)/sizeof(*sigs); n++) signal(sigs[n], SIG_DFL);
-    sigset_t none;
-    sigemptyset(&none);
-    sigprocmask(SIG_SETMASK,&none,NULL);
-
-    /* change the real and effective user ids, and set the gid and supp groups */
-    if (*job->user) {
-      struct passwd *p;
-      if ( (p = getpwnam(job->user)) == NULL)                {rc=-7; goto fail;}
-      if (setgid(p->pw_gid) == -1)                           {rc=-8; goto fail;}
-      if (initgroups(job->user, p->pw_gid) == -1)            {rc=-9; goto fail;}
-      if (setuid(p->pw_uid) == -1)                           {rc=-10; goto fail;}
-    }
+/* the pidfd of a job became readable: that process (and only it) exited */
+void collect_job(pmtr_t *cfg, pid_t pid, UT_string *sm) {
+  job_t *job;
+  int es;
 
-    /* redirect the child's stdout and stderr to syslog unless user specified */
-    i = job->in  ? job->in  : "/dev/null";
-    o = job->out ? job->out : "syslog";
-    e = job->err ? job->err : "syslog";
-
-    int flags_wr = O_WRONLY|O_CREAT|O_APPEND;
-    if (redirect(cfg, STDIN_FILENO,  i, O_RDONLY, 0)    < 0) { rc=-2; goto fail;}
-    if (redirect(cfg, STDOUT_FILENO, o, flags_wr, 0644) < 0) { rc=-3; goto fail;}
-    if (redirect(cfg, STDERR_FILENO, e, flags_wr, 0644) < 0) { rc=-4; goto fail;}
-
-    /* at last. we're ready to run the child process */
-    argv = (char**)utarray_front(&job->cmdv);
-    pathname = *argv;
-    if (execv(pathname, argv) == -1)                         {rc=-11; goto fail;}
-
-    /* not reached - child has exec'd */
-    assert(0); 
-
-   fail:
-    if (rc==-1) syslog(LOG_ERR,"can't chdir %s: %s", job->dir, strerror(errno));
-    if (rc==-2) syslog(LOG_ERR,"can't open/dup %s: %s", i, strerror(errno));
-    if (rc==-3) syslog(LOG_ERR,"can't open/dup %s: %s", o, strerror(errno));
-    if (rc==-4) syslog(LOG_ERR,"can't open/dup %s: %s", e, strerror(errno));
-    if (rc==-5) syslog(LOG_ERR,"can't setpriority: %s", strerror(errno));
-    if (rc==-6) syslog(LOG_ERR,"can't setrlimit: %s", strerror(errno));
-    if (rc==-7) syslog(LOG_ERR,"unknown user: %s", job->user);
-    if (rc==-8) syslog(LOG_ERR,"can't setgid %s: %s", job->user, strerror(errno));
-    if (rc==-9) syslog(LOG_ERR,"can't initgroups %s: %s", job->user, strerror(errno));
-    if (rc==-10) syslog(LOG_ERR,"can't setuid %s: %s", job->user, strerror(errno));
-    if (rc==-11) syslog(LOG_ERR,"can't exec %s: %s", pathname, strerror(errno));
-    if (rc==-12) syslog(LOG_ERR,"can't set cpu affinity: %s", strerror(errno));
-    exit(-1);  /* child exit */
-  }
+  job = get_job_by_pid(&cfg->jx, pid);
+  if (!job) return;   /* already reaped via SIGCHLD in this same batch */
+  if (waitpid(pid, &es, WNOHANG) != pid) return;
+  reap_job(cfg, job, es, sm);
 }
 
+/* on SIGCHLD, reap our logger sub process, jobs that have no pidfd, and
+ * any orphans that were re-parented to us when we are a container's pid 1 */
 void collect_jobs(pmtr_t *cfg, UT_string *sm) {
-  int es, ex, elapsed;
-  time_t now;
   job_t *job;
   pid_t pid;
+  int es;
 
   while ( (pid = waitpid(-1, &es, WNOHANG)) > 0) {
 
-    /* respawn if it's our dependency monitor, unless its flagged */
-    if (pid==cfg->dm_pid) { 
-      if (WIFEXITED(es) && ((WEXITSTATUS(es)) == PMTR_NO_RESTART)) {
-        syslog(LOG_INFO, "inotify-based dependency monitoring disabled");
-        cfg->dm_pid = 0;
-      } else {
-        cfg->dm_pid = dep_monitor(cfg->file);
-      }
-      continue;
-    }
     /* if it's our logger sub process ... */
     if (pid==cfg->logger_pid) { 
       kill(getpid(), 15); /* induce graceful shutdown in main loop */
       continue;
     }
     /* find the job.  we should always find it by pid. */
-    job = get_job_by_pid(cfg->jobs, pid);
+    job = get_job_by_pid(&cfg->jx, pid);
     if (!job) {
       syslog(LOG_ERR,"sigchld for unknown pid %d",(int)pid); 
       continue;
     }
-    /* decide if and when it should be restarted */
-    job->pid = 0;
-    job->terminate = 0; /* any termination request has succeeded */
-    now = time(NULL);
-    elapsed = now - job->start_ts;
-    job->start_at = (elapsed < SHORT_DELAY) ? (now+SHORT_DELAY) : now;
-    if (job->once) job->respawn=0;
-
-    /* write a log message about how the job exited */
-    utstring_clear(sm);
-    utstring_printf(sm,"job %s [%d] exited after %d sec: ", job->name, 
-      (int)pid, elapsed);
-    if (WIFSIGNALED(es)) utstring_printf(sm, "signal %d", (int)WTERMSIG(es));
-    if (WIFEXITED(es)) {
-      if ( (ex = WEXITSTATUS(es)) == PMTR_NO_RESTART) job->respawn=0;
-      utstring_printf(sm,"exit status %d", ex);
-    }
-    syslog(LOG_INFO,"%s",utstring_body(sm));
-
-    /* is this a former job that was deleted from the config file? */
-    if (job->delete_when_collected) {
-      utarray_erase(cfg->jobs, utarray_eltidx(cfg->jobs,job), 1);
-      job=NULL;
-    }
+    reap_job(cfg, job, es, sm);
   }
 }
 
@@ -770,25 +1451,141 @@ void term_jobs(UT_array *jobs) {
   }
 }
 
-job_t *get_job_by_pid(UT_array *jobs, pid_t pid) {
-  job_t *job = NULL;
-  while ( (job = (job_t*)utarray_next(jobs,job))) {
+/* the job index. a lookup checks the job in each slot it probes against
+ * the key, so the tables need only be exact about which slots are in use.
+ * an index whose array changed length (as jobs get pushed onto it) is
+ * rebuilt at the next lookup. erase_job keeps it exact across an erase. */
+#define job_at(jx,v) ((job_t*)_utarray_eltptr((jx)->jobs, (v)-1))
+
+static unsigned hash_name(const char *name) {
+  unsigned h = 2166136261U;  /* FNV-1a */
+  while (*name) { h ^= (unsigned char)*name++; h *= 16777619U; }
+  return h;
+}
+static unsigned hash_pid(pid_t pid) {
+  return (unsigned)pid * 2654435761U;
+}
+static unsigned home_slot(job_index *jx, unsigned *tab, unsigned v) {
+  job_t *job = job_at(jx, v);
+  unsigned h = (tab == jx->by_pid) ? hash_pid(job->pid) : hash_name(job->name);
+  return h & (jx->size - 1);
+}
+static void slot_add(job_index *jx, unsigned *tab, unsigned v) {
+  unsigned i = home_slot(jx, tab, v);
+  while (tab[i]) i = (i+1) & (jx->size - 1);
+  tab[i] = v;
+}
+/* remove v, shifting back any later entries of its probe run that could
+ * then no longer be reached from their home slot */
+static void slot_del(job_index *jx, unsigned *tab, unsigned v) {
+  unsigned mask = jx->size - 1, i, j, k;
+
+  for(i = home_slot(jx, tab, v); tab[i] != v; i = (i+1) & mask) {
+    if (tab[i] == 0) return; /* not indexed */
+  }
+  for(j = (i+1) & mask; tab[j]; j = (j+1) & mask) {
+    k = home_slot(jx, tab, tab[j]);
+    if ((i <= j) ? ((i < k) && (k <= j)) : ((i < k) || (k <= j))) continue;
+    tab[i] = tab[j];
+    i = j;
+  }
+  tab[i] = 0;
+}
+
+void index_jobs(job_index *jx, UT_array *jobs) {
+  unsigned size = 16, v;
+  job_t *job;
+
+  jx->jobs = jobs;
+  jx->len = utarray_len(jobs);
+  while (size < 2*jx->len) size *= 2;
+  if (size != jx->size) {
+    index_free(jx);
+    jx->by_name = calloc(size, sizeof(unsigned));
+    jx->by_pid = calloc(size, sizeof(unsigned));
+    if ((jx->by_name == NULL) || (jx->by_pid == NULL)) {
+      syslog(LOG_ERR,"out of memory");
+      exit(-1);
+    }
+    jx->size = size;
+  } else {
+    memset(jx->by_name, 0, size * sizeof(unsigned));
+    memset(jx->by_pid, 0, size * sizeof(unsigned));
+  }
+  for(v = 1; v <= jx->len; v++) {
+    job = job_at(jx, v);
+    if (job->name) slot_add(jx, jx->by_name, v);
+    if (job->pid) slot_add(jx, jx->by_pid, v);
+  }
+}
+
+void index_free(job_index *jx) {
+  if (jx->by_name) free(jx->by_name);
+  if (jx->by_pid) free(jx->by_pid);
+  jx->by_name = NULL;
+  jx->by_pid = NULL;
+  jx->size = 0;
+}
+
+/* rebuild the index if it is out of date. returns 1 if it was rebuilt */
+static int index_check(job_index *jx) {
+  if ((jx->size > 0) && (jx->len == utarray_len(jx->jobs))) return 0;
+  index_jobs(jx, jx->jobs);
+  return 1;
+}
+
+/* call when a job gets a pid. unindex_pid must precede clearing it */
+void index_pid(job_index *jx, job_t *job) {
+  if (index_check(jx)) return; /* rebuilt, with this pid */
+  slot_add(jx, jx->by_pid, utarray_eltidx(jx->jobs, job) + 1);
+}
+void unindex_pid(job_index *jx, job_t *job) {
+  index_check(jx);
+  slot_del(jx, jx->by_pid, utarray_eltidx(jx->jobs, job) + 1);
+}
+
+/* erase a job from the indexed array, renumbering the jobs after it */
+void erase_job(job_index *jx, job_t *job) {
+  unsigned v, i;
+
+  index_check(jx);
+  v = utarray_eltidx(jx->jobs, job) + 1;
+  if (job->name) slot_del(jx, jx->by_name, v);
+  if (job->pid) slot_del(jx, jx->by_pid, v);
+  utarray_erase(jx->jobs, v-1, 1);
+  jx->len--;
+  for(i = 0; i < jx->size; i++) {
+    if (jx->by_name[i] > v) jx->by_name[i]--;
+    if (jx->by_pid[i] > v) jx->by_pid[i]--;
+  }
+}
+
+job_t *get_job_by_pid(job_index *jx, pid_t pid) {
+  unsigned i;
+  job_t *job;
+
+  index_check(jx);
+  for(i = hash_pid(pid) & (jx->size-1); jx->by_pid[i]; i = (i+1) & (jx->size-1)) {
+    job = job_at(jx, jx->by_pid[i]);
     if (job->pid == pid) return job;
   }
   return NULL;
 }
 
-job_t *get_job_by_name(UT_array *jobs, char *name) {
-  job_t *job = NULL;
-  while ( (job = (job_t*)utarray_next(jobs,job))) {
-    if (!strcmp(job->name,name)) return job;
+job_t *get_job_by_name(job_index *jx, char *name) {
+  unsigned i;
+  job_t *job;
+
+  index_check(jx);
+  for(i = hash_name(name) & (jx->size-1); jx->by_name[i]; i = (i+1) & (jx->size-1)) {
+    job = job_at(jx, jx->by_name[i]);
+    if (!strcmp(job->name, name)) return job;
   }
   return NULL;
 }
 
-/* this comparison function is used to see if two job _definitions_ (not
- * running instances) are equal. it is used when rescanning the config file */
-int job_cmp(job_t *a, job_t *b) {
+/* compare two job definitions field by field */
+static int cmp_fields(job_t *a, job_t *b) {
   char **ac,**bc;
   int rc, alen, blen;
   if ( (rc=strcmp(a->name,b->name)) != 0) return rc;
@@ -827,7 +1624,15 @@ int job_cmp(job_t *a, job_t *b) {
     bc = (char**)utarray_next(&b->depv,bc);
     if ((*ac && *bc) && ((rc=strcmp(*ac,*bc)) != 0)) return rc;
   }
-  if ( (rc = (a->deps_hash-b->deps_hash))) return rc;
+  if (a->deps_hash != b->deps_hash) return (a->deps_hash < b->deps_hash) ? -1 : 1;
+  /* compare the jobs it starts after */
+  alen = utarray_len(&a->after); blen = utarray_len(&b->after); 
+  if (alen != blen) return alen-blen;
+  ac=NULL; bc=NULL;
+  while ( (ac=(char**)utarray_next(&a->after,ac))) {
+    bc = (char**)utarray_next(&b->after,bc);
+    if ((rc=strcmp(*ac,*bc)) != 0) return rc;
+  }
   /* dir */
   if ((!a->dir && b->dir) || (a->dir && !b->dir) ) return a->dir-b->dir;
   if ((a->dir && b->dir) && (rc = strcmp(a->dir,b->dir))) return rc;
@@ -843,34 +1648,145 @@ int job_cmp(job_t *a, job_t *b) {
 
   if ( (rc = memcmp(a->user, b->user, PMTR_MAX_USER))) return rc;
   if (a->order != b->order) return a->order - b->order;
+  if (a->nice != b->nice) return a->nice - b->nice;
   if (a->disabled != b->disabled) return a->disabled - b->disabled;
   if (a->wait != b->wait) return a->wait - b->wait;
   if (a->once != b->once) return a->once - b->once;
   if (a->bounce_interval != b->bounce_interval) return a->bounce_interval - b->bounce_interval;
+  if (a->backoff_min != b->backoff_min) return a->backoff_min - b->backoff_min;
+  if (a->backoff_max != b->backoff_max) return a->backoff_max - b->backoff_max;
+  if (a->backoff_factor != b->backoff_factor) return (a->backoff_factor < b->backoff_factor) ? -1 : 1;
+  if (a->jitter != b->jitter) return a->jitter - b->jitter;
+  if (a->breaker_count != b->breaker_count) return a->breaker_count - b->breaker_count;
+  if (a->breaker_window != b->breaker_window) return a->breaker_window - b->breaker_window;
   if (CPU_EQUAL(&a->cpuset, &b->cpuset) == 0) return -1;
   return 0;
 }
 
-/* certain events require a periodic timer. these are deferred job 
- * restarts, and periodic status reporting. when we establish the
- * alarm handler, we only need to reset the timer if the next scheduled
- * alarm is non-existent or its later than we need. 
- */
-void alarm_within(pmtr_t *cfg, int sec) {
-  time_t now = time(NULL);
-  int reset = 0;
+/* this comparison function is used to see if two job _definitions_ (not
+ * running instances) are equal. it is used when rescanning the config file.
+ * jobs from the parser have a fingerprint of their definition, so that
+ * comparing those takes one compare; then only what the parse found out
+ * about the job after push_job is left to compare. other jobs are compared
+ * field by field. building with PMTR_CHECK_FP checks the one against the
+ * other */
+int job_cmp(job_t *a, job_t *b) {
+  int rc;
+
+  if (!has_fp(a) || !has_fp(b)) return cmp_fields(a, b);
+  if (a->fp[0] != b->fp[0]) rc = (a->fp[0] < b->fp[0]) ? -1 : 1;
+  else if (a->fp[1] != b->fp[1]) rc = (a->fp[1] < b->fp[1]) ? -1 : 1;
+  else if (a->deps_hash != b->deps_hash) rc = (a->deps_hash < b->deps_hash) ? -1 : 1;
+  else rc = a->disabled - b->disabled;  /* as by a missing dependency */
+#ifdef PMTR_CHECK_FP
+  assert((rc == 0) == (cmp_fields(a, b) == 0));
+#endif
+  return rc;
+}
 
-  if (cfg->next_alarm == 0) reset=1;      /* first time setup */
-  if (cfg->next_alarm <= now) reset=1;    /* alarm woke us up, rescheduling */
-  if (cfg->next_alarm > now+sec) reset=1; /* move alarm earlier */
-  if (!reset) {
-    alarm(cfg->next_alarm - now);         /* already set but play it safe .*/
+/* move a job onto the end of the array, without copying what it owns */
+static void move_job(UT_array *jobs, job_t *job) {
+  utarray_reserve(jobs, 1);
+  memcpy(_utarray_eltptr(jobs, utarray_len(jobs)), job, jobs->icd.sz);
+  jobs->i++;
+}
+
+/* carry the running state of the previous jobs over to the jobs just
+ * parsed into cfg->jobs, matching them by name through the previous index.
+ * an unchanged job is moved over whole. a changed one takes over the
+ * process of its predecessor, which is terminated so it restarts with the
+ * new settings. a removed job that is still running is moved to the end
+ * of the new jobs, to be terminated and deleted once it exits. this is one
+ * pass over each array, with no erasing; the previous array is freed */
+void merge_jobs(pmtr_t *cfg, UT_array *previous, job_index *pjx, job_diff *d) {
+  unsigned i, len = utarray_len(previous);
+  char *seen, *name;  /* per previous job: 1 if matched, 2 if moved too */
+  job_t *job, *old;
+  size_t sz;
+
+  memset(d, 0, sizeof(*d));
+  seen = calloc(len ? len : 1, sizeof(char));
+  if (seen == NULL) {
+    syslog(LOG_ERR,"out of memory");
+    exit(-1);
+  }
+
+  job = NULL;
+  while ( (job = (job_t*)utarray_next(cfg->jobs,job))) {
+    old = get_job_by_name(pjx, job->name);
+    if (old == NULL) { d->added++; continue; } /* startup forthcoming */
+    i = utarray_eltidx(previous, old);
+    seen[i] = 1;
+    if (job_cmp(job,old) == 0) {  /* identical: keep the old one, pid etc */
+      job_fin(job);
+      memcpy(job, old, sizeof(*job));
+      seen[i] = 2;
+      if (job->parked) unpark_job(job); /* a reload gives it another chance */
+      d->unchanged++;
+      continue;
+    }
+    job->pid = old->pid;          /* changed: restart to pick up settings */
+    job->pidfd = old->pidfd;
+    job->start_ts = old->start_ts;
+    job->timer_at = old->timer_at;
+    job->finished = old->finished;
+    if (job->pid) job->terminate = old->terminate ? old->terminate : 1;
+    d->changed++;
+  }
+
+  /* any previous jobs not matched are no longer in the configuration */
+  for(i = 0; i < len; i++) {
+    if (seen[i] == 2) continue;
+    old = (job_t*)_utarray_eltptr(previous, i);
+    if (seen[i] == 1) { job_fin(old); continue; }
+    d->removed++;
+    if (old->pid == 0) { job_fin(old); continue; } /* not running */
+    /* terminate old job, but keep a record of it til it exits */
+    if (old->terminate == 0) old->terminate = 1;
+    old->respawn = 0;
+    old->delete_when_collected = 1;
+    if (old->timer_at) tw_del(&cfg->tw, TIMER_JOB, old->name);
+    old->timer_at = 0; /* a timer would be keyed by its former name */
+    sz = strlen(old->name) + sizeof("(deleted)");
+    name = old->arena ? arena_alloc(old->arena, sz) : malloc(sz);
+    if (name == NULL) {
+      syslog(LOG_ERR,"out of memory");
+      exit(-1);
+    }
+    snprintf(name, sz, "%s(deleted)", old->name);
+    if (old->arena == NULL) free(old->name);
+    old->name = name;
+    move_job(cfg->jobs, old);
+  }
+
+  previous->i = 0;  /* each job was freed or moved above */
+  utarray_free(previous);
+  index_free(pjx);
+  index_jobs(&cfg->jx, cfg->jobs);  /* pids and names changed above */
+  free(seen);
+}
+
+/* arrange for do_job to be called for this job at time 'when'. a job keeps
+ * at most one timer pending: the earliest of its deadlines; a sooner one
+ * replaces it. when it fires, do_job sets up the timer for the next
+ * deadline, if any. */
+void timer_job(pmtr_t *cfg, job_t *job, time_t when) {
+  if (job->timer_at && (job->timer_at <= when)) return; /* already covered */
+  if (job->timer_at) tw_del(&cfg->tw, TIMER_JOB, job->name); /* moved up */
+  job->timer_at = 0;
+  if (tw_add(&cfg->tw, TIMER_JOB, job->name, tw_at(when)) < 0) {
+    syslog(LOG_ERR,"job %s: can't add timer", job->name);
     return;
   }
+  job->timer_at = when;
+}
 
-  if (sec==0) sec=1;                      /* zero-second timer is ignored */
-  cfg->next_alarm = now+sec;
-  alarm(sec);
+/* a job timer expired */
+void job_timer(pmtr_t *cfg, char *name) {
+  job_t *job = get_job_by_name(&cfg->jx, name);
+  if (job == NULL) return;  /* job went away since */
+  job->timer_at = 0;
+  do_job(cfg, job);
 }
 
 /* if the config file needs to be made, create a blank one */
@@ -7,8 +7,10 @@
 #include <stdarg.h>
 #include <time.h>
 #include <signal.h>
+#include <setjmp.h>
 
 #include "pmtr.h"
+#include "arena.h"
 #include "utstring.h"
 #include "utarray.h"
 
@@ -17,10 +19,10 @@
 /* exit status that a job can use to indicate it does not want to be respawned */
 #define PMTR_NO_RESTART 33
 #define PMTR_MAX_USER 100
+#define PMTR_MAX_INSTANCES 4096
 
-/* signals that we'll allow (unblock) during sigsuspend */
-static const int sigs[] = {SIGHUP,SIGCHLD,SIGTERM,SIGINT,SIGQUIT,
-                           SIGALRM,SIGUSR1,SIGIO};
+/* signals that we accept synchronously through the signalfd */
+static const int sigs[] = {SIGHUP,SIGCHLD,SIGTERM,SIGINT,SIGQUIT,SIGUSR1};
 
 #define S(x) #x, x
 static struct rlimit_label { 
@@ -52,21 +54,41 @@ typedef struct {
 
 static const UT_icd rlimit_icd={.sz=sizeof(resource_rlimit_t)};
 
+/* what spawn_job needs to start a job, prepared once from its definition
+ * so that a start does no lookups and no allocation. see spawn.c */
+typedef struct {
+  char **envp;     /* environment to exec with; NULL until prepared */
+  char *exe;       /* the command, with the job dir prefixed if relative */
+  int user;        /* 1 to switch to the ids below; -1 if user is unknown */
+  uid_t uid;
+  gid_t gid;
+  gid_t *groups;   /* supplementary groups */
+  int ngroups;
+} spawn_plan;
+
+/* the strings of a job parsed from the config are in the arena of that
+ * parse, which the job holds a reference to; string arrays then hold
+ * pointers into it (ut_ptr_icd). a job put together otherwise has no
+ * arena, and owns its strings (ut_str_icd) */
 typedef struct {
   char *name;
   UT_array cmdv; // cmd and args
   UT_array envv; // environment variables
   UT_array depv; // monitored dependencies
   UT_array rlim; // resource ulimits
-  int deps_hash;
+  UT_array after; // names of jobs to start this one after
+  uint64_t deps_hash;
+  uint64_t fp[2];  /* fingerprint of the definition, or 0; see job_cmp */
   char *dir;
   char *out;
   char *err;
   char *in;
   pid_t pid;
+  int pidfd;       /* pollable handle on the running process, or -1 */
   time_t start_ts; /* last start time */
   time_t start_at; /* desired next start - used to slow restarts if cycling */
   time_t terminate;/* non-zero if termination requested due to disabling */
+  time_t timer_at; /* when the pending timer for this job fires, or 0 */
   char user[PMTR_MAX_USER];
   int respawn;
   int delete_when_collected;
@@ -75,38 +97,95 @@ typedef struct {
   int disabled;
   int wait;
   int once;
+  int finished;    /* has exited since it was first started */
+  int queued;      /* Q_ flags: the queues in pmtr_t that have this job */
   int bounce_interval;
+  int backoff_min;  /* restart delay after a quick exit, in seconds */
+  int backoff_max;  /* longest delay; a run at least this long resets it */
+  double backoff_factor; /* growth of the delay with each quick exit */
+  int jitter;       /* percent by which to vary the delay */
+  int breaker_count;/* park the job after this many failures ... */
+  int breaker_window;/* ... within this many seconds; 0 count for never */
+  double backoff;   /* delay before the last restart, or 0 */
+  time_t fail_since;/* start of the current breaker window */
+  int fails;        /* failures within it */
+  time_t parked;    /* when the breaker tripped, or 0 */
   cpu_set_t cpuset;
+  int pinned;      /* has a cpu, though it may name none here; for -t */
+  spawn_plan plan; /* derived from the above; not part of the definition */
+  arena_t *arena;  /* has the strings above, or NULL if they are owned */
   /* remember to edit job_cmp in job.c if equality definition needs updating */
 } job_t;
 
+/* queued flags */
+#define Q_STOP    (1 << 0)
+#define Q_READY   (1 << 1)
+#define Q_BLOCKED (1 << 2)
+
+/* what a reload changed; see merge_jobs */
+typedef struct {
+  unsigned added;
+  unsigned removed;
+  unsigned changed;
+  unsigned unchanged;
+} job_diff;
+
 typedef struct {
   int line;
   int rc;
   UT_string *em;
   job_t *job; /* scratch space */
   pmtr_t *cfg; /* the global ptmr config */
+  char *file;  /* being parsed */
+  UT_array *jobs; /* where its jobs go */
+  int include; /* it is an included file, parsed off the main thread */
+  unsigned instances; /* of the job, if it is a template; see expand_job */
+  char *cpu_spec;     /* of each instance, if it has %i in it */
+  int topo;           /* cpus were resolved from the host's topology */
 } parse_t;
 
+#define has_fp(job) ((job)->fp[0] || (job)->fp[1])
+
 extern const UT_icd job_mm;
 
 /* prototypes */
 int parse_jobs(pmtr_t *cfg, UT_string *em);
+int hash_deps(pmtr_t *cfg);
+int deps_changed(pmtr_t *cfg, UT_array *names);
 void do_jobs(pmtr_t *cfg);
+void do_job(pmtr_t *cfg, job_t *job);
+void queue_job(pmtr_t *cfg, job_t *job);
+void queue_jobs(pmtr_t *cfg);
+int run_jobs(pmtr_t *cfg);
+void signal_job(pmtr_t *cfg, job_t *job);
 void term_jobs(UT_array *jobs);
 int term_job(job_t *job);
 void push_job(parse_t *ps);
-job_t *get_job_by_pid(UT_array *jobs, pid_t pid);
-job_t *get_job_by_name(UT_array *jobs, char *name);
+job_t *get_job_by_pid(job_index *jx, pid_t pid);
+job_t *get_job_by_name(job_index *jx, char *name);
+void index_jobs(job_index *jx, UT_array *jobs);
+void index_free(job_index *jx);
+void index_pid(job_index *jx, job_t *job);
+void unindex_pid(job_index *jx, job_t *job);
+void erase_job(job_index *jx, job_t *job);
 int job_cmp(job_t *a, job_t *b);
+void merge_jobs(pmtr_t *cfg, UT_array *previous, job_index *pjx, job_diff *d);
+void job_ini(job_t *job);
 void job_fin(job_t *job);
+void job_arena(job_t *job, arena_t *a);
 void job_cpy(job_t *dst, const job_t *src);
 void collect_jobs(pmtr_t *cfg, UT_string *sm);
+void collect_job(pmtr_t *cfg, pid_t pid, UT_string *sm);
 void set_name(parse_t *ps, char *name);
 void set_ulimit(parse_t *ps, char *rname, char *value_a);
 void set_bounce(parse_t *ps, char *timespec);
+void set_backoff(parse_t *ps, char *min, char *max, char *factor);
+void set_jitter(parse_t *ps, char *pct);
+void set_breaker(parse_t *ps, char *count, char *window);
+void unpark_job(job_t *job);
 char *unquote(char *str);
-void alarm_within(pmtr_t *cfg, int sec);
+void timer_job(pmtr_t *cfg, job_t *job, time_t when);
+void job_timer(pmtr_t *cfg, char *name);
 int get_tok(char *c_orig, char **c, size_t *bsz, size_t *toksz, int *line);
 void set_dir(parse_t *ps, char *s);
 void set_out(parse_t *ps, char *s);
@@ -121,9 +200,15 @@ void set_wait(parse_t *ps);
 void set_once(parse_t *ps);
 void set_cmd(parse_t *ps, char *s);
 void set_cpu(parse_t *ps, char *s);
+void set_cpu_cores(parse_t *ps, char *a, char *b, char *c);
+void set_instances(parse_t *ps, char *s);
+void set_after(parse_t *ps, char *s);
 char *fpath(job_t *job, char *file);
-pid_t dep_monitor(char *file);
 int instantiate_cfg_file(pmtr_t *cfg);
+int map_file(char *file, char **text, size_t *len);
+void unmap_file(char *text, size_t len);
+int parse_text(parse_t *ps, void *parser, char *buf, size_t len);
+extern __thread sigjmp_buf bus_jmp;
 
 
 #endif /* _JOB_H_ */
@@ -16,7 +16,9 @@
 
 #include <string.h>
 #include "utarray.h"
+#include "event.h"
 #include "net.h"
+#include "watch.h"
 
 static int parse_spec(pmtr_t *cfg, UT_string *em, char *spec, 
                       in_addr_t *addr, int *port, char **iface) {
@@ -58,17 +60,26 @@ static int parse_spec(pmtr_t *cfg, UT_string *em, char *spec,
   return rc;
 }
 
+/* a test of the config keeps the addresses, to write into the image */
+static void keep_spec(UT_array **specs, char *spec) {
+  if (*specs == NULL) utarray_new(*specs, &ut_str_icd);
+  utarray_push_back(*specs, &spec);
+}
+
 /* addr is like "udp://127.0.0.1:3333".
  * only one listener can be set up currently.
  * we set up a UDP socket file descriptor bound to the port,
- * during the main loop we get SIGIO on incoming datagram 
+ * the main loop polls it with epoll for incoming datagrams
 */
 void set_listen(parse_t *ps, char *addr) { 
   in_addr_t local_ip;
   int rc = -1, port, flags;
 
   if (parse_spec(ps->cfg, ps->em, addr, &local_ip, &port, NULL)) goto done;
-  if (ps->cfg->test_only) return;  /* syntax looked ok */
+  if (ps->cfg->test_only) {  /* syntax looked ok */
+    keep_spec(&ps->cfg->listen_spec, addr);
+    return;
+  }
 
   int fd = socket(AF_INET, SOCK_DGRAM, 0);
   if (fd == -1) {rc = -2; goto done;}
@@ -92,11 +103,10 @@ void set_listen(parse_t *ps, char *addr) {
     goto done;
   }
 
-  /* enable SIGIO to our pid whenever it becomes readable */
+  /* non-blocking, so the main loop can drain it until EAGAIN */
   int fl = fcntl(fd, F_GETFL);
-  fl |= O_ASYNC | O_NONBLOCK;
+  fl |= O_NONBLOCK;
   fcntl(fd, F_SETFL, fl);
-  fcntl(fd, F_SETOWN, getpid()); 
 
   /* success */
   utarray_push_back(ps->cfg->listen, &fd);
@@ -121,7 +131,10 @@ void set_report(parse_t *ps, char *dest) {
   char *iface;
 
   if (parse_spec(ps->cfg, ps->em, dest, &dest_ip, &port, &iface)) goto done;
-  if (ps->cfg->test_only) return;  /* syntax looked ok */
+  if (ps->cfg->test_only) {  /* syntax looked ok */
+    keep_spec(&ps->cfg->report_spec, dest);
+    return;
+  }
 
   int fd = socket(AF_INET, SOCK_DGRAM, 0);
   if (fd == -1) {rc = -2; goto done;}
@@ -225,7 +238,7 @@ static void decode_msg(pmtr_t *cfg, char *buf, size_t n) {
     else if (!strcmp(pos,"disable")) { mode=disable; pos = sp+1; continue; }
     if (mode == err) { syslog(LOG_ERR, "invalid control msg"); goto done; }
     job = pos;
-    j = get_job_by_name(cfg->jobs, job);
+    j = get_job_by_name(&cfg->jx, job);
     pos = sp+1;
     if (j == NULL) {
       syslog(LOG_INFO,"control msg for unknown job %s", job); /* ignore */
@@ -233,22 +246,24 @@ static void decode_msg(pmtr_t *cfg, char *buf, size_t n) {
     }
     switch(mode) {
       case enable:
-        if (!j->disabled) break; /* no-op */
+        if (!j->disabled && !j->parked) break; /* no-op */
         syslog(LOG_INFO,"enabling %s", job);
         j->disabled=0;
-        alarm_within(cfg,1); /* let SIGALRM handler start it soon */
+        unpark_job(j);
+        queue_job(cfg, j);       /* the main loop starts it after this batch */
         break;
       case disable:
         if (j->disabled) break; /* no-op */
         syslog(LOG_INFO,"disabling %s", job);
         j->disabled=1;
         if (j->pid) { if (j->terminate==0) j->terminate=1; }
-        alarm_within(cfg,1); /* report soon if needed */
+        queue_job(cfg, j);
+        report_within(cfg,1);    /* report soon if needed */
         break;
       default: assert(0); break;
     }
-    /* induce dependency monitor restart */
-    if (cfg->dm_pid != -1) kill(cfg->dm_pid,SIGHUP);
+    /* watch the dependencies of the jobs that are enabled now */
+    watch_sync(cfg);
   }
 
  done:
@@ -261,21 +276,58 @@ static char buf[BUF_SZ+1];
 /* called when we have datagrams to read */
 void service_socket(pmtr_t *cfg) {
   ssize_t rc;
-  int *fd = (int*)utarray_front(cfg->listen); assert(fd);
-  do {
-    rc = read(*fd, buf, BUF_SZ);        /* fd is non-blocking, thus */
-    if (rc > 0) decode_msg(cfg,buf,rc); /* we get rc==-1 after last */
-  } while (rc >= 0);
+  int *fd=NULL;
+  while ( (fd=(int*)utarray_next(cfg->listen,fd))) {
+    do {
+      rc = read(*fd, buf, BUF_SZ);        /* fd is non-blocking, thus */
+      if (rc > 0) decode_msg(cfg,buf,rc); /* we get rc==-1 after last */
+    } while (rc >= 0);
+  }
+}
+
+/* add the UDP listeners to the main loop; they are re-opened on rescan */
+void watch_sockets(pmtr_t *cfg) {
+  int *fd=NULL;
+  while( (fd=(int*)utarray_next(cfg->listen,fd))) {
+    add_epoll(cfg, *fd, EV_LISTEN, *fd);
+  }
 }
 
 void close_sockets(pmtr_t *cfg) {
   int *fd;
-  fd=NULL; while( (fd=(int*)utarray_next(cfg->listen,fd))) close(*fd);
+  fd=NULL; while( (fd=(int*)utarray_next(cfg->listen,fd))) {
+    del_epoll(cfg, *fd);
+    close(*fd);
+  }
   fd=NULL; while( (fd=(int*)utarray_next(cfg->report,fd))) close(*fd);
   utarray_clear(cfg->listen);
   utarray_clear(cfg->report);
 }
 
+/* schedule a status report within sec seconds, unless one is already due
+ * sooner. nothing is scheduled without report destinations, so that an
+ * idle pmtr does not wake up at all */
+void report_within(pmtr_t *cfg, int sec) {
+  time_t when = time(NULL) + sec;
+
+  if (utarray_len(cfg->report) == 0) return;
+  if (cfg->report_at && (cfg->report_at <= when)) return;
+  if (cfg->report_at) tw_del(&cfg->tw, TIMER_REPORT, NULL); /* moved up */
+  cfg->report_at = 0;
+  if (tw_add(&cfg->tw, TIMER_REPORT, NULL, tw_at(when)) < 0) {
+    syslog(LOG_ERR,"can't add report timer");
+    return;
+  }
+  cfg->report_at = when;
+}
+
+/* the report timer expired. send one, and schedule the next */
+void report_timer(pmtr_t *cfg) {
+  cfg->report_at = 0;
+  report_status(cfg);
+  report_within(cfg, SHORT_DELAY);
+}
+
 /* report to all configured destinations */
 void report_status(pmtr_t *cfg) {
   int rc;
@@ -283,11 +335,13 @@ void report_status(pmtr_t *cfg) {
 
   /* construct msg */
   utstring_clear(cfg->s);
-  utstring_printf(cfg->s, "report %s\n", cfg->report_id);
+  utstring_printf(cfg->s, "report %s config %016llx\n", cfg->report_id,
+                  (unsigned long long)cfg->version);
   job_t *j = NULL;
   while ( (j=(job_t*)utarray_next(cfg->jobs,j))) {
     if (j->respawn == 0) continue; /* don't advertise one-time jobs */
-    utstring_printf(cfg->s, "%s %c %u %d %s\n", j->name, j->disabled?'d':'e',
+    utstring_printf(cfg->s, "%s %c %u %d %s\n", j->name,
+                    j->disabled ? 'd' : (j->parked ? 'p' : 'e'),
                     (unsigned)(now - j->start_ts), (int)j->pid,
                     *((char**)utarray_front(&j->cmdv)));
   }
@@ -8,6 +8,9 @@ void set_listen(parse_t *ps, char *spec);
 void set_report(parse_t *ps, char *spec);
 void close_sockets(pmtr_t *cfg);
 void service_socket(pmtr_t *cfg);
+void watch_sockets(pmtr_t *cfg);
 void report_status(pmtr_t *cfg);
+void report_within(pmtr_t *cfg, int sec);
+void report_timer(pmtr_t *cfg);
 
 #endif /* _NET_H_ */
@@ -1,10 +1,18 @@
 #include "pmtr.h"
 #include "job.h"
 #include "net.h"
+#include "event.h"
+#include "watch.h"
+#include "frag.h"
+#include "topo.h"
 
 
 pmtr_t cfg = {
   .logger_fd = -1,
+  .signal_fd = -1,
+  .epoll_fd = -1,
+  .timer_fd = -1,
+  .wt = {.fd = -1},
 };
 
 void usage(char *prog) {
@@ -15,89 +23,25 @@ void usage(char *prog) {
   fprintf(stderr, "   -p <file>    (make pidfile)\n");
   fprintf(stderr, "   -F           (stay in foreground)\n");
   fprintf(stderr, "   -t           (just test config file)\n");
+  fprintf(stderr, "   -C <file>    (compiled config: written by -t, else loaded)\n");
   fprintf(stderr, "\n");
   fprintf(stderr, " Default config: %s\n", DEFAULT_PMTR_CONFIG);
   fprintf(stderr, "\n");
   exit(-1);
 }
 
-sigjmp_buf jmp;
-void sighandler(int signo) {
-  siglongjmp(jmp,signo);
-}
-
-/* fork a process that signals us if the config or deps change */
-pid_t dep_monitor(char *file) {
-  int rc, fd, wd, sc;
-  pid_t pid;
-
-  pid = fork();
-
-  if (pid == (pid_t)-1) {
-    syslog(LOG_ERR, "fork: %s\n", strerror(errno));
-    return (pid_t)-1;
-  }
-
-  if (pid > 0) return pid;
-
-  /* child here */
-  prctl(PR_SET_NAME, "pmtr-dep");
-  close_sockets(&cfg);
-
-  /* This sub-process monitors pmtr.conf for changes, and also any
-   * files explicitly named by the "depends" keyword. It is based on
-   * inotify in Linux. In some situations, inotify is not available,
-   * e.g., in a Linux container on a Mac host that mounts a host folder.
-   * Log if inotify initialization fails but treat this as non-fatal. */
-  fd = inotify_init();
-  if (fd == -1) {
-    syslog(LOG_ERR, "inotify_init: %s", strerror(errno)); 
-    job_t *job=NULL;
-    while ( (job=(job_t*)utarray_next(cfg.jobs,job))) {
-      if (job->disabled) continue;
-      if (utarray_len(&job->depv) > 0) {
-        syslog(LOG_ERR, "job %s: dependency watching disabled", job->name);
-      }
-    }
-    exit(PMTR_NO_RESTART); /* don't restart the dep_monitor process */
-  }
-
-  wd = inotify_add_watch(fd, file, IN_CLOSE_WRITE);
-  if (wd == -1) {
-    syslog(LOG_ERR, "can't watch %s: %s", file, strerror(errno)); 
-    sleep(SHORT_DELAY);  /* pmtr.conf unlinked pending rewrite? */
-    exit(-1);            /* parent will restart us to try again */
-  }
-
-  /* loop over jobs' dependencies, adding watch on each one. if one
-   * is missing, we log the error but not fatally, because parent
-   * detects this situation and disables the job */
-  job_t *job=NULL;
-  while ( (job=(job_t*)utarray_next(cfg.jobs,job))) {
-    if (job->disabled) continue;
-    char **dep=NULL;
-    while ( (dep=(char**)utarray_next(&job->depv,dep))) {
-      char *path = fpath(job,*dep);
-      if (path == NULL) {
-        syslog(LOG_ERR,"can't watch %s: path too long", *dep);
-        continue;
-      }
-      sc = inotify_add_watch(fd, path, IN_CLOSE_WRITE);
-      if (sc == -1) syslog(LOG_ERR,"can't watch %s: %s", *dep, strerror(errno));
-    }
-  }
-
-  /* request HUP if parent exits, unblock, action terminate */
-  signal(SIGHUP, SIG_DFL);
-  prctl(PR_SET_PDEATHSIG, SIGHUP);
-  sigset_t hup; sigemptyset(&hup); sigaddset(&hup,SIGHUP);
-  sigprocmask(SIG_UNBLOCK,&hup,NULL);
-
-  /* block for any inotify event. when one happens, notify parent */
-  rc = read(fd, &cfg.eb, sizeof(cfg.eb));
-  nanosleep(&halfsec,NULL);
-  kill(getppid(), SIGHUP);
-  exit(0);
+/* a forked helper closes the main loop descriptors. the epoll set is
+ * shared with the parent, so it must be closed before close_sockets,
+ * otherwise removing the listeners would unregister them in the parent */
+static void close_loop(void) {
+  if (cfg.epoll_fd != -1) close(cfg.epoll_fd);
+  if (cfg.signal_fd != -1) close(cfg.signal_fd);
+  if (cfg.timer_fd != -1) close(cfg.timer_fd);
+  if (cfg.wt.fd != -1) close(cfg.wt.fd);
+  cfg.epoll_fd = -1;
+  cfg.signal_fd = -1;
+  cfg.timer_fd = -1;
+  cfg.wt.fd = -1;
 }
 
 /* set up the logger socket here, in the parent, so parent can
@@ -232,6 +176,7 @@ pid_t start_logger(void) {
 
   /* child here */
   prctl(PR_SET_NAME, "pmtr-log");
+  close_loop();
   close_sockets(&cfg);
 
   /* request HUP if parent exits, unblock, action terminate */
@@ -319,13 +264,14 @@ pid_t start_logger(void) {
 }
 
 void rescan_config(void) {
-  job_t *job, *old;
-  int c;
+  job_diff d;
 
   syslog(LOG_INFO,"rescanning job configuration");
   UT_string *em; utstring_new(em);
   UT_array *previous_jobs = cfg.jobs;
+  job_index previous_jx = cfg.jx;
   UT_array *new_jobs; utarray_new(new_jobs, &job_mm); cfg.jobs = new_jobs;
+  memset(&cfg.jx, 0, sizeof(cfg.jx));
 
   /* udp sockets get re-opened during config parsing */
   close_sockets(&cfg); 
@@ -334,41 +280,20 @@ void rescan_config(void) {
     syslog(LOG_CRIT,"FAILED to parse %s", cfg.file);
     syslog(LOG_CRIT,"ERROR: %s", utstring_body(em));
     syslog(LOG_CRIT,"NOTE: using PREVIOUS job config");
+    index_free(&cfg.jx);
     cfg.jobs = previous_jobs;
+    cfg.jx = previous_jx;
     goto done;
   }
 
-  /* parse succeeded. diff the new jobs vs. existing jobs */
-  job=NULL;
-  while( (job = (job_t*)utarray_next(new_jobs,job))) {
-    old = get_job_by_name(previous_jobs, job->name);
-    if (!old) continue;          // new job definition; startup forthcoming.
-    c = job_cmp(job,old);        
-    if (c == 0) {                // new job with same name and identical to old:
-      job_fin(job);              // free up new job,
-      job_cpy(job,old);          // and copy old job into new to retain pid etc.
-    } else {                     // new job with same name, but new config:
-      job->start_ts = old->start_ts;
-      job->pid = old->pid;
-      if (job->pid) job->terminate=1;// induce reset to pick up new settings.
-    }
-    utarray_erase(previous_jobs, utarray_eltidx(previous_jobs,old), 1);
-  }
-  /* any jobs left in previous_jobs are no longer in the new configuration */
-  old=NULL;
-  while ( (old=(job_t*)utarray_next(previous_jobs,old))) {
-    if (old->pid == 0) continue; /* not running. free it below. */
-    /* terminate old job, but keep a record of it til it exits */
-    old->terminate=1;
-    old->respawn=0;
-    old->delete_when_collected=1;
-    utstring_clear(em); utstring_printf(em, "%s(deleted)", old->name);
-    free(old->name); old->name = strdup(utstring_body(em));
-    utarray_push_back(cfg.jobs, old); 
-  }
-  utarray_free(previous_jobs);
+  /* parse succeeded. carry the state of the existing jobs over */
+  merge_jobs(&cfg, previous_jobs, &previous_jx, &d);
+  syslog(LOG_INFO,"jobs: %u added, %u changed, %u removed, %u unchanged",
+    d.added, d.changed, d.removed, d.unchanged);
+  queue_jobs(&cfg);              /* the queues named jobs of the old array */
 
  done:
+  watch_sync(&cfg);
   utstring_free(em);
 }
 
@@ -404,21 +329,136 @@ int make_pidfile() {
   return rc;
 }
 
+/* read every queued signal from the signalfd. returns PENDING_ flags */
+#define PENDING_RESCAN  (1 << 0)
+#define PENDING_COLLECT (1 << 1)
+#define PENDING_TIMER   (1 << 2)
+#define PENDING_EXIT    (1 << 3)
+static int drain_signals(int *exit_signo) {
+  struct signalfd_siginfo info[8];
+  int pending = 0, i, n;
+  ssize_t nr;
+
+  while ( (nr = read(cfg.signal_fd, info, sizeof(info))) > 0) {
+    n = nr / sizeof(*info);
+    for(i=0; i < n; i++) {
+      switch(info[i].ssi_signo) {
+        case SIGHUP:  pending |= PENDING_RESCAN;  break;
+        case SIGCHLD: pending |= PENDING_COLLECT; break;
+        default:
+          pending |= PENDING_EXIT;
+          *exit_signo = info[i].ssi_signo;
+          break;
+      }
+    }
+  }
+  if ((nr < 0) && (errno != EAGAIN)) {
+    syslog(LOG_ERR,"read signalfd: %s", strerror(errno));
+  }
+  return pending;
+}
+
+/* arm the timerfd for the earliest deadline in the timer wheel, or
+ * disarm it when there is none. the timerfd uses absolute expirations */
+static void arm_timer(void) {
+  struct itimerspec its;
+  uint64_t next;
+
+  next = tw_next(&cfg.tw);
+  if (next == cfg.timer_armed) return;
+
+  memset(&its, 0, sizeof(its));
+  its.it_value.tv_sec = next / 1000;
+  its.it_value.tv_nsec = (next % 1000) * 1000000;
+  if (timerfd_settime(cfg.timer_fd, TFD_TIMER_ABSTIME, &its, NULL) < 0) {
+    syslog(LOG_ERR,"timerfd_settime: %s", strerror(errno));
+    return;
+  }
+  cfg.timer_armed = next;
+}
+
+/* watched files changed. pmtr.conf, or a file it includes or a directory
+ * it includes files from, needs a rescan, which covers the rest; otherwise
+ * just the jobs that depend on the files are taken care of */
+static int files_changed(UT_array *paths) {
+  UT_array *names, *jobs;
+  char **path = NULL;
+  int rescan = 0;
+
+  utarray_new(names, &ut_str_icd);
+  while ( (path = (char**)utarray_next(paths, path))) {
+    syslog(LOG_INFO,"%s changed", *path);
+    if (is_config(&cfg, *path)) rescan = 1;
+    jobs = watch_jobs(&cfg, *path);
+    if (jobs) utarray_concat(names, jobs);
+  }
+  if ((rescan == 0) && deps_changed(&cfg, names)) {
+    watch_sync(&cfg);              /* stop watching for disabled jobs */
+    report_within(&cfg,SHORT_DELAY);
+  }
+  utarray_free(names);
+  return rescan ? PENDING_RESCAN : 0;
+}
+
+/* dispatch every timer that is due. returns PENDING_ flags */
+static int run_timers(void) {
+  tw_entry *e, *next;
+  uint64_t expirations;
+  int pending = 0;
+  UT_array *paths;
+
+  /* reset the timerfd readability */
+  if (read(cfg.timer_fd, &expirations, sizeof(expirations)) < 0) {
+    if (errno != EAGAIN) syslog(LOG_ERR,"read timerfd: %s", strerror(errno));
+  }
+  cfg.timer_armed = 0;
+
+  for(e = tw_expire(&cfg.tw, tw_clock()); e; e = next) {
+    next = e->next;
+    switch(e->kind) {
+      case TIMER_JOB:    job_timer(&cfg, e->name); break;
+      case TIMER_REPORT: report_timer(&cfg);       break;
+      case TIMER_WATCH:
+        utarray_new(paths, &ut_ptr_icd);
+        if (watch_timer(&cfg, paths) > 0) pending |= files_changed(paths);
+        utarray_free(paths);
+        break;
+      default: assert(0); break;
+    }
+    tw_free(e);
+  }
+  return pending;
+}
+
+/* -t shows the cpus each pinned job resolved to, as the cpu selectors and
+ * "spread" depend on the host it is run on. a job whose cpu names none
+ * here shows "-"; it runs unpinned */
+static void show_cpus(void) {
+  char list[8192];
+  job_t *job = NULL;
+
+  while ( (job = (job_t*)utarray_next(cfg.jobs, job))) {
+    if (!job->pinned) continue;
+    printf("%s: cpu %s\n", job->name,
+           topo_list(&job->cpuset, list, sizeof(list)));
+  }
+}
+
 int main (int argc, char *argv[]) {
-  int n, opt, log_opt;
-  job_t *job;
+  int n, opt, log_opt, nev, pending, signo = 0;
 
   UT_string *em, *sm;
   utstring_new(em);
   utstring_new(sm);
 
-  while ( (opt = getopt(argc, argv, "v+p:Fc:s:tIh")) != -1) {
+  while ( (opt = getopt(argc, argv, "v+p:Fc:C:s:tIh")) != -1) {
     switch (opt) {
       case 'v': cfg.verbose++; break;
       case 'p': cfg.pidfile=strdup(optarg); break;
       case 'F': cfg.foreground=1; break;
       case 'I': cfg.echo_syslog_to_stderr=1; break;
       case 'c': cfg.file=strdup(optarg); break;
+      case 'C': cfg.image=strdup(optarg); break;
       case 't': cfg.test_only=1; cfg.foreground=1; break;
       case 'h': default: usage(argv[0]); break;
     }
@@ -443,12 +483,15 @@ int main (int argc, char *argv[]) {
     close(STDERR_FILENO);
   }
 
-  /* block all signals. we remain fully blocked except in sigsuspend */
+  /* block all signals. we take the ones we handle via signalfd */
   sigset_t all;
   sigfillset(&all);
   sigprocmask(SIG_SETMASK,&all,NULL);
 
   utarray_new(cfg.jobs, &job_mm);
+  utarray_new(cfg.stopping, &ut_str_icd);
+  utarray_new(cfg.ready, &ut_str_icd);
+  utarray_new(cfg.blocked, &ut_str_icd);
   utarray_new(cfg.listen, &ut_int_icd);
   utarray_new(cfg.report, &ut_int_icd);
   utstring_new(cfg.s);
@@ -456,73 +499,102 @@ int main (int argc, char *argv[]) {
   if (make_pidfile()) goto final;
   umask(0);
 
-  /* parse config file. we blocked signals above because we can get SIGIO 
-   * during parsing if we open UDP listeners and get any datagrams */
+  /* parse config file */
   if (instantiate_cfg_file(&cfg) == -1) goto final;
   if (parse_jobs(&cfg, em) == -1) {
     syslog(LOG_ERR,"parse failed: %s", utstring_body(em));
     goto final;
   }
 
-  if (cfg.test_only) goto final;
+  if (cfg.test_only) {
+    show_cpus();
+    goto final;
+  }
   syslog(LOG_INFO,"pmtr: starting");
 
-  /* define a smaller set of signals to block within sigsuspend. */
-  sigset_t ss;
-  sigfillset(&ss);
-  for(n=0; n < sizeof(sigs)/sizeof(*sigs); n++) sigdelset(&ss, sigs[n]);
-
-  /* establish handlers for signals that we'll unblock in sigsuspend */
-  struct sigaction sa;
-  sa.sa_handler = sighandler;
-  sa.sa_flags = 0;
-  sigfillset(&sa.sa_mask);
-  for(n=0; n < sizeof(sigs)/sizeof(*sigs); n++) sigaction(sigs[n], &sa, NULL);
-
-  /* here is a special line. we'll come back here whenever a signal happens */
-  int signo = sigsetjmp(jmp,1);
-
-  switch(signo) {
-    case 0:   /* not a signal yet, first time setup */
-      if (setup_logger() < 0) goto final;
-      cfg.logger_pid = start_logger();
-      if (cfg.logger_pid == (pid_t)-1) goto final;
-      do_jobs(&cfg);
-      cfg.dm_pid = dep_monitor(cfg.file);
-      if (cfg.dm_pid == (pid_t)-1) goto final;
-      report_status(&cfg);
-      alarm_within(&cfg,SHORT_DELAY);
-      break;
-    case SIGHUP:
-      rescan_config();
-      do_jobs(&cfg);
-      break;
-    case SIGCHLD:
-      collect_jobs(&cfg,sm);
-      do_jobs(&cfg);
-      break;
-    case SIGALRM:
-      do_jobs(&cfg);
-      report_status(&cfg);
-      alarm_within(&cfg,SHORT_DELAY);
-      break;
-    case SIGIO:  /* our UDP listener (if enabled) got a datagram */
-      service_socket(&cfg);
-      do_jobs(&cfg);
-      break;
-    default:
-      syslog(LOG_INFO,"pmtr: exiting on signal %d", signo);
-      goto done;
-      break;
+  /* set up the signalfd and the epoll set that the main loop waits on */
+  sigset_t sw;
+  sigemptyset(&sw);
+  for(n=0; n < adim(sigs); n++) sigaddset(&sw, sigs[n]);
+  cfg.signal_fd = signalfd(-1, &sw, SFD_NONBLOCK|SFD_CLOEXEC);
+  if (cfg.signal_fd == -1) {
+    syslog(LOG_ERR,"signalfd: %s", strerror(errno));
+    goto final;
   }
+  cfg.epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+  if (cfg.epoll_fd == -1) {
+    syslog(LOG_ERR,"epoll: %s", strerror(errno));
+    goto final;
+  }
+  cfg.timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK|TFD_CLOEXEC);
+  if (cfg.timer_fd == -1) {
+    syslog(LOG_ERR,"timerfd: %s", strerror(errno));
+    goto final;
+  }
+  if (add_epoll(&cfg, cfg.signal_fd, EV_SIGNAL, 0) < 0) goto final;
+  if (add_epoll(&cfg, cfg.timer_fd, EV_TIMER, 0) < 0) goto final;
+  watch_sockets(&cfg);
+
+  /* first time setup */
+  if (setup_logger() < 0) goto final;
+  cfg.logger_pid = start_logger();
+  if (cfg.logger_pid == (pid_t)-1) goto final;
+  queue_jobs(&cfg);
+  run_jobs(&cfg);
+  if (watch_init(&cfg) < 0) goto final;
+  watch_sync(&cfg);
+  report_status(&cfg);
+  report_within(&cfg,SHORT_DELAY);
+
+  /* main loop. each wakeup drains every ready source, then visits the
+   * jobs that those events queued. timers visit their due jobs directly */
+  struct epoll_event evs[32];
+  while (1) {
+    arm_timer();
+    nev = epoll_wait(cfg.epoll_fd, evs, adim(evs), -1);
+    if (nev < 0) {
+      if (errno == EINTR) continue;
+      syslog(LOG_ERR,"epoll_wait: %s", strerror(errno));
+      goto done;
+    }
 
-  /* wait for signals */
-  sigsuspend(&ss);
+    pending = 0;
+    for(n=0; n < nev; n++) {
+      switch(EV_KIND(evs[n].data.u64)) {
+        case EV_SIGNAL:
+          pending |= drain_signals(&signo);
+          break;
+        case EV_LISTEN:  /* our UDP listener (if enabled) got a datagram */
+          service_socket(&cfg);
+          break;
+        case EV_PIDFD:   /* a job exited */
+          collect_job(&cfg, (pid_t)EV_VAL(evs[n].data.u64), sm);
+          break;
+        case EV_TIMER:
+          pending |= PENDING_TIMER;
+          break;
+        case EV_INOTIFY: /* pmtr.conf or a dependency changed */
+          watch_read(&cfg);
+          break;
+        default:
+          assert(0);
+          break;
+      }
+    }
 
-  /* the only way to get past this point 
-   * is from the "goto done" above, because 
-   * sigsuspend waits for signals, and when
-   * one arrives we longjmp back to sigsetjmp! */
+    if (pending & PENDING_EXIT) {
+      syslog(LOG_INFO,"pmtr: exiting on signal %d", signo);
+      goto done;
+    }
+    if (pending & PENDING_TIMER) pending |= run_timers();
+    if (pending & PENDING_RESCAN) {
+      rescan_config();
+      watch_sockets(&cfg);
+      report_within(&cfg,SHORT_DELAY);
+    }
+    if (pending & PENDING_COLLECT) collect_jobs(&cfg,sm);
+    run_jobs(&cfg);
+  }
 
  done:
   term_jobs(cfg.jobs);      /* just sets termination flag, so */
@@ -532,8 +604,19 @@ int main (int argc, char *argv[]) {
 
  final:
   close_sockets(&cfg);
+  if (cfg.epoll_fd != -1) close(cfg.epoll_fd);
+  if (cfg.signal_fd != -1) close(cfg.signal_fd);
+  if (cfg.timer_fd != -1) close(cfg.timer_fd);
+  watch_fin(&cfg);
+  tw_clear(&cfg.tw);
+  dep_clear(&cfg.dc);
+  includes_free(&cfg);
   free(cfg.file);
   utarray_free(cfg.jobs);
+  index_free(&cfg.jx);
+  utarray_free(cfg.stopping);
+  utarray_free(cfg.ready);
+  utarray_free(cfg.blocked);
   utarray_free(cfg.listen);
   utarray_free(cfg.report);
   utstring_free(cfg.s);
@@ -3,6 +3,8 @@
 
 #define _GNU_SOURCE /* To get struct ucred definition from <sys/sockets.h> */
 
+#include <sys/signalfd.h>
+#include <sys/timerfd.h>
 #include <sys/inotify.h>
 #include <sys/socket.h>
 #include <sys/prctl.h>
@@ -14,7 +16,6 @@
 #include <string.h>
 #include <syslog.h>
 #include <signal.h>
-#include <setjmp.h>
 #include <unistd.h>
 #include <stdlib.h>
 #include <assert.h>
@@ -25,6 +26,8 @@
 #include <time.h>
 #include "utstring.h"
 #include "utarray.h"
+#include "timer.h"
+#include "deps.h"
 
 /* pmtr.conf is expected in /etc by default. This expectation can be overridden
  * at build time using ./configure --sysconfdir=/dir. The end user can also tell
@@ -37,24 +40,116 @@
 
 static struct timespec halfsec = {.tv_sec =  0, .tv_nsec = 500000000};
 
+/* open-addressing (linear probing) hash indexes over a job array, by name
+ * and by pid. a slot holds the element index plus one, zero being empty;
+ * not a pointer, since job_t elements move as the array grows, is sorted
+ * or is erased from. */
+typedef struct {
+  UT_array *jobs;      /* the array that is indexed */
+  unsigned len;        /* number of jobs it had when indexed */
+  unsigned size;       /* slots in each table, a power of two */
+  unsigned *by_name;
+  unsigned *by_pid;    /* only jobs with a running process */
+} job_index;
+
+/* a watched path: pmtr.conf, or a dependency of an enabled job */
+typedef struct {
+  char *path;          /* NULL for an empty slot */
+  int wd;              /* inotify watch of its directory, or -1 */
+  unsigned gen;        /* the last sync that wanted it */
+  UT_array jobs;       /* names of the enabled jobs that depend on it */
+  struct {             /* without inotify, what polling last saw */
+    uint64_t dev, ino, size, mtime_ns, ctime_ns;
+    int err;           /* errno if it could not be looked at, or 0 */
+    unsigned every_ms; /* how often it is looked at now */
+    uint64_t next_ms;  /* when it is to be looked at next */
+  } poll;
+} watch_t;
+
+/* a watched directory, as the start of the watched paths in it. one
+ * directory can be reached by more than one prefix ("a/" and "a//") */
+typedef struct {
+  int wd;              /* 0 for an empty slot */
+  char *prefix;        /* the path up to and including the last slash */
+} watch_dir;
+
+/* the inotify descriptor lives in the main epoll set. the watched paths
+ * are kept in an open-addressing hash table by path, and are added and
+ * removed as the jobs change. it is their directories that are watched,
+ * once each, so that files renamed into place are seen; the events are
+ * matched up to the paths by a second table, of the directories by wd.
+ * events are collected until they stop for a while; then the paths they
+ * were for are handed back. see watch.c */
+typedef struct {
+  int fd;              /* inotify descriptor, or -1 */
+  int poll;            /* inotify is unavailable: poll the paths instead */
+  watch_t *tab;
+  unsigned size;       /* slots, a power of two; or 0 */
+  unsigned n;          /* slots in use */
+  unsigned gen;        /* the current sync */
+  watch_dir *dirs;
+  unsigned dsize;      /* slots in dirs, a power of two; or 0 */
+  UT_array *changed;   /* paths with events pending, sorted */
+  UT_array *gone;      /* directory watches the kernel removed */
+  int all;             /* events were lost: every path may have changed */
+  uint64_t first_ms;   /* when the pending events began */
+  uint64_t flush_ms;   /* when they are due to be handed back */
+  unsigned delay_ms;   /* the quiet period to wait for now */
+  int armed;           /* a TIMER_WATCH is in the timer wheel */
+  uint64_t armed_ms;   /* when it expires */
+  int retry;           /* pmtr.conf could not be watched */
+} watcher;
+
+/* a file brought in by "include", as last parsed */
+typedef struct {
+  char *path;
+  uint64_t hash;       /* of its text */
+  size_t size;
+  UT_array *jobs;      /* the jobs parsed from it (job_mm), not yet ordered */
+  uint64_t topo;       /* topo_hash of the host, if it resolved cpus from
+                          the topology; it is parsed again if that changes */
+} frag_t;
+
+/* the files included by pmtr.conf. they are kept from one parse to the
+ * next, so that a rescan parses again only those whose text changed.
+ * see frag.c */
+typedef struct {
+  UT_array *specs;     /* the "include" patterns of the latest parse */
+  UT_array *frags;     /* frag_t, sorted by path */
+  UT_array *watch;     /* where files may come and go: "dir/" for the files
+                          in a directory, or a path that may appear */
+} include_set;
+
 typedef struct {
   char *file;
+  char *image;         /* compiled config (-C), or NULL; see image.c */
   char *pidfile;
   int verbose;
   int foreground;
   int test_only;
   int echo_syslog_to_stderr;
-  pid_t dm_pid;        /* pid of dependency monitor sub process */
+  int signal_fd;       /* signals are taken synchronously via signalfd */
+  int epoll_fd;        /* main loop waits on all event sources here */
   UT_array *jobs;
-  time_t next_alarm;
+  uint64_t version;    /* identifies the job config; see parse_jobs */
+  job_index jx;        /* lookup of jobs by name and pid */
+  UT_array *stopping;  /* names of jobs to be signalled */
+  UT_array *ready;     /* names of jobs to be started, if they may be */
+  UT_array *blocked;   /* names of jobs waiting on others to be ready */
+  dep_cache dc;        /* hashes of dependency files */
+  watcher wt;          /* changes to pmtr.conf and dependency files */
+  timer_wheel tw;      /* deadlines of jobs, and the status report */
+  int timer_fd;        /* timerfd armed for the earliest deadline */
+  uint64_t timer_armed;/* expiration the timerfd is armed for, or 0 */
+  time_t report_at;    /* when the next status report is due, or 0 */
   UT_array *listen;    /* UDP listening descriptors */
   UT_array *report;    /* UDP sending descriptors */
+  UT_array *listen_spec; /* their addresses, kept by -t for the image */
+  UT_array *report_spec;
+  include_set inc;     /* files included by pmtr.conf */
+  const char *sysfs;   /* cpu topology is read here; NULL for TOPO_SYSFS */
   char report_id[100]; /* our identity in report */
   UT_string *s;        /* scratch space */
-  union {              /* buffer for inotify event reads */
-    struct inotify_event ev;
-    char buf[sizeof(struct inotify_event) + PATH_MAX];
-  } eb;
   pid_t logger_pid;       /* pid of logger sub process */
   int logger_fd;          /* listening socket descriptor */
   char logger_socket[10]; /* listening socket name (abstract, not C string!) */
@@ -0,0 +1,332 @@
+#define _GNU_SOURCE /* for clone and CPU_SET macros */
+#include <sched.h>
+#include <stdio.h>
+#include <string.h>
+#include <syslog.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <sys/types.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <signal.h>
+#include <errno.h>
+#include <assert.h>
+#include <fcntl.h>
+#include <grp.h>
+#include <pwd.h>
+
+#include "utarray.h"
+#include "pmtr.h"
+#include "job.h"
+#include "spawn.h"
+
+/* a job is started by cloning a child that borrows our memory and runs on
+ * a stack of its own; CLONE_VFORK suspends us until it execs or exits, as
+ * posix_spawn does. this avoids copying our page tables at each start, a
+ * cost that grows with our own size. since the memory is ours, the child
+ * must not allocate, write globals, or use stdio or syslog. so everything
+ * it needs is in the job's plan, prepared when the job is parsed, and it
+ * leaves the step that failed in the report for us to log. */
+#define SPAWN_STACK (64*1024)
+
+static struct {
+  int rc;          /* the step of child setup that failed, or 0 */
+  int err;         /* errno from that step */
+} *report;         /* in shared memory, so a copied child can also write it */
+static char *stack;
+
+typedef struct {
+  pmtr_t *cfg;
+  job_t *job;
+  char *in;        /* where to point stdin, stdout and stderr */
+  char *out;
+  char *err;
+  char **argv;     /* command and arguments */
+} spawn_t;
+
+/* open descriptor to the logger socket on given fd */
+static int logger_on(pmtr_t *cfg, int dst_fd) {
+  struct sockaddr_un addr;
+  int sc, fd, rc = -1;
+
+  fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd == -1) goto done;
+
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  assert(cfg->logger_namelen > 0);
+  memcpy(addr.sun_path, cfg->logger_socket, cfg->logger_namelen);
+
+  socklen_t len = sizeof(sa_family_t) + cfg->logger_namelen;
+  sc = connect(fd, (struct sockaddr*)&addr, len);
+  if (sc == -1) goto done;
+
+  if (fd != dst_fd) {
+		sc = dup2(fd, dst_fd);
+		if (sc < 0) goto done;
+		sc = close(fd);
+		if (sc < 0) goto done;
+  }
+
+  rc = 0;
+
+ done:
+  return rc;
+}
+
+/* open filename and dup so fileno becomes attached to it */ 
+static int redirect(pmtr_t *cfg, int fileno, char *filename, int flags, int mode) {
+  int rc = -1, fd, sc;
+
+  if (filename == NULL) { /* nothing to do */
+    rc = 0;
+    goto done;
+  }
+
+  /* handle reserved word - syslog */
+  if (!strcmp(filename, "syslog")) {
+    rc = logger_on(cfg, fileno);
+    goto done;
+  }
+
+  /* regular file */
+  fd = open(filename, flags, mode);
+  if (fd < 0) goto done;
+
+  if (fd != fileno) {
+    sc = dup2(fd, fileno);
+    if (sc < 0) goto done;
+    close(fd);
+  }
+
+  rc = 0;
+
+ done:
+  return rc;
+}
+
+/* compare the names of two VAR=VALUE strings */
+static int same_var(const char *a, const char *b) {
+  while (*a && (*a == *b) && (*a != '=')) { a++; b++; }
+  return (*a == '=') && (*b == '=');
+}
+
+/* the environment for a job: ours, with the job's variables set over it */
+static char **make_envp(job_t *job) {
+  extern char **environ;
+  char **env, **envp, **e, **f;
+  size_t n = 0;
+
+  for(e = environ; *e; e++) n++;
+  envp = malloc((n + utarray_len(&job->envv) + 1) * sizeof(char*));
+  if (envp == NULL) return NULL;
+
+  n = 0;
+  for(e = environ; *e; e++) {
+    env = NULL;
+    while ( (env=(char**)utarray_next(&job->envv,env))) {
+      if (same_var(*e, *env)) break;
+    }
+    if (env == NULL) envp[n++] = *e;
+  }
+  env = NULL;
+  while ( (env=(char**)utarray_next(&job->envv,env))) {
+    if (strchr(*env, '=') == NULL) continue;
+    f = env; /* a later setting of the same variable wins */
+    while ( (f=(char**)utarray_next(&job->envv,f))) {
+      if (same_var(*env, *f)) break;
+    }
+    if (f == NULL) envp[n++] = *env;
+  }
+  envp[n] = NULL;
+  return envp;
+}
+
+/* look up the user to run as, and its supplementary groups */
+static int get_user(spawn_plan *plan, const char *user) {
+  struct passwd *p;
+  gid_t *g;
+  int ng = 32;
+
+  if ( (p = getpwnam(user)) == NULL) {
+    plan->user = -1; /* reported by the child, as a failure to start */
+    return 0;
+  }
+  plan->user = 1;
+  plan->uid = p->pw_uid;
+  plan->gid = p->pw_gid;
+  while (1) {
+    if ( (g = realloc(plan->groups, ng * sizeof(gid_t))) == NULL) return -1;
+    plan->groups = g;
+    if (getgrouplist(user, plan->gid, plan->groups, &ng) != -1) break;
+  }
+  plan->ngroups = ng;
+  return 0;
+}
+
+/* prepare the job's plan. this is done as each job is parsed; a job that
+ * has no plan by the time it is started (as after a failure here) gets it
+ * then. returns -1 on failure, leaving the job without a plan */
+int plan_job(job_t *job) {
+  spawn_plan *plan = &job->plan;
+  char **argv, *exe, *path;
+
+  plan_fin(plan);
+  argv = (char**)utarray_front(&job->cmdv);
+  if ((argv == NULL) || (*argv == NULL)) return 0; /* nothing to plan */
+  /* the child runs it from the job dir; if that is absolute, so is this */
+  exe = *argv;
+  if (job->dir && (*job->dir == '/') && (path = fpath(job, *argv))) exe = path;
+  if ( (plan->exe = strdup(exe)) == NULL) goto fail;
+  if (*job->user && (get_user(plan, job->user) == -1)) goto fail;
+  if ( (plan->envp = make_envp(job)) == NULL) goto fail;
+  return 0;
+
+ fail:
+  plan_fin(plan);
+  return -1;
+}
+
+/* give a copy of a job the plan of the original. the lookups are reused,
+ * but its environment refers to the strings of the copy */
+void plan_cpy(job_t *dst, const job_t *src) {
+  spawn_plan *plan = &dst->plan;
+
+  memset(plan, 0, sizeof(*plan));
+  if (src->plan.envp == NULL) return;
+  plan->user = src->plan.user;
+  plan->uid = src->plan.uid;
+  plan->gid = src->plan.gid;
+  plan->ngroups = src->plan.ngroups;
+  if (src->plan.groups) {
+    plan->groups = malloc(plan->ngroups * sizeof(gid_t));
+    if (plan->groups == NULL) goto fail;
+    memcpy(plan->groups, src->plan.groups, plan->ngroups * sizeof(gid_t));
+  }
+  if ( (plan->exe = strdup(src->plan.exe)) == NULL) goto fail;
+  if ( (plan->envp = make_envp(dst)) == NULL) goto fail;
+  return;
+
+ fail:
+  plan_fin(plan); /* planned again when started */
+}
+
+void plan_fin(spawn_plan *plan) {
+  if (plan->envp) free(plan->envp);
+  if (plan->exe) free(plan->exe);
+  if (plan->groups) free(plan->groups);
+  memset(plan, 0, sizeof(*plan));
+}
+
+/* runs in the child. see the notes at the top */
+static int child(void *arg) {
+  spawn_t *sp = (spawn_t*)arg;
+  job_t *job = sp->job;
+  spawn_plan *plan = &job->plan;
+  resource_rlimit_t *rt=NULL;
+  sigset_t none;
+  unsigned n;
+  int rc;
+
+  /* setup working dir */
+  if (job->dir && (chdir(job->dir) == -1))                 {rc=-1; goto fail;}
+
+  /* set process priority / nice */
+  if (setpriority(PRIO_PROCESS, 0, job->nice) < 0)         {rc=-5; goto fail;}
+
+  /* set cpu affinity, if any */
+  if ((CPU_COUNT(&job->cpuset) > 0) &&
+    sched_setaffinity(0, sizeof(cpu_set_t), &job->cpuset)) {rc=-12; goto fail;}
+
+  /* set ulimits */
+  while ( (rt=(resource_rlimit_t*)utarray_next(&job->rlim,rt))) {
+    if (setrlimit(rt->id, &rt->rlim))                      {rc=-6; goto fail;}
+  }
+
+  /* restore/unblock default handlers so they're unblocked after exec */
+  for(n=0; n < adim(sigs); n++) signal(sigs[n], SIG_DFL);
+  sigemptyset(&none);
+  sigprocmask(SIG_SETMASK,&none,NULL);
+
+  /* change the real and effective user ids, and set the gid and supp groups */
+  if (plan->user == -1)                                    {rc=-7; goto fail;}
+  if (plan->user) {
+    if (setgid(plan->gid) == -1)                           {rc=-8; goto fail;}
+    if (setgroups(plan->ngroups, plan->groups) == -1)      {rc=-9; goto fail;}
+    if (setuid(plan->uid) == -1)                           {rc=-10; goto fail;}
+  }
+
+  int flags_wr = O_WRONLY|O_CREAT|O_APPEND;
+  if (redirect(sp->cfg, STDIN_FILENO,  sp->in,  O_RDONLY, 0)    < 0) {rc=-2; goto fail;}
+  if (redirect(sp->cfg, STDOUT_FILENO, sp->out, flags_wr, 0644) < 0) {rc=-3; goto fail;}
+  if (redirect(sp->cfg, STDERR_FILENO, sp->err, flags_wr, 0644) < 0) {rc=-4; goto fail;}
+
+  /* at last. we're ready to run the child process */
+  execve(plan->exe, sp->argv, plan->envp);
+  rc=-11;
+
+ fail:
+  report->rc = rc;
+  report->err = errno;
+  _exit(-1);  /* child exit */
+}
+
+/* start a process for the job. returns its pid, or -1 if none was created.
+ * if it was created, but failed to set up or exec, this is logged and it
+ * has already exited; it gets reaped like any other job */
+pid_t spawn_job(pmtr_t *cfg, job_t *job, int how) {
+  int flags = CLONE_VFORK | SIGCHLD;
+  pid_t pid;
+  spawn_t sp;
+  void *m;
+
+  memset(&sp, 0, sizeof(sp));
+  sp.cfg = cfg;
+  sp.job = job;
+
+  if (report == NULL) {
+    m = mmap(NULL, SPAWN_STACK, PROT_READ|PROT_WRITE,
+             MAP_SHARED|MAP_ANONYMOUS, -1, 0);
+    if (m == MAP_FAILED) return -1;
+    report = m;                  /* at the low end; the stack grows down */
+    stack = (char*)m + SPAWN_STACK;
+  }
+
+  /* a user unknown when the job was planned may have been added since */
+  if ((job->plan.user == -1) && (get_user(&job->plan, job->user) == -1))
+    return -1;
+  if ((job->plan.envp == NULL) && (plan_job(job) == -1)) return -1;
+
+  /* redirect the child's stdout and stderr to syslog unless user specified */
+  sp.in  = job->in  ? job->in  : "/dev/null";
+  sp.out = job->out ? job->out : "syslog";
+  sp.err = job->err ? job->err : "syslog";
+  sp.argv = (char**)utarray_front(&job->cmdv);
+
+  if (how & SPAWN_VM) flags |= CLONE_VM;
+  report->rc = 0;
+  pid = clone(child, stack, flags, &sp);
+  if (pid == -1) return -1;
+
+  /* the child has exec'd, or failed; in which case say why */
+  errno = report->err;
+  switch(report->rc) {
+   case 0: break;
+   case -1: syslog(LOG_ERR,"can't chdir %s: %s", job->dir, strerror(errno)); break;
+   case -2: syslog(LOG_ERR,"can't open/dup %s: %s", sp.in, strerror(errno)); break;
+   case -3: syslog(LOG_ERR,"can't open/dup %s: %s", sp.out, strerror(errno)); break;
+   case -4: syslog(LOG_ERR,"can't open/dup %s: %s", sp.err, strerror(errno)); break;
+   case -5: syslog(LOG_ERR,"can't setpriority: %s", strerror(errno)); break;
+   case -6: syslog(LOG_ERR,"can't setrlimit: %s", strerror(errno)); break;
+   case -7: syslog(LOG_ERR,"unknown user: %s", job->user); break;
+   case -8: syslog(LOG_ERR,"can't setgid %s: %s", job->user, strerror(errno)); break;
+   case -9: syslog(LOG_ERR,"can't setgroups %s: %s", job->user, strerror(errno)); break;
+   case -10: syslog(LOG_ERR,"can't setuid %s: %s", job->user, strerror(errno)); break;
+   case -11: syslog(LOG_ERR,"can't exec %s: %s", job->plan.exe, strerror(errno)); break;
+   case -12: syslog(LOG_ERR,"can't set cpu affinity: %s", strerror(errno)); break;
+  }
+
+  return pid;
+}
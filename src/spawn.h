@@ -0,0 +1,16 @@
+#ifndef _SPAWN_H_
+#define _SPAWN_H_
+
+#include "pmtr.h"
+#include "job.h"
+
+/* how spawn_job creates the process */
+#define SPAWN_VM 1   /* the child borrows our memory until it execs */
+
+/* prototypes */
+pid_t spawn_job(pmtr_t *cfg, job_t *job, int how);
+int plan_job(job_t *job);
+void plan_cpy(job_t *dst, const job_t *src);
+void plan_fin(spawn_plan *plan);
+
+#endif /* _SPAWN_H_ */
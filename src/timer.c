@@ -0,0 +1,207 @@
+#include <string.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "timer.h"
+
+/* current time on the monotonic clock, in ms */
+uint64_t tw_clock(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/* convert a wall clock deadline (as kept in a job) to wheel time. rounds
+ * up to the next ms so that time(NULL) has reached 'when' once it fires */
+uint64_t tw_at(time_t when) {
+  struct timespec ts;
+  int64_t delay;
+
+  clock_gettime(CLOCK_REALTIME, &ts);
+  delay = ((int64_t)when - ts.tv_sec) * 1000 - ts.tv_nsec / 1000000;
+  if (delay < 0) delay = 0;
+  return tw_clock() + delay + 1;
+}
+
+/* put an entry in the slot that corresponds to its distance from now */
+static void place(timer_wheel *tw, tw_entry *e) {
+  uint64_t t = e->expires, delta;
+  int level, idx;
+
+  if (t < tw->now) t = tw->now;  /* overdue, fires on the next tick */
+  delta = t - tw->now;
+  for(level = 0; level < TW_LEVELS-1; level++) {
+    if (delta < (1ULL << (TW_BITS * (level+1)))) break;
+  }
+  /* too far out for the wheel: park it in the last level; it gets placed
+   * again when that slot cascades */
+  if (delta >= (1ULL << (TW_BITS * TW_LEVELS))) {
+    t = tw->now + (1ULL << (TW_BITS * TW_LEVELS)) - 1;
+  }
+  idx = (t >> (TW_BITS * level)) & TW_MASK;
+  e->next = tw->slot[level][idx];
+  tw->slot[level][idx] = e;
+  tw->count[level]++;
+}
+
+int tw_add(timer_wheel *tw, int kind, const char *name, uint64_t expires) {
+  tw_entry *e;
+
+  e = calloc(1, sizeof(*e));
+  if (e == NULL) return -1;
+  if (name && ((e->name = strdup(name)) == NULL)) {
+    free(e);
+    return -1;
+  }
+  e->kind = kind;
+  e->expires = expires;
+
+  /* an empty wheel can jump ahead to the present */
+  if (tw->n == 0) {
+    uint64_t now = tw_clock();
+    if (tw->now < now) tw->now = now;
+  }
+  place(tw, e);
+  tw->n++;
+  return 0;
+}
+
+/* the level 0 index just wrapped; move entries from higher levels down */
+static void cascade(timer_wheel *tw) {
+  tw_entry *e, *next;
+  int level, idx;
+
+  for(level = 1; level < TW_LEVELS; level++) {
+    idx = (tw->now >> (TW_BITS * level)) & TW_MASK;
+    e = tw->slot[level][idx];
+    tw->slot[level][idx] = NULL;
+    for( ; e; e = next) {
+      next = e->next;
+      tw->count[level]--;
+      place(tw, e);
+    }
+    if (idx != 0) break;
+  }
+}
+
+/* turn the wheel up to and including 'now'. returns the expired entries as
+ * a list; the caller frees them with tw_free */
+tw_entry *tw_expire(timer_wheel *tw, uint64_t now) {
+  tw_entry *done = NULL, *e, *next;
+  uint64_t boundary, span;
+  int idx, level;
+
+  while (tw->now <= now) {
+    if (tw->n == 0) {
+      tw->now = now + 1;
+      break;
+    }
+    /* nothing in level 0: skip ahead to the next cascade that can
+     * bring something down, from the lowest occupied level */
+    if (tw->count[0] == 0) {
+      for(level = 1; tw->count[level] == 0; level++) ;
+      span = 1ULL << (TW_BITS * level);
+      boundary = (tw->now + span - 1) & ~(span - 1);
+      if (boundary > now) {
+        tw->now = now + 1;
+        break;
+      }
+      tw->now = boundary;
+    }
+    idx = tw->now & TW_MASK;
+    if (idx == 0) cascade(tw);
+    for(e = tw->slot[0][idx]; e; e = next) {
+      next = e->next;
+      e->next = done;
+      done = e;
+      tw->n--;
+      tw->count[0]--;
+    }
+    tw->slot[0][idx] = NULL;
+    tw->now++;
+  }
+  return done;
+}
+
+/* remove the entries of a kind, and of a name if one is given. returns
+ * how many there were. this walks the whole wheel; it is for the rare
+ * timer that has to be moved up, rather than for every expiration */
+int tw_del(timer_wheel *tw, int kind, const char *name) {
+  tw_entry **p, *e;
+  int level, idx, n = 0;
+
+  for(level = 0; level < TW_LEVELS; level++) {
+    for(idx = 0; tw->count[level] && (idx < TW_SLOTS); idx++) {
+      for(p = &tw->slot[level][idx]; (e = *p) != NULL; ) {
+        if ((e->kind != kind) || (name && (!e->name || strcmp(e->name, name)))) {
+          p = &e->next;
+          continue;
+        }
+        *p = e->next;
+        tw_free(e);
+        tw->count[level]--;
+        tw->n--;
+        n++;
+      }
+    }
+  }
+  return n;
+}
+
+/* earliest expiration in the wheel, or 0 if it is empty. within a level
+ * the first occupied slot, in the order the wheel turns, holds the
+ * earliest entries of that level; but an entry still waiting in a higher
+ * level can be due before one already in a lower level, so the minimum is
+ * taken over all the levels */
+uint64_t tw_next(timer_wheel *tw) {
+  uint64_t next = 0;
+  tw_entry *e;
+  int level, i, cur, idx;
+
+  if (tw->n == 0) return 0;
+
+  if (tw->count[0]) {
+    for(i = 0; i < TW_SLOTS; i++) {
+      if (tw->slot[0][(tw->now + i) & TW_MASK] == NULL) continue;
+      next = tw->now + i;
+      break;
+    }
+  }
+
+  for(level = 1; level < TW_LEVELS; level++) {
+    if (tw->count[level] == 0) continue;
+    cur = (tw->now >> (TW_BITS * level)) & TW_MASK;
+    for(i = 1; i <= TW_SLOTS; i++) {
+      idx = (cur + i) & TW_MASK;
+      if (tw->slot[level][idx] == NULL) continue;
+      for(e = tw->slot[level][idx]; e; e = e->next) {
+        if ((next == 0) || (e->expires < next)) next = e->expires;
+      }
+      break;
+    }
+  }
+  if (next < tw->now) next = tw->now;
+  return next;
+}
+
+void tw_free(tw_entry *e) {
+  if (e->name) free(e->name);
+  free(e);
+}
+
+void tw_clear(timer_wheel *tw) {
+  tw_entry *e, *next;
+  int level, idx;
+
+  for(level = 0; level < TW_LEVELS; level++) {
+    for(idx = 0; idx < TW_SLOTS; idx++) {
+      for(e = tw->slot[level][idx]; e; e = next) {
+        next = e->next;
+        tw_free(e);
+      }
+      tw->slot[level][idx] = NULL;
+    }
+  }
+  tw->n = 0;
+  memset(tw->count, 0, sizeof(tw->count));
+}
@@ -0,0 +1,45 @@
+#ifndef _TIMER_H_
+#define _TIMER_H_
+
+#include <stdint.h>
+#include <time.h>
+
+/* a hierarchical timer wheel with millisecond ticks on the monotonic clock.
+ * level 0 has one slot per tick; each higher level has slots covering the
+ * whole span of the level beneath it. entries cascade down a level as the
+ * wheel turns, so adding and expiring an entry are O(1). */
+#define TW_BITS   8
+#define TW_SLOTS  (1 << TW_BITS)
+#define TW_MASK   (TW_SLOTS - 1)
+#define TW_LEVELS 4            /* covers 2^32 ms (~49 days); beyond, cascades */
+
+/* kinds of timer */
+#define TIMER_JOB    1         /* a job has a deadline: restart, bounce, kill */
+#define TIMER_REPORT 2         /* periodic status report */
+#define TIMER_WATCH  3         /* watched files changed, or a retry is due */
+
+typedef struct tw_entry {
+  struct tw_entry *next;
+  uint64_t expires;            /* monotonic ms */
+  int kind;
+  char *name;                  /* job name for TIMER_JOB */
+} tw_entry;
+
+typedef struct {
+  uint64_t now;                /* next tick to be processed */
+  size_t n;                    /* entries in the wheel */
+  size_t count[TW_LEVELS];     /* entries in each level */
+  tw_entry *slot[TW_LEVELS][TW_SLOTS];
+} timer_wheel;
+
+/* prototypes */
+uint64_t tw_clock(void);
+uint64_t tw_at(time_t when);
+int tw_add(timer_wheel *tw, int kind, const char *name, uint64_t expires);
+tw_entry *tw_expire(timer_wheel *tw, uint64_t now);
+int tw_del(timer_wheel *tw, int kind, const char *name);
+uint64_t tw_next(timer_wheel *tw);
+void tw_free(tw_entry *e);
+void tw_clear(timer_wheel *tw);
+
+#endif /* _TIMER_H_ */
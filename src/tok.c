@@ -1,49 +1,158 @@
+#include <stdint.h>
 #include <string.h>
 #include "cfg.h"
 
-static struct {
-  char *str;
-  size_t len;
-  int id;
-} kw[] = 
-{
- {"job",     3, TOK_JOB},
- {"name",    4, TOK_NAME},
- {"user",    4, TOK_USER},
- {"cmd",     3, TOK_CMD},
- {"env",     3, TOK_ENV},
- {"dir",     3, TOK_DIR},
- {"out",     3, TOK_OUT},
- {"err",     3, TOK_ERR},
- {"in",      2, TOK_IN},
- {"order",   5, TOK_ORDER},
- {"disable", 7, TOK_DISABLED},
- {"wait",    4, TOK_WAIT},
- {"once",    4, TOK_ONCE},
- {"{",       1, TOK_LCURLY},
- {"}",       1, TOK_RCURLY},
- {"listen",  6, TOK_LISTEN},
- {"on",      2, TOK_ON},
- {"report",  6, TOK_REPORT},
- {"to",      2, TOK_TO},
- {"bounce",  6, TOK_BOUNCE},
- {"every",   5, TOK_EVERY},
- {"depends", 7, TOK_DEPENDS},
- {"ulimit",  6, TOK_ULIMIT},
- {"nice",    4, TOK_NICE},
- {"cpu",     3, TOK_CPUSET},
-};
 static const int ws[256] = { ['\r']=1, ['\n']=1, ['\t']=1, [' ']=1 };
 
+#define IS(s,kw) (memcmp((s), (kw), sizeof(kw)-1) == 0)
+
+/* the keyword a word is, or 0. by length, then by first byte, so a word is
+ * compared to one or two keywords at most */
+static int keyword(const char *s, size_t len) {
+  switch (len) {
+    case 1:
+      if (*s == '{') return TOK_LCURLY;
+      if (*s == '}') return TOK_RCURLY;
+      break;
+    case 2:
+      if (IS(s,"in")) return TOK_IN;
+      if (IS(s,"on")) return TOK_ON;
+      if (IS(s,"to")) return TOK_TO;
+      break;
+    case 3:
+      switch (*s) {
+        case 'j':
+          if (IS(s,"job")) return TOK_JOB;
+          break;
+        case 'c':
+          if (IS(s,"cmd")) return TOK_CMD;
+          if (IS(s,"cpu")) return TOK_CPUSET;
+          break;
+        case 'e':
+          if (IS(s,"env")) return TOK_ENV;
+          if (IS(s,"err")) return TOK_ERR;
+          break;
+        case 'd':
+          if (IS(s,"dir")) return TOK_DIR;
+          break;
+        case 'o':
+          if (IS(s,"out")) return TOK_OUT;
+          break;
+      }
+      break;
+    case 4:
+      switch (*s) {
+        case 'n':
+          if (IS(s,"name")) return TOK_NAME;
+          if (IS(s,"nice")) return TOK_NICE;
+          break;
+        case 'u':
+          if (IS(s,"user")) return TOK_USER;
+          break;
+        case 'w':
+          if (IS(s,"wait")) return TOK_WAIT;
+          break;
+        case 'o':
+          if (IS(s,"once")) return TOK_ONCE;
+          break;
+      }
+      break;
+    case 5:
+      switch (*s) {
+        case 'o':
+          if (IS(s,"order")) return TOK_ORDER;
+          break;
+        case 'e':
+          if (IS(s,"every")) return TOK_EVERY;
+          break;
+        case 'a':
+          if (IS(s,"after")) return TOK_AFTER;
+          break;
+      }
+      break;
+    case 6:
+      switch (*s) {
+        case 'l':
+          if (IS(s,"listen")) return TOK_LISTEN;
+          break;
+        case 'r':
+          if (IS(s,"report")) return TOK_REPORT;
+          break;
+        case 'b':
+          if (IS(s,"bounce")) return TOK_BOUNCE;
+          break;
+        case 'u':
+          if (IS(s,"ulimit")) return TOK_ULIMIT;
+          break;
+        case 'j':
+          if (IS(s,"jitter")) return TOK_JITTER;
+          break;
+      }
+      break;
+    case 7:
+      switch (*s) {
+        case 'd':
+          if (IS(s,"disable")) return TOK_DISABLED;
+          if (IS(s,"depends")) return TOK_DEPENDS;
+          break;
+        case 'b':
+          if (IS(s,"backoff")) return TOK_BACKOFF;
+          if (IS(s,"breaker")) return TOK_BREAKER;
+          break;
+        case 'i':
+          if (IS(s,"include")) return TOK_INCLUDE;
+          break;
+      }
+      break;
+    case 9:
+      switch (*s) {
+        case 'i':
+          if (IS(s,"instances")) return TOK_INSTANCES;
+          break;
+      }
+      break;
+  }
+  return 0;
+}
+
+/* keywords except "{ on to every" must begin a line */
+static int anywhere(int id) {
+  return (id == TOK_LCURLY) || (id == TOK_ON) || (id == TOK_TO) ||
+         (id == TOK_EVERY);
+}
+
+/* the length of the word at s: up to whitespace, or the end. whitespace
+ * is all below 0x21, so eight bytes at a time are checked for any byte
+ * that is; the exact check is made only around one that is found */
+static size_t word_len(const char *s, size_t n) {
+  const uint64_t ones = 0x0101010101010101ULL, highs = 0x8080808080808080ULL;
+  size_t i = 0;
+  uint64_t x;
+
+  while (i + 8 <= n) {
+    memcpy(&x, s + i, 8);
+    if ((x - 0x21 * ones) & ~x & highs) break;  /* a byte below 0x21 */
+    i += 8;
+  }
+  while ((i < n) && !ws[(unsigned char)s[i]]) i++;
+  return i;
+}
+
+/* gets the next token from the buffer: skipping whitespace and comments,
+ * sets *c to its start and *toksz to its length, and returns its id; or
+ * 0 at the end of the buffer, or -1 on a bad quoted string. c_orig is the
+ * start of the buffer. whether the token begins a line is known from the
+ * whitespace skipped over, without looking back along the line */
 int get_tok(char *c_orig, char **c, size_t *bsz, size_t *toksz, int *line) {
+  int bol = (*c == c_orig) || ((*c)[-1] == '\n');
   char *e;
-  int leading_nl=0;
+  int id;
 
  again:
   /* skip leading whitespace */
-  while(*bsz && ws[(int)**c]) {
-    if (**c=='\n') { 
-      leading_nl=1;
+  while(*bsz && ws[(unsigned char)**c]) {
+    if (**c=='\n') {
+      bol=1;
       (*line)++;
     }
     (*bsz)--; (*c)++;
@@ -52,54 +161,26 @@ int get_tok(char *c_orig, char **c, size_t *bsz, size_t *toksz, int *line) {
 
   /* disregard comments til end of line */
   if (**c=='#') {
-    while (*bsz) {
-      (*c)++; (*bsz)--;
-      if (**c == '\n') goto again;
-    }
-    return 0; /* eob while looking for trailing newline */
+    e = memchr(*c, '\n', *bsz);
+    if (e == NULL) return 0; /* eob while looking for trailing newline */
+    *bsz -= e - *c;
+    *c = e;
+    goto again;
   }
 
-  /* identify literal keywords */
-  int i;
-  for(i=0; i < sizeof(kw)/sizeof(*kw); i++) {
-    if (*bsz < kw[i].len) continue;
-    if (memcmp(*c,kw[i].str,kw[i].len) ) continue;
-    /* keywords except "{ on to every" must be preceded by start-of-buf or newline */
-    if (kw[i].id != TOK_LCURLY && 
-        kw[i].id != TOK_ON     && 
-        kw[i].id != TOK_TO     && 
-        kw[i].id != TOK_EVERY) {
-      for(e=(*c)-1; e > c_orig; e--) {
-        if (*e == '\n') break;
-        if (ws[(int)*e]) continue;
-        /* has non-newline chars preceding, so do not consider as a keyword */
-        else goto quoted; 
-      }
-    }
-    /* require keywords to end with space or eob */
-    e = (*bsz > kw[i].len) ? (*c + kw[i].len) : " ";
-    if (!ws[(int)(*e)]) continue;
-    *toksz = kw[i].len;
-    return kw[i].id;
-  }
-
- quoted:
   /* identify quoted string that ends with the closing quote on same line */
   if (**c=='"') {
-    *toksz=1;
-    while (*toksz < *bsz) {
-      e = *c + *toksz;
-      (*toksz)++;
-      if (*e == '"') return TOK_QUOTEDSTR;
-      if (*e == '\n') return -1;
-    }
-    return -1; /* eob without terminating quote */
+    e = memchr(*c + 1, '"', *bsz - 1);
+    if (e == NULL) return -1; /* eob without terminating quote */
+    if (memchr(*c + 1, '\n', e - *c - 1)) return -1;
+    *toksz = e - *c + 1;
+    return TOK_QUOTEDSTR;
   }
 
-  /* otherwise its a string ending with end-of-buffer or whitespace */
-  *toksz=0; 
-  while ((*toksz < *bsz) && (!ws[(int)*(*c+*toksz)])) (*toksz)++;
-  if (*toksz) return TOK_STR; 
-
-  return -1;
+  /* otherwise its a word ending with end-of-buffer or whitespace; it is a
+   * keyword if it is one, and where that keyword is allowed */
+  *toksz = word_len(*c, *bsz);
+  id = keyword(*c, *toksz);
+  if (id && (bol || anywhere(id))) return id;
+  return TOK_STR;
 }
@@ -0,0 +1,246 @@
+#define _GNU_SOURCE /* for CPU_SET macros */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <dirent.h>
+
+#include "topo.h"
+#include "deps.h"
+
+/* reads a cpu list file of the kind in sysfs ("0-3,8,10-11") into set.
+ * returns -1 if it cannot be read or is not such a list */
+static int read_list(const char *path, cpu_set_t *set) {
+  char buf[8192], *c, *end;
+  unsigned long a, b;
+  size_t n;
+  FILE *f;
+
+  CPU_ZERO(set);
+  if ( (f = fopen(path, "r")) == NULL) return -1;
+  n = fread(buf, 1, sizeof(buf) - 1, f);
+  fclose(f);
+  buf[n] = '\0';
+
+  for(c = buf; (*c != '\0') && (*c != '\n'); c = end) {
+    if (*c == ',') c++;
+    a = strtoul(c, &end, 10);
+    if (end == c) return -1;
+    b = a;
+    if (*end == '-') {
+      c = end + 1;
+      b = strtoul(c, &end, 10);
+      if ((end == c) || (b < a)) return -1;
+    }
+    for(; (a <= b) && (a < CPU_SETSIZE); a++) CPU_SET(a, set);
+  }
+  return 0;
+}
+
+/* reads a file holding one number, as sysfs has; -1 if it cannot */
+static int read_int(const char *path) {
+  FILE *f;
+  int v;
+
+  if ( (f = fopen(path, "r")) == NULL) return -1;
+  if (fscanf(f, "%d", &v) != 1) v = -1;
+  fclose(f);
+  return v;
+}
+
+/* the threads of the core of cpu, from its topology/thread_siblings_list;
+ * a cpu without one is taken for a core of its own */
+static void core_of(const char *root, int cpu, cpu_set_t *core) {
+  char path[PATH_MAX];
+
+  snprintf(path, sizeof(path), "%s/cpu/cpu%d/topology/thread_siblings_list",
+           root, cpu);
+  if (read_list(path, core) < 0) {
+    CPU_ZERO(core);
+    CPU_SET(cpu, core);
+  }
+}
+
+/* the number of threads of its core that come before cpu in set */
+static int thread_rank(const char *root, int cpu, const cpu_set_t *set) {
+  cpu_set_t core;
+  int c, rank = 0;
+
+  core_of(root, cpu, &core);
+  for(c = 0; c < cpu; c++) {
+    if (CPU_ISSET(c, &core) && CPU_ISSET(c, set)) rank++;
+  }
+  return rank;
+}
+
+/* puts the allowed cpus into order, as instances are to be placed on them:
+ * one on each physical core, then on the second thread of each core, and
+ * so on. returns their number */
+int spread_cpus(const char *root, const cpu_set_t *allowed, int *order) {
+  unsigned short rank[CPU_SETSIZE];
+  int cpu, r, ranks = 0, n = 0;
+
+  for(cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+    if (!CPU_ISSET(cpu, allowed)) continue;
+    rank[cpu] = thread_rank(root, cpu, allowed);
+    if (rank[cpu] >= ranks) ranks = rank[cpu] + 1;
+  }
+
+  for(r = 0; r < ranks; r++) {
+    for(cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+      if (CPU_ISSET(cpu, allowed) && (rank[cpu] == r)) order[n++] = cpu;
+    }
+  }
+  return n;
+}
+
+/* the number after prefix in name, or -1 if name is not prefix and one */
+static int numbered(const char *name, const char *prefix) {
+  size_t l = strlen(prefix);
+  int v, end;
+
+  if (strncmp(name, prefix, l)) return -1;
+  if ((name[l] < '0') || (name[l] > '9')) return -1;
+  if ((sscanf(name + l, "%d%n", &v, &end) != 1) || name[l + end]) return -1;
+  return v;
+}
+
+/* resolves a cpu selector into set: nodeN, the cpus of a NUMA node;
+ * socketN, those of a physical package; or isolated, those kept from the
+ * scheduler at boot (isolcpus). what the host does not have resolves to
+ * no cpus, so that one config serves hosts of different kinds. returns
+ * -1 if name is not a selector */
+int topo_select(const char *root, const char *name, cpu_set_t *set) {
+  char path[PATH_MAX];
+  cpu_set_t present;
+  int n, cpu;
+
+  CPU_ZERO(set);
+  if (!strcmp(name, "isolated")) {
+    snprintf(path, sizeof(path), "%s/cpu/isolated", root);
+    read_list(path, set);
+  } else if ( (n = numbered(name, "node")) >= 0) {
+    snprintf(path, sizeof(path), "%s/node/node%d/cpulist", root, n);
+    read_list(path, set);
+  } else if ( (n = numbered(name, "socket")) >= 0) {
+    snprintf(path, sizeof(path), "%s/cpu/present", root);
+    if (read_list(path, &present) < 0) return 0;
+    for(cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+      if (!CPU_ISSET(cpu, &present)) continue;
+      snprintf(path, sizeof(path),
+               "%s/cpu/cpu%d/topology/physical_package_id", root, cpu);
+      if (read_int(path) == n) CPU_SET(cpu, set);
+    }
+  } else return -1;
+  return 0;
+}
+
+/* widens set to the whole of each core it has a thread of */
+void topo_cores(const char *root, cpu_set_t *set) {
+  cpu_set_t in, core;
+  int cpu;
+
+  CPU_ZERO(&in);
+  CPU_OR(&in, &in, set);
+  for(cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+    if (!CPU_ISSET(cpu, &in)) continue;
+    core_of(root, cpu, &core);
+    CPU_OR(set, set, &core);
+  }
+}
+
+/* narrows set to the first of the threads of each core that it has */
+void topo_one_thread(const char *root, cpu_set_t *set) {
+  cpu_set_t in;
+  int cpu;
+
+  CPU_ZERO(&in);
+  CPU_OR(&in, &in, set);
+  for(cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+    if (CPU_ISSET(cpu, &in) && thread_rank(root, cpu, &in)) CPU_CLR(cpu, set);
+  }
+}
+
+/* adds the text of a file to h, or a mark if it cannot be read */
+static void hash_file(hash64_t *h, const char *path) {
+  char buf[8192];
+  size_t n = 0;
+  FILE *f;
+
+  if ( (f = fopen(path, "r")) != NULL) {
+    n = fread(buf, 1, sizeof(buf), f);
+    fclose(f);
+  }
+  h64_update(h, &n, sizeof(n));
+  h64_update(h, buf, n);
+}
+
+/* a hash of what the selectors and "spread" read: the cpus pmtr may run
+ * on, and the topology under root. cpus resolved on one host are kept
+ * (see image.c) only for a host where this is the same. never 0 */
+uint64_t topo_hash(const char *root) {
+  char path[PATH_MAX];
+  cpu_set_t allowed, cpus, nodes;
+  struct dirent *de;
+  hash64_t h;
+  uint64_t v;
+  int cpu, n;
+  DIR *d;
+
+  h64_init(&h, 0);
+  if (sched_getaffinity(0, sizeof(allowed), &allowed) < 0) CPU_ZERO(&allowed);
+  h64_update(&h, &allowed, sizeof(allowed));
+  snprintf(path, sizeof(path), "%s/cpu/isolated", root);
+  hash_file(&h, path);
+  snprintf(path, sizeof(path), "%s/cpu/present", root);
+  hash_file(&h, path);
+
+  if (read_list(path, &cpus) < 0) CPU_ZERO(&cpus);
+  CPU_OR(&cpus, &cpus, &allowed);
+  for(cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+    if (!CPU_ISSET(cpu, &cpus)) continue;
+    snprintf(path, sizeof(path), "%s/cpu/cpu%d/topology/thread_siblings_list",
+             root, cpu);
+    hash_file(&h, path);
+    snprintf(path, sizeof(path),
+             "%s/cpu/cpu%d/topology/physical_package_id", root, cpu);
+    hash_file(&h, path);
+  }
+
+  /* the nodes, in order of their number */
+  CPU_ZERO(&nodes);
+  snprintf(path, sizeof(path), "%s/node", root);
+  if ( (d = opendir(path)) != NULL) {
+    while ( (de = readdir(d))) {
+      n = numbered(de->d_name, "node");
+      if ((n >= 0) && (n < CPU_SETSIZE)) CPU_SET(n, &nodes);
+    }
+    closedir(d);
+  }
+  for(n = 0; n < CPU_SETSIZE; n++) {
+    if (!CPU_ISSET(n, &nodes)) continue;
+    h64_update(&h, &n, sizeof(n));
+    snprintf(path, sizeof(path), "%s/node/node%d/cpulist", root, n);
+    hash_file(&h, path);
+  }
+
+  v = h64_final(&h);
+  return v ? v : 1;
+}
+
+/* formats set as a cpu list ("0-3,8"), or "-" if it is empty */
+char *topo_list(const cpu_set_t *set, char *buf, size_t len) {
+  int cpu = 0, end;
+  size_t n = 0;
+
+  snprintf(buf, len, "-");
+  while ((cpu < CPU_SETSIZE) && (n < len)) {
+    if (!CPU_ISSET(cpu, set)) { cpu++; continue; }
+    for(end = cpu; (end + 1 < CPU_SETSIZE) && CPU_ISSET(end + 1, set); end++);
+    if (end > cpu) n += snprintf(buf + n, len - n, "%s%d-%d", n ? "," : "",
+                                 cpu, end);
+    else n += snprintf(buf + n, len - n, "%s%d", n ? "," : "", cpu);
+    cpu = end + 1;
+  }
+  return buf;
+}
@@ -0,0 +1,22 @@
+#ifndef _TOPO_H_
+#define _TOPO_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sched.h>
+
+/* where the kernel describes the cpus (cpu/cpuN/topology/, cpu/isolated)
+ * and the NUMA nodes (node/nodeN/cpulist). pmtr_t can name another place
+ * for it (tests do) */
+#define TOPO_SYSFS "/sys/devices/system"
+#define topo_root(cfg) ((cfg)->sysfs ? (cfg)->sysfs : TOPO_SYSFS)
+
+/* prototypes */
+int spread_cpus(const char *root, const cpu_set_t *allowed, int *order);
+int topo_select(const char *root, const char *name, cpu_set_t *set);
+void topo_cores(const char *root, cpu_set_t *set);
+void topo_one_thread(const char *root, cpu_set_t *set);
+char *topo_list(const cpu_set_t *set, char *buf, size_t len);
+uint64_t topo_hash(const char *root);
+
+#endif /* _TOPO_H_ */
@@ -0,0 +1,479 @@
+#include "pmtr.h"
+#include "job.h"
+#include "event.h"
+#include "watch.h"
+
+/* watching pmtr.conf and the dependencies of the jobs with inotify. the
+ * set of paths to watch is worked out again when the jobs change, and
+ * only the difference is added or removed. the events that follow a
+ * change usually come in a burst, as a file gets written a piece at a
+ * time or several files get deployed together; they are gathered until
+ * they stop for a while, and then the paths they were for are handed
+ * back to the main loop all at once. each path keeps the names of the
+ * jobs that depend on it, so a change can be taken to just those jobs.
+ *
+ * it is the directory of each path that is watched, not the file. a
+ * deploy that writes a new file and renames it over the old one, or that
+ * swaps a symlink, never writes to the file that was there; the old file
+ * just goes away, and a watch on it with it. in the directory, the events
+ * name the file, and the names that are not watched paths are ignored.
+ *
+ * where inotify is not to be had (some container and network mounts),
+ * the paths are polled with statx instead, in one pass over the table
+ * each WATCH_POLL_MIN. a path is only looked at when it is due, and the
+ * longer it stays the same, the less often it is due */
+
+#define WATCH_MASK (IN_CLOSE_WRITE | IN_CREATE | IN_MOVED_TO | IN_MOVED_FROM | \
+                    IN_DELETE | IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR)
+
+static int wd_cmp(const void *a, const void *b) {
+  int x = *(const int*)a, y = *(const int*)b;
+  return (x < y) ? -1 : (x > y);
+}
+
+static int has_wd(UT_array *wds, int wd) {
+  return utarray_find(wds, &wd, wd_cmp) != NULL;
+}
+
+static void add_wd(UT_array *wds, int wd) {
+  if (has_wd(wds, wd)) return;
+  utarray_push_back(wds, &wd);
+  utarray_sort(wds, wd_cmp);
+}
+
+static int path_cmp(const void *a, const void *b) {
+  return strcmp(*(char * const *)a, *(char * const *)b);
+}
+
+static void add_path(UT_array *paths, char *path) {
+  if (utarray_find(paths, &path, path_cmp)) return;
+  utarray_push_back(paths, &path);
+  utarray_sort(paths, path_cmp);
+}
+
+/* the length of the directory part of path, up to the last slash */
+static size_t prefix_len(const char *path) {
+  const char *slash = strrchr(path, '/');
+  return slash ? (size_t)(slash - path + 1) : 0;
+}
+
+static watch_t *slot_of(watcher *w, const char *path) {
+  unsigned i = hash64(path, strlen(path), 0) & (w->size - 1);
+  while (w->tab[i].path && strcmp(w->tab[i].path, path)) {
+    i = (i + 1) & (w->size - 1);
+  }
+  return &w->tab[i];
+}
+
+static unsigned dir_slot(watcher *w, int wd) {
+  return ((unsigned)wd * 2654435761U) & (w->dsize - 1);
+}
+
+/* watch the directory that path is in. returns the wd, or -1. a directory
+ * is watched once by the kernel, however many paths are in it */
+static int add_dir(watcher *w, const char *path) {
+  char dir[PATH_MAX];
+  size_t len = prefix_len(path);
+  int wd;
+
+  if (len == 0) strcpy(dir, ".");
+  else if (len == 1) strcpy(dir, "/");
+  else if (len > sizeof(dir)) { errno = ENAMETOOLONG; return -1; }
+  else { memcpy(dir, path, len - 1); dir[len - 1] = '\0'; }
+
+  wd = inotify_add_watch(w->fd, dir, WATCH_MASK);
+  if (wd == -1) syslog(LOG_ERR,"can't watch %s: %s", dir, strerror(errno));
+  return wd;
+}
+
+/* make the table of directories by wd over again, from the paths */
+static int index_dirs(watcher *w) {
+  unsigned i, j, size = 16;
+  watch_dir *d;
+  size_t len;
+
+  for(j = 0; j < w->dsize; j++) free(w->dirs[j].prefix);
+  free(w->dirs);
+  w->dirs = NULL;
+  w->dsize = 0;
+
+  while (size < 2 * w->n) size *= 2;
+  if ( (w->dirs = calloc(size, sizeof(watch_dir))) == NULL) return -1;
+  w->dsize = size;
+  for(i = 0; i < w->size; i++) {
+    if ((w->tab[i].path == NULL) || (w->tab[i].wd == -1)) continue;
+    len = prefix_len(w->tab[i].path);
+    for(j = dir_slot(w, w->tab[i].wd); w->dirs[j].wd; j = (j+1) & (size-1)) {
+      d = &w->dirs[j];
+      if ((d->wd == w->tab[i].wd) && (strlen(d->prefix) == len) &&
+          (memcmp(d->prefix, w->tab[i].path, len) == 0)) break;
+    }
+    if (w->dirs[j].wd) continue; /* this prefix of this directory is known */
+    if ( (w->dirs[j].prefix = strndup(w->tab[i].path, len)) == NULL) return -1;
+    w->dirs[j].wd = w->tab[i].wd;
+  }
+  return 0;
+}
+
+/* rebuild the table to hold at least n paths, at most half full, keeping
+ * the paths wanted by the current sync. the watches of the others are
+ * removed, unless a path that is kept shares the watch (as it does when
+ * the paths are in the same directory) */
+static int rebuild(watcher *w, unsigned n, int prune) {
+  watcher old = *w;
+  UT_array dropped, kept;
+  unsigned i, size = 16;
+  int *wd, last = -1;
+
+  while (size < 2 * n) size *= 2;
+  w->tab = calloc(size, sizeof(watch_t));
+  if (w->tab == NULL) { *w = old; return -1; }
+  w->size = size;
+  w->n = 0;
+  utarray_init(&dropped, &ut_int_icd);
+  utarray_init(&kept, &ut_int_icd);
+  for(i = 0; i < old.size; i++) {
+    if (old.tab[i].path == NULL) continue;
+    if (prune && (old.tab[i].gen != w->gen)) {
+      if (old.tab[i].wd != -1) utarray_push_back(&dropped, &old.tab[i].wd);
+      utarray_done(&old.tab[i].jobs);
+      free(old.tab[i].path);
+      continue;
+    }
+    if (old.tab[i].wd != -1) utarray_push_back(&kept, &old.tab[i].wd);
+    *slot_of(w, old.tab[i].path) = old.tab[i];
+    w->n++;
+  }
+  utarray_sort(&kept, wd_cmp);
+  utarray_sort(&dropped, wd_cmp);
+  wd = NULL;
+  while ( (wd = (int*)utarray_next(&dropped, wd))) {
+    if ((*wd == last) || has_wd(&kept, *wd)) continue;
+    inotify_rm_watch(w->fd, *wd);
+    last = *wd;
+  }
+  utarray_done(&dropped);
+  utarray_done(&kept);
+  free(old.tab);
+  return 0;
+}
+
+/* look at a path, as polling does. returns 1 if it differs from the last
+ * look. only the fields that show a change are asked of statx; the inode
+ * shows a file renamed over the path, and the ctime a file copied in with
+ * its mtime kept */
+static int look(watch_t *wt) {
+  uint64_t dev = 0, ino = 0, size = 0, mtime_ns = 0, ctime_ns = 0;
+  struct statx sx;
+  int err = 0, changed;
+
+  if (statx(AT_FDCWD, wt->path, 0,
+            STATX_INO | STATX_SIZE | STATX_MTIME | STATX_CTIME, &sx) < 0) {
+    err = errno;
+  } else {
+    dev = ((uint64_t)sx.stx_dev_major << 32) | sx.stx_dev_minor;
+    ino = sx.stx_ino;
+    size = sx.stx_size;
+    mtime_ns = sx.stx_mtime.tv_sec * 1000000000ULL + sx.stx_mtime.tv_nsec;
+    ctime_ns = sx.stx_ctime.tv_sec * 1000000000ULL + sx.stx_ctime.tv_nsec;
+  }
+
+  changed = (err != wt->poll.err) || (dev != wt->poll.dev) ||
+            (ino != wt->poll.ino) || (size != wt->poll.size) ||
+            (mtime_ns != wt->poll.mtime_ns) || (ctime_ns != wt->poll.ctime_ns);
+  wt->poll.err = err;
+  wt->poll.dev = dev;
+  wt->poll.ino = ino;
+  wt->poll.size = size;
+  wt->poll.mtime_ns = mtime_ns;
+  wt->poll.ctime_ns = ctime_ns;
+  return changed;
+}
+
+/* watch a path, if it is not watched already, on behalf of a job (or of
+ * no job, for pmtr.conf) */
+static void want(watcher *w, const char *path, const char *job) {
+  watch_t *wt;
+
+  if ((2 * (w->n + 1) > w->size) && (rebuild(w, w->n + 1, 0) < 0)) return;
+  wt = slot_of(w, path);
+  if (wt->path == NULL) {
+    if ( (wt->path = strdup(path)) == NULL) return;
+    wt->wd = -1;
+    utarray_init(&wt->jobs, &ut_str_icd);
+    memset(&wt->poll, 0, sizeof(wt->poll));
+    w->n++;
+    if (w->poll) {                 /* what it is like now, to compare to */
+      look(wt);
+      wt->poll.every_ms = WATCH_POLL_MIN;
+      wt->poll.next_ms = tw_clock() + WATCH_POLL_MIN;
+    }
+  }
+  if (wt->gen != w->gen) utarray_clear(&wt->jobs);  /* first want this sync */
+  wt->gen = w->gen;
+  if (job) utarray_push_back(&wt->jobs, &job);
+  if ((wt->wd == -1) && !w->poll) wt->wd = add_dir(w, path);
+}
+
+/* the timer gets set for the earliest thing due. a timer already set for
+ * later is moved up; one set sooner fires early at worst */
+static void arm(pmtr_t *cfg, uint64_t when) {
+  watcher *w = &cfg->wt;
+
+  if (w->armed && (w->armed_ms <= when)) return;
+  if (w->armed) tw_del(&cfg->tw, TIMER_WATCH, NULL);
+  w->armed = 0;
+  if (tw_add(&cfg->tw, TIMER_WATCH, NULL, when) < 0) {
+    syslog(LOG_ERR,"can't add watch timer");
+    return;
+  }
+  w->armed = 1;
+  w->armed_ms = when;
+}
+
+/* an event named a file in a watched directory. returns 1 if that is one
+ * of the watched paths, or if the directory is watched as a whole (as a
+ * path ending in a slash, whose files are included by pmtr.conf); else 0 */
+static int name_changed(watcher *w, int wd, const char *name) {
+  char path[PATH_MAX];
+  unsigned j;
+  watch_t *wt;
+
+  if (w->dsize == 0) return 0;
+  for(j = dir_slot(w, wd); w->dirs[j].wd; j = (j+1) & (w->dsize-1)) {
+    if (w->dirs[j].wd != wd) continue;
+    if (snprintf(path, sizeof(path), "%s%s", w->dirs[j].prefix, name)
+        >= (int)sizeof(path)) continue;
+    wt = slot_of(w, path);
+    if (wt->path == NULL) wt = slot_of(w, w->dirs[j].prefix);
+    if (wt->path == NULL) continue;
+    add_path(w->changed, wt->path);
+    return 1;
+  }
+  return 0;
+}
+
+/* a watched directory itself went away. returns the paths affected */
+static int dir_changed(watcher *w, int wd) {
+  unsigned i;
+  int n = 0;
+
+  for(i = 0; i < w->size; i++) {
+    if ((w->tab[i].path == NULL) || (w->tab[i].wd != wd)) continue;
+    add_path(w->changed, w->tab[i].path);
+    n++;
+  }
+  return n;
+}
+
+/* look at the paths that are due. returns how many changed, after putting
+ * them into paths. the timer ticks at the shortest interval */
+static int poll_paths(pmtr_t *cfg, UT_array *paths) {
+  watcher *w = &cfg->wt;
+  uint64_t now = tw_clock();
+  watch_t *wt;
+  unsigned i;
+
+  for(i = 0; i < w->size; i++) {
+    wt = &w->tab[i];
+    if ((wt->path == NULL) || (wt->poll.next_ms > now)) continue;
+    if (look(wt)) {
+      utarray_push_back(paths, &wt->path);
+      wt->poll.every_ms = WATCH_POLL_MIN;
+    } else if (wt->poll.every_ms < WATCH_POLL_MAX) {
+      wt->poll.every_ms *= 2;
+      if (wt->poll.every_ms > WATCH_POLL_MAX) wt->poll.every_ms = WATCH_POLL_MAX;
+    }
+    wt->poll.next_ms = now + wt->poll.every_ms;
+  }
+  arm(cfg, now + WATCH_POLL_MIN);
+  return utarray_len(paths);
+}
+
+/* set up inotify, with its descriptor in the main epoll set. without it,
+ * the paths are polled instead */
+int watch_init(pmtr_t *cfg) {
+  watcher *w = &cfg->wt;
+
+  w->fd = inotify_init1(IN_NONBLOCK|IN_CLOEXEC);
+  if (w->fd == -1) {
+    syslog(LOG_ERR, "inotify_init: %s; polling for changes", strerror(errno));
+    w->poll = 1;
+    return 0;
+  }
+  utarray_new(w->changed, &ut_str_icd);
+  utarray_new(w->gone, &ut_int_icd);
+  if (add_epoll(cfg, w->fd, EV_INOTIFY, 0) < 0) {
+    watch_fin(cfg);
+    return -1;
+  }
+  return 0;
+}
+
+/* watch pmtr.conf, the files it includes and the directories they are
+ * from, and the dependencies of the enabled jobs, and stop watching
+ * anything else. run this whenever those may have changed */
+void watch_sync(pmtr_t *cfg) {
+  watcher *w = &cfg->wt;
+  job_t *job = NULL;
+  frag_t *frag;
+  char **dep, *path;
+
+  if ((w->fd == -1) && !w->poll) {
+    while ( (job=(job_t*)utarray_next(cfg->jobs,job))) {
+      if (job->disabled) continue;
+      if (utarray_len(&job->depv) > 0) {
+        syslog(LOG_ERR, "job %s: dependency watching disabled", job->name);
+      }
+    }
+    return;
+  }
+
+  if (++w->gen == 0) w->gen = 1;
+  want(w, cfg->file, NULL);
+  w->retry = !w->poll && (slot_of(w, cfg->file)->wd == -1);
+  frag = NULL;
+  while (cfg->inc.frags && (frag=(frag_t*)utarray_next(cfg->inc.frags,frag))) {
+    want(w, frag->path, NULL);
+  }
+  dep = NULL;
+  while (cfg->inc.watch && (dep=(char**)utarray_next(cfg->inc.watch,dep))) {
+    want(w, *dep, NULL);
+  }
+  while ( (job=(job_t*)utarray_next(cfg->jobs,job))) {
+    if (job->disabled) continue;
+    dep = NULL;
+    while ( (dep=(char**)utarray_next(&job->depv,dep))) {
+      path = fpath(job,*dep);
+      if (path == NULL) {
+        syslog(LOG_ERR,"can't watch %s: path too long", *dep);
+        continue;
+      }
+      want(w, path, job->name);
+    }
+  }
+  rebuild(w, w->n, 1);
+  index_dirs(w);
+  if (w->poll) arm(cfg, tw_clock() + WATCH_POLL_MIN);
+
+  /* the directory of pmtr.conf may be in the midst of a rename */
+  if (w->retry) arm(cfg, tw_clock() + SHORT_DELAY * 1000);
+}
+
+/* take the pending inotify events. each batch of events lengthens the
+ * quiet period to wait for, up to a limit, so that a burst of writes is
+ * handed back as one change; but never later than WATCH_WAIT_MAX after
+ * the burst began. events for other files do not count */
+void watch_read(pmtr_t *cfg) {
+  char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+  struct inotify_event *ev;
+  watcher *w = &cfg->wt;
+  uint64_t now, flush;
+  int n = 0;
+  ssize_t nr;
+  char *p;
+
+  while ( (nr = read(w->fd, buf, sizeof(buf))) > 0) {
+    for(p = buf; p < buf + nr; p += sizeof(*ev) + ev->len) {
+      ev = (struct inotify_event*)p;
+      if (ev->mask & IN_Q_OVERFLOW) { w->all = 1; n++; continue; }
+      if (ev->mask & IN_MOVE_SELF) inotify_rm_watch(w->fd, ev->wd);
+      if (ev->mask & IN_IGNORED) add_wd(w->gone, ev->wd);
+      if (ev->len) n += name_changed(w, ev->wd, ev->name);
+      else n += dir_changed(w, ev->wd);
+    }
+  }
+  if ((nr < 0) && (errno != EAGAIN)) {
+    syslog(LOG_ERR,"read inotify: %s", strerror(errno));
+  }
+  if (n == 0) return;
+
+  now = tw_clock();
+  if (w->first_ms == 0) {
+    w->first_ms = now;
+    w->delay_ms = WATCH_DELAY_MIN;
+  } else {
+    w->delay_ms *= 2;
+    if (w->delay_ms > WATCH_DELAY_MAX) w->delay_ms = WATCH_DELAY_MAX;
+  }
+  flush = now + w->delay_ms;
+  if (flush > w->first_ms + WATCH_WAIT_MAX) flush = w->first_ms + WATCH_WAIT_MAX;
+  w->flush_ms = flush;
+  arm(cfg, flush);
+}
+
+/* the watch timer expired. once the events have been quiet long enough,
+ * puts the paths they were for into paths, and returns how many there
+ * are. when events were lost, that is every path */
+int watch_timer(pmtr_t *cfg, UT_array *paths) {
+  watcher *w = &cfg->wt;
+  uint64_t now = tw_clock();
+  char **path = NULL;
+  watch_t *wt;
+  unsigned i;
+
+  w->armed = 0;
+  if (w->poll) return poll_paths(cfg, paths);
+  if (w->fd == -1) return 0;
+  if (w->first_ms == 0) {
+    if (w->retry) watch_sync(cfg);
+    return 0;
+  }
+  if (w->flush_ms > now) { arm(cfg, w->flush_ms); return 0; }
+
+  for(i = 0; w->all && (i < w->size); i++) {
+    if (w->tab[i].path) utarray_push_back(paths, &w->tab[i].path);
+  }
+  while ( !w->all && (path = (char**)utarray_next(w->changed, path))) {
+    wt = slot_of(w, *path);
+    if (wt->path) utarray_push_back(paths, &wt->path); /* if still wanted */
+  }
+
+  /* the kernel removed the watch of a directory that was deleted or moved:
+   * watch what is at its path now, if anything */
+  if (utarray_len(w->gone) > 0) {
+    for(i = 0; i < w->size; i++) {
+      if ((w->tab[i].path == NULL) || (w->tab[i].wd == -1)) continue;
+      if (!has_wd(w->gone, w->tab[i].wd)) continue;
+      w->tab[i].wd = add_dir(w, w->tab[i].path);
+    }
+    index_dirs(w);
+  }
+
+  utarray_clear(w->changed);
+  utarray_clear(w->gone);
+  w->all = 0;
+  w->first_ms = 0;
+  return utarray_len(paths);
+}
+
+/* the names of the jobs that depend on a watched path, or NULL */
+UT_array *watch_jobs(pmtr_t *cfg, const char *path) {
+  watch_t *wt;
+
+  if (cfg->wt.size == 0) return NULL;
+  wt = slot_of(&cfg->wt, path);
+  return wt->path ? &wt->jobs : NULL;
+}
+
+void watch_fin(pmtr_t *cfg) {
+  watcher *w = &cfg->wt;
+  unsigned i;
+
+  if (w->fd != -1) {
+    del_epoll(cfg, w->fd);
+    close(w->fd);
+  }
+  for(i = 0; i < w->size; i++) {
+    if (w->tab[i].path == NULL) continue;
+    utarray_done(&w->tab[i].jobs);
+    free(w->tab[i].path);
+  }
+  free(w->tab);
+  for(i = 0; i < w->dsize; i++) free(w->dirs[i].prefix);
+  free(w->dirs);
+  if (w->changed) utarray_free(w->changed);
+  if (w->gone) utarray_free(w->gone);
+  memset(w, 0, sizeof(*w));
+  w->fd = -1;
+}
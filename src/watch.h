@@ -0,0 +1,23 @@
+#ifndef _WATCH_H_
+#define _WATCH_H_
+
+#include "pmtr.h"
+
+#define WATCH_DELAY_MIN   100  /* quiet period after a lone event, in ms */
+#define WATCH_DELAY_MAX  1000  /* it doubles with each event, up to this */
+#define WATCH_WAIT_MAX   3000  /* events never wait longer than this */
+
+/* when polling, a path is looked at every WATCH_POLL_MIN ms at first.
+ * each look that finds it unchanged doubles that, up to WATCH_POLL_MAX */
+#define WATCH_POLL_MIN   1000
+#define WATCH_POLL_MAX  16000
+
+/* prototypes */
+int watch_init(pmtr_t *cfg);
+void watch_sync(pmtr_t *cfg);
+void watch_read(pmtr_t *cfg);
+int watch_timer(pmtr_t *cfg, UT_array *paths);
+UT_array *watch_jobs(pmtr_t *cfg, const char *path);
+void watch_fin(pmtr_t *cfg);
+
+#endif /* _WATCH_H_ */
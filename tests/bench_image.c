@@ -0,0 +1,87 @@
+/*
+ * Compiled config benchmark for pmtr
+ * Measures a cold start of the jobs: parse_jobs on pmtr.conf, against
+ * parse_jobs taking the jobs from an image compiled from it (see image.c).
+ *
+ * usage: bench_image [jobs]
+ *
+ * Each job has an env setting and a ulimit, and every tenth a dependency.
+ * Not run by ctest.
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "test_helpers.h"
+
+static double now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void write_config(char *file, int njobs, char *dep) {
+    FILE *f = fopen(file, "w");
+    int i;
+
+    if (f == NULL) { perror(file); exit(-1); }
+    for(i = 0; i < njobs; i++) {
+        fprintf(f, "job {\n  name job%d\n  cmd /bin/sleep %d\n", i, i);
+        fprintf(f, "  env WORKER=%d\n  ulimit -n 1024\n", i);
+        if (i % 10 == 0) fprintf(f, "  depends {\n    %s\n  }\n", dep);
+        fprintf(f, "}\n");
+    }
+    fclose(f);
+}
+
+/* a cold start's parse_jobs, in msec */
+static double start(char *file, char *image, int test_only) {
+    UT_string *em;
+    pmtr_t cfg;
+    double t0, t;
+
+    utstring_new(em);
+    init_test_cfg(&cfg);
+    cfg.file = strdup(file);
+    if (image) cfg.image = strdup(image);
+    cfg.test_only = test_only;
+    t0 = now_sec();
+    if (parse_jobs(&cfg, em) < 0) {
+        fprintf(stderr, "parse failed: %s\n", utstring_body(em));
+        exit(-1);
+    }
+    t = (now_sec() - t0) * 1e3;
+    free_test_cfg(&cfg);
+    utstring_free(em);
+    return t;
+}
+
+int main(int argc, char *argv[]) {
+    int njobs = (argc > 1) ? atoi(argv[1]) : 10000;
+    char file[512], image[512], *dep;
+    double parse, load;
+    struct stat st;
+
+    if (njobs < 1) njobs = 1;
+    if (test_init() < 0) return -1;
+    dep = create_temp_file("dep.conf", "settings");
+    snprintf(file, sizeof(file), "%s", create_temp_config(NULL));
+    snprintf(image, sizeof(image), "%s/pmtr.img", g_test_tmpdir);
+    write_config(file, njobs, dep);
+
+    start(file, image, 1);  /* pmtr -t -C */
+    start(file, NULL, 0);   /* warm the page cache */
+    parse = start(file, NULL, 0);
+    load = start(file, image, 0);
+    stat(image, &st);
+
+    printf("cold start of %d jobs (image %lld bytes)\n", njobs, (long long)st.st_size);
+    printf("  parsed:                 %10.2f msec\n", parse);
+    printf("  from image:             %10.2f msec\n", load);
+
+    test_cleanup();
+    return 0;
+}
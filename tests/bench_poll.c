@@ -0,0 +1,90 @@
+/*
+ * Polling benchmark for pmtr
+ * Measures what watching dependencies costs without inotify, when each
+ * path is looked at with statx as it falls due (see watch.c).
+ *
+ * usage: bench_poll [paths] [passes]
+ *
+ * A pass where every path is due costs one statx per path; a pass where
+ * none is due costs a walk of the table. From those it works out the
+ * share of a core taken when every path is polled at the shortest
+ * interval (just after a change), and once they have all backed off to
+ * the longest. Not run by ctest.
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "test_helpers.h"
+#include "../src/watch.h"
+
+static double cpu_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void all_due(pmtr_t *cfg) {
+    unsigned i;
+    for(i = 0; i < cfg->wt.size; i++) cfg->wt.tab[i].poll.next_ms = 0;
+}
+
+int main(int argc, char *argv[]) {
+    int npaths = (argc > 1) ? atoi(argv[1]) : 5000;
+    int passes = (argc > 2) ? atoi(argv[2]) : 50;
+    double t0, due, idle, t, busy, settled;
+    char name[32], *path;
+    UT_array *paths;
+    pmtr_t cfg;
+    job_t job;
+    int i;
+
+    if (npaths < 1) npaths = 1;
+    if (test_init() < 0) return -1;
+    init_test_cfg(&cfg);
+    cfg.file = strdup(create_temp_file("pmtr.conf", ""));
+    cfg.wt.poll = 1;
+    for(i = 0; i < npaths; i++) {
+        job_ini(&job);
+        snprintf(name, sizeof(name), "dep%d", i);
+        job.name = strdup(name);
+        path = create_temp_file(name, name);
+        utarray_push_back(&job.depv, &path);
+        utarray_push_back(cfg.jobs, &job);
+        job_fin(&job);
+    }
+    watch_sync(&cfg);
+    utarray_new(paths, &ut_ptr_icd);
+
+    t = 0;
+    for(i = 0; i < passes; i++) {
+        all_due(&cfg);
+        t0 = cpu_sec();
+        watch_timer(&cfg, paths);
+        t += cpu_sec() - t0;
+    }
+    due = t / passes;
+
+    t0 = cpu_sec();
+    for(i = 0; i < passes; i++) watch_timer(&cfg, paths);
+    idle = (cpu_sec() - t0) / passes;
+
+    /* per second: the ticks, and the looks at the paths that are due */
+    busy = (1000.0 / WATCH_POLL_MIN) * due;
+    settled = (1000.0 / WATCH_POLL_MIN) * idle +
+              (1000.0 / WATCH_POLL_MAX) * (due - idle);
+
+    printf("polling %d paths with statx\n", npaths);
+    printf("  pass, all due:          %10.2f usec\n", due * 1e6);
+    printf("  pass, none due:         %10.2f usec\n", idle * 1e6);
+    printf("  each every %5d ms:    %10.4f%% of a core\n", WATCH_POLL_MIN, busy * 100);
+    printf("  each every %5d ms:    %10.4f%% of a core\n", WATCH_POLL_MAX, settled * 100);
+
+    utarray_free(paths);
+    free_test_cfg(&cfg);
+    test_cleanup();
+    return 0;
+}
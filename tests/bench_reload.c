@@ -0,0 +1,94 @@
+/*
+ * Reload benchmark for pmtr
+ * Measures a config reload: parsing the config file again, and merging
+ * the state of the running jobs into the new jobs (merge_jobs), with one
+ * job in a hundred changed and one removed.
+ *
+ * usage: bench_reload [jobs]
+ *
+ * The jobs of the first config are given made-up pids, as if running.
+ * Not run by ctest.
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "test_helpers.h"
+
+static double now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* write a config of njobs jobs. every hundredth one bounces every so many
+ * minutes, and the last one is left out if drop is set */
+static void write_config(char *file, int njobs, int bounce, int drop) {
+    FILE *f = fopen(file, "w");
+    int i;
+
+    if (f == NULL) { perror(file); exit(-1); }
+    if (drop) njobs--;
+    for(i = 0; i < njobs; i++) {
+        fprintf(f, "job {\n  name job%d\n  cmd /bin/sleep %d\n", i, i);
+        if (i % 100 == 0) fprintf(f, "  bounce every %dm\n", bounce);
+        fprintf(f, "}\n");
+    }
+    fclose(f);
+}
+
+static void parse(pmtr_t *cfg, UT_string *em) {
+    if (parse_jobs(cfg, em) < 0) {
+        fprintf(stderr, "parse failed: %s\n", utstring_body(em));
+        exit(-1);
+    }
+}
+
+int main(int argc, char *argv[]) {
+    int njobs = (argc > 1) ? atoi(argv[1]) : 20000;
+    double t0, t1, t2;
+    UT_array *previous;
+    job_index pjx;
+    job_diff d;
+    UT_string *em;
+    pmtr_t cfg;
+    job_t *job;
+    int i = 0;
+
+    if (njobs < 2) njobs = 2;
+    if (test_init() < 0) return -1;
+    utstring_new(em);
+    init_test_cfg(&cfg);
+    cfg.file = strdup(create_temp_config(NULL));
+
+    write_config(cfg.file, njobs, 1, 0);
+    parse(&cfg, em);
+    job = NULL;
+    while ( (job = (job_t*)utarray_next(cfg.jobs, job))) job->pid = 100000 + i++;
+    index_jobs(&cfg.jx, cfg.jobs);
+
+    /* reload, as rescan_config does */
+    write_config(cfg.file, njobs, 2, 1);
+    previous = cfg.jobs;
+    pjx = cfg.jx;
+    utarray_new(cfg.jobs, &job_mm);
+    memset(&cfg.jx, 0, sizeof(cfg.jx));
+    t0 = now_sec();
+    parse(&cfg, em);
+    t1 = now_sec();
+    merge_jobs(&cfg, previous, &pjx, &d);
+    t2 = now_sec();
+
+    printf("reload of %d jobs: %u added, %u changed, %u removed, %u unchanged\n",
+        njobs, d.added, d.changed, d.removed, d.unchanged);
+    printf("  parse:                  %10.2f msec\n", (t1 - t0) * 1e3);
+    printf("  merge:                  %10.2f msec\n", (t2 - t1) * 1e3);
+
+    free_test_cfg(&cfg);
+    utstring_free(em);
+    test_cleanup();
+    return 0;
+}
@@ -0,0 +1,68 @@
+/*
+ * Scheduling benchmark for pmtr
+ * Measures the cost of the pass over the jobs that follows each event:
+ * visiting every job (do_jobs), as the main loop once did, against
+ * visiting only the job that the event queued (run_jobs).
+ *
+ * usage: bench_sched [jobs] [passes]
+ *
+ * The jobs are all running (with made-up pids) so that neither pass
+ * starts or signals anything; every tenth one bounces. Not run by ctest.
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "test_helpers.h"
+
+static double now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int main(int argc, char *argv[]) {
+    int njobs = (argc > 1) ? atoi(argv[1]) : 10000;
+    int passes = (argc > 2) ? atoi(argv[2]) : 1000;
+    double t0, full, queued;
+    char name[32];
+    pmtr_t cfg;
+    job_t job;
+    int i;
+
+    if (njobs < 1) njobs = 1;
+    init_test_cfg(&cfg);
+    for(i = 0; i < njobs; i++) {
+        job_ini(&job);
+        snprintf(name, sizeof(name), "job%d", i);
+        job.name = strdup(name);
+        job.pid = 100000 + i;
+        job.start_ts = time(NULL);
+        if (i % 10 == 0) job.bounce_interval = 3600;
+        utarray_push_back(cfg.jobs, &job);
+        job_fin(&job);
+    }
+    index_jobs(&cfg.jx, cfg.jobs);
+
+    t0 = now_sec();
+    for(i = 0; i < passes; i++) do_jobs(&cfg);
+    full = (now_sec() - t0) / passes;
+
+    t0 = now_sec();
+    for(i = 0; i < passes; i++) {
+        queue_job(&cfg, (job_t*)utarray_eltptr(cfg.jobs, i % njobs));
+        run_jobs(&cfg);
+    }
+    queued = (now_sec() - t0) / passes;
+
+    printf("%d passes over %d jobs, one job with work per pass\n", passes, njobs);
+    printf("  every job (do_jobs):    %10.2f usec/pass\n", full * 1e6);
+    printf("  queued jobs (run_jobs): %10.2f usec/pass\n", queued * 1e6);
+    printf("  speedup:                %10.0fx\n", full / queued);
+
+    free_test_cfg(&cfg);
+    return 0;
+}
@@ -0,0 +1,81 @@
+/*
+ * Spawn benchmark for pmtr
+ * Measures job starts per second with the child sharing our memory until
+ * it execs (SPAWN_VM) against it getting a copy, as it did under fork().
+ *
+ * usage: bench_spawn [count] [rss_mb]
+ *
+ * rss_mb grows the benchmark's own memory first, since the cost of the
+ * copy grows with the size of the supervisor. Not run by ctest.
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/wait.h>
+#include "test_helpers.h"
+#include "../src/spawn.h"
+
+static double now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* start the job count times, reaping each; returns starts per second */
+static double run(pmtr_t *cfg, job_t *job, int count, int how) {
+    double t0, t1;
+    pid_t pid;
+    int i, es;
+
+    t0 = now_sec();
+    for(i = 0; i < count; i++) {
+        pid = spawn_job(cfg, job, how);
+        if (pid == -1) {
+            fprintf(stderr, "spawn_job: %s\n", strerror(errno));
+            exit(-1);
+        }
+        waitpid(pid, &es, 0);
+    }
+    t1 = now_sec();
+    return count / (t1 - t0);
+}
+
+int main(int argc, char *argv[]) {
+    int count = (argc > 1) ? atoi(argv[1]) : 2000;
+    int rss_mb = (argc > 2) ? atoi(argv[2]) : 256;
+    char *ballast = NULL, *arg;
+    double copied, shared;
+    pmtr_t cfg;
+    job_t job;
+
+    if (rss_mb > 0) {
+        ballast = malloc((size_t)rss_mb << 20);
+        if (ballast == NULL) { fprintf(stderr, "out of memory\n"); return -1; }
+        memset(ballast, 1, (size_t)rss_mb << 20);
+    }
+
+    init_test_cfg(&cfg);
+    job_ini(&job);
+    job.name = strdup("bench");
+    arg = "/bin/true"; utarray_push_back(&job.cmdv, &arg);
+    utarray_extend_back(&job.cmdv);
+    job.out = strdup("/dev/null");
+    job.err = strdup("/dev/null");
+
+    copied = run(&cfg, &job, count, 0);
+    shared = run(&cfg, &job, count, SPAWN_VM);
+
+    printf("%d starts of /bin/true with %d MB resident\n", count, rss_mb);
+    printf("  copied memory (fork):   %10.0f starts/sec\n", copied);
+    printf("  shared memory (vfork):  %10.0f starts/sec\n", shared);
+    printf("  speedup:                %10.2fx\n", shared / copied);
+
+    job_fin(&job);
+    free_test_cfg(&cfg);
+    if (ballast) free(ballast);
+    return 0;
+}
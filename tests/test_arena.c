@@ -0,0 +1,176 @@
+/*
+ * Unit Tests for pmtr Arenas (arena.c)
+ * Tests the allocator, and that parsed jobs keep their strings in the
+ * arena of their parse across reloads
+ */
+
+#define _GNU_SOURCE
+#include "test_framework.h"
+#include "test_helpers.h"
+#include "../src/arena.h"
+
+/*
+ * arena Tests
+ */
+TEST_CASE(arena_strings) {
+    arena_t *a = arena_new();
+    TEST_ASSERT_NOT_NULL(a);
+
+    char *s = arena_strndup(a, "hello world", 5);
+    char *t = arena_strdup(a, "there");
+    TEST_ASSERT_STR_EQ("hello", s);
+    TEST_ASSERT_STR_EQ("there", t);
+    TEST_ASSERT(t == s + 6);  /* one after the other */
+    TEST_ASSERT_EQ(12, (int)a->bytes);
+
+    arena_unref(a);
+}
+
+TEST_CASE(arena_large_and_many) {
+    arena_t *a = arena_new();
+    char big[ARENA_CHUNK + 100], *s, *first;
+    int i;
+
+    first = arena_strdup(a, "first");
+    memset(big, 'x', sizeof(big) - 1);
+    big[sizeof(big) - 1] = '\0';
+    s = arena_strdup(a, big);
+    TEST_ASSERT_EQ(strlen(big), strlen(s));
+
+    /* a block of its own does not cut short the one being filled */
+    TEST_ASSERT(arena_strdup(a, "next") == first + 6);
+
+    for(i = 0; i < 100000; i++) {
+        s = arena_strdup(a, "some job string");
+        TEST_ASSERT_NOT_NULL(s);
+    }
+    TEST_ASSERT_STR_EQ("some job string", s);
+    TEST_ASSERT_STR_EQ("first", first);
+
+    arena_unref(a);
+}
+
+TEST_CASE(arena_refs) {
+    arena_t *a = arena_new();
+    TEST_ASSERT_EQ(1, (int)a->refs);
+    TEST_ASSERT(arena_ref(a) == a);
+    TEST_ASSERT_EQ(2, (int)a->refs);
+    arena_unref(a);
+    TEST_ASSERT_EQ(1, (int)a->refs);
+    arena_unref(a);
+    TEST_ASSERT_NULL(arena_ref(NULL));
+    arena_unref(NULL);
+}
+
+/*
+ * generation Tests
+ */
+static void parse_config(pmtr_t *cfg, const char *text) {
+    UT_string *em;
+    utstring_new(em);
+    create_temp_config(text);
+    TEST_ASSERT_EQ(0, parse_jobs(cfg, em));
+    utstring_free(em);
+}
+
+TEST_CASE(parse_jobs_share_arena) {
+    pmtr_t cfg;
+    TEST_ASSERT_EQ(0, test_init());
+    init_test_cfg(&cfg);
+    cfg.file = strdup(create_temp_config(NULL));
+
+    parse_config(&cfg,
+        "job {\n  name first\n  cmd /bin/sleep 10\n  env A=1\n  wait\n}\n"
+        "job {\n  name second\n  cmd /bin/echo \"a b\"\n  dir /tmp\n}\n");
+    TEST_ASSERT_EQ(2, job_count(&cfg));
+
+    job_t *a = get_job_by_name(&cfg.jx, "first");
+    job_t *b = get_job_by_name(&cfg.jx, "second");
+    TEST_ASSERT_NOT_NULL(a->arena);
+    TEST_ASSERT(a->arena == b->arena);
+    TEST_ASSERT_EQ(2, (int)a->arena->refs);  /* one per job */
+    TEST_ASSERT_STR_EQ("a b", ((char**)utarray_eltptr(&b->cmdv, 1))[0]);
+    TEST_ASSERT_STR_EQ("/tmp", b->dir);
+
+    /* the implied 'after' the wait job is its name, in the same arena */
+    TEST_ASSERT_EQ(1, utarray_len(&b->after));
+    TEST_ASSERT(*(char**)utarray_front(&b->after) == a->name);
+
+    /* a copy shares the strings and the arena */
+    job_t c;
+    job_cpy(&c, b);
+    TEST_ASSERT(c.dir == b->dir);
+    TEST_ASSERT_EQ(3, (int)a->arena->refs);
+    job_fin(&c);
+    TEST_ASSERT_EQ(2, (int)a->arena->refs);
+
+    free_test_cfg(&cfg);
+    test_cleanup();
+}
+
+TEST_CASE(reload_keeps_generation) {
+    pmtr_t cfg;
+    job_index pjx;
+    job_diff d;
+    TEST_ASSERT_EQ(0, test_init());
+    init_test_cfg(&cfg);
+    cfg.file = strdup(create_temp_config(NULL));
+
+    parse_config(&cfg,
+        "job {\n  name same\n  cmd /bin/sleep 1\n}\n"
+        "job {\n  name changed\n  cmd /bin/sleep 2\n}\n"
+        "job {\n  name gone\n  cmd /bin/sleep 3\n}\n");
+    arena_t *old = get_job_at(&cfg, 0)->arena;
+    get_job_by_name(&cfg.jx, "same")->pid = 1001;
+    get_job_by_name(&cfg.jx, "gone")->pid = 1003;
+
+    /* set aside the jobs, as rescan_config does */
+    UT_array *previous = cfg.jobs;
+    pjx = cfg.jx;
+    utarray_new(cfg.jobs, &job_mm);
+    memset(&cfg.jx, 0, sizeof(cfg.jx));
+    parse_config(&cfg,
+        "job {\n  name same\n  cmd /bin/sleep 1\n}\n"
+        "job {\n  name changed\n  cmd /bin/sleep 20\n}\n");
+    arena_t *new = get_job_at(&cfg, 0)->arena;
+    TEST_ASSERT(new != old);
+    merge_jobs(&cfg, previous, &pjx, &d);
+    TEST_ASSERT_EQ(1, d.unchanged);
+
+    /* the kept job and the one on its way out refer to the old generation */
+    job_t *j = get_job_by_name(&cfg.jx, "same");
+    TEST_ASSERT(j->arena == old);
+    TEST_ASSERT_EQ(1001, j->pid);
+    j = get_job_by_name(&cfg.jx, "gone(deleted)");
+    TEST_ASSERT_NOT_NULL(j);
+    TEST_ASSERT(j->arena == old);
+    TEST_ASSERT_EQ(2, (int)old->refs);
+    TEST_ASSERT(get_job_by_name(&cfg.jx, "changed")->arena == new);
+    TEST_ASSERT_EQ(1, (int)new->refs);
+
+    /* once the deleted job is collected, the kept one alone holds it */
+    erase_job(&cfg.jx, j);
+    TEST_ASSERT_EQ(1, (int)old->refs);
+
+    free_test_cfg(&cfg);
+    test_cleanup();
+}
+
+int main(int argc, char *argv[]) {
+    (void)argc; (void)argv;
+    printf("pmtr Arena Tests\n");
+
+    TEST_SUITE_BEGIN("arena");
+    RUN_TEST(arena_strings);
+    RUN_TEST(arena_large_and_many);
+    RUN_TEST(arena_refs);
+    TEST_SUITE_END();
+
+    TEST_SUITE_BEGIN("generations");
+    RUN_TEST(parse_jobs_share_arena);
+    RUN_TEST(reload_keeps_generation);
+    TEST_SUITE_END();
+
+    print_test_results();
+    return get_test_exit_code();
+}
@@ -0,0 +1,263 @@
+/*
+ * Unit Tests for pmtr Dependency Hashing (deps.c)
+ * Tests the hash function and the cache of dependency file hashes
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <sys/stat.h>
+#include "test_framework.h"
+#include "../src/deps.h"
+
+static char tmpdir[64];
+
+static char *write_file(const char *name, const char *content, size_t len) {
+    static char path[128];
+    snprintf(path, sizeof(path), "%s/%s", tmpdir, name);
+    FILE *f = fopen(path, "w");
+    if (f == NULL) return NULL;
+    fwrite(content, 1, len, f);
+    fclose(f);
+    return path;
+}
+
+/* set the mtime of a file to some seconds ago */
+static void age_file(const char *path, int secs) {
+    struct timespec ts[2];
+    clock_gettime(CLOCK_REALTIME, &ts[0]);
+    ts[0].tv_sec -= secs;
+    ts[1] = ts[0];
+    utimensat(AT_FDCWD, path, ts, 0);
+}
+
+/*
+ * hash64 Tests
+ */
+TEST_CASE(hash64_known_values) {
+    /* the published XXH64 values, seed 0 */
+    TEST_ASSERT(hash64("", 0, 0) == 0xEF46DB3751D8E999ULL);
+    TEST_ASSERT(hash64("abc", 3, 0) == 0x44BC2CF5AD770999ULL);
+}
+
+TEST_CASE(hash64_pieces_match_whole) {
+    unsigned char data[1000];
+    size_t i, k, cut[] = {0, 1, 7, 31, 32, 33, 64, 500, 995};
+    hash64_t h;
+
+    for(i = 0; i < sizeof(data); i++) data[i] = (unsigned char)(i * 7 + 3);
+    uint64_t whole = hash64(data, sizeof(data), 0);
+
+    /* three pieces: up to the cut, five bytes, and the rest */
+    for(i = 0; i < sizeof(cut)/sizeof(*cut); i++) {
+        k = cut[i] + 5;
+        h64_init(&h, 0);
+        h64_update(&h, data, cut[i]);
+        h64_update(&h, data + cut[i], 5);
+        h64_update(&h, data + k, sizeof(data) - k);
+        TEST_ASSERT(h64_final(&h) == whole);
+    }
+}
+
+TEST_CASE(hash64_seed_and_content) {
+    TEST_ASSERT(hash64("abc", 3, 0) != hash64("abc", 3, 1));
+    TEST_ASSERT(hash64("abc", 3, 0) != hash64("abd", 3, 0));
+}
+
+/*
+ * dep_hash Tests
+ */
+TEST_CASE(dep_hash_reuses_unchanged) {
+    dep_cache dc;
+    uint64_t h1, h2;
+    memset(&dc, 0, sizeof(dc));
+
+    char *path = write_file("a", "version=1", 9);
+    age_file(path, 10);
+    TEST_ASSERT_EQ(0, dep_hash(&dc, path, &h1));
+    TEST_ASSERT_EQ(1, (int)dc.reads);
+    TEST_ASSERT(h1 == hash64("version=1", 9, 0));
+
+    /* unchanged: not read again */
+    TEST_ASSERT_EQ(0, dep_hash(&dc, path, &h2));
+    TEST_ASSERT_EQ(1, (int)dc.reads);
+    TEST_ASSERT(h1 == h2);
+
+    /* same size, new mtime: read again */
+    write_file("a", "version=2", 9);
+    age_file(path, 5);
+    TEST_ASSERT_EQ(0, dep_hash(&dc, path, &h2));
+    TEST_ASSERT_EQ(2, (int)dc.reads);
+    TEST_ASSERT(h1 != h2);
+
+    dep_clear(&dc);
+}
+
+/* a file modified just before it was hashed could be modified again
+ * within the same mtime, so it is not trusted until it is older */
+TEST_CASE(dep_hash_recent_file_is_reread) {
+    dep_cache dc;
+    uint64_t h1, h2;
+    memset(&dc, 0, sizeof(dc));
+
+    char *path = write_file("b", "version=1", 9);
+    TEST_ASSERT_EQ(0, dep_hash(&dc, path, &h1));
+    write_file("b", "version=2", 9);
+    age_file(path, 0);
+    TEST_ASSERT_EQ(0, dep_hash(&dc, path, &h2));
+    TEST_ASSERT_EQ(2, (int)dc.reads);
+    TEST_ASSERT(h1 != h2);
+
+    dep_clear(&dc);
+}
+
+TEST_CASE(dep_hash_empty_and_missing) {
+    dep_cache dc;
+    uint64_t h;
+    memset(&dc, 0, sizeof(dc));
+
+    char *path = write_file("empty", "", 0);
+    TEST_ASSERT_EQ(0, dep_hash(&dc, path, &h));
+    TEST_ASSERT(h == 0);
+
+    snprintf(path, 128, "%s/missing", tmpdir);
+    TEST_ASSERT_EQ(-1, dep_hash(&dc, path, &h));
+
+    dep_clear(&dc);
+}
+
+/* a file larger than one read, hashed in pieces */
+TEST_CASE(dep_hash_large_file) {
+    dep_cache dc;
+    size_t len = 1000000, i;
+    uint64_t h;
+    memset(&dc, 0, sizeof(dc));
+
+    char *data = malloc(len);
+    for(i = 0; i < len; i++) data[i] = (char)(i % 251);
+    char *path = write_file("large", data, len);
+    TEST_ASSERT_EQ(0, dep_hash(&dc, path, &h));
+    TEST_ASSERT(h == hash64(data, len, 0));
+
+    free(data);
+    dep_clear(&dc);
+}
+
+TEST_CASE(dep_hash_many_files) {
+    dep_cache dc;
+    char name[128];
+    uint64_t h;
+    int i;
+    memset(&dc, 0, sizeof(dc));
+
+    for(i = 0; i < 100; i++) {
+        snprintf(name, sizeof(name), "f%d", i);
+        char *path = write_file(name, name, strlen(name));
+        age_file(path, 10);
+        TEST_ASSERT_EQ(0, dep_hash(&dc, path, &h));
+    }
+    TEST_ASSERT_EQ(100, (int)dc.n);
+    for(i = 0; i < 100; i++) {
+        snprintf(name, sizeof(name), "%s/f%d", tmpdir, i);
+        TEST_ASSERT_EQ(0, dep_hash(&dc, name, &h));
+        snprintf(name, sizeof(name), "f%d", i);
+        TEST_ASSERT(h == hash64(name, strlen(name), 0));
+    }
+    TEST_ASSERT_EQ(100, (int)dc.reads);
+
+    dep_clear(&dc);
+}
+
+/*
+ * dep_pass / dep_prune Tests
+ */
+TEST_CASE(dep_pass_looks_once) {
+    dep_cache dc;
+    uint64_t h;
+    int i;
+    memset(&dc, 0, sizeof(dc));
+
+    char *path = write_file("shared", "shared", 6);
+    dep_pass(&dc);
+    for(i = 0; i < 400; i++) TEST_ASSERT_EQ(0, dep_hash(&dc, path, &h));
+    TEST_ASSERT_EQ(1, (int)dc.stats);
+    TEST_ASSERT_EQ(1, (int)dc.reads);
+
+    /* a failure is remembered for the pass too */
+    snprintf(path, 128, "%s/missing", tmpdir);
+    for(i = 0; i < 10; i++) TEST_ASSERT_EQ(-1, dep_hash(&dc, path, &h));
+    TEST_ASSERT_EQ(2, (int)dc.stats);
+
+    /* the next pass looks again */
+    dep_pass(&dc);
+    TEST_ASSERT_EQ(-1, dep_hash(&dc, path, &h));
+    TEST_ASSERT_EQ(3, (int)dc.stats);
+
+    dep_clear(&dc);
+}
+
+TEST_CASE(dep_prune_forgets_unused) {
+    dep_cache dc;
+    uint64_t h;
+    char a[128], b[128];
+    memset(&dc, 0, sizeof(dc));
+
+    strcpy(a, write_file("a", "a", 1));
+    strcpy(b, write_file("b", "b", 1));
+    age_file(a, 10);
+    dep_pass(&dc);
+    dep_hash(&dc, a, &h);
+    dep_hash(&dc, b, &h);
+    dep_prune(&dc);
+    TEST_ASSERT_EQ(2, (int)dc.n);
+
+    dep_pass(&dc);
+    dep_hash(&dc, a, &h);
+    dep_prune(&dc);
+    TEST_ASSERT_EQ(1, (int)dc.n);
+    TEST_ASSERT_EQ(2, (int)dc.reads);  /* a was kept; not read again */
+
+    dep_pass(&dc);
+    dep_hash(&dc, a, &h);
+    TEST_ASSERT_EQ(2, (int)dc.reads);
+
+    dep_clear(&dc);
+}
+
+int main(int argc, char *argv[]) {
+    (void)argc; (void)argv;
+    printf("pmtr Dependency Hashing Tests\n");
+
+    snprintf(tmpdir, sizeof(tmpdir), "/tmp/pmtr_deps_XXXXXX");
+    if (mkdtemp(tmpdir) == NULL) { perror("mkdtemp"); return 1; }
+
+    TEST_SUITE_BEGIN("hash64");
+    RUN_TEST(hash64_known_values);
+    RUN_TEST(hash64_pieces_match_whole);
+    RUN_TEST(hash64_seed_and_content);
+    TEST_SUITE_END();
+
+    TEST_SUITE_BEGIN("dep_hash");
+    RUN_TEST(dep_hash_reuses_unchanged);
+    RUN_TEST(dep_hash_recent_file_is_reread);
+    RUN_TEST(dep_hash_empty_and_missing);
+    RUN_TEST(dep_hash_large_file);
+    RUN_TEST(dep_hash_many_files);
+    TEST_SUITE_END();
+
+    TEST_SUITE_BEGIN("dep_pass / dep_prune");
+    RUN_TEST(dep_pass_looks_once);
+    RUN_TEST(dep_prune_forgets_unused);
+    TEST_SUITE_END();
+
+    char cmd[128];
+    snprintf(cmd, sizeof(cmd), "rm -rf %s", tmpdir);
+    if (system(cmd) != 0) fprintf(stderr, "can't remove %s\n", tmpdir);
+
+    print_test_results();
+    return get_test_exit_code();
+}
@@ -57,6 +57,22 @@ test_config_validation() {
     else
         fail "invalid config accepted"
     fi
+
+    # -t shows the cpus that the pinned jobs resolved to
+    printf 'job {\n  name pinned\n  cmd /bin/true\n  cpu 0\n}\n' > "$TEST_DIR/cpu.conf"
+    if "$PMTR" -t -c "$TEST_DIR/cpu.conf" 2>/dev/null | grep -q "^pinned: cpu 0$"; then
+        pass "resolved cpus shown"
+    else
+        fail "resolved cpus not shown"
+    fi
+
+    # and a selector that names no cpus on this host, so the job is unpinned
+    printf 'job {\n  name none\n  cmd /bin/true\n  cpu node999\n}\n' > "$TEST_DIR/cpu.conf"
+    if "$PMTR" -t -c "$TEST_DIR/cpu.conf" 2>/dev/null | grep -q "^none: cpu -$"; then
+        pass "cpus that resolved to none shown"
+    else
+        fail "cpus that resolved to none not shown"
+    fi
 }
 
 # Test 2: Basic job execution
@@ -516,7 +532,52 @@ EOF
     pkill -9 -f "sleep 7[456]" 2>/dev/null || true
 }
 
-# Test 14: Exit code 33 prevents respawn
+# Test 14: after keyword (start once prerequisites are ready)
+test_after_keyword() {
+    echo "Test: after keyword (parallel prerequisites)"
+    test_cleanup
+
+    # A wait job and a job listed before it have no relation to each other,
+    # so they start side by side; the main job, listed first, starts once
+    # the one is running and the other has finished
+    cat > "$TEST_DIR/after.conf" << EOF
+job {
+    name main_job
+    after setup server
+    cmd /bin/sh -c "echo main >> $TEST_DIR/after.txt; sleep 77"
+}
+job {
+    name server
+    cmd /bin/sh -c "echo server >> $TEST_DIR/after.txt; sleep 77"
+}
+job {
+    name setup
+    wait
+    once
+    cmd /bin/sh -c "echo start >> $TEST_DIR/after.txt; sleep 1; echo done >> $TEST_DIR/after.txt"
+}
+EOF
+
+    rm -f "$TEST_DIR/after.txt"
+
+    "$PMTR" -F -c "$TEST_DIR/after.conf" &
+    PMTR_PID=$!
+
+    sleep 3
+
+    ORDER=$(tr '\n' ' ' < "$TEST_DIR/after.txt" 2>/dev/null || true)
+    if [ "$ORDER" = "server start done main " ] || [ "$ORDER" = "start server done main " ]; then
+        pass "prerequisites ran in parallel and main job started after them"
+    else
+        fail "unexpected start sequence: $ORDER"
+    fi
+
+    kill -TERM $PMTR_PID 2>/dev/null || true
+    sleep 1
+    pkill -9 -f "sleep 77" 2>/dev/null || true
+}
+
+# Test 15: Exit code 33 prevents respawn
 test_exit_code_no_restart() {
     echo "Test: exit code 33 prevents respawn"
     test_cleanup
@@ -551,7 +612,7 @@ EOF
     sleep 1
 }
 
-# Test 15: Graceful shutdown terminates all jobs
+# Test 16: Graceful shutdown terminates all jobs
 test_graceful_shutdown() {
     echo "Test: graceful shutdown terminates all jobs"
     test_cleanup
@@ -613,6 +674,7 @@ test_environment_variables
 test_output_redirection
 test_wait_flag
 test_job_order
+test_after_keyword
 test_exit_code_no_restart
 test_graceful_shutdown
 
@@ -0,0 +1,390 @@
+/*
+ * Unit Tests for pmtr Included Files (frag.c)
+ * Tests "include" of a directory or a pattern of files, each parsed on its
+ * own, and parsed again on a rescan only if its text changed
+ */
+
+#define _GNU_SOURCE
+#include "test_framework.h"
+#include "test_helpers.h"
+
+static char dir[512];
+
+static void setup(void) {
+    char path[600];
+
+    TEST_ASSERT_EQ(0, test_init());
+    snprintf(path, sizeof(path), "%s/conf.d", g_test_tmpdir);
+    TEST_ASSERT_EQ(0, mkdir(path, 0755));
+    snprintf(path, sizeof(path), "%s/more", g_test_tmpdir);
+    TEST_ASSERT_EQ(0, mkdir(path, 0755));
+    snprintf(dir, sizeof(dir), "%s/conf.d/", g_test_tmpdir);
+}
+
+static void put_job(const char *file, const char *name, const char *extra) {
+    char text[256];
+    snprintf(text, sizeof(text), "job {\n  name %s\n  cmd /bin/true\n%s}\n",
+             name, extra ? extra : "");
+    create_temp_file(file, text);
+}
+
+/* parses pmtr.conf again into a new job array, as rescan_config does */
+static int rescan(pmtr_t *cfg, UT_string *em) {
+    UT_array *jobs = cfg->jobs;
+    int rc;
+
+    utarray_new(cfg->jobs, &job_mm);
+    index_free(&cfg->jx);
+    utstring_clear(em);
+    rc = parse_jobs(cfg, em);
+    if (rc < 0) {
+        utarray_free(cfg->jobs);
+        cfg->jobs = jobs;
+        index_jobs(&cfg->jx, cfg->jobs);
+    } else {
+        utarray_free(jobs);
+    }
+    return rc;
+}
+
+static arena_t *arena_of(pmtr_t *cfg, char *name) {
+    job_t *job = get_job_by_name(&cfg->jx, name);
+    return job ? job->arena : NULL;
+}
+
+/*
+ * include Tests
+ */
+TEST_CASE(include_directory_and_pattern) {
+    pmtr_t cfg;
+    UT_string *em;
+    job_t *job;
+
+    setup();
+    utstring_new(em);
+    put_job("conf.d/a", "a", "  after main\n");
+    put_job("conf.d/.hidden", "hidden", NULL);
+    put_job("more/b.conf", "b", NULL);
+    put_job("more/c.txt", "c", NULL);
+    init_test_cfg(&cfg);
+    cfg.file = strdup(create_temp_config(
+        "job {\n  name main\n  cmd /bin/true\n}\n"
+        "include conf.d\n"
+        "include more/*.conf\n"));
+
+    TEST_ASSERT_EQ(0, parse_jobs(&cfg, em));
+    TEST_ASSERT_EQ(3, job_count(&cfg));
+    TEST_ASSERT_NOT_NULL(get_job_by_name(&cfg.jx, "a"));
+    TEST_ASSERT_NOT_NULL(get_job_by_name(&cfg.jx, "b"));
+    TEST_ASSERT_NULL(get_job_by_name(&cfg.jx, "hidden"));
+    TEST_ASSERT_NULL(get_job_by_name(&cfg.jx, "c"));
+
+    /* the jobs are ordered as one, across the files */
+    job = get_job_at(&cfg, 0);
+    TEST_ASSERT_STR_EQ("main", job->name);
+
+    /* each file is parsed into an arena of its own */
+    TEST_ASSERT(arena_of(&cfg, "a") != arena_of(&cfg, "main"));
+    TEST_ASSERT(arena_of(&cfg, "a") != arena_of(&cfg, "b"));
+    TEST_ASSERT_EQ(2, utarray_len(cfg.inc.frags));
+
+    /* a change to any of them, or to where they come from, is a rescan */
+    TEST_ASSERT(is_config(&cfg, cfg.file));
+    TEST_ASSERT(is_config(&cfg, dir));
+    TEST_ASSERT(is_config(&cfg, ((frag_t*)utarray_front(cfg.inc.frags))->path));
+    TEST_ASSERT(!is_config(&cfg, "/etc/passwd"));
+
+    utstring_free(em);
+    free_test_cfg(&cfg);
+    test_cleanup();
+}
+
+TEST_CASE(include_reparses_changed_files) {
+    pmtr_t cfg;
+    UT_string *em;
+    arena_t *a, *b;
+    uint64_t version;
+    char path[600];
+
+    setup();
+    utstring_new(em);
+    put_job("conf.d/a", "a", NULL);
+    put_job("conf.d/b", "b", NULL);
+    init_test_cfg(&cfg);
+    cfg.file = strdup(create_temp_config("include conf.d\n"));
+    TEST_ASSERT_EQ(0, parse_jobs(&cfg, em));
+    TEST_ASSERT_EQ(2, job_count(&cfg));
+    a = arena_of(&cfg, "a");
+    b = arena_of(&cfg, "b");
+    version = cfg.version;
+
+    /* unchanged, nothing is parsed again */
+    TEST_ASSERT_EQ(0, rescan(&cfg, em));
+    TEST_ASSERT(a == arena_of(&cfg, "a"));
+    TEST_ASSERT(b == arena_of(&cfg, "b"));
+    TEST_ASSERT(version == cfg.version);
+
+    /* just the file that changed is */
+    put_job("conf.d/b", "b", "  nice 5\n");
+    TEST_ASSERT_EQ(0, rescan(&cfg, em));
+    TEST_ASSERT(a == arena_of(&cfg, "a"));
+    TEST_ASSERT(b != arena_of(&cfg, "b"));
+    TEST_ASSERT_EQ(5, get_job_by_name(&cfg.jx, "b")->nice);
+    TEST_ASSERT(version != cfg.version);
+
+    /* files come and go */
+    put_job("conf.d/c", "c", NULL);
+    snprintf(path, sizeof(path), "%sa", dir);
+    TEST_ASSERT_EQ(0, unlink(path));
+    TEST_ASSERT_EQ(0, rescan(&cfg, em));
+    TEST_ASSERT_EQ(2, job_count(&cfg));
+    TEST_ASSERT_NULL(get_job_by_name(&cfg.jx, "a"));
+    TEST_ASSERT_NOT_NULL(get_job_by_name(&cfg.jx, "c"));
+    TEST_ASSERT_EQ(2, utarray_len(cfg.inc.frags));
+
+    /* without the include, they are forgotten */
+    create_temp_config("job {\n  name main\n  cmd /bin/true\n}\n");
+    TEST_ASSERT_EQ(0, rescan(&cfg, em));
+    TEST_ASSERT_EQ(1, job_count(&cfg));
+    TEST_ASSERT_NULL(cfg.inc.frags);
+
+    utstring_free(em);
+    free_test_cfg(&cfg);
+    test_cleanup();
+}
+
+TEST_CASE(include_errors) {
+    pmtr_t cfg;
+    UT_string *em;
+    arena_t *a;
+
+    setup();
+    utstring_new(em);
+    put_job("conf.d/a", "a", NULL);
+    put_job("conf.d/b", "b", NULL);
+    init_test_cfg(&cfg);
+    cfg.file = strdup(create_temp_config("include conf.d\n"));
+    TEST_ASSERT_EQ(0, parse_jobs(&cfg, em));
+    a = arena_of(&cfg, "a");
+
+    /* an error names the included file it is in */
+    create_temp_file("conf.d/b", "job {\n  name b\n  bogus\n}\n");
+    TEST_ASSERT_EQ(-1, rescan(&cfg, em));
+    TEST_ASSERT(strstr(utstring_body(em), "conf.d/b line 3") != NULL);
+
+    /* the last parse is kept, and used once the file is fixed */
+    TEST_ASSERT_EQ(2, job_count(&cfg));
+    put_job("conf.d/b", "b", NULL);
+    TEST_ASSERT_EQ(0, rescan(&cfg, em));
+    TEST_ASSERT(a == arena_of(&cfg, "a"));
+
+    /* an included file has jobs only */
+    create_temp_file("conf.d/b", "listen on udp://127.0.0.1:0\n");
+    TEST_ASSERT_EQ(-1, rescan(&cfg, em));
+    TEST_ASSERT(strstr(utstring_body(em), "listen") != NULL);
+    create_temp_file("conf.d/b", "include /etc\n");
+    TEST_ASSERT_EQ(-1, rescan(&cfg, em));
+    TEST_ASSERT(strstr(utstring_body(em), "include") != NULL);
+
+    /* a job name is used once, across the files */
+    put_job("conf.d/b", "a", NULL);
+    TEST_ASSERT_EQ(-1, rescan(&cfg, em));
+    TEST_ASSERT(strstr(utstring_body(em), "job a is in both") != NULL);
+
+    utstring_free(em);
+    free_test_cfg(&cfg);
+    test_cleanup();
+}
+
+/* a pattern that can't be expanded fails the parse, and a rescan keeps
+ * the last one */
+TEST_CASE(include_expand_fails) {
+    pmtr_t cfg;
+    UT_string *em;
+    char text[PATH_MAX + 64];
+
+    setup();
+    utstring_new(em);
+    put_job("conf.d/a", "a", NULL);
+    init_test_cfg(&cfg);
+    cfg.file = strdup(create_temp_config("include conf.d\n"));
+    TEST_ASSERT_EQ(0, parse_jobs(&cfg, em));
+
+    memset(text, 'x', sizeof(text));
+    memcpy(text, "include ", 8);
+    strcpy(text + PATH_MAX + 8, "\n");
+    create_temp_config(text);
+    TEST_ASSERT_EQ(-1, rescan(&cfg, em));
+    TEST_ASSERT(strstr(utstring_body(em), "path too long") != NULL);
+    TEST_ASSERT_EQ(1, job_count(&cfg));
+    TEST_ASSERT_NOT_NULL(get_job_by_name(&cfg.jx, "a"));
+
+    utstring_free(em);
+    free_test_cfg(&cfg);
+    test_cleanup();
+}
+
+/* a wait job in pmtr.conf holds up a job in an included file. a reload
+ * that changes the wait job keeps the other, which still names it */
+TEST_CASE(include_after_wait_reload) {
+    pmtr_t cfg;
+    UT_string *em;
+    UT_array *previous;
+    job_index pjx;
+    job_diff d;
+    job_t *a;
+
+    setup();
+    utstring_new(em);
+    put_job("conf.d/a", "a", NULL);
+    init_test_cfg(&cfg);
+    cfg.file = strdup(create_temp_config(
+        "job {\n  name w\n  cmd /bin/true\n  wait\n}\n"
+        "include conf.d\n"));
+    TEST_ASSERT_EQ(0, parse_jobs(&cfg, em));
+
+    /* reload, as rescan_config does */
+    previous = cfg.jobs;
+    pjx = cfg.jx;
+    utarray_new(cfg.jobs, &job_mm);
+    memset(&cfg.jx, 0, sizeof(cfg.jx));
+    create_temp_config(
+        "job {\n  name w\n  cmd /bin/echo\n  wait\n}\n"
+        "include conf.d\n");
+    TEST_ASSERT_EQ(0, parse_jobs(&cfg, em));
+    merge_jobs(&cfg, previous, &pjx, &d);
+    TEST_ASSERT_EQ(1, d.changed);
+    TEST_ASSERT_EQ(1, d.unchanged);
+
+    a = get_job_by_name(&cfg.jx, "a");
+    TEST_ASSERT_EQ(1, utarray_len(&a->after));
+    TEST_ASSERT_STR_EQ("w", *(char**)utarray_front(&a->after));
+    TEST_ASSERT(get_job_by_name(&cfg.jx, *(char**)utarray_front(&a->after))
+                == get_job_by_name(&cfg.jx, "w"));
+
+    utstring_free(em);
+    free_test_cfg(&cfg);
+    test_cleanup();
+}
+
+/* a file whose cpus came from the topology is parsed again when it changes,
+ * though its text has not */
+TEST_CASE(include_reresolves_topology) {
+    char root[600], path[700];
+    pmtr_t cfg;
+    UT_string *em;
+    arena_t *a, *b;
+
+    setup();
+    utstring_new(em);
+    snprintf(root, sizeof(root), "%s/sys", g_test_tmpdir);
+    TEST_ASSERT_EQ(0, mkdir(root, 0755));
+    snprintf(path, sizeof(path), "%s/node", root);
+    TEST_ASSERT_EQ(0, mkdir(path, 0755));
+    snprintf(path, sizeof(path), "%s/node/node0", root);
+    TEST_ASSERT_EQ(0, mkdir(path, 0755));
+    create_temp_file("sys/node/node0/cpulist", "0\n");
+    put_job("conf.d/a", "a", "  cpu node0\n");
+    put_job("conf.d/b", "b", NULL);
+    init_test_cfg(&cfg);
+    cfg.sysfs = root;
+    cfg.file = strdup(create_temp_config("include conf.d\n"));
+    TEST_ASSERT_EQ(0, parse_jobs(&cfg, em));
+    TEST_ASSERT(CPU_ISSET(0, &get_job_by_name(&cfg.jx, "a")->cpuset));
+    a = arena_of(&cfg, "a");
+    b = arena_of(&cfg, "b");
+
+    /* the same topology, nothing is parsed again */
+    TEST_ASSERT_EQ(0, rescan(&cfg, em));
+    TEST_ASSERT(a == arena_of(&cfg, "a"));
+    TEST_ASSERT(b == arena_of(&cfg, "b"));
+
+    /* node0 moved; only the file that resolved it is parsed again */
+    create_temp_file("sys/node/node0/cpulist", "1\n");
+    TEST_ASSERT_EQ(0, rescan(&cfg, em));
+    TEST_ASSERT(a != arena_of(&cfg, "a"));
+    TEST_ASSERT(b == arena_of(&cfg, "b"));
+    TEST_ASSERT(CPU_ISSET(1, &get_job_by_name(&cfg.jx, "a")->cpuset));
+    TEST_ASSERT(!CPU_ISSET(0, &get_job_by_name(&cfg.jx, "a")->cpuset));
+
+    utstring_free(em);
+    free_test_cfg(&cfg);
+    test_cleanup();
+}
+
+TEST_CASE(include_nothing_there) {
+    pmtr_t cfg;
+    UT_string *em;
+    char path[600];
+
+    setup();
+    utstring_new(em);
+    init_test_cfg(&cfg);
+    cfg.file = strdup(create_temp_config(
+        "include absent.d\n"
+        "include conf.d/*.conf\n"));
+    TEST_ASSERT_EQ(0, parse_jobs(&cfg, em));
+    TEST_ASSERT_EQ(0, job_count(&cfg));
+
+    /* the path that may yet appear is watched, and the directory */
+    snprintf(path, sizeof(path), "%s/absent.d", g_test_tmpdir);
+    TEST_ASSERT(is_config(&cfg, path));
+    TEST_ASSERT(is_config(&cfg, dir));
+
+    utstring_free(em);
+    free_test_cfg(&cfg);
+    test_cleanup();
+}
+
+/* more files than threads, each parsed the same as on one thread */
+TEST_CASE(include_many_files) {
+    pmtr_t cfg;
+    UT_string *em;
+    char name[64], text[256];
+    job_t *job;
+    int i, n = 200;
+
+    setup();
+    utstring_new(em);
+    for(i = 0; i < n; i++) {
+        snprintf(name, sizeof(name), "conf.d/%03d.conf", i);
+        snprintf(text, sizeof(text), "job {\n  name j%d\n  cmd /bin/echo %d\n"
+                 "  order %d\n}\n", i, i, n - i);
+        create_temp_file(name, text);
+    }
+    init_test_cfg(&cfg);
+    cfg.file = strdup(create_temp_config("include conf.d\n"));
+    TEST_ASSERT_EQ(0, parse_jobs(&cfg, em));
+    TEST_ASSERT_EQ(n, job_count(&cfg));
+    for(i = 0; i < n; i++) {
+        snprintf(name, sizeof(name), "j%d", i);
+        job = get_job_by_name(&cfg.jx, name);
+        TEST_ASSERT_NOT_NULL(job);
+        snprintf(text, sizeof(text), "%d", i);
+        TEST_ASSERT_STR_EQ(text, *(char**)utarray_eltptr(&job->cmdv, 1));
+    }
+    TEST_ASSERT_STR_EQ("j199", get_job_at(&cfg, 0)->name);  /* by order */
+
+    utstring_free(em);
+    free_test_cfg(&cfg);
+    test_cleanup();
+}
+
+int main(int argc, char *argv[]) {
+    (void)argc; (void)argv;
+    printf("pmtr Included File Tests\n");
+
+    TEST_SUITE_BEGIN("include");
+    RUN_TEST(include_directory_and_pattern);
+    RUN_TEST(include_reparses_changed_files);
+    RUN_TEST(include_errors);
+    RUN_TEST(include_expand_fails);
+    RUN_TEST(include_after_wait_reload);
+    RUN_TEST(include_reresolves_topology);
+    RUN_TEST(include_nothing_there);
+    RUN_TEST(include_many_files);
+    TEST_SUITE_END();
+
+    print_test_results();
+    return get_test_exit_code();
+}
@@ -26,6 +26,9 @@
 #include "../src/job.h"
 #include "../src/net.h"
 #include "../src/cfg.h"
+#include "../src/watch.h"
+#include "../src/frag.h"
+#include "../src/topo.h"
 
 /* External declaration for job_ini (defined in job.c but not in job.h) */
 void job_ini(job_t *job);
@@ -92,7 +95,15 @@ static inline char *create_temp_file(const char *name, const char *content) {
 /* Initialize a pmtr_t config structure for testing */
 static inline void init_test_cfg(pmtr_t *cfg) {
     memset(cfg, 0, sizeof(*cfg));
+    cfg->signal_fd = -1;
+    cfg->epoll_fd = -1;
+    cfg->timer_fd = -1;
+    cfg->wt.fd = -1;
     utarray_new(cfg->jobs, &job_mm);
+    index_jobs(&cfg->jx, cfg->jobs);
+    utarray_new(cfg->stopping, &ut_str_icd);
+    utarray_new(cfg->ready, &ut_str_icd);
+    utarray_new(cfg->blocked, &ut_str_icd);
     utarray_new(cfg->listen, &ut_int_icd);
     utarray_new(cfg->report, &ut_int_icd);
     utstring_new(cfg->s);
@@ -101,10 +112,21 @@ static inline void init_test_cfg(pmtr_t *cfg) {
 /* Free a pmtr_t config structure */
 static inline void free_test_cfg(pmtr_t *cfg) {
     if (cfg->jobs) utarray_free(cfg->jobs);
+    index_free(&cfg->jx);
+    if (cfg->stopping) utarray_free(cfg->stopping);
+    if (cfg->ready) utarray_free(cfg->ready);
+    if (cfg->blocked) utarray_free(cfg->blocked);
     if (cfg->listen) utarray_free(cfg->listen);
     if (cfg->report) utarray_free(cfg->report);
+    if (cfg->listen_spec) utarray_free(cfg->listen_spec);
+    if (cfg->report_spec) utarray_free(cfg->report_spec);
+    includes_free(cfg);
+    if (cfg->image) free(cfg->image);
     if (cfg->s) utstring_free(cfg->s);
     if (cfg->file) free(cfg->file);
+    watch_fin(cfg);
+    tw_clear(&cfg->tw);
+    dep_clear(&cfg->dc);
 }
 
 /* Initialize a parse_t structure for testing setters */
@@ -114,6 +136,11 @@ static inline void init_test_parse(parse_t *ps, pmtr_t *cfg, job_t *job, UT_stri
     ps->em = em;
     ps->job = job;
     ps->cfg = cfg;
+    ps->file = cfg->file;
+    ps->jobs = cfg->jobs;
+    ps->include = 0;
+    ps->instances = 0;
+    ps->cpu_spec = NULL;
 }
 
 /* Get job from config by index */
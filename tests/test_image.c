@@ -0,0 +1,267 @@
+/*
+ * Unit Tests for pmtr Compiled Configs (image.c)
+ * Tests writing the image of a parsed config, and loading the jobs from it
+ * in place of parsing when it is of the same text
+ */
+
+#define _GNU_SOURCE
+#include "test_framework.h"
+#include "test_helpers.h"
+#include "../src/image.h"
+
+static const char *conf =
+    "report to udp://127.0.0.1:9\n"
+    "listen on udp://127.0.0.1:0\n"
+    "job {\n  name db\n  cmd /bin/sleep 10\n  wait\n  user root\n}\n"
+    "job {\n  name app\n  cmd /bin/echo \"hello world\" x\n  env A=1\n"
+    "  env B=2\n  dir /tmp\n  out app.log\n  err app.err\n  in /dev/null\n"
+    "  ulimit -n 1024\n  nice 5\n  order 3\n  cpu 0x3\n  depends {\n"
+    "    app.conf\n  }\n  bounce every 1h\n  backoff 2s 1m 1.5\n"
+    "  jitter 10%\n  breaker 5 5m\n}\n"
+    "job {\n  name off\n  cmd /bin/true\n  disable\n  once\n}\n";
+
+static char image[512];
+
+/* compile the config, as pmtr -t -C does */
+static void compile(const char *text) {
+    pmtr_t cfg;
+    UT_string *em;
+
+    init_test_cfg(&cfg);
+    utstring_new(em);
+    cfg.test_only = 1;
+    cfg.image = strdup(image);
+    cfg.file = strdup(create_temp_config(text));
+    TEST_ASSERT_EQ(0, parse_jobs(&cfg, em));
+    utstring_free(em);
+    free_test_cfg(&cfg);
+}
+
+static void setup(void) {
+    TEST_ASSERT_EQ(0, test_init());
+    snprintf(image, sizeof(image), "%s/pmtr.img", g_test_tmpdir);
+    create_temp_file("app.conf", "settings");
+}
+
+/* the hash and size of the text of the config, as parse_jobs keys it */
+static int load(pmtr_t *cfg, const char *text, UT_string *em) {
+    return image_load(cfg, hash64(text, strlen(text), 0), strlen(text), em);
+}
+
+/*
+ * image Tests
+ */
+TEST_CASE(image_matches_parse) {
+    pmtr_t p, l;
+    UT_string *em;
+    job_t *a, *b;
+
+    setup();
+    utstring_new(em);
+    compile(conf);
+
+    init_test_cfg(&p);
+    p.file = strdup(create_temp_config(conf));
+    TEST_ASSERT_EQ(0, parse_jobs(&p, em));
+
+    /* the image is of this text; the jobs loaded from it are then ordered
+     * along with those of any included files, as parsed ones are */
+    init_test_cfg(&l);
+    l.image = strdup(image);
+    TEST_ASSERT_EQ(0, load(&l, conf, em));
+    TEST_ASSERT_EQ(3, job_count(&l));
+    close_sockets(&l);
+    free_test_cfg(&l);
+
+    init_test_cfg(&l);
+    l.image = strdup(image);
+    l.file = strdup(p.file);
+    TEST_ASSERT_EQ(0, parse_jobs(&l, em));
+    TEST_ASSERT_EQ(job_count(&p), job_count(&l));
+
+    /* the same jobs in the same order, field for field (PMTR_CHECK_FP) */
+    a = NULL; b = NULL;
+    while ( (a = (job_t*)utarray_next(p.jobs, a))) {
+        b = (job_t*)utarray_next(l.jobs, b);
+        TEST_ASSERT_STR_EQ(a->name, b->name);
+        TEST_ASSERT_EQ(0, job_cmp(a, b));
+        TEST_ASSERT_EQ(utarray_len(&a->cmdv), utarray_len(&b->cmdv));
+        TEST_ASSERT_EQ(utarray_len(&a->after), utarray_len(&b->after));
+        TEST_ASSERT_NOT_NULL(b->arena);
+    }
+    b = get_job_by_name(&l.jx, "app");
+    TEST_ASSERT_NOT_NULL(b);
+    TEST_ASSERT_STR_EQ("hello world", *(char**)utarray_eltptr(&b->cmdv, 1));
+    TEST_ASSERT_NULL(*(char**)utarray_back(&b->cmdv));
+    TEST_ASSERT_STR_EQ("/tmp", b->dir);
+    TEST_ASSERT_EQ(1, utarray_len(&b->rlim));
+    TEST_ASSERT(CPU_ISSET(1, &b->cpuset));
+    TEST_ASSERT_STR_EQ("root", get_job_by_name(&l.jx, "db")->user);
+    TEST_ASSERT_EQ(1, get_job_by_name(&l.jx, "off")->disabled);
+
+    /* the addresses were set up as they are by the parse */
+    TEST_ASSERT_EQ(1, utarray_len(l.report));
+    TEST_ASSERT_EQ(1, utarray_len(l.listen));
+
+    close_sockets(&p);
+    close_sockets(&l);
+    utstring_free(em);
+    free_test_cfg(&p);
+    free_test_cfg(&l);
+    test_cleanup();
+}
+
+TEST_CASE(image_of_other_text) {
+    pmtr_t cfg;
+    UT_string *em;
+
+    setup();
+    utstring_new(em);
+    compile(conf);
+
+    init_test_cfg(&cfg);
+    cfg.image = strdup(image);
+    TEST_ASSERT_EQ(1, load(&cfg, "job {\n  name x\n  cmd /bin/true\n}\n", em));
+    TEST_ASSERT_EQ(0, job_count(&cfg));
+
+    /* parse_jobs parses the text instead */
+    cfg.file = strdup(create_temp_config("job {\n  name x\n  cmd /bin/true\n}\n"));
+    TEST_ASSERT_EQ(0, parse_jobs(&cfg, em));
+    TEST_ASSERT_EQ(1, job_count(&cfg));
+    TEST_ASSERT_NOT_NULL(get_job_by_name(&cfg.jx, "x"));
+
+    utstring_free(em);
+    free_test_cfg(&cfg);
+    test_cleanup();
+}
+
+TEST_CASE(image_damaged_or_missing) {
+    pmtr_t cfg;
+    UT_string *em;
+    struct stat st;
+    FILE *f;
+
+    setup();
+    utstring_new(em);
+    init_test_cfg(&cfg);
+    cfg.image = strdup(image);
+    TEST_ASSERT_EQ(1, load(&cfg, conf, em));   /* none yet */
+
+    compile(conf);
+    TEST_ASSERT_EQ(0, stat(image, &st));
+    f = fopen(image, "r+");
+    TEST_ASSERT_NOT_NULL(f);
+    fseek(f, st.st_size - 3, SEEK_SET);
+    fputc('#', f);
+    fclose(f);
+    TEST_ASSERT_EQ(1, load(&cfg, conf, em));
+
+    TEST_ASSERT_EQ(0, truncate(image, st.st_size / 2));
+    TEST_ASSERT_EQ(1, load(&cfg, conf, em));
+    TEST_ASSERT_EQ(0, job_count(&cfg));
+
+    utstring_free(em);
+    free_test_cfg(&cfg);
+    test_cleanup();
+}
+
+/* cpus named by where they are were resolved on the host it was compiled
+ * on; the image is not used where they would resolve otherwise */
+TEST_CASE(image_of_other_topology) {
+    const char *text = "job {\n  name x\n  cmd /bin/true\n  cpu node0\n}\n";
+    char root[600], path[700];
+    pmtr_t cfg;
+    UT_string *em;
+
+    setup();
+    utstring_new(em);
+    snprintf(root, sizeof(root), "%s/sys", g_test_tmpdir);
+    snprintf(path, sizeof(path), "%s/node", root);
+    TEST_ASSERT_EQ(0, mkdir(root, 0755));
+    TEST_ASSERT_EQ(0, mkdir(path, 0755));
+    snprintf(path, sizeof(path), "%s/node/node0", root);
+    TEST_ASSERT_EQ(0, mkdir(path, 0755));
+    create_temp_file("sys/node/node0/cpulist", "0\n");
+
+    init_test_cfg(&cfg);
+    cfg.test_only = 1;
+    cfg.sysfs = root;
+    cfg.image = strdup(image);
+    cfg.file = strdup(create_temp_config(text));
+    TEST_ASSERT_EQ(0, parse_jobs(&cfg, em));
+    free_test_cfg(&cfg);
+
+    init_test_cfg(&cfg);
+    cfg.sysfs = root;
+    cfg.image = strdup(image);
+    TEST_ASSERT_EQ(0, load(&cfg, text, em));
+    TEST_ASSERT_EQ(1, job_count(&cfg));
+    free_test_cfg(&cfg);
+
+    create_temp_file("sys/node/node0/cpulist", "1\n");
+    init_test_cfg(&cfg);
+    cfg.sysfs = root;
+    cfg.image = strdup(image);
+    TEST_ASSERT_EQ(1, load(&cfg, text, em));
+    TEST_ASSERT_EQ(0, job_count(&cfg));
+
+    /* parse_jobs parses the text instead, on this host */
+    cfg.file = strdup(create_temp_config(text));
+    TEST_ASSERT_EQ(0, parse_jobs(&cfg, em));
+    TEST_ASSERT(CPU_ISSET(1, &get_job_by_name(&cfg.jx, "x")->cpuset));
+    TEST_ASSERT(!CPU_ISSET(0, &get_job_by_name(&cfg.jx, "x")->cpuset));
+
+    utstring_free(em);
+    free_test_cfg(&cfg);
+    test_cleanup();
+}
+
+/* with an image, parse_jobs loads the jobs, and finishes them as a parse */
+TEST_CASE(parse_jobs_uses_image) {
+    pmtr_t p, l;
+    UT_string *em;
+
+    setup();
+    utstring_new(em);
+    const char *text =
+        "job {\n  name a\n  cmd /bin/true\n  depends {\n    missing\n  }\n}\n"
+        "job {\n  name b\n  cmd /bin/true\n  dir /tmp\n}\n";
+    compile(text);
+
+    init_test_cfg(&p);
+    p.file = strdup(create_temp_config(text));
+    TEST_ASSERT_EQ(0, parse_jobs(&p, em));
+
+    init_test_cfg(&l);
+    l.image = strdup(image);
+    l.file = strdup(p.file);
+    TEST_ASSERT_EQ(0, parse_jobs(&l, em));
+    TEST_ASSERT_EQ(2, job_count(&l));
+    TEST_ASSERT(p.version == l.version);
+
+    /* the missing dependency disables the job after loading, as after
+     * parsing; the image has the job as configured */
+    TEST_ASSERT_EQ(1, get_job_by_name(&l.jx, "a")->disabled);
+    TEST_ASSERT_EQ(0, get_job_by_name(&l.jx, "b")->disabled);
+
+    utstring_free(em);
+    free_test_cfg(&p);
+    free_test_cfg(&l);
+    test_cleanup();
+}
+
+int main(int argc, char *argv[]) {
+    (void)argc; (void)argv;
+    printf("pmtr Compiled Config Tests\n");
+
+    TEST_SUITE_BEGIN("image");
+    RUN_TEST(image_matches_parse);
+    RUN_TEST(image_of_other_text);
+    RUN_TEST(image_damaged_or_missing);
+    RUN_TEST(image_of_other_topology);
+    RUN_TEST(parse_jobs_uses_image);
+    TEST_SUITE_END();
+
+    print_test_results();
+    return get_test_exit_code();
+}
@@ -230,9 +230,9 @@ TEST_CASE(parse_multiple_jobs) {
     TEST_ASSERT_EQ(0, rc);
     TEST_ASSERT_EQ(3, job_count(&cfg));
 
-    TEST_ASSERT_NOT_NULL(get_job_by_name(cfg.jobs, "job1"));
-    TEST_ASSERT_NOT_NULL(get_job_by_name(cfg.jobs, "job2"));
-    TEST_ASSERT_NOT_NULL(get_job_by_name(cfg.jobs, "job3"));
+    TEST_ASSERT_NOT_NULL(get_job_by_name(&cfg.jx, "job1"));
+    TEST_ASSERT_NOT_NULL(get_job_by_name(&cfg.jx, "job2"));
+    TEST_ASSERT_NOT_NULL(get_job_by_name(&cfg.jx, "job3"));
 
     utstring_free(em);
     free_test_cfg(&cfg);
@@ -1070,6 +1070,163 @@ TEST_CASE(parse_bounce_units) {
     test_cleanup();
 }
 
+/*
+ * Instances Tests
+ */
+static const char *workers =
+    "job {\n"
+    "  name worker-%i\n"
+    "  cmd /bin/sleep 100\n"
+    "  env SHARD=%i\n"
+    "  env MODE=fast\n"
+    "  out /tmp/worker-%i.log\n"
+    "  cpu %i\n"
+    "  instances 4\n"
+    "}\n";
+
+TEST_CASE(parse_instances) {
+    pmtr_t cfg;
+    UT_string *em;
+    job_t *a, *b;
+    char name[32];
+    int i;
+
+    TEST_ASSERT_EQ(0, test_init());
+    init_test_cfg(&cfg);
+    utstring_new(em);
+    cfg.file = strdup(create_temp_config(workers));
+
+    TEST_ASSERT_EQ(0, parse_jobs(&cfg, em));
+    TEST_ASSERT_EQ(4, job_count(&cfg));
+    for(i = 0; i < 4; i++) {
+        snprintf(name, sizeof(name), "worker-%d", i);
+        a = get_job_by_name(&cfg.jx, name);
+        TEST_ASSERT_NOT_NULL(a);
+        snprintf(name, sizeof(name), "SHARD=%d", i);
+        TEST_ASSERT_STR_EQ(name, *(char**)utarray_eltptr(&a->envv, 0));
+        snprintf(name, sizeof(name), "/tmp/worker-%d.log", i);
+        TEST_ASSERT_STR_EQ(name, a->out);
+        TEST_ASSERT(CPU_ISSET(i, &a->cpuset));
+        TEST_ASSERT_EQ(1, CPU_COUNT(&a->cpuset));
+    }
+
+    /* the strings without %i are those of the template, shared */
+    a = get_job_by_name(&cfg.jx, "worker-0");
+    b = get_job_by_name(&cfg.jx, "worker-3");
+    TEST_ASSERT(*(char**)utarray_eltptr(&a->cmdv, 0) ==
+                *(char**)utarray_eltptr(&b->cmdv, 0));
+    TEST_ASSERT(*(char**)utarray_eltptr(&a->envv, 1) ==
+                *(char**)utarray_eltptr(&b->envv, 1));
+    TEST_ASSERT(a->arena == b->arena);
+    TEST_ASSERT(job_cmp(a, b) != 0);
+
+    utstring_free(em);
+    free_test_cfg(&cfg);
+    test_cleanup();
+}
+
+TEST_CASE(parse_instances_errors) {
+    pmtr_t cfg;
+    UT_string *em;
+
+    TEST_ASSERT_EQ(0, test_init());
+    init_test_cfg(&cfg);
+    utstring_new(em);
+
+    /* the instances need names of their own */
+    cfg.file = strdup(create_temp_config(
+        "job {\n  name worker\n  cmd /bin/true\n  instances 2\n}\n"));
+    TEST_ASSERT_EQ(-1, parse_jobs(&cfg, em));
+    TEST_ASSERT(strstr(utstring_body(em), "%i in the name") != NULL);
+
+    utstring_clear(em);
+    create_temp_config(
+        "job {\n  name w-%i\n  cmd /bin/true\n  instances 0\n}\n");
+    TEST_ASSERT_EQ(-1, parse_jobs(&cfg, em));
+    TEST_ASSERT(strstr(utstring_body(em), "instances must be") != NULL);
+
+    utstring_clear(em);
+    create_temp_config(
+        "job {\n  name w\n  cmd /bin/true\n  cpu %i\n}\n");
+    TEST_ASSERT_EQ(-1, parse_jobs(&cfg, em));
+    TEST_ASSERT(strstr(utstring_body(em), "needs instances") != NULL);
+
+    utstring_clear(em);
+    create_temp_config(
+        "job {\n  name w-%i\n  cmd /bin/true\n  cpu x%i\n  instances 2\n}\n");
+    TEST_ASSERT_EQ(-1, parse_jobs(&cfg, em));
+    TEST_ASSERT(strstr(utstring_body(em), "cpuset") != NULL);
+
+    /* one instance keeps its name as is, but for the %i */
+    utstring_clear(em);
+    utarray_clear(cfg.jobs);
+    index_free(&cfg.jx);
+    create_temp_config(
+        "job {\n  name single\n  cmd /bin/true\n  instances 1\n}\n"
+        "job {\n  name literal-%i\n  cmd /bin/true\n}\n");
+    TEST_ASSERT_EQ(0, parse_jobs(&cfg, em));
+    TEST_ASSERT_EQ(2, job_count(&cfg));
+    TEST_ASSERT_NOT_NULL(get_job_by_name(&cfg.jx, "single"));
+    TEST_ASSERT_NOT_NULL(get_job_by_name(&cfg.jx, "literal-%i"));
+
+    utstring_free(em);
+    free_test_cfg(&cfg);
+    test_cleanup();
+}
+
+/* an instance is the same job as one written out with its fields; more
+ * instances on a reload leave the ones there were alone */
+TEST_CASE(parse_instances_reload) {
+    pmtr_t cfg, one;
+    UT_string *em;
+    UT_array *previous;
+    job_index pjx;
+    job_diff d;
+    char more[512], *c;
+
+    TEST_ASSERT_EQ(0, test_init());
+    init_test_cfg(&cfg);
+    utstring_new(em);
+    cfg.file = strdup(create_temp_config(workers));
+    TEST_ASSERT_EQ(0, parse_jobs(&cfg, em));
+
+    init_test_cfg(&one);
+    one.file = strdup(create_temp_config(
+        "job {\n"
+        "  name worker-1\n"
+        "  cmd /bin/sleep 100\n"
+        "  env SHARD=1\n"
+        "  env MODE=fast\n"
+        "  out /tmp/worker-1.log\n"
+        "  cpu 1\n"
+        "}\n"));
+    TEST_ASSERT_EQ(0, parse_jobs(&one, em));
+    TEST_ASSERT_EQ(0, job_cmp(get_job_by_name(&cfg.jx, "worker-1"),
+                              get_job_at(&one, 0)));
+
+    /* set aside the jobs, as rescan_config does */
+    previous = cfg.jobs;
+    pjx = cfg.jx;
+    utarray_new(cfg.jobs, &job_mm);
+    memset(&cfg.jx, 0, sizeof(cfg.jx));
+    snprintf(more, sizeof(more), "%s", workers);
+    c = strstr(more, "instances 4");
+    c[10] = '6';
+    create_temp_config(more);
+    TEST_ASSERT_EQ(0, parse_jobs(&cfg, em));
+    TEST_ASSERT_EQ(6, job_count(&cfg));
+
+    merge_jobs(&cfg, previous, &pjx, &d);
+    TEST_ASSERT_EQ(4, d.unchanged);
+    TEST_ASSERT_EQ(2, d.added);
+    TEST_ASSERT_EQ(0, d.changed);
+
+    utstring_free(em);
+    free_test_cfg(&one);
+    free_test_cfg(&cfg);
+    test_cleanup();
+}
+
 /*
  * Test Runner
  */
@@ -1138,6 +1295,12 @@ int main(int argc, char *argv[]) {
     RUN_TEST(parse_bounce_units);
     TEST_SUITE_END();
 
+    TEST_SUITE_BEGIN("Instances");
+    RUN_TEST(parse_instances);
+    RUN_TEST(parse_instances_errors);
+    RUN_TEST(parse_instances_reload);
+    TEST_SUITE_END();
+
     print_test_results();
     return get_test_exit_code();
 }
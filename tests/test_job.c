@@ -9,8 +9,10 @@
 #include <stdlib.h>
 #include <string.h>
 #include <sched.h>
+#include <sys/wait.h>
 #include "test_framework.h"
 #include "test_helpers.h"
+#include "../src/spawn.h"
 
 /*
  * job_ini Tests
@@ -574,7 +576,7 @@ TEST_CASE(get_job_by_pid_found) {
     utarray_push_back(cfg.jobs, &job);
     job_fin(&job);  /* The array made a copy */
 
-    job_t *found = get_job_by_pid(cfg.jobs, 12345);
+    job_t *found = get_job_by_pid(&cfg.jx, 12345);
     TEST_ASSERT_NOT_NULL(found);
     TEST_ASSERT_STR_EQ("testjob", found->name);
 
@@ -592,7 +594,7 @@ TEST_CASE(get_job_by_pid_not_found) {
     utarray_push_back(cfg.jobs, &job);
     job_fin(&job);
 
-    job_t *found = get_job_by_pid(cfg.jobs, 99999);
+    job_t *found = get_job_by_pid(&cfg.jx, 99999);
     TEST_ASSERT_NULL(found);
 
     free_test_cfg(&cfg);
@@ -602,7 +604,7 @@ TEST_CASE(get_job_by_pid_empty_list) {
     pmtr_t cfg;
     init_test_cfg(&cfg);
 
-    job_t *found = get_job_by_pid(cfg.jobs, 12345);
+    job_t *found = get_job_by_pid(&cfg.jx, 12345);
     TEST_ASSERT_NULL(found);
 
     free_test_cfg(&cfg);
@@ -632,7 +634,7 @@ TEST_CASE(get_job_by_pid_multiple_jobs) {
     utarray_push_back(cfg.jobs, &job3);
     job_fin(&job3);
 
-    job_t *found = get_job_by_pid(cfg.jobs, 200);
+    job_t *found = get_job_by_pid(&cfg.jx, 200);
     TEST_ASSERT_NOT_NULL(found);
     TEST_ASSERT_STR_EQ("job2", found->name);
 
@@ -652,7 +654,7 @@ TEST_CASE(get_job_by_name_found) {
     utarray_push_back(cfg.jobs, &job);
     job_fin(&job);
 
-    job_t *found = get_job_by_name(cfg.jobs, "myjob");
+    job_t *found = get_job_by_name(&cfg.jx, "myjob");
     TEST_ASSERT_NOT_NULL(found);
     TEST_ASSERT_STR_EQ("myjob", found->name);
 
@@ -669,7 +671,7 @@ TEST_CASE(get_job_by_name_not_found) {
     utarray_push_back(cfg.jobs, &job);
     job_fin(&job);
 
-    job_t *found = get_job_by_name(cfg.jobs, "otherjob");
+    job_t *found = get_job_by_name(&cfg.jx, "otherjob");
     TEST_ASSERT_NULL(found);
 
     free_test_cfg(&cfg);
@@ -679,7 +681,7 @@ TEST_CASE(get_job_by_name_empty_list) {
     pmtr_t cfg;
     init_test_cfg(&cfg);
 
-    job_t *found = get_job_by_name(cfg.jobs, "anyjob");
+    job_t *found = get_job_by_name(&cfg.jx, "anyjob");
     TEST_ASSERT_NULL(found);
 
     free_test_cfg(&cfg);
@@ -696,10 +698,10 @@ TEST_CASE(get_job_by_name_case_sensitive) {
     job_fin(&job);
 
     /* Exact match required */
-    job_t *found = get_job_by_name(cfg.jobs, "myjob");
+    job_t *found = get_job_by_name(&cfg.jx, "myjob");
     TEST_ASSERT_NULL(found);
 
-    found = get_job_by_name(cfg.jobs, "MyJob");
+    found = get_job_by_name(&cfg.jx, "MyJob");
     TEST_ASSERT_NOT_NULL(found);
 
     free_test_cfg(&cfg);
@@ -901,51 +903,978 @@ TEST_CASE(term_jobs_already_terminating) {
 }
 
 /*
- * alarm_within Tests
+ * collect_job Tests
  */
-extern void alarm_within(pmtr_t *cfg, int sec);
+TEST_CASE(collect_job_reaps_exited_child) {
+    pmtr_t cfg;
+    init_test_cfg(&cfg);
+    UT_string *sm;
+    utstring_new(sm);
+
+    pid_t pid = fork();
+    if (pid == 0) _exit(PMTR_NO_RESTART);
+    TEST_ASSERT(pid > 0);
+
+    job_t job;
+    job_ini(&job);
+    job.name = strdup("exiter");
+    job.pid = pid;
+    job.start_ts = time(NULL);
+    utarray_push_back(cfg.jobs, &job);
+    job_fin(&job);
+
+    /* wait until the child is a zombie, as when its pidfd is readable */
+    siginfo_t si;
+    TEST_ASSERT_EQ(0, waitid(P_PID, pid, &si, WEXITED|WNOWAIT));
+
+    collect_job(&cfg, pid, sm);
+
+    job_t *j = get_job_at(&cfg, 0);
+    TEST_ASSERT_EQ(0, j->pid);
+    TEST_ASSERT_EQ(-1, j->pidfd);
+    TEST_ASSERT_EQ(0, j->respawn);  /* exited with PMTR_NO_RESTART */
+    TEST_ASSERT(j->start_at > j->start_ts);  /* quick exit is delayed */
+
+    utstring_free(sm);
+    free_test_cfg(&cfg);
+}
+
+static job_t *push_named_job(pmtr_t *cfg, const char *name) {
+    job_t job;
+    job_ini(&job);
+    job.name = strdup(name);
+    utarray_push_back(cfg->jobs, &job);
+    job_fin(&job);
+    return (job_t*)utarray_back(cfg->jobs);
+}
 
-TEST_CASE(alarm_within_first_call) {
+/* run a child that exits at once, and collect it as the job */
+static void exit_and_collect(pmtr_t *cfg, job_t *j, UT_string *sm) {
+    siginfo_t si;
+    pid_t pid = fork();
+    if (pid == 0) _exit(1);
+    j->pid = pid;
+    j->start_ts = time(NULL);
+    index_pid(&cfg->jx, j);
+    waitid(P_PID, pid, &si, WEXITED|WNOWAIT);
+    collect_job(cfg, pid, sm);
+}
+
+TEST_CASE(collect_job_backoff) {
     pmtr_t cfg;
     init_test_cfg(&cfg);
-    cfg.next_alarm = 0;  /* No alarm set */
+    UT_string *sm;
+    utstring_new(sm);
+
+    job_t *j = push_named_job(&cfg, "crasher");
+    j->backoff_min = 1;
+    j->backoff_max = 60;
+    j->backoff_factor = 2;
+
+    /* each quick exit doubles the delay, up to the longest */
+    int want[] = {1, 2, 4, 8, 16, 32, 60, 60}, i;
+    for(i = 0; i < adim(want); i++) {
+        exit_and_collect(&cfg, j, sm);
+        long d = j->start_at - time(NULL);  /* a second may have passed */
+        TEST_ASSERT((d == want[i]) || (d == want[i] - 1));
+    }
 
-    alarm_within(&cfg, 5);
+    /* a run as long as the longest delay restarts at once, and resets it */
+    pid_t pid = fork();
+    if (pid == 0) _exit(1);
+    j->pid = pid;
+    j->start_ts = time(NULL) - 60;
+    index_pid(&cfg.jx, j);
+    siginfo_t si;
+    waitid(P_PID, pid, &si, WEXITED|WNOWAIT);
+    collect_job(&cfg, pid, sm);
+    TEST_ASSERT(j->start_at <= time(NULL));
+    TEST_ASSERT(j->backoff == 0);
+
+    utstring_free(sm);
+    free_test_cfg(&cfg);
+}
 
-    /* next_alarm should be set */
-    TEST_ASSERT(cfg.next_alarm > 0);
+TEST_CASE(collect_job_breaker) {
+    pmtr_t cfg;
+    init_test_cfg(&cfg);
+    UT_string *sm;
+    utstring_new(sm);
+
+    job_t *j = push_named_job(&cfg, "crasher");
+    j->breaker_count = 3;
+    j->breaker_window = 60;
+
+    exit_and_collect(&cfg, j, sm);
+    exit_and_collect(&cfg, j, sm);
+    TEST_ASSERT_EQ(0, j->parked);
+    exit_and_collect(&cfg, j, sm);
+    TEST_ASSERT(j->parked != 0);
+
+    /* a parked job is not started */
+    j->start_at = 0;
+    do_job(&cfg, j);
+    TEST_ASSERT_EQ(0, j->pid);
 
+    unpark_job(j);
+    TEST_ASSERT_EQ(0, j->parked);
+    TEST_ASSERT_EQ(0, j->fails);
+
+    utstring_free(sm);
     free_test_cfg(&cfg);
 }
 
-TEST_CASE(alarm_within_earlier_alarm) {
+TEST_CASE(collect_job_requested_exit) {
     pmtr_t cfg;
     init_test_cfg(&cfg);
+    UT_string *sm;
+    utstring_new(sm);
 
-    time_t now = time(NULL);
-    cfg.next_alarm = now + 100;  /* Alarm far in future */
+    job_t *j = push_named_job(&cfg, "bounced");
+    j->breaker_count = 1;
+    j->breaker_window = 60;
+
+    /* an exit we asked for is neither delayed nor a failure */
+    j->terminate = 1;
+    exit_and_collect(&cfg, j, sm);
+    TEST_ASSERT(j->start_at <= time(NULL));
+    TEST_ASSERT_EQ(0, j->parked);
+
+    utstring_free(sm);
+    free_test_cfg(&cfg);
+}
+
+TEST_CASE(collect_job_unknown_pid) {
+    pmtr_t cfg;
+    init_test_cfg(&cfg);
+    UT_string *sm;
+    utstring_new(sm);
+
+    job_t job;
+    job_ini(&job);
+    job.name = strdup("other");
+    job.pid = 12345;
+    utarray_push_back(cfg.jobs, &job);
+    job_fin(&job);
+
+    /* a stale event for a pid we no longer track is ignored */
+    collect_job(&cfg, 54321, sm);
+    TEST_ASSERT_EQ(12345, get_job_at(&cfg, 0)->pid);
+
+    utstring_free(sm);
+    free_test_cfg(&cfg);
+}
+
+/*
+ * spawn_job Tests
+ */
+static void push_arg(job_t *job, const char *arg) {
+    char *a = (char*)arg;
+    if (arg) utarray_push_back(&job->cmdv, &a);
+    else utarray_extend_back(&job->cmdv);  /* NULL on end of argv */
+}
+
+static void spawn_echo(int how) {
+    pmtr_t cfg;
+    init_test_cfg(&cfg);
+    TEST_ASSERT_EQ(0, test_init());
+
+    job_t job;
+    job_ini(&job);
+    job.name = strdup("echo");
+    push_arg(&job, "/bin/sh");
+    push_arg(&job, "-c");
+    push_arg(&job, "echo $PMTR_T");
+    push_arg(&job, NULL);
+    char *env = "PMTR_T=one";
+    utarray_push_back(&job.envv, &env);
+    env = "PMTR_T=two";  /* later setting wins */
+    utarray_push_back(&job.envv, &env);
+    job.out = strdup(create_temp_file("out", NULL));
+    job.err = strdup("/dev/null");
+
+    int es;
+    pid_t pid = spawn_job(&cfg, &job, how);
+    TEST_ASSERT(pid > 0);
+    TEST_ASSERT_EQ(pid, waitpid(pid, &es, 0));
+    TEST_ASSERT(WIFEXITED(es));
+    TEST_ASSERT_EQ(0, WEXITSTATUS(es));
+
+    char buf[32] = "";
+    FILE *f = fopen(job.out, "r");
+    TEST_ASSERT_NOT_NULL(f);
+    TEST_ASSERT_NOT_NULL(fgets(buf, sizeof(buf), f));
+    fclose(f);
+    TEST_ASSERT_STR_EQ("two\n", buf);
+
+    job_fin(&job);
+    test_cleanup();
+    free_test_cfg(&cfg);
+}
+
+TEST_CASE(spawn_job_shared_vm) {
+    spawn_echo(SPAWN_VM);
+}
+
+TEST_CASE(spawn_job_copied_vm) {
+    spawn_echo(0);
+}
+
+TEST_CASE(spawn_job_setup_failure) {
+    pmtr_t cfg;
+    init_test_cfg(&cfg);
+
+    job_t job;
+    job_ini(&job);
+    job.name = strdup("nodir");
+    job.dir = strdup("/nonexistent/pmtr/dir");
+    push_arg(&job, "/bin/true");
+    push_arg(&job, NULL);
+
+    /* the process is created, logs why it failed, and exits */
+    int es;
+    pid_t pid = spawn_job(&cfg, &job, SPAWN_VM);
+    TEST_ASSERT(pid > 0);
+    TEST_ASSERT_EQ(pid, waitpid(pid, &es, 0));
+    TEST_ASSERT(WIFEXITED(es));
+    TEST_ASSERT_EQ(255, WEXITSTATUS(es));
+
+    job_fin(&job);
+    free_test_cfg(&cfg);
+}
+
+static char *plan_env(job_t *job, const char *name) {
+    size_t len = strlen(name);
+    char **e;
+    for(e = job->plan.envp; *e; e++) {
+        if (!strncmp(*e, name, len) && ((*e)[len] == '=')) return *e;
+    }
+    return NULL;
+}
+
+TEST_CASE(spawn_plan_at_parse) {
+    pmtr_t cfg;
+    if (test_init() != 0) {
+        TEST_ASSERT_MSG(0, "Failed to init test environment");
+    }
+    init_test_cfg(&cfg);
+    const char *conf =
+        "job {\n  name planned\n  dir /opt/app\n  cmd bin/run -x\n"
+        "  env PMTR_T=x\n  user root\n}\n"
+        "job {\n  name nobody\n  cmd /bin/true\n"
+        "  user no_such_user_pmtr\n}\n";
+
+    char *path = create_temp_config(conf);
+    cfg.file = strdup(path);
+    UT_string *em;
+    utstring_new(em);
+    TEST_ASSERT_EQ(0, parse_jobs(&cfg, em));
+
+    job_t *j = get_job_by_name(&cfg.jx, "planned");
+    TEST_ASSERT_NOT_NULL(j->plan.envp);
+    TEST_ASSERT_STR_EQ("/opt/app/bin/run", j->plan.exe);
+    TEST_ASSERT_STR_EQ("PMTR_T=x", plan_env(j, "PMTR_T"));
+    TEST_ASSERT_EQ(1, j->plan.user);
+    TEST_ASSERT_EQ(0, j->plan.uid);
+    TEST_ASSERT(j->plan.ngroups >= 1);
+
+    /* an unknown user is left for the child to report */
+    j = get_job_by_name(&cfg.jx, "nobody");
+    TEST_ASSERT_EQ(-1, j->plan.user);
+
+    utstring_free(em);
+    free_test_cfg(&cfg);
+    test_cleanup();
+}
+
+TEST_CASE(spawn_plan_copied) {
+    job_t src, dst;
+    job_ini(&src);
+    src.name = strdup("src");
+    push_arg(&src, "/bin/true");
+    push_arg(&src, NULL);
+    char *env = "PMTR_T=y";
+    utarray_push_back(&src.envv, &env);
+    TEST_ASSERT_EQ(0, plan_job(&src));
+
+    job_cpy(&dst, &src);
+    job_fin(&src);
 
-    alarm_within(&cfg, 5);  /* Request earlier alarm */
+    /* the copy's environment refers to its own strings */
+    TEST_ASSERT_NOT_NULL(dst.plan.envp);
+    TEST_ASSERT(plan_env(&dst, "PMTR_T") == *(char**)utarray_front(&dst.envv));
+    TEST_ASSERT_STR_EQ("/bin/true", dst.plan.exe);
 
-    /* next_alarm should be updated to earlier time */
-    TEST_ASSERT(cfg.next_alarm <= now + 5);
+    job_fin(&dst);
+}
+
+/*
+ * timer_job Tests
+ */
+TEST_CASE(timer_job_first_call) {
+    pmtr_t cfg;
+    init_test_cfg(&cfg);
+    job_t *j = push_named_job(&cfg, "timed");
+
+    time_t when = time(NULL) + 5;
+    timer_job(&cfg, j, when);
+
+    TEST_ASSERT_EQ_LONG(when, j->timer_at);
+    TEST_ASSERT_EQ_SIZE(1, cfg.tw.n);
 
     free_test_cfg(&cfg);
 }
 
-TEST_CASE(alarm_within_zero_becomes_one) {
+TEST_CASE(timer_job_earlier_deadline) {
     pmtr_t cfg;
     init_test_cfg(&cfg);
-    cfg.next_alarm = 0;
+    job_t *j = push_named_job(&cfg, "timed");
+
+    time_t now = time(NULL);
+    timer_job(&cfg, j, now + 100);
+    timer_job(&cfg, j, now + 5);  /* the later timer is replaced */
+
+    TEST_ASSERT_EQ_LONG(now + 5, j->timer_at);
+    TEST_ASSERT_EQ_SIZE(1, cfg.tw.n);
+    TEST_ASSERT(tw_next(&cfg.tw) <= tw_at(now + 5));  /* the sooner one */
 
-    alarm_within(&cfg, 0);
+    free_test_cfg(&cfg);
+}
+
+TEST_CASE(timer_job_later_deadline_covered) {
+    pmtr_t cfg;
+    init_test_cfg(&cfg);
+    job_t *j = push_named_job(&cfg, "timed");
 
-    /* 0 second timer should become 1 second */
     time_t now = time(NULL);
-    TEST_ASSERT(cfg.next_alarm >= now);
-    TEST_ASSERT(cfg.next_alarm <= now + 2);
+    timer_job(&cfg, j, now + 5);
+    timer_job(&cfg, j, now + 100);  /* handled when the first one fires */
+
+    TEST_ASSERT_EQ_LONG(now + 5, j->timer_at);
+    TEST_ASSERT_EQ_SIZE(1, cfg.tw.n);
+
+    free_test_cfg(&cfg);
+}
+
+TEST_CASE(job_timer_clears_pending) {
+    pmtr_t cfg;
+    init_test_cfg(&cfg);
+    job_t *j = push_named_job(&cfg, "timed");
+    j->disabled = 1;  /* so do_job has nothing to start */
+
+    timer_job(&cfg, j, time(NULL) + 5);
+    job_timer(&cfg, "timed");
+    TEST_ASSERT_EQ(0, j->timer_at);
+
+    /* a timer for a job that no longer exists is ignored */
+    job_timer(&cfg, "gone");
+
+    free_test_cfg(&cfg);
+}
+
+/*
+ * job index Tests
+ */
+TEST_CASE(job_index_many_jobs) {
+    pmtr_t cfg;
+    init_test_cfg(&cfg);
+    char name[32];
+    int i;
+
+    for(i = 0; i < 5000; i++) {
+        snprintf(name, sizeof(name), "job%d", i);
+        push_named_job(&cfg, name)->pid = 1000 + i;
+    }
+
+    for(i = 0; i < 5000; i += 7) {
+        snprintf(name, sizeof(name), "job%d", i);
+        job_t *j = get_job_by_name(&cfg.jx, name);
+        TEST_ASSERT_NOT_NULL(j);
+        TEST_ASSERT_STR_EQ(name, j->name);
+        TEST_ASSERT(get_job_by_pid(&cfg.jx, 1000 + i) == j);
+    }
+    TEST_ASSERT_NULL(get_job_by_name(&cfg.jx, "job5000"));
+    TEST_ASSERT_NULL(get_job_by_pid(&cfg.jx, 999));
+
+    free_test_cfg(&cfg);
+}
+
+TEST_CASE(job_index_pid_updates) {
+    pmtr_t cfg;
+    init_test_cfg(&cfg);
+    push_named_job(&cfg, "a");
+    push_named_job(&cfg, "b");
+    TEST_ASSERT_NULL(get_job_by_pid(&cfg.jx, 4242));
+
+    /* as when the job is started */
+    job_t *j = get_job_by_name(&cfg.jx, "b");
+    j->pid = 4242;
+    index_pid(&cfg.jx, j);
+    TEST_ASSERT(get_job_by_pid(&cfg.jx, 4242) == j);
+
+    /* as when it is reaped */
+    unindex_pid(&cfg.jx, j);
+    j->pid = 0;
+    TEST_ASSERT_NULL(get_job_by_pid(&cfg.jx, 4242));
+    TEST_ASSERT(get_job_by_name(&cfg.jx, "b") == j);
+
+    free_test_cfg(&cfg);
+}
+
+TEST_CASE(job_index_erase) {
+    pmtr_t cfg;
+    init_test_cfg(&cfg);
+    char name[32];
+    int i;
 
+    for(i = 0; i < 100; i++) {
+        snprintf(name, sizeof(name), "job%d", i);
+        push_named_job(&cfg, name)->pid = 1000 + i;
+    }
+
+    /* erase from the front, middle and end; later jobs move down */
+    erase_job(&cfg.jx, get_job_by_name(&cfg.jx, "job0"));
+    erase_job(&cfg.jx, get_job_by_name(&cfg.jx, "job50"));
+    erase_job(&cfg.jx, get_job_by_pid(&cfg.jx, 1099));
+    TEST_ASSERT_EQ(97, utarray_len(cfg.jobs));
+    TEST_ASSERT_EQ(97, cfg.jx.len);
+
+    TEST_ASSERT_NULL(get_job_by_name(&cfg.jx, "job0"));
+    TEST_ASSERT_NULL(get_job_by_name(&cfg.jx, "job50"));
+    TEST_ASSERT_NULL(get_job_by_pid(&cfg.jx, 1099));
+    for(i = 1; i < 99; i++) {
+        if (i == 50) continue;
+        snprintf(name, sizeof(name), "job%d", i);
+        job_t *j = get_job_by_name(&cfg.jx, name);
+        TEST_ASSERT_NOT_NULL(j);
+        TEST_ASSERT_STR_EQ(name, j->name);
+        TEST_ASSERT(get_job_by_pid(&cfg.jx, 1000 + i) == j);
+    }
+
+    free_test_cfg(&cfg);
+}
+
+TEST_CASE(job_index_after_sort) {
+    pmtr_t cfg;
+    if (test_init() != 0) {
+        TEST_ASSERT_MSG(0, "Failed to init test environment");
+    }
+    init_test_cfg(&cfg);
+    const char *conf =
+        "job {\n  name late\n  cmd /bin/true\n  order 2\n}\n"
+        "job {\n  name early\n  cmd /bin/true\n  order 1\n}\n";
+
+    char *path = create_temp_config(conf);
+    cfg.file = strdup(path);
+    UT_string *em;
+    utstring_new(em);
+    TEST_ASSERT_EQ(0, parse_jobs(&cfg, em));
+
+    /* parse_jobs sorts by order; the index follows the elements */
+    TEST_ASSERT_STR_EQ("early", get_job_at(&cfg, 0)->name);
+    TEST_ASSERT(get_job_by_name(&cfg.jx, "early") == get_job_at(&cfg, 0));
+    TEST_ASSERT(get_job_by_name(&cfg.jx, "late") == get_job_at(&cfg, 1));
+
+    utstring_free(em);
     free_test_cfg(&cfg);
+    test_cleanup();
+}
+
+/*
+ * after Tests
+ */
+static int parse_conf(pmtr_t *cfg, UT_string *em, const char *conf) {
+    cfg->file = strdup(create_temp_config(conf));
+    return parse_jobs(cfg, em);
+}
+
+TEST_CASE(after_orders_jobs) {
+    pmtr_t cfg;
+    TEST_ASSERT_EQ(0, test_init());
+    init_test_cfg(&cfg);
+    UT_string *em;
+    utstring_new(em);
+    const char *conf =
+        "job {\n  name app\n  cmd /bin/true\n  after db cache\n}\n"
+        "job {\n  name cache\n  cmd /bin/true\n  order 5\n}\n"
+        "job {\n  name db\n  cmd /bin/true\n  after setup\n}\n"
+        "job {\n  name setup\n  cmd /bin/true\n  wait\n}\n";
+
+    TEST_ASSERT_EQ(0, parse_conf(&cfg, em, conf));
+
+    /* each job follows those it starts after */
+    TEST_ASSERT_STR_EQ("setup", get_job_at(&cfg, 0)->name);
+    TEST_ASSERT_STR_EQ("db", get_job_at(&cfg, 1)->name);
+    TEST_ASSERT_STR_EQ("cache", get_job_at(&cfg, 2)->name);
+    TEST_ASSERT_STR_EQ("app", get_job_at(&cfg, 3)->name);
+    TEST_ASSERT(get_job_by_name(&cfg.jx, "app") == get_job_at(&cfg, 3));
+
+    /* 'setup' is a 'wait' job ordered before 'cache' */
+    job_t *j = get_job_by_name(&cfg.jx, "cache");
+    TEST_ASSERT_EQ(1, utarray_len(&j->after));
+    TEST_ASSERT_STR_EQ("setup", *(char**)utarray_front(&j->after));
+
+    utstring_free(em);
+    free_test_cfg(&cfg);
+    test_cleanup();
+}
+
+TEST_CASE(after_implied_by_wait) {
+    pmtr_t cfg;
+    TEST_ASSERT_EQ(0, test_init());
+    init_test_cfg(&cfg);
+    UT_string *em;
+    utstring_new(em);
+    const char *conf =
+        "job {\n  name first\n  cmd /bin/true\n}\n"
+        "job {\n  name setup\n  cmd /bin/true\n  wait\n}\n"
+        "job {\n  name next\n  cmd /bin/true\n}\n";
+
+    TEST_ASSERT_EQ(0, parse_conf(&cfg, em, conf));
+
+    job_t *j = get_job_by_name(&cfg.jx, "next");
+    TEST_ASSERT_EQ(1, utarray_len(&j->after));
+    TEST_ASSERT_STR_EQ("setup", *(char**)utarray_front(&j->after));
+    TEST_ASSERT_EQ(0, utarray_len(&get_job_by_name(&cfg.jx, "first")->after));
+
+    utstring_free(em);
+    free_test_cfg(&cfg);
+    test_cleanup();
+}
+
+/* 'after' in some jobs leaves 'wait' holding up the others */
+TEST_CASE(after_mixed_with_wait) {
+    pmtr_t cfg;
+    TEST_ASSERT_EQ(0, test_init());
+    init_test_cfg(&cfg);
+    UT_string *em;
+    utstring_new(em);
+    const char *conf =
+        "job {\n  name first\n  cmd /bin/true\n}\n"
+        "job {\n  name setup\n  cmd /bin/true\n  wait\n}\n"
+        "job {\n  name plain\n  cmd /bin/true\n}\n"
+        "job {\n  name db\n  cmd /bin/true\n}\n"
+        "job {\n  name app\n  cmd /bin/true\n  after db setup\n}\n";
+
+    TEST_ASSERT_EQ(0, parse_conf(&cfg, em, conf));
+
+    job_t *j = get_job_by_name(&cfg.jx, "plain");
+    TEST_ASSERT_EQ(1, utarray_len(&j->after));
+    TEST_ASSERT_STR_EQ("setup", *(char**)utarray_front(&j->after));
+    TEST_ASSERT_EQ(0, utarray_len(&get_job_by_name(&cfg.jx, "first")->after));
+
+    /* a 'wait' job that is also named is not added twice */
+    j = get_job_by_name(&cfg.jx, "app");
+    TEST_ASSERT_EQ(2, utarray_len(&j->after));
+    TEST_ASSERT_STR_EQ("db", *(char**)utarray_eltptr(&j->after, 0));
+    TEST_ASSERT_STR_EQ("setup", *(char**)utarray_eltptr(&j->after, 1));
+
+    utstring_free(em);
+    free_test_cfg(&cfg);
+    test_cleanup();
+}
+
+/* a 'wait' job can't start after a job that waits for it */
+TEST_CASE(after_wait_on_later_job) {
+    pmtr_t cfg;
+    TEST_ASSERT_EQ(0, test_init());
+    init_test_cfg(&cfg);
+    UT_string *em;
+    utstring_new(em);
+    const char *conf =
+        "job {\n  name setup\n  cmd /bin/true\n  wait\n  after db\n}\n"
+        "job {\n  name db\n  cmd /bin/true\n}\n";
+
+    TEST_ASSERT_EQ(-1, parse_conf(&cfg, em, conf));
+    TEST_ASSERT(strstr(utstring_body(em), "circular") != NULL);
+
+    utstring_free(em);
+    free_test_cfg(&cfg);
+    test_cleanup();
+}
+
+TEST_CASE(after_unknown_job) {
+    pmtr_t cfg;
+    TEST_ASSERT_EQ(0, test_init());
+    init_test_cfg(&cfg);
+    UT_string *em;
+    utstring_new(em);
+    const char *conf =
+        "job {\n  name app\n  cmd /bin/true\n  after nosuch\n}\n";
+
+    TEST_ASSERT_EQ(-1, parse_conf(&cfg, em, conf));
+    TEST_ASSERT(strstr(utstring_body(em), "nosuch") != NULL);
+
+    utstring_free(em);
+    free_test_cfg(&cfg);
+    test_cleanup();
+}
+
+TEST_CASE(after_circular) {
+    pmtr_t cfg;
+    TEST_ASSERT_EQ(0, test_init());
+    init_test_cfg(&cfg);
+    UT_string *em;
+    utstring_new(em);
+    const char *conf =
+        "job {\n  name a\n  cmd /bin/true\n  after c\n}\n"
+        "job {\n  name b\n  cmd /bin/true\n  after a\n}\n"
+        "job {\n  name c\n  cmd /bin/true\n  after b\n}\n";
+
+    TEST_ASSERT_EQ(-1, parse_conf(&cfg, em, conf));
+    TEST_ASSERT(strstr(utstring_body(em), "circular") != NULL);
+
+    utstring_free(em);
+    free_test_cfg(&cfg);
+    test_cleanup();
+}
+
+TEST_CASE(after_holds_start) {
+    pmtr_t cfg;
+    init_test_cfg(&cfg);
+
+    push_named_job(&cfg, "pre")->respawn = 0;  /* so it is not started here */
+    job_t *j = push_named_job(&cfg, "app");
+    job_t *pre = get_job_by_name(&cfg.jx, "pre");
+    push_arg(j, "/bin/true");
+    push_arg(j, NULL);
+    j->out = strdup("/dev/null");
+    j->err = strdup("/dev/null");
+    char *name = "pre";
+    utarray_push_back(&j->after, &name);
+
+    do_jobs(&cfg);
+    TEST_ASSERT_EQ(0, j->pid);
+
+    /* once its prerequisite runs, it is started */
+    pre->pid = getpid();
+    do_jobs(&cfg);
+    TEST_ASSERT(j->pid > 0);
+    int es;
+    TEST_ASSERT_EQ(j->pid, waitpid(j->pid, &es, 0));
+
+    /* a wait job is ready once it has finished */
+    j->pid = 0;
+    pre->wait = 1;
+    do_jobs(&cfg);
+    TEST_ASSERT_EQ(0, j->pid);
+    pre->pid = 0;
+    pre->finished = 1;
+    do_jobs(&cfg);
+    TEST_ASSERT(j->pid > 0);
+    TEST_ASSERT_EQ(j->pid, waitpid(j->pid, &es, 0));
+
+    free_test_cfg(&cfg);
+}
+
+/*
+ * job queue Tests
+ */
+
+/* a running job that bounces later: a visit from do_job sets its timer */
+static job_t *push_bouncer(pmtr_t *cfg, const char *name, pid_t pid) {
+    job_t *j = push_named_job(cfg, name);
+    j->pid = pid;
+    j->start_ts = time(NULL);
+    j->bounce_interval = 100;
+    return j;
+}
+
+TEST_CASE(queue_runs_only_queued) {
+    pmtr_t cfg;
+    init_test_cfg(&cfg);
+    push_bouncer(&cfg, "a", 1001);
+    push_bouncer(&cfg, "b", 1002);
+    push_bouncer(&cfg, "c", 1003);
+    job_t *b = get_job_by_name(&cfg.jx, "b");
+
+    queue_job(&cfg, b);
+    queue_job(&cfg, b);  /* once is enough */
+    TEST_ASSERT_EQ(Q_READY, b->queued);
+    TEST_ASSERT_EQ(1, run_jobs(&cfg));
+    TEST_ASSERT_EQ(0, b->queued);
+    TEST_ASSERT(b->timer_at != 0);
+    TEST_ASSERT_EQ(0, get_job_by_name(&cfg.jx, "a")->timer_at);
+    TEST_ASSERT_EQ(0, get_job_by_name(&cfg.jx, "c")->timer_at);
+
+    /* nothing queued, nothing visited */
+    TEST_ASSERT_EQ(0, run_jobs(&cfg));
+
+    queue_jobs(&cfg);
+    TEST_ASSERT_EQ(3, run_jobs(&cfg));
+
+    free_test_cfg(&cfg);
+}
+
+TEST_CASE(queue_skips_erased) {
+    pmtr_t cfg;
+    init_test_cfg(&cfg);
+    push_bouncer(&cfg, "a", 1001);
+    push_bouncer(&cfg, "b", 1002);
+
+    queue_jobs(&cfg);
+    erase_job(&cfg.jx, get_job_by_name(&cfg.jx, "a"));
+    TEST_ASSERT_EQ(1, run_jobs(&cfg));
+
+    free_test_cfg(&cfg);
+}
+
+TEST_CASE(queue_collected_job) {
+    pmtr_t cfg;
+    init_test_cfg(&cfg);
+    UT_string *sm;
+    utstring_new(sm);
+
+    job_t *j = push_named_job(&cfg, "exits");
+    j->respawn = 0;
+    exit_and_collect(&cfg, j, sm);
+    TEST_ASSERT_EQ(Q_READY, j->queued);
+    TEST_ASSERT_EQ(1, run_jobs(&cfg));
+
+    utstring_free(sm);
+    free_test_cfg(&cfg);
+}
+
+TEST_CASE(queue_wakes_blocked) {
+    pmtr_t cfg;
+    init_test_cfg(&cfg);
+
+    push_named_job(&cfg, "pre")->respawn = 0;  /* so it is not started here */
+    job_t *j = push_named_job(&cfg, "app");
+    job_t *pre = get_job_by_name(&cfg.jx, "pre");
+    push_arg(j, "/bin/true");
+    push_arg(j, NULL);
+    j->out = strdup("/dev/null");
+    j->err = strdup("/dev/null");
+    char *name = "pre";
+    utarray_push_back(&j->after, &name);
+
+    queue_jobs(&cfg);
+    TEST_ASSERT_EQ(2, run_jobs(&cfg));
+    TEST_ASSERT_EQ(0, j->pid);
+    TEST_ASSERT_EQ(Q_BLOCKED, j->queued);
+    TEST_ASSERT_EQ(1, utarray_len(cfg.blocked));
+
+    /* something happening to its prerequisite brings it back */
+    pre->pid = getpid();
+    queue_job(&cfg, pre);
+    TEST_ASSERT_EQ(0, utarray_len(cfg.blocked));
+    TEST_ASSERT_EQ(2, run_jobs(&cfg));
+    TEST_ASSERT(j->pid > 0);
+    TEST_ASSERT_EQ(0, j->queued);
+    int es;
+    TEST_ASSERT_EQ(j->pid, waitpid(j->pid, &es, 0));
+
+    free_test_cfg(&cfg);
+}
+
+/*
+ * merge_jobs Tests
+ */
+
+/* set aside the jobs of cfg as the previous config, as rescan_config does */
+static UT_array *previous_config(pmtr_t *cfg, job_index *pjx) {
+    UT_array *previous = cfg->jobs;
+    *pjx = cfg->jx;
+    utarray_new(cfg->jobs, &job_mm);
+    memset(&cfg->jx, 0, sizeof(cfg->jx));
+    index_jobs(&cfg->jx, cfg->jobs);
+    return previous;
+}
+
+TEST_CASE(merge_jobs_diff) {
+    pmtr_t cfg;
+    init_test_cfg(&cfg);
+    job_index pjx;
+    job_diff d;
+
+    push_named_job(&cfg, "same")->pid = 1001;
+    push_named_job(&cfg, "changed")->pid = 1002;
+    push_named_job(&cfg, "gone")->pid = 1003;
+    push_named_job(&cfg, "idle");
+    get_job_by_name(&cfg.jx, "same")->parked = 1;
+    get_job_by_name(&cfg.jx, "changed")->start_ts = 42;
+    UT_array *previous = previous_config(&cfg, &pjx);
+
+    push_named_job(&cfg, "new");
+    push_named_job(&cfg, "same");
+    push_named_job(&cfg, "changed")->bounce_interval = 5;
+    merge_jobs(&cfg, previous, &pjx, &d);
+
+    TEST_ASSERT_EQ(1, d.added);
+    TEST_ASSERT_EQ(1, d.changed);
+    TEST_ASSERT_EQ(2, d.removed);
+    TEST_ASSERT_EQ(1, d.unchanged);
+    TEST_ASSERT_EQ(4, job_count(&cfg));
+
+    job_t *j = get_job_by_name(&cfg.jx, "same");
+    TEST_ASSERT_EQ(1001, j->pid);
+    TEST_ASSERT_EQ(0, j->terminate);
+    TEST_ASSERT_EQ(0, j->parked);
+    TEST_ASSERT(get_job_by_pid(&cfg.jx, 1001) == j);
+
+    j = get_job_by_name(&cfg.jx, "changed");
+    TEST_ASSERT_EQ(1002, j->pid);
+    TEST_ASSERT_EQ(42, j->start_ts);
+    TEST_ASSERT_EQ(1, j->terminate);
+    TEST_ASSERT_EQ(5, j->bounce_interval);
+
+    /* a removed job is kept until it exits; an idle one is dropped */
+    j = get_job_by_name(&cfg.jx, "gone(deleted)");
+    TEST_ASSERT(j != NULL);
+    TEST_ASSERT_EQ(1003, j->pid);
+    TEST_ASSERT_EQ(1, j->terminate);
+    TEST_ASSERT_EQ(1, j->delete_when_collected);
+    TEST_ASSERT_EQ(0, j->respawn);
+    TEST_ASSERT(get_job_by_name(&cfg.jx, "idle") == NULL);
+
+    free_test_cfg(&cfg);
+}
+
+TEST_CASE(merge_jobs_keeps_termination) {
+    pmtr_t cfg;
+    init_test_cfg(&cfg);
+    job_index pjx;
+    job_diff d;
+
+    job_t *j = push_named_job(&cfg, "stopping");
+    j->pid = 1001;
+    j->terminate = 12345;  /* SIGTERM sent; SIGKILL due at this time */
+    UT_array *previous = previous_config(&cfg, &pjx);
+
+    push_named_job(&cfg, "stopping")->bounce_interval = 5;
+    merge_jobs(&cfg, previous, &pjx, &d);
+    TEST_ASSERT_EQ(12345, get_job_by_name(&cfg.jx, "stopping")->terminate);
+
+    free_test_cfg(&cfg);
+}
+
+TEST_CASE(merge_jobs_many) {
+    pmtr_t cfg;
+    init_test_cfg(&cfg);
+    job_index pjx;
+    job_diff d;
+    char name[32];
+    int i;
+
+    for(i = 0; i < 5000; i++) {
+        snprintf(name, sizeof(name), "job%d", i);
+        push_named_job(&cfg, name)->pid = 1000 + i;
+    }
+    UT_array *previous = previous_config(&cfg, &pjx);
+
+    /* keep the even jobs, drop the odd ones */
+    for(i = 0; i < 5000; i += 2) {
+        snprintf(name, sizeof(name), "job%d", i);
+        push_named_job(&cfg, name);
+    }
+    merge_jobs(&cfg, previous, &pjx, &d);
+    TEST_ASSERT_EQ(2500, d.unchanged);
+    TEST_ASSERT_EQ(2500, d.removed);
+    TEST_ASSERT_EQ(5000, job_count(&cfg));
+    TEST_ASSERT_EQ(1000 + 4998, get_job_by_name(&cfg.jx, "job4998")->pid);
+    TEST_ASSERT_EQ(1000 + 4999, get_job_by_name(&cfg.jx, "job4999(deleted)")->pid);
+
+    free_test_cfg(&cfg);
+}
+
+/*
+ * fingerprint Tests
+ */
+TEST_CASE(fingerprint_same_definition) {
+    pmtr_t a, b;
+    TEST_ASSERT_EQ(0, test_init());
+    init_test_cfg(&a);
+    init_test_cfg(&b);
+    UT_string *em;
+    utstring_new(em);
+    const char *conf =
+        "job {\n  name app\n  cmd /bin/sleep 10\n  env A=1\n  nice 5\n}\n"
+        "job {\n  name other\n  cmd /bin/true\n}\n";
+
+    TEST_ASSERT_EQ(0, parse_conf(&a, em, conf));
+    TEST_ASSERT_EQ(0, parse_conf(&b, em, conf));
+    job_t *ja = get_job_by_name(&a.jx, "app");
+    job_t *jb = get_job_by_name(&b.jx, "app");
+    TEST_ASSERT(has_fp(ja));
+    TEST_ASSERT(ja->fp[0] == jb->fp[0] && ja->fp[1] == jb->fp[1]);
+    TEST_ASSERT_EQ(0, job_cmp(ja, jb));
+    TEST_ASSERT(a.version == b.version);
+    TEST_ASSERT(a.version != 0);
+
+    utstring_free(em);
+    free_test_cfg(&a);
+    free_test_cfg(&b);
+    test_cleanup();
+}
+
+TEST_CASE(fingerprint_changed_definition) {
+    pmtr_t a, b;
+    TEST_ASSERT_EQ(0, test_init());
+    init_test_cfg(&a);
+    init_test_cfg(&b);
+    UT_string *em;
+    utstring_new(em);
+
+    TEST_ASSERT_EQ(0, parse_conf(&a, em,
+        "job {\n  name app\n  cmd /bin/sleep 10\n  nice 5\n}\n"));
+    TEST_ASSERT_EQ(0, parse_conf(&b, em,
+        "job {\n  name app\n  cmd /bin/sleep 10\n  nice 6\n}\n"));
+    job_t *ja = get_job_by_name(&a.jx, "app");
+    job_t *jb = get_job_by_name(&b.jx, "app");
+    TEST_ASSERT(ja->fp[0] != jb->fp[0] || ja->fp[1] != jb->fp[1]);
+    TEST_ASSERT(job_cmp(ja, jb) != 0);
+    TEST_ASSERT(a.version != b.version);
+
+    utstring_free(em);
+    free_test_cfg(&a);
+    free_test_cfg(&b);
+    test_cleanup();
+}
+
+/* the length of each string is hashed, so moving text between the
+ * arguments of a command changes the fingerprint */
+TEST_CASE(fingerprint_argument_boundaries) {
+    pmtr_t a, b;
+    TEST_ASSERT_EQ(0, test_init());
+    init_test_cfg(&a);
+    init_test_cfg(&b);
+    UT_string *em;
+    utstring_new(em);
+
+    TEST_ASSERT_EQ(0, parse_conf(&a, em,
+        "job {\n  name app\n  cmd /bin/echo ab c\n}\n"));
+    TEST_ASSERT_EQ(0, parse_conf(&b, em,
+        "job {\n  name app\n  cmd /bin/echo a bc\n}\n"));
+    TEST_ASSERT(job_cmp(get_job_at(&a, 0), get_job_at(&b, 0)) != 0);
+
+    utstring_free(em);
+    free_test_cfg(&a);
+    free_test_cfg(&b);
+    test_cleanup();
+}
+
+/* a job after a 'wait' job that is added before it has changed */
+TEST_CASE(fingerprint_implied_after) {
+    pmtr_t a, b;
+    TEST_ASSERT_EQ(0, test_init());
+    init_test_cfg(&a);
+    init_test_cfg(&b);
+    UT_string *em;
+    utstring_new(em);
+
+    TEST_ASSERT_EQ(0, parse_conf(&a, em,
+        "job {\n  name app\n  cmd /bin/true\n}\n"));
+    TEST_ASSERT_EQ(0, parse_conf(&b, em,
+        "job {\n  name setup\n  cmd /bin/true\n  wait\n}\n"
+        "job {\n  name app\n  cmd /bin/true\n}\n"));
+    TEST_ASSERT(job_cmp(get_job_by_name(&a.jx, "app"),
+                        get_job_by_name(&b.jx, "app")) != 0);
+
+    utstring_free(em);
+    free_test_cfg(&a);
+    free_test_cfg(&b);
+    test_cleanup();
 }
 
 /*
@@ -1099,11 +2028,12 @@ TEST_CASE(job_cmp_different_in) {
 }
 
 /*
- * slurp Tests
+ * map_file Tests
  */
-extern int slurp(char *file, char **text, size_t *len);
+extern int map_file(char *file, char **text, size_t *len);
+extern void unmap_file(char *text, size_t len);
 
-TEST_CASE(slurp_existing_file) {
+TEST_CASE(map_file_existing_file) {
     char *text = NULL;
     size_t len = 0;
 
@@ -1117,17 +2047,17 @@ TEST_CASE(slurp_existing_file) {
     char path[512];
     snprintf(path, sizeof(path), "%s/testfile.txt", g_test_tmpdir);
 
-    int rc = slurp(path, &text, &len);
+    int rc = map_file(path, &text, &len);
     TEST_ASSERT_EQ(0, rc);
     TEST_ASSERT_NOT_NULL(text);
     TEST_ASSERT_EQ(13, len);  /* "Hello, World!" is 13 bytes */
     TEST_ASSERT(memcmp(text, "Hello, World!", 13) == 0);
 
-    free(text);
+    unmap_file(text, len);
     test_cleanup();
 }
 
-TEST_CASE(slurp_empty_file) {
+TEST_CASE(map_file_empty_file) {
     char *text = NULL;
     size_t len = 0;
 
@@ -1141,7 +2071,7 @@ TEST_CASE(slurp_empty_file) {
     char path[512];
     snprintf(path, sizeof(path), "%s/empty.txt", g_test_tmpdir);
 
-    int rc = slurp(path, &text, &len);
+    int rc = map_file(path, &text, &len);
     TEST_ASSERT_EQ(0, rc);
     TEST_ASSERT_EQ(0, len);
     TEST_ASSERT_NULL(text);  /* Empty file returns NULL text */
@@ -1149,16 +2079,16 @@ TEST_CASE(slurp_empty_file) {
     test_cleanup();
 }
 
-TEST_CASE(slurp_nonexistent_file) {
+TEST_CASE(map_file_nonexistent_file) {
     char *text = NULL;
     size_t len = 0;
 
-    int rc = slurp("/nonexistent/path/to/file.txt", &text, &len);
+    int rc = map_file("/nonexistent/path/to/file.txt", &text, &len);
     TEST_ASSERT_EQ(-1, rc);
     TEST_ASSERT_NULL(text);
 }
 
-TEST_CASE(slurp_binary_content) {
+TEST_CASE(map_file_binary_content) {
     char *text = NULL;
     size_t len = 0;
 
@@ -1177,16 +2107,16 @@ TEST_CASE(slurp_binary_content) {
         fclose(f);
     }
 
-    int rc = slurp(path, &text, &len);
+    int rc = map_file(path, &text, &len);
     TEST_ASSERT_EQ(0, rc);
     TEST_ASSERT_NOT_NULL(text);
     TEST_ASSERT_EQ(5, len);
 
-    free(text);
+    unmap_file(text, len);
     test_cleanup();
 }
 
-TEST_CASE(slurp_with_nul_bytes) {
+TEST_CASE(map_file_with_nul_bytes) {
     char *text = NULL;
     size_t len = 0;
 
@@ -1205,18 +2135,18 @@ TEST_CASE(slurp_with_nul_bytes) {
         fclose(f);
     }
 
-    int rc = slurp(path, &text, &len);
+    int rc = map_file(path, &text, &len);
     TEST_ASSERT_EQ(0, rc);
     TEST_ASSERT_NOT_NULL(text);
     TEST_ASSERT_EQ(12, len);
     /* Verify NUL bytes are preserved */
     TEST_ASSERT(memcmp(text, "hello\0world\0", 12) == 0);
 
-    free(text);
+    unmap_file(text, len);
     test_cleanup();
 }
 
-TEST_CASE(slurp_larger_file) {
+TEST_CASE(map_file_larger_file) {
     char *text = NULL;
     size_t len = 0;
 
@@ -1238,16 +2168,16 @@ TEST_CASE(slurp_larger_file) {
         fclose(f);
     }
 
-    int rc = slurp(path, &text, &len);
+    int rc = map_file(path, &text, &len);
     TEST_ASSERT_EQ(0, rc);
     TEST_ASSERT_NOT_NULL(text);
     TEST_ASSERT_EQ(102400, len);
 
-    free(text);
+    unmap_file(text, len);
     test_cleanup();
 }
 
-TEST_CASE(slurp_permission_denied) {
+TEST_CASE(map_file_permission_denied) {
     char *text = NULL;
     size_t len = 0;
 
@@ -1272,7 +2202,7 @@ TEST_CASE(slurp_permission_denied) {
     }
     chmod(path, 0000);  /* No permissions */
 
-    int rc = slurp(path, &text, &len);
+    int rc = map_file(path, &text, &len);
     TEST_ASSERT_EQ(-1, rc);
     TEST_ASSERT_NULL(text);
 
@@ -1281,11 +2211,68 @@ TEST_CASE(slurp_permission_denied) {
     test_cleanup();
 }
 
+/* the mapping is of the file itself, and has no size limit */
+TEST_CASE(map_file_over_ten_megabytes) {
+    char *text = NULL;
+    size_t len = 0;
+    size_t big = 11 * 1024 * 1024;
+
+    TEST_ASSERT_EQ(0, test_init());
+    char path[512];
+    snprintf(path, sizeof(path), "%s/big.dat", g_test_tmpdir);
+    FILE *f = fopen(path, "w");
+    TEST_ASSERT_NOT_NULL(f);
+    TEST_ASSERT_EQ(0, ftruncate(fileno(f), big - 4));
+    fseek(f, 0, SEEK_END);
+    fputs("tail", f);
+    fclose(f);
+
+    TEST_ASSERT_EQ(0, map_file(path, &text, &len));
+    TEST_ASSERT_EQ(big, len);
+    TEST_ASSERT(memcmp(text + big - 4, "tail", 4) == 0);
+
+    unmap_file(text, len);
+    test_cleanup();
+}
+
+/* a config past the former 10 MB limit parses */
+TEST_CASE(parse_jobs_large_config) {
+    pmtr_t cfg;
+    UT_string *em;
+    char line[128];
+    int i;
+
+    TEST_ASSERT_EQ(0, test_init());
+    init_test_cfg(&cfg);
+    utstring_new(em);
+    cfg.file = strdup(create_temp_config(NULL));
+    FILE *f = fopen(cfg.file, "w");
+    TEST_ASSERT_NOT_NULL(f);
+    memset(line, '#', sizeof(line) - 2);
+    line[sizeof(line) - 2] = '\n';
+    line[sizeof(line) - 1] = '\0';
+    for(i = 0; i < 100000; i++) {
+        if (i % 100 == 0) fprintf(f, "job {\n  name job%d\n  cmd /bin/true\n}\n", i);
+        fputs(line, f);
+    }
+    fputs("job {\n  name last\n  cmd /bin/true \"quoted arg\"\n}", f);
+    TEST_ASSERT(ftell(f) > 10 * 1024 * 1024);
+    fclose(f);
+
+    TEST_ASSERT_EQ(0, parse_jobs(&cfg, em));
+    TEST_ASSERT_EQ(1001, job_count(&cfg));
+    job_t *job = get_job_by_name(&cfg.jx, "last");
+    TEST_ASSERT_NOT_NULL(job);
+    TEST_ASSERT_STR_EQ("quoted arg", *(char**)utarray_eltptr(&job->cmdv, 1));
+
+    utstring_free(em);
+    free_test_cfg(&cfg);
+    test_cleanup();
+}
+
 /*
  * hash_deps Tests
  */
-extern int hash_deps(UT_array *jobs);
-
 TEST_CASE(hash_deps_no_dependencies) {
     pmtr_t cfg;
     init_test_cfg(&cfg);
@@ -1297,7 +2284,7 @@ TEST_CASE(hash_deps_no_dependencies) {
     utarray_push_back(cfg.jobs, &job);
     job_fin(&job);
 
-    int rc = hash_deps(cfg.jobs);
+    int rc = hash_deps(&cfg);
     TEST_ASSERT_EQ(0, rc);
 
     job_t *j = get_job_at(&cfg, 0);
@@ -1328,7 +2315,7 @@ TEST_CASE(hash_deps_with_dependency) {
     utarray_push_back(cfg.jobs, &job);
     job_fin(&job);
 
-    int rc = hash_deps(cfg.jobs);
+    int rc = hash_deps(&cfg);
     TEST_ASSERT_EQ(0, rc);
 
     job_t *j = get_job_at(&cfg, 0);
@@ -1354,7 +2341,7 @@ TEST_CASE(hash_deps_missing_dependency) {
     utarray_push_back(cfg.jobs, &job);
     job_fin(&job);
 
-    int rc = hash_deps(cfg.jobs);
+    int rc = hash_deps(&cfg);
     /* hash_deps returns 0 but disables the job */
     TEST_ASSERT_EQ(0, rc);
 
@@ -1388,8 +2375,8 @@ TEST_CASE(hash_deps_detects_change) {
     job_fin(&job);
 
     /* First hash */
-    hash_deps(cfg.jobs);
-    int first_hash = get_job_at(&cfg, 0)->deps_hash;
+    hash_deps(&cfg);
+    uint64_t first_hash = get_job_at(&cfg, 0)->deps_hash;
 
     /* Modify the file */
     FILE *f = fopen(dep_path, "w");
@@ -1397,8 +2384,8 @@ TEST_CASE(hash_deps_detects_change) {
     fclose(f);
 
     /* Re-hash */
-    hash_deps(cfg.jobs);
-    int second_hash = get_job_at(&cfg, 0)->deps_hash;
+    hash_deps(&cfg);
+    uint64_t second_hash = get_job_at(&cfg, 0)->deps_hash;
 
     /* Hashes should be different */
     TEST_ASSERT(first_hash != second_hash);
@@ -1407,6 +2394,104 @@ TEST_CASE(hash_deps_detects_change) {
     test_cleanup();
 }
 
+/* jobs that share dependency files have each read once, and again only
+ * once they change */
+TEST_CASE(hash_deps_shared) {
+    pmtr_t cfg;
+    char name[32], *dep;
+    int i;
+
+    TEST_ASSERT_EQ(0, test_init());
+    init_test_cfg(&cfg);
+    char *files[3];
+    files[0] = strdup(create_temp_file("tls.pem", "cert"));
+    files[1] = strdup(create_temp_file("common.conf", "common"));
+    files[2] = strdup(create_temp_file("hosts", "hosts"));
+    for(i = 0; i < 3; i++) {
+        struct timespec ts[2];
+        clock_gettime(CLOCK_REALTIME, &ts[0]);
+        ts[0].tv_sec -= 10;  /* old enough to be trusted by its mtime */
+        ts[1] = ts[0];
+        utimensat(AT_FDCWD, files[i], ts, 0);
+    }
+
+    for(i = 0; i < 400; i++) {
+        snprintf(name, sizeof(name), "job%d", i);
+        job_t *j = push_named_job(&cfg, name);
+        dep = files[i % 3];
+        utarray_push_back(&j->depv, &dep);
+    }
+
+    TEST_ASSERT_EQ(0, hash_deps(&cfg));
+    TEST_ASSERT_EQ(3, (int)cfg.dc.reads);
+    TEST_ASSERT_EQ(3, (int)cfg.dc.stats);
+    TEST_ASSERT(get_job_at(&cfg, 0)->deps_hash == get_job_at(&cfg, 3)->deps_hash);
+    TEST_ASSERT(get_job_at(&cfg, 0)->deps_hash != get_job_at(&cfg, 1)->deps_hash);
+
+    /* as on a reload */
+    TEST_ASSERT_EQ(0, hash_deps(&cfg));
+    TEST_ASSERT_EQ(3, (int)cfg.dc.reads);
+    TEST_ASSERT_EQ(6, (int)cfg.dc.stats);
+
+    for(i = 0; i < 3; i++) free(files[i]);
+    free_test_cfg(&cfg);
+    test_cleanup();
+}
+
+TEST_CASE(deps_changed_restarts_dependents) {
+    pmtr_t cfg;
+    UT_array *names;
+    char *name, *dep;
+
+    TEST_ASSERT_EQ(0, test_init());
+    init_test_cfg(&cfg);
+    utarray_new(names, &ut_str_icd);
+    char *a = strdup(create_temp_file("a.conf", "a"));
+    char *b = strdup(create_temp_file("b.conf", "b"));
+
+    job_t *j = push_named_job(&cfg, "runs");
+    dep = a; utarray_push_back(&j->depv, &dep);
+    j = push_named_job(&cfg, "idle");
+    dep = a; utarray_push_back(&j->depv, &dep);
+    j = push_named_job(&cfg, "other");
+    dep = b; utarray_push_back(&j->depv, &dep);
+    index_free(&cfg.jx);
+    index_jobs(&cfg.jx, cfg.jobs);
+    TEST_ASSERT_EQ(0, hash_deps(&cfg));
+    get_job_at(&cfg, 0)->pid = 12345;   /* not signalled; only flagged */
+
+    /* unchanged content: nothing to do */
+    name = "runs"; utarray_push_back(names, &name);
+    name = "idle"; utarray_push_back(names, &name);
+    TEST_ASSERT_EQ(0, deps_changed(&cfg, names));
+    TEST_ASSERT_EQ(0, get_job_at(&cfg, 0)->terminate);
+    TEST_ASSERT_EQ(0, (int)utarray_len(cfg.stopping));
+
+    FILE *f = fopen(a, "w"); fputs("a2", f); fclose(f);
+    TEST_ASSERT_EQ(0, deps_changed(&cfg, names));
+    TEST_ASSERT_EQ(1, get_job_at(&cfg, 0)->terminate);
+    TEST_ASSERT_EQ(0, get_job_at(&cfg, 1)->terminate);  /* not running */
+    TEST_ASSERT(get_job_at(&cfg, 0)->queued & Q_STOP);
+    TEST_ASSERT(get_job_at(&cfg, 1)->queued);
+    TEST_ASSERT_EQ(0, get_job_at(&cfg, 2)->queued);     /* not named */
+
+    /* a rescan now would find the jobs unchanged */
+    uint64_t was = get_job_at(&cfg, 1)->deps_hash;
+    TEST_ASSERT_EQ(0, hash_deps(&cfg));
+    TEST_ASSERT(get_job_at(&cfg, 1)->deps_hash == was);
+
+    /* a dependency that is gone disables the job */
+    unlink(a);
+    TEST_ASSERT_EQ(2, deps_changed(&cfg, names));
+    TEST_ASSERT_EQ(1, get_job_at(&cfg, 1)->disabled);
+
+    get_job_at(&cfg, 0)->pid = 0;
+    free(a); free(b);
+    utarray_free(names);
+    free_test_cfg(&cfg);
+    test_cleanup();
+}
+
 TEST_CASE(hash_deps_multiple_dependencies) {
     pmtr_t cfg;
 
@@ -1438,7 +2523,7 @@ TEST_CASE(hash_deps_multiple_dependencies) {
     utarray_push_back(cfg.jobs, &job);
     job_fin(&job);
 
-    int rc = hash_deps(cfg.jobs);
+    int rc = hash_deps(&cfg);
     TEST_ASSERT_EQ(0, rc);
 
     job_t *j = get_job_at(&cfg, 0);
@@ -1480,7 +2565,7 @@ TEST_CASE(hash_deps_binary_dependency) {
     utarray_push_back(cfg.jobs, &job);
     job_fin(&job);
 
-    int rc = hash_deps(cfg.jobs);
+    int rc = hash_deps(&cfg);
     TEST_ASSERT_EQ(0, rc);
 
     job_t *j = get_job_at(&cfg, 0);
@@ -1528,7 +2613,7 @@ TEST_CASE(hash_deps_permission_denied) {
     utarray_push_back(cfg.jobs, &job);
     job_fin(&job);
 
-    int rc = hash_deps(cfg.jobs);
+    int rc = hash_deps(&cfg);
     TEST_ASSERT_EQ(0, rc);
 
     job_t *j = get_job_at(&cfg, 0);
@@ -1563,7 +2648,7 @@ TEST_CASE(hash_deps_empty_dependency_file) {
     utarray_push_back(cfg.jobs, &job);
     job_fin(&job);
 
-    int rc = hash_deps(cfg.jobs);
+    int rc = hash_deps(&cfg);
     TEST_ASSERT_EQ(0, rc);
 
     job_t *j = get_job_at(&cfg, 0);
@@ -1671,20 +2756,76 @@ int main(int argc, char *argv[]) {
     RUN_TEST(term_jobs_already_terminating);
     TEST_SUITE_END();
 
-    TEST_SUITE_BEGIN("alarm_within");
-    RUN_TEST(alarm_within_first_call);
-    RUN_TEST(alarm_within_earlier_alarm);
-    RUN_TEST(alarm_within_zero_becomes_one);
+    TEST_SUITE_BEGIN("collect_job");
+    RUN_TEST(collect_job_reaps_exited_child);
+    RUN_TEST(collect_job_unknown_pid);
+    RUN_TEST(collect_job_backoff);
+    RUN_TEST(collect_job_breaker);
+    RUN_TEST(collect_job_requested_exit);
+    TEST_SUITE_END();
+
+    TEST_SUITE_BEGIN("timer_job");
+    RUN_TEST(timer_job_first_call);
+    RUN_TEST(timer_job_earlier_deadline);
+    RUN_TEST(timer_job_later_deadline_covered);
+    RUN_TEST(job_timer_clears_pending);
+    TEST_SUITE_END();
+
+    TEST_SUITE_BEGIN("spawn_job");
+    RUN_TEST(spawn_job_shared_vm);
+    RUN_TEST(spawn_job_copied_vm);
+    RUN_TEST(spawn_job_setup_failure);
+    RUN_TEST(spawn_plan_at_parse);
+    RUN_TEST(spawn_plan_copied);
+    TEST_SUITE_END();
+
+    TEST_SUITE_BEGIN("after");
+    RUN_TEST(after_orders_jobs);
+    RUN_TEST(after_implied_by_wait);
+    RUN_TEST(after_mixed_with_wait);
+    RUN_TEST(after_wait_on_later_job);
+    RUN_TEST(after_unknown_job);
+    RUN_TEST(after_circular);
+    RUN_TEST(after_holds_start);
+    TEST_SUITE_END();
+
+    TEST_SUITE_BEGIN("job queues");
+    RUN_TEST(queue_runs_only_queued);
+    RUN_TEST(queue_skips_erased);
+    RUN_TEST(queue_collected_job);
+    RUN_TEST(queue_wakes_blocked);
+    TEST_SUITE_END();
+
+    TEST_SUITE_BEGIN("merge_jobs");
+    RUN_TEST(merge_jobs_diff);
+    RUN_TEST(merge_jobs_keeps_termination);
+    RUN_TEST(merge_jobs_many);
+    TEST_SUITE_END();
+
+    TEST_SUITE_BEGIN("fingerprint");
+    RUN_TEST(fingerprint_same_definition);
+    RUN_TEST(fingerprint_changed_definition);
+    RUN_TEST(fingerprint_argument_boundaries);
+    RUN_TEST(fingerprint_implied_after);
+    TEST_SUITE_END();
+
+    TEST_SUITE_BEGIN("job index");
+    RUN_TEST(job_index_many_jobs);
+    RUN_TEST(job_index_pid_updates);
+    RUN_TEST(job_index_erase);
+    RUN_TEST(job_index_after_sort);
     TEST_SUITE_END();
 
-    TEST_SUITE_BEGIN("slurp");
-    RUN_TEST(slurp_existing_file);
-    RUN_TEST(slurp_empty_file);
-    RUN_TEST(slurp_nonexistent_file);
-    RUN_TEST(slurp_binary_content);
-    RUN_TEST(slurp_with_nul_bytes);
-    RUN_TEST(slurp_larger_file);
-    RUN_TEST(slurp_permission_denied);
+    TEST_SUITE_BEGIN("map_file");
+    RUN_TEST(map_file_existing_file);
+    RUN_TEST(map_file_empty_file);
+    RUN_TEST(map_file_nonexistent_file);
+    RUN_TEST(map_file_binary_content);
+    RUN_TEST(map_file_with_nul_bytes);
+    RUN_TEST(map_file_larger_file);
+    RUN_TEST(map_file_permission_denied);
+    RUN_TEST(map_file_over_ten_megabytes);
+    RUN_TEST(parse_jobs_large_config);
     TEST_SUITE_END();
 
     TEST_SUITE_BEGIN("hash_deps");
@@ -1696,6 +2837,8 @@ int main(int argc, char *argv[]) {
     RUN_TEST(hash_deps_binary_dependency);
     RUN_TEST(hash_deps_permission_denied);
     RUN_TEST(hash_deps_empty_dependency_file);
+    RUN_TEST(hash_deps_shared);
+    RUN_TEST(deps_changed_restarts_dependents);
     TEST_SUITE_END();
 
     TEST_SUITE_BEGIN("fpath extended");
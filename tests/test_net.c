@@ -456,13 +456,12 @@ TEST_CASE(udp_enable_disabled_job) {
     job_fin(&job);
 
     /* Simulate what decode_msg does for "enable myjob" */
-    job_t *j = get_job_by_name(cfg.jobs, "myjob");
+    job_t *j = get_job_by_name(&cfg.jx, "myjob");
     TEST_ASSERT_NOT_NULL(j);
     TEST_ASSERT_EQ(1, j->disabled);
 
     /* Enable the job (what decode_msg would do) */
     j->disabled = 0;
-    alarm_within(&cfg, 1);
 
     TEST_ASSERT_EQ(0, j->disabled);
 
@@ -483,7 +482,7 @@ TEST_CASE(udp_disable_enabled_job) {
     utarray_push_back(cfg.jobs, &job);
     job_fin(&job);
 
-    job_t *j = get_job_by_name(cfg.jobs, "myjob");
+    job_t *j = get_job_by_name(&cfg.jx, "myjob");
     TEST_ASSERT_NOT_NULL(j);
 
     /* Disable the job (what decode_msg would do) */
@@ -491,10 +490,26 @@ TEST_CASE(udp_disable_enabled_job) {
     if (j->pid) {
         if (j->terminate == 0) j->terminate = 1;
     }
-    alarm_within(&cfg, 1);
+    report_within(&cfg, 1);
 
     TEST_ASSERT_EQ(1, j->disabled);
     TEST_ASSERT_EQ(1, j->terminate);
+    TEST_ASSERT_EQ_SIZE(0, cfg.tw.n);  /* no report destinations, no timer */
+
+    free_test_cfg(&cfg);
+}
+
+TEST_CASE(report_within_sooner) {
+    pmtr_t cfg;
+    init_test_cfg(&cfg);
+    int fd = -1;  /* a destination; nothing is sent */
+    utarray_push_back(cfg.report, &fd);
+
+    report_within(&cfg, 10);
+    report_within(&cfg, 1);  /* moves the report up, not a second one */
+
+    TEST_ASSERT_EQ_SIZE(1, cfg.tw.n);
+    TEST_ASSERT(cfg.report_at <= time(NULL) + 1);
 
     free_test_cfg(&cfg);
 }
@@ -511,7 +526,7 @@ TEST_CASE(udp_enable_already_enabled) {
     utarray_push_back(cfg.jobs, &job);
     job_fin(&job);
 
-    job_t *j = get_job_by_name(cfg.jobs, "myjob");
+    job_t *j = get_job_by_name(&cfg.jx, "myjob");
 
     /* Enabling an already enabled job is a no-op */
     int was_disabled = j->disabled;
@@ -537,7 +552,7 @@ TEST_CASE(udp_disable_already_disabled) {
     utarray_push_back(cfg.jobs, &job);
     job_fin(&job);
 
-    job_t *j = get_job_by_name(cfg.jobs, "myjob");
+    job_t *j = get_job_by_name(&cfg.jx, "myjob");
 
     /* Disabling an already disabled job is a no-op */
     int was_disabled = j->disabled;
@@ -564,7 +579,7 @@ TEST_CASE(udp_control_unknown_job) {
     job_fin(&job);
 
     /* Try to find a non-existent job (what decode_msg does) */
-    job_t *j = get_job_by_name(cfg.jobs, "unknownjob");
+    job_t *j = get_job_by_name(&cfg.jx, "unknownjob");
 
     /* Should return NULL and be ignored */
     TEST_ASSERT_NULL(j);
@@ -598,9 +613,9 @@ TEST_CASE(udp_control_multiple_jobs) {
     job_fin(&job3);
 
     /* Simulate "enable job1 job2" message processing */
-    job_t *j1 = get_job_by_name(cfg.jobs, "job1");
-    job_t *j2 = get_job_by_name(cfg.jobs, "job2");
-    job_t *j3 = get_job_by_name(cfg.jobs, "job3");
+    job_t *j1 = get_job_by_name(&cfg.jx, "job1");
+    job_t *j2 = get_job_by_name(&cfg.jx, "job2");
+    job_t *j3 = get_job_by_name(&cfg.jx, "job3");
 
     j1->disabled = 0;
     j2->disabled = 0;
@@ -651,6 +666,7 @@ int main(int argc, char *argv[]) {
     TEST_SUITE_BEGIN("UDP Control Message Simulation");
     RUN_TEST(udp_enable_disabled_job);
     RUN_TEST(udp_disable_enabled_job);
+    RUN_TEST(report_within_sooner);
     RUN_TEST(udp_enable_already_enabled);
     RUN_TEST(udp_disable_already_disabled);
     RUN_TEST(udp_control_unknown_job);
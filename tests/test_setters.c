@@ -813,6 +813,133 @@ TEST_CASE(set_bounce_non_numeric) {
     free_test_cfg(&cfg);
 }
 
+/*
+ * set_backoff / set_jitter / set_breaker Tests
+ */
+TEST_CASE(set_backoff_defaults) {
+    job_t job;
+    job_ini(&job);
+
+    /* without backoff, a quick exit is delayed by a fixed SHORT_DELAY */
+    TEST_ASSERT_EQ(SHORT_DELAY, job.backoff_min);
+    TEST_ASSERT_EQ(SHORT_DELAY, job.backoff_max);
+    TEST_ASSERT(job.backoff_factor == 1);
+    TEST_ASSERT_EQ(0, job.breaker_count);
+
+    job_fin(&job);
+}
+
+TEST_CASE(set_backoff_basic) {
+    pmtr_t cfg;
+    job_t job;
+    UT_string *em;
+    parse_t ps;
+
+    init_test_cfg(&cfg);
+    job_ini(&job);
+    utstring_new(em);
+    init_test_parse(&ps, &cfg, &job, em);
+
+    char min[] = "1s", max[] = "5m";
+    set_backoff(&ps, min, max, NULL);
+
+    TEST_ASSERT_EQ(0, ps.rc);
+    TEST_ASSERT_EQ(1, job.backoff_min);
+    TEST_ASSERT_EQ(300, job.backoff_max);
+    TEST_ASSERT(job.backoff_factor == 2);
+
+    char factor[] = "1.5";
+    set_backoff(&ps, min, max, factor);
+    TEST_ASSERT_EQ(0, ps.rc);
+    TEST_ASSERT(job.backoff_factor == 1.5);
+
+    job_fin(&job);
+    utstring_free(em);
+    free_test_cfg(&cfg);
+}
+
+TEST_CASE(set_backoff_invalid) {
+    pmtr_t cfg;
+    job_t job;
+    UT_string *em;
+    parse_t ps;
+
+    init_test_cfg(&cfg);
+    job_ini(&job);
+    utstring_new(em);
+    init_test_parse(&ps, &cfg, &job, em);
+
+    char min[] = "5m", max[] = "1m";
+    set_backoff(&ps, min, max, NULL);
+    TEST_ASSERT_EQ(-1, ps.rc);
+
+    ps.rc = 0;
+    char lo[] = "1s", hi[] = "1m", factor[] = "0.5";
+    set_backoff(&ps, lo, hi, factor);
+    TEST_ASSERT_EQ(-1, ps.rc);
+
+    ps.rc = 0;
+    char bad[] = "10x";
+    set_backoff(&ps, lo, bad, NULL);
+    TEST_ASSERT_EQ(-1, ps.rc);
+
+    job_fin(&job);
+    utstring_free(em);
+    free_test_cfg(&cfg);
+}
+
+TEST_CASE(set_jitter_percent) {
+    pmtr_t cfg;
+    job_t job;
+    UT_string *em;
+    parse_t ps;
+
+    init_test_cfg(&cfg);
+    job_ini(&job);
+    utstring_new(em);
+    init_test_parse(&ps, &cfg, &job, em);
+
+    set_jitter(&ps, "20%");
+    TEST_ASSERT_EQ(0, ps.rc);
+    TEST_ASSERT_EQ(20, job.jitter);
+
+    set_jitter(&ps, "10");
+    TEST_ASSERT_EQ(0, ps.rc);
+    TEST_ASSERT_EQ(10, job.jitter);
+
+    set_jitter(&ps, "150%");
+    TEST_ASSERT_EQ(-1, ps.rc);
+
+    job_fin(&job);
+    utstring_free(em);
+    free_test_cfg(&cfg);
+}
+
+TEST_CASE(set_breaker_basic) {
+    pmtr_t cfg;
+    job_t job;
+    UT_string *em;
+    parse_t ps;
+
+    init_test_cfg(&cfg);
+    job_ini(&job);
+    utstring_new(em);
+    init_test_parse(&ps, &cfg, &job, em);
+
+    char window[] = "10m";
+    set_breaker(&ps, "5", window);
+    TEST_ASSERT_EQ(0, ps.rc);
+    TEST_ASSERT_EQ(5, job.breaker_count);
+    TEST_ASSERT_EQ(600, job.breaker_window);
+
+    set_breaker(&ps, "0", window);
+    TEST_ASSERT_EQ(-1, ps.rc);
+
+    job_fin(&job);
+    utstring_free(em);
+    free_test_cfg(&cfg);
+}
+
 /*
  * set_cpu Tests
  */
@@ -1945,6 +2072,14 @@ int main(int argc, char *argv[]) {
     RUN_TEST(set_bounce_non_numeric);
     TEST_SUITE_END();
 
+    TEST_SUITE_BEGIN("set_backoff");
+    RUN_TEST(set_backoff_defaults);
+    RUN_TEST(set_backoff_basic);
+    RUN_TEST(set_backoff_invalid);
+    RUN_TEST(set_jitter_percent);
+    RUN_TEST(set_breaker_basic);
+    TEST_SUITE_END();
+
     TEST_SUITE_BEGIN("set_cpu");
     RUN_TEST(set_cpu_single);
     RUN_TEST(set_cpu_range);
@@ -0,0 +1,209 @@
+/*
+ * Unit Tests for pmtr Timer Wheel (timer.c)
+ * Tests insertion, cascading and expiration of timer entries
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "test_framework.h"
+#include "../src/timer.h"
+
+/* Helper to count and free an expired list */
+static int count_expired(tw_entry *e) {
+    tw_entry *next;
+    int n = 0;
+    for( ; e; e = next) {
+        next = e->next;
+        tw_free(e);
+        n++;
+    }
+    return n;
+}
+
+/* Start a wheel ahead of the real clock, so an empty wheel never jumps
+ * to the present and the tests can use exact times relative to it */
+static uint64_t init_wheel(timer_wheel *tw) {
+    memset(tw, 0, sizeof(*tw));
+    tw->now = tw_clock() + 3600000;
+    return tw->now;
+}
+
+/*
+ * tw_add / tw_expire Tests
+ */
+TEST_CASE(tw_empty_has_no_next) {
+    timer_wheel tw;
+    memset(&tw, 0, sizeof(tw));
+    TEST_ASSERT(tw_next(&tw) == 0);
+    TEST_ASSERT_NULL(tw_expire(&tw, tw_clock()));
+}
+
+TEST_CASE(tw_expire_level0) {
+    timer_wheel tw;
+    uint64_t t0 = init_wheel(&tw);
+    TEST_ASSERT_EQ(0, tw_add(&tw, TIMER_JOB, "a", t0 + 50));
+
+    TEST_ASSERT(tw_next(&tw) == t0 + 50);
+    TEST_ASSERT_EQ(0, count_expired(tw_expire(&tw, t0 + 49)));
+    TEST_ASSERT_EQ(1, count_expired(tw_expire(&tw, t0 + 50)));
+    TEST_ASSERT_EQ_SIZE(0, tw.n);
+    TEST_ASSERT(tw_next(&tw) == 0);
+}
+
+TEST_CASE(tw_expire_returns_name) {
+    timer_wheel tw;
+    uint64_t t0 = init_wheel(&tw);
+    tw_add(&tw, TIMER_JOB, "myjob", t0 + 10);
+
+    tw_entry *e = tw_expire(&tw, t0 + 10);
+    TEST_ASSERT_NOT_NULL(e);
+    TEST_ASSERT_EQ(TIMER_JOB, e->kind);
+    TEST_ASSERT_STR_EQ("myjob", e->name);
+    TEST_ASSERT_NULL(e->next);
+    tw_free(e);
+}
+
+TEST_CASE(tw_cascade_from_higher_levels) {
+    timer_wheel tw;
+    uint64_t t0 = init_wheel(&tw);
+    tw_add(&tw, TIMER_JOB, "a", t0 + 300);           /* level 1 */
+    tw_add(&tw, TIMER_JOB, "b", t0 + 70000);         /* level 2 */
+    tw_add(&tw, TIMER_JOB, "c", t0 + 20000000);      /* level 3 */
+
+    TEST_ASSERT(tw_next(&tw) == t0 + 300);
+    TEST_ASSERT_EQ(0, count_expired(tw_expire(&tw, t0 + 299)));
+    TEST_ASSERT_EQ(1, count_expired(tw_expire(&tw, t0 + 300)));
+    TEST_ASSERT(tw_next(&tw) == t0 + 70000);
+    TEST_ASSERT_EQ(0, count_expired(tw_expire(&tw, t0 + 69999)));
+    TEST_ASSERT_EQ(1, count_expired(tw_expire(&tw, t0 + 70000)));
+    TEST_ASSERT(tw_next(&tw) == t0 + 20000000);
+    TEST_ASSERT_EQ(0, count_expired(tw_expire(&tw, t0 + 19999999)));
+    TEST_ASSERT_EQ(1, count_expired(tw_expire(&tw, t0 + 20000000)));
+    TEST_ASSERT_EQ_SIZE(0, tw.n);
+}
+
+TEST_CASE(tw_next_sees_higher_level_first) {
+    timer_wheel tw;
+    uint64_t t0 = init_wheel(&tw);
+    t0 &= ~(uint64_t)TW_MASK;      /* no cascade in the first 256 ms */
+    tw.now = t0;
+    tw_add(&tw, TIMER_JOB, "a", t0 + 300);           /* level 1 */
+    TEST_ASSERT_EQ(0, count_expired(tw_expire(&tw, t0 + 199)));
+    tw_add(&tw, TIMER_JOB, "b", t0 + 400);           /* level 0 */
+
+    TEST_ASSERT(tw_next(&tw) == t0 + 300);
+    TEST_ASSERT_EQ(1, count_expired(tw_expire(&tw, t0 + 300)));
+    TEST_ASSERT(tw_next(&tw) == t0 + 400);
+    TEST_ASSERT_EQ(1, count_expired(tw_expire(&tw, t0 + 400)));
+}
+
+TEST_CASE(tw_beyond_wheel_range) {
+    timer_wheel tw;
+    uint64_t t0 = init_wheel(&tw);
+    uint64_t far = t0 + 5000000000ULL;  /* more than 2^32 ms ahead */
+    tw_add(&tw, TIMER_REPORT, NULL, far);
+
+    TEST_ASSERT(tw_next(&tw) == far);
+    TEST_ASSERT_EQ(0, count_expired(tw_expire(&tw, far - 1)));
+    TEST_ASSERT_EQ(1, count_expired(tw_expire(&tw, far)));
+}
+
+TEST_CASE(tw_overdue_fires_next_tick) {
+    timer_wheel tw;
+    uint64_t t0 = init_wheel(&tw);
+    tw_add(&tw, TIMER_JOB, "late", t0 - 10);
+
+    TEST_ASSERT(tw_next(&tw) == t0);
+    TEST_ASSERT_EQ(1, count_expired(tw_expire(&tw, t0)));
+}
+
+TEST_CASE(tw_many_entries_in_order) {
+    timer_wheel tw;
+    uint64_t t, last = 0;
+    int i, n = 0;
+    uint64_t t0 = init_wheel(&tw);
+    for(i = 0; i < 1000; i++) {
+        tw_add(&tw, TIMER_JOB, "x", t0 + (uint64_t)(i * 7919) % 100000 + 1);
+    }
+
+    /* walking from one next expiration to the next finds them all */
+    while ((t = tw_next(&tw)) != 0) {
+        TEST_ASSERT(t >= last);
+        n += count_expired(tw_expire(&tw, t));
+        last = t;
+    }
+    TEST_ASSERT_EQ(1000, n);
+}
+
+TEST_CASE(tw_del_by_kind_and_name) {
+    timer_wheel tw;
+    uint64_t t0 = init_wheel(&tw);
+    tw_add(&tw, TIMER_JOB, "a", t0 + 10);
+    tw_add(&tw, TIMER_JOB, "b", t0 + 20);
+    tw_add(&tw, TIMER_WATCH, NULL, t0 + 5);
+    tw_add(&tw, TIMER_WATCH, NULL, t0 + 100000);
+
+    TEST_ASSERT_EQ(2, tw_del(&tw, TIMER_WATCH, NULL));
+    TEST_ASSERT_EQ_SIZE(2, tw.n);
+    TEST_ASSERT(tw_next(&tw) == t0 + 10);
+    TEST_ASSERT_EQ(1, tw_del(&tw, TIMER_JOB, "a"));
+    TEST_ASSERT_EQ(0, tw_del(&tw, TIMER_JOB, "a"));
+    TEST_ASSERT(tw_next(&tw) == t0 + 20);
+    TEST_ASSERT_EQ(1, count_expired(tw_expire(&tw, t0 + 100000)));
+    TEST_ASSERT_EQ_SIZE(0, tw.n);
+}
+
+TEST_CASE(tw_clear_frees_all) {
+    timer_wheel tw;
+    uint64_t t0 = init_wheel(&tw);
+    tw_add(&tw, TIMER_JOB, "a", t0 + 10);
+    tw_add(&tw, TIMER_JOB, "b", t0 + 100000);
+    tw_clear(&tw);
+
+    TEST_ASSERT_EQ_SIZE(0, tw.n);
+    TEST_ASSERT(tw_next(&tw) == 0);
+}
+
+/*
+ * tw_at Tests
+ */
+TEST_CASE(tw_at_past_deadline_is_due) {
+    uint64_t now = tw_clock();
+    uint64_t at = tw_at(time(NULL) - 10);
+    TEST_ASSERT(at >= now);
+    TEST_ASSERT(at <= now + 10);
+}
+
+TEST_CASE(tw_at_future_deadline) {
+    uint64_t now = tw_clock();
+    uint64_t at = tw_at(time(NULL) + 5);
+    TEST_ASSERT(at > now + 4000);
+    TEST_ASSERT(at <= now + 5001);
+}
+
+int main(int argc, char *argv[]) {
+    (void)argc; (void)argv;
+    printf("pmtr Timer Wheel Tests\n");
+
+    TEST_SUITE_BEGIN("tw_add / tw_expire");
+    RUN_TEST(tw_empty_has_no_next);
+    RUN_TEST(tw_expire_level0);
+    RUN_TEST(tw_expire_returns_name);
+    RUN_TEST(tw_cascade_from_higher_levels);
+    RUN_TEST(tw_next_sees_higher_level_first);
+    RUN_TEST(tw_beyond_wheel_range);
+    RUN_TEST(tw_overdue_fires_next_tick);
+    RUN_TEST(tw_many_entries_in_order);
+    RUN_TEST(tw_del_by_kind_and_name);
+    RUN_TEST(tw_clear_frees_all);
+    TEST_SUITE_END();
+
+    TEST_SUITE_BEGIN("tw_at");
+    RUN_TEST(tw_at_past_deadline_is_due);
+    RUN_TEST(tw_at_future_deadline);
+    TEST_SUITE_END();
+
+    print_test_results();
+    return get_test_exit_code();
+}
@@ -744,6 +744,90 @@ TEST_CASE(tok_keyword_like_prefix_in_string) {
 /*
  * Test Runner
  */
+TEST_CASE(tok_keyword_after_text_on_first_line) {
+    /* the first byte of the buffer counts as text before the keyword */
+    token_info_t tokens[10];
+    char input[] = "x job }\n";
+    int count = tokenize_all(input, tokens, 10);
+
+    TEST_ASSERT_EQ(3, count);
+    TEST_ASSERT_EQ(TOK_STR, tokens[1].id);
+    TEST_ASSERT_EQ(TOK_STR, tokens[2].id);
+}
+
+TEST_CASE(tok_keyword_after_comment_line) {
+    token_info_t tokens[10];
+    char input[] = "# a comment\n   name x # trailing\n\tuser y";
+    int count = tokenize_all(input, tokens, 10);
+
+    TEST_ASSERT_EQ(4, count);
+    TEST_ASSERT_EQ(TOK_NAME, tokens[0].id);
+    TEST_ASSERT_EQ(2, tokens[0].line);
+    TEST_ASSERT_EQ(TOK_USER, tokens[2].id);
+    TEST_ASSERT_EQ(3, tokens[2].line);
+}
+
+TEST_CASE(tok_keyword_after_wide_whitespace) {
+    /* a keyword after a run of blanks in mid line is still mid line */
+    static char input[20000];
+    token_info_t tokens[10];
+    size_t n;
+
+    strcpy(input, "cmd");
+    n = strlen(input);
+    memset(input + n, ' ', 10000);
+    strcpy(input + n + 10000, "name every\n");
+    int count = tokenize_all(input, tokens, 10);
+
+    TEST_ASSERT_EQ(3, count);
+    TEST_ASSERT_EQ(TOK_STR, tokens[1].id);
+    TEST_ASSERT_EQ(TOK_EVERY, tokens[2].id);
+}
+
+TEST_CASE(tok_long_line_of_words) {
+    /* as a generated config might have: one line, very many words */
+    static char input[200000];
+    char *p = input, *c;
+    size_t bsz, toksz;
+    int i, id, line = 1, strs = 0, other = 0;
+
+    p += sprintf(p, "cmd /bin/true");
+    for(i = 0; i < 10000; i++) p += sprintf(p, " job%d name on", i);
+    p += sprintf(p, "\n");
+
+    c = input;
+    bsz = p - input;
+    while ((id = get_tok(input, &c, &bsz, &toksz, &line)) > 0) {
+        if (id == TOK_STR) strs++;
+        else if (id != TOK_CMD) other++;
+        c += toksz;
+        bsz -= toksz;
+    }
+    TEST_ASSERT_EQ(0, id);
+    TEST_ASSERT_EQ(1 + 20000, strs);   /* the path, jobN and name */
+    TEST_ASSERT_EQ(10000, other);      /* on */
+    TEST_ASSERT_EQ(2, line);
+}
+
+TEST_CASE(tok_word_ends_at_each_whitespace) {
+    /* words of every length up to past eight bytes, ended each way */
+    char input[64];
+    const char *ends = " \t\r\n";
+    size_t len, toksz;
+    int e;
+
+    for(len = 1; len < 20; len++) {
+        for(e = 0; e < 4; e++) {
+            memset(input, 'x', len);
+            input[len] = ends[e];
+            memset(input + len + 1, 'y', 10);
+            input[len + 11] = '\0';
+            TEST_ASSERT_EQ(TOK_STR, tokenize_single(input, &toksz));
+            TEST_ASSERT_EQ(len, toksz);
+        }
+    }
+}
+
 int main(int argc, char *argv[]) {
     (void)argc; (void)argv;
 
@@ -855,6 +939,11 @@ int main(int argc, char *argv[]) {
     RUN_TEST(tok_adjacent_quoted_strings);
     RUN_TEST(tok_mixed_tokens_complex);
     RUN_TEST(tok_keyword_like_prefix_in_string);
+    RUN_TEST(tok_keyword_after_text_on_first_line);
+    RUN_TEST(tok_keyword_after_comment_line);
+    RUN_TEST(tok_keyword_after_wide_whitespace);
+    RUN_TEST(tok_long_line_of_words);
+    RUN_TEST(tok_word_ends_at_each_whitespace);
     TEST_SUITE_END();
 
     print_test_results();
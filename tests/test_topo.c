@@ -0,0 +1,300 @@
+/*
+ * Unit Tests for pmtr CPU Topology (topo.c)
+ * Tests the order in which instances are placed on cpus, a core at a time,
+ * and the cpu selectors, from a topology laid out in a scratch sysfs tree
+ */
+
+#define _GNU_SOURCE
+#include "test_framework.h"
+#include "test_helpers.h"
+
+static char root[512];
+
+static void setup(void) {
+    TEST_ASSERT_EQ(0, test_init());
+    snprintf(root, sizeof(root), "%s/sys", g_test_tmpdir);
+}
+
+/* a file under the scratch sysfs root, with the directories to it */
+static void put_sys(const char *rel, const char *text) {
+    char path[600], *c;
+
+    snprintf(path, sizeof(path), "%s/%s", root, rel);
+    for(c = path + strlen(g_test_tmpdir); (c = strchr(c + 1, '/')); ) {
+        *c = '\0';
+        mkdir(path, 0755);
+        *c = '/';
+    }
+    snprintf(path, sizeof(path), "sys/%s", rel);
+    TEST_ASSERT_NOT_NULL(create_temp_file(path, text));
+}
+
+/* a cpu whose core has the threads in list */
+static void put_cpu(int cpu, const char *list) {
+    char rel[128];
+    snprintf(rel, sizeof(rel), "cpu/cpu%d/topology/thread_siblings_list", cpu);
+    put_sys(rel, list);
+}
+
+/* two sockets, each a NUMA node, of two cores of two threads: cpus 0-3
+ * and 4-7, with the second threads numbered after the first (0 and 2 are
+ * a core) */
+static void put_host(void) {
+    char rel[128], text[16];
+    int i;
+
+    for(i = 0; i < 8; i++) {
+        snprintf(text, sizeof(text), "%d,%d\n", i & ~2, i | 2);
+        put_cpu(i, text);
+        snprintf(rel, sizeof(rel), "cpu/cpu%d/topology/physical_package_id", i);
+        put_sys(rel, i < 4 ? "0\n" : "1\n");
+    }
+    put_sys("cpu/present", "0-7\n");
+    put_sys("cpu/isolated", "3,7\n");
+    put_sys("node/node0/cpulist", "0-3\n");
+    put_sys("node/node1/cpulist", "4-7\n");
+}
+
+static const char *list_of(const cpu_set_t *set) {
+    static char buf[256];
+    return topo_list(set, buf, sizeof(buf));
+}
+
+static void allow(cpu_set_t *set, int from, int to) {
+    CPU_ZERO(set);
+    for(; from <= to; from++) CPU_SET(from, set);
+}
+
+/*
+ * spread_cpus Tests
+ */
+TEST_CASE(spread_cores_then_siblings) {
+    int order[CPU_SETSIZE], want[] = {0, 2, 4, 6, 1, 3, 5, 7}, i;
+    char list[16];
+    cpu_set_t set;
+
+    setup();
+    /* four cores of two threads, numbered together */
+    for(i = 0; i < 8; i++) {
+        snprintf(list, sizeof(list), "%d-%d\n", i & ~1, i | 1);
+        put_cpu(i, list);
+    }
+    allow(&set, 0, 7);
+    TEST_ASSERT_EQ(8, spread_cpus(root, &set, order));
+    for(i = 0; i < 8; i++) TEST_ASSERT_EQ(want[i], order[i]);
+
+    test_cleanup();
+}
+
+TEST_CASE(spread_siblings_numbered_apart) {
+    int order[CPU_SETSIZE], i;
+    char list[16];
+    cpu_set_t set;
+
+    setup();
+    /* the second threads come after all the first, as on most x86 */
+    for(i = 0; i < 8; i++) {
+        snprintf(list, sizeof(list), "%d,%d\n", i % 4, i % 4 + 4);
+        put_cpu(i, list);
+    }
+    allow(&set, 0, 7);
+    TEST_ASSERT_EQ(8, spread_cpus(root, &set, order));
+    for(i = 0; i < 8; i++) TEST_ASSERT_EQ(i, order[i]);
+
+    test_cleanup();
+}
+
+/* a thread whose sibling pmtr may not run on has the core to itself */
+TEST_CASE(spread_allowed_only) {
+    int order[CPU_SETSIZE], want[] = {1, 2, 5, 3}, i;
+    char list[16];
+    cpu_set_t set;
+
+    setup();
+    for(i = 0; i < 8; i++) {
+        snprintf(list, sizeof(list), "%d-%d\n", i & ~1, i | 1);
+        put_cpu(i, list);
+    }
+    CPU_ZERO(&set);
+    CPU_SET(1, &set);
+    CPU_SET(2, &set);
+    CPU_SET(3, &set);
+    CPU_SET(5, &set);
+    TEST_ASSERT_EQ(4, spread_cpus(root, &set, order));
+    for(i = 0; i < 4; i++) TEST_ASSERT_EQ(want[i], order[i]);
+
+    test_cleanup();
+}
+
+TEST_CASE(spread_without_topology) {
+    int order[CPU_SETSIZE], i;
+    cpu_set_t set;
+
+    setup();
+    allow(&set, 4, 9);
+    TEST_ASSERT_EQ(6, spread_cpus(root, &set, order));
+    for(i = 0; i < 6; i++) TEST_ASSERT_EQ(4 + i, order[i]);
+
+    /* an unreadable list is the same as none */
+    put_cpu(5, "garbage\n");
+    TEST_ASSERT_EQ(6, spread_cpus(root, &set, order));
+    TEST_ASSERT_EQ(5, order[1]);
+
+    test_cleanup();
+}
+
+/*
+ * selector Tests
+ */
+TEST_CASE(select_named_cpus) {
+    cpu_set_t set;
+
+    setup();
+    put_host();
+    TEST_ASSERT_EQ(0, topo_select(root, "node1", &set));
+    TEST_ASSERT_STR_EQ("4-7", list_of(&set));
+    TEST_ASSERT_EQ(0, topo_select(root, "socket0", &set));
+    TEST_ASSERT_STR_EQ("0-3", list_of(&set));
+    TEST_ASSERT_EQ(0, topo_select(root, "isolated", &set));
+    TEST_ASSERT_STR_EQ("3,7", list_of(&set));
+
+    /* what the host lacks is no cpus; what is no selector is an error */
+    TEST_ASSERT_EQ(0, topo_select(root, "node9", &set));
+    TEST_ASSERT_EQ(0, CPU_COUNT(&set));
+    TEST_ASSERT_EQ(-1, topo_select(root, "node", &set));
+    TEST_ASSERT_EQ(-1, topo_select(root, "node1x", &set));
+    TEST_ASSERT_EQ(-1, topo_select(root, "numa0", &set));
+
+    test_cleanup();
+}
+
+TEST_CASE(select_cores) {
+    cpu_set_t set;
+
+    setup();
+    put_host();
+    CPU_ZERO(&set);
+    CPU_SET(1, &set);
+    CPU_SET(4, &set);
+    topo_cores(root, &set);
+    TEST_ASSERT_STR_EQ("1,3-4,6", list_of(&set));
+    topo_one_thread(root, &set);
+    TEST_ASSERT_STR_EQ("1,4", list_of(&set));
+
+    /* the second thread alone is the one thread of its core */
+    CPU_ZERO(&set);
+    CPU_SET(3, &set);
+    topo_one_thread(root, &set);
+    TEST_ASSERT_STR_EQ("3", list_of(&set));
+
+    CPU_ZERO(&set);
+    TEST_ASSERT_STR_EQ("-", list_of(&set));
+
+    test_cleanup();
+}
+
+/* the selectors in pmtr.conf are resolved as it is parsed */
+TEST_CASE(select_in_config) {
+    UT_string *em;
+    pmtr_t cfg;
+
+    setup();
+    put_host();
+    utstring_new(em);
+    init_test_cfg(&cfg);
+    cfg.sysfs = root;
+    cfg.file = strdup(create_temp_config(
+        "job {\n  name a\n  cmd /bin/true\n  cpu node0\n}\n"
+        "job {\n  name b\n  cmd /bin/true\n  cpu socket1,isolated,2\n}\n"
+        "job {\n  name c\n  cmd /bin/true\n"
+        "  cpu cores-of node1 exclude-siblings\n}\n"
+        "job {\n  name d\n  cmd /bin/true\n  cpu isolated exclude-siblings\n}\n"
+        "job {\n  name e\n  cmd /bin/true\n  cpu cores-of 0\n}\n"));
+    TEST_ASSERT_EQ(0, parse_jobs(&cfg, em));
+    TEST_ASSERT_STR_EQ("0-3", list_of(&get_job_by_name(&cfg.jx, "a")->cpuset));
+    TEST_ASSERT_STR_EQ("2-7", list_of(&get_job_by_name(&cfg.jx, "b")->cpuset));
+    TEST_ASSERT_STR_EQ("4-5", list_of(&get_job_by_name(&cfg.jx, "c")->cpuset));
+    TEST_ASSERT_STR_EQ("3,7", list_of(&get_job_by_name(&cfg.jx, "d")->cpuset));
+    TEST_ASSERT_STR_EQ("0,2", list_of(&get_job_by_name(&cfg.jx, "e")->cpuset));
+
+    utstring_clear(em);
+    utarray_clear(cfg.jobs);
+    index_free(&cfg.jx);
+    create_temp_config("job {\n  name a\n  cmd /bin/true\n  cpu nod0\n}\n");
+    TEST_ASSERT_EQ(-1, parse_jobs(&cfg, em));
+    TEST_ASSERT(strstr(utstring_body(em), "cpuset nod0") != NULL);
+
+    utstring_clear(em);
+    create_temp_config("job {\n  name a\n  cmd /bin/true\n"
+                       "  cpu node0 exclude-threads\n}\n");
+    TEST_ASSERT_EQ(-1, parse_jobs(&cfg, em));
+
+    utstring_clear(em);
+    create_temp_config("job {\n  name a\n  cmd /bin/true\n  cpu node0,\n}\n");
+    TEST_ASSERT_EQ(-1, parse_jobs(&cfg, em));
+
+    utstring_free(em);
+    free_test_cfg(&cfg);
+    test_cleanup();
+}
+
+/* the instances of a job with cpu spread are pinned one to a cpu */
+TEST_CASE(spread_instances) {
+    int order[CPU_SETSIZE], n, i;
+    char name[32];
+    cpu_set_t set;
+    UT_string *em;
+    pmtr_t cfg;
+    job_t *job;
+
+    setup();
+    TEST_ASSERT_EQ(0, sched_getaffinity(0, sizeof(set), &set));
+    n = spread_cpus(root, &set, order);
+    TEST_ASSERT(n > 0);
+
+    utstring_new(em);
+    init_test_cfg(&cfg);
+    cfg.sysfs = root;
+    cfg.file = strdup(create_temp_config(
+        "job {\n  name w-%i\n  cmd /bin/true\n  cpu spread\n"
+        "  instances 9\n}\n"));
+    TEST_ASSERT_EQ(0, parse_jobs(&cfg, em));
+    TEST_ASSERT_EQ(9, job_count(&cfg));
+    for(i = 0; i < 9; i++) {
+        snprintf(name, sizeof(name), "w-%d", i);
+        job = get_job_by_name(&cfg.jx, name);
+        TEST_ASSERT_NOT_NULL(job);
+        TEST_ASSERT_EQ(1, CPU_COUNT(&job->cpuset));
+        TEST_ASSERT(CPU_ISSET(order[i % n], &job->cpuset));
+    }
+
+    /* as a placement, it is only for instances */
+    utstring_clear(em);
+    utarray_clear(cfg.jobs);
+    create_temp_config("job {\n  name w\n  cmd /bin/true\n  cpu spread\n}\n");
+    TEST_ASSERT_EQ(-1, parse_jobs(&cfg, em));
+    TEST_ASSERT(strstr(utstring_body(em), "needs instances") != NULL);
+
+    utstring_free(em);
+    free_test_cfg(&cfg);
+    test_cleanup();
+}
+
+int main(int argc, char *argv[]) {
+    (void)argc; (void)argv;
+    printf("pmtr CPU Topology Tests\n");
+
+    TEST_SUITE_BEGIN("topology");
+    RUN_TEST(spread_cores_then_siblings);
+    RUN_TEST(spread_siblings_numbered_apart);
+    RUN_TEST(spread_allowed_only);
+    RUN_TEST(spread_without_topology);
+    RUN_TEST(spread_instances);
+    RUN_TEST(select_named_cpus);
+    RUN_TEST(select_cores);
+    RUN_TEST(select_in_config);
+    TEST_SUITE_END();
+
+    print_test_results();
+    return get_test_exit_code();
+}
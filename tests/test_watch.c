@@ -0,0 +1,606 @@
+/*
+ * Unit Tests for pmtr File Watching (watch.c)
+ * Tests the set of watched paths and the debouncing of inotify events
+ */
+
+#define _GNU_SOURCE
+
+#include <time.h>
+#include <sys/epoll.h>
+#include "test_framework.h"
+#include "test_helpers.h"
+#include "../src/watch.h"
+
+static job_t *push_dep_job(pmtr_t *cfg, const char *name, char *dep) {
+    job_t job;
+    job_ini(&job);
+    job.name = strdup(name);
+    if (dep) utarray_push_back(&job.depv, &dep);
+    utarray_push_back(cfg->jobs, &job);
+    job_fin(&job);
+    return (job_t*)utarray_back(cfg->jobs);
+}
+
+static int setup(pmtr_t *cfg) {
+    if (test_init() < 0) return -1;
+    init_test_cfg(cfg);
+    cfg->file = strdup(create_temp_file("pmtr.conf", "job {}\n"));
+    cfg->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (cfg->epoll_fd == -1) return -1;
+    return watch_init(cfg);
+}
+
+static void teardown(pmtr_t *cfg) {
+    watch_fin(cfg);
+    close(cfg->epoll_fd);
+    free_test_cfg(cfg);
+    test_cleanup();
+}
+
+static void sleep_ms(int ms) {
+    struct timespec ts = {ms / 1000, (ms % 1000) * 1000000L};
+    nanosleep(&ts, NULL);
+}
+
+static void touch(const char *path, const char *content) {
+    FILE *f = fopen(path, "w");
+    if (f == NULL) return;
+    fputs(content, f);
+    fclose(f);
+}
+
+/* the wd a watched path has, or -2 if it is not watched */
+static int slot_wd(pmtr_t *cfg, const char *path) {
+    unsigned i;
+    for(i = 0; i < cfg->wt.size; i++) {
+        if (cfg->wt.tab[i].path && !strcmp(cfg->wt.tab[i].path, path)) {
+            return cfg->wt.tab[i].wd;
+        }
+    }
+    return -2;
+}
+
+static int has_path(UT_array *paths, const char *path) {
+    char **p = NULL;
+    int n = 0;
+    while ( (p = (char**)utarray_next(paths, p))) {
+        if (strcmp(*p, path) == 0) n++;
+    }
+    return n;
+}
+
+/*
+ * watch_sync Tests
+ */
+TEST_CASE(watch_sync_follows_jobs) {
+    pmtr_t cfg;
+    TEST_ASSERT_EQ(0, setup(&cfg));
+    TEST_ASSERT(cfg.wt.fd != -1);
+
+    char *a = strdup(create_temp_file("a.conf", "a"));
+    char *b = strdup(create_temp_file("b.conf", "b"));
+    push_dep_job(&cfg, "one", a);
+    push_dep_job(&cfg, "two", a);    /* shares a dependency */
+    job_t *three = push_dep_job(&cfg, "three", b);
+
+    watch_sync(&cfg);
+    TEST_ASSERT_EQ(3, (int)cfg.wt.n);  /* pmtr.conf, a and b */
+
+    three->disabled = 1;
+    watch_sync(&cfg);
+    TEST_ASSERT_EQ(2, (int)cfg.wt.n);
+
+    three->disabled = 0;
+    watch_sync(&cfg);
+    TEST_ASSERT_EQ(3, (int)cfg.wt.n);
+
+    free(a); free(b);
+    teardown(&cfg);
+}
+
+TEST_CASE(watch_jobs_by_path) {
+    pmtr_t cfg;
+    TEST_ASSERT_EQ(0, setup(&cfg));
+
+    char *a = strdup(create_temp_file("a.conf", "a"));
+    char *b = strdup(create_temp_file("b.conf", "b"));
+    push_dep_job(&cfg, "one", a);
+    push_dep_job(&cfg, "two", a);
+    job_t *three = push_dep_job(&cfg, "three", b);
+    three->disabled = 1;
+    watch_sync(&cfg);
+
+    UT_array *jobs = watch_jobs(&cfg, a);
+    TEST_ASSERT_NOT_NULL(jobs);
+    TEST_ASSERT_EQ(2, (int)utarray_len(jobs));
+    TEST_ASSERT_STR_EQ("one", *(char**)utarray_eltptr(jobs, 0));
+    TEST_ASSERT_STR_EQ("two", *(char**)utarray_eltptr(jobs, 1));
+    TEST_ASSERT(watch_jobs(&cfg, b) == NULL);      /* disabled: not watched */
+    TEST_ASSERT_EQ(0, (int)utarray_len(watch_jobs(&cfg, cfg.file)));
+
+    /* the names are worked out again on each sync */
+    three->disabled = 0;
+    utarray_erase(cfg.jobs, 1, 1);
+    watch_sync(&cfg);
+    TEST_ASSERT_EQ(1, (int)utarray_len(watch_jobs(&cfg, a)));
+    TEST_ASSERT_EQ(1, (int)utarray_len(watch_jobs(&cfg, b)));
+
+    free(a); free(b);
+    teardown(&cfg);
+}
+
+TEST_CASE(watch_sync_shares_directories) {
+    pmtr_t cfg;
+    unsigned i, dirs = 0;
+    TEST_ASSERT_EQ(0, setup(&cfg));
+
+    char *a = strdup(create_temp_file("a.conf", "a"));
+    char *b = strdup(create_temp_file("b.conf", "b"));
+    push_dep_job(&cfg, "one", a);
+    push_dep_job(&cfg, "two", b);
+    watch_sync(&cfg);
+
+    /* pmtr.conf, a and b are in one directory, watched once */
+    TEST_ASSERT_EQ(3, (int)cfg.wt.n);
+    TEST_ASSERT(watch_jobs(&cfg, a) != NULL);
+    for(i = 0; i < cfg.wt.dsize; i++) if (cfg.wt.dirs[i].wd) dirs++;
+    TEST_ASSERT_EQ(1, (int)dirs);
+    for(i = 0; i < cfg.wt.size; i++) {
+        if (cfg.wt.tab[i].path) TEST_ASSERT(cfg.wt.tab[i].wd != -1);
+    }
+
+    free(a); free(b);
+    teardown(&cfg);
+}
+
+TEST_CASE(watch_sync_many_paths) {
+    pmtr_t cfg;
+    char name[32], *path;
+    int i;
+    TEST_ASSERT_EQ(0, setup(&cfg));
+
+    for(i = 0; i < 100; i++) {
+        snprintf(name, sizeof(name), "dep%d", i);
+        path = strdup(create_temp_file(name, name));
+        push_dep_job(&cfg, name, path);
+        free(path);
+    }
+    watch_sync(&cfg);
+    TEST_ASSERT_EQ(101, (int)cfg.wt.n);
+    TEST_ASSERT(cfg.wt.size >= 2 * cfg.wt.n);
+
+    utarray_clear(cfg.jobs);
+    watch_sync(&cfg);
+    TEST_ASSERT_EQ(1, (int)cfg.wt.n);
+
+    teardown(&cfg);
+}
+
+/*
+ * watch_read / watch_timer Tests
+ */
+TEST_CASE(watch_change_after_quiet_period) {
+    pmtr_t cfg;
+    UT_array *paths;
+    TEST_ASSERT_EQ(0, setup(&cfg));
+    utarray_new(paths, &ut_ptr_icd);
+
+    char *a = strdup(create_temp_file("a.conf", "a"));
+    push_dep_job(&cfg, "one", a);
+    watch_sync(&cfg);
+
+    touch(a, "a2");
+    watch_read(&cfg);
+    TEST_ASSERT_EQ(1, cfg.wt.armed);
+    TEST_ASSERT_EQ(0, watch_timer(&cfg, paths));  /* not quiet long enough */
+    TEST_ASSERT_EQ(1, cfg.wt.armed);              /* so it waits again */
+
+    sleep_ms(WATCH_DELAY_MIN + 20);
+    TEST_ASSERT_EQ(1, watch_timer(&cfg, paths));
+    TEST_ASSERT_EQ(1, has_path(paths, a));
+
+    /* nothing more is pending */
+    utarray_clear(paths);
+    TEST_ASSERT_EQ(0, watch_timer(&cfg, paths));
+
+    free(a);
+    utarray_free(paths);
+    teardown(&cfg);
+}
+
+TEST_CASE(watch_burst_is_coalesced) {
+    pmtr_t cfg;
+    UT_array *paths;
+    int i;
+    TEST_ASSERT_EQ(0, setup(&cfg));
+    utarray_new(paths, &ut_ptr_icd);
+
+    char *a = strdup(create_temp_file("a.conf", "a"));
+    char *b = strdup(create_temp_file("b.conf", "b"));
+    push_dep_job(&cfg, "one", a);
+    push_dep_job(&cfg, "two", b);
+    watch_sync(&cfg);
+
+    for(i = 0; i < 4; i++) {
+        touch((i % 2) ? a : b, "x");
+        watch_read(&cfg);
+    }
+    TEST_ASSERT(cfg.wt.delay_ms > WATCH_DELAY_MIN);  /* the wait grew */
+    TEST_ASSERT(cfg.wt.flush_ms <= cfg.wt.first_ms + WATCH_WAIT_MAX);
+
+    sleep_ms(cfg.wt.flush_ms - tw_clock() + 20);
+    TEST_ASSERT_EQ(2, watch_timer(&cfg, paths));
+    TEST_ASSERT_EQ(1, has_path(paths, a));
+    TEST_ASSERT_EQ(1, has_path(paths, b));
+
+    free(a); free(b);
+    utarray_free(paths);
+    teardown(&cfg);
+}
+
+TEST_CASE(watch_removed_file_rewatched) {
+    pmtr_t cfg;
+    UT_array *paths;
+    TEST_ASSERT_EQ(0, setup(&cfg));
+    utarray_new(paths, &ut_ptr_icd);
+
+    char *a = strdup(create_temp_file("a.conf", "a"));
+    push_dep_job(&cfg, "one", a);
+    watch_sync(&cfg);
+
+    unlink(a);
+    watch_read(&cfg);
+    sleep_ms(WATCH_DELAY_MIN + 20);
+    TEST_ASSERT_EQ(1, watch_timer(&cfg, paths));
+    TEST_ASSERT_EQ(1, has_path(paths, a));
+
+    /* recreated, then picked up again by the sync after the rescan */
+    touch(a, "a2");
+    watch_sync(&cfg);
+    touch(a, "a3");
+    watch_read(&cfg);
+    sleep_ms(WATCH_DELAY_MIN + 20);
+    utarray_clear(paths);
+    TEST_ASSERT_EQ(1, watch_timer(&cfg, paths));
+
+    free(a);
+    utarray_free(paths);
+    teardown(&cfg);
+}
+
+TEST_CASE(watch_follows_rename_over) {
+    pmtr_t cfg;
+    UT_array *paths;
+    char tmp[512];
+    TEST_ASSERT_EQ(0, setup(&cfg));
+    utarray_new(paths, &ut_ptr_icd);
+
+    char *a = strdup(create_temp_file("a.conf", "a"));
+    push_dep_job(&cfg, "one", a);
+    watch_sync(&cfg);
+
+    /* as an editor or deployment tool replaces a file */
+    snprintf(tmp, sizeof(tmp), "%s.new", a);
+    touch(tmp, "a2");
+    TEST_ASSERT_EQ(0, rename(tmp, a));
+    watch_read(&cfg);
+    sleep_ms(WATCH_DELAY_MIN + 20);
+    TEST_ASSERT_EQ(1, watch_timer(&cfg, paths));
+
+    /* the new file is watched without a sync */
+    touch(a, "a3");
+    watch_read(&cfg);
+    sleep_ms(WATCH_DELAY_MIN + 20);
+    utarray_clear(paths);
+    TEST_ASSERT_EQ(1, watch_timer(&cfg, paths));
+    TEST_ASSERT_EQ(1, has_path(paths, a));
+
+    free(a);
+    utarray_free(paths);
+    teardown(&cfg);
+}
+
+TEST_CASE(watch_ignores_other_files) {
+    pmtr_t cfg;
+    UT_array *paths;
+    TEST_ASSERT_EQ(0, setup(&cfg));
+    utarray_new(paths, &ut_ptr_icd);
+
+    char *a = strdup(create_temp_file("a.conf", "a"));
+    push_dep_job(&cfg, "one", a);
+    watch_sync(&cfg);
+
+    /* a file beside it, and one with the watched name as a prefix */
+    create_temp_file("other", "x");
+    create_temp_file("a.conf.swp", "x");
+    watch_read(&cfg);
+    TEST_ASSERT_EQ(0, cfg.wt.armed);
+    TEST_ASSERT_EQ(0, watch_timer(&cfg, paths));
+
+    free(a);
+    utarray_free(paths);
+    teardown(&cfg);
+}
+
+/* files included from a directory: a new one there is a change to it */
+TEST_CASE(watch_included_directory) {
+    pmtr_t cfg;
+    UT_array *paths;
+    UT_string *em;
+    char dir[512], path[600];
+    TEST_ASSERT_EQ(0, setup(&cfg));
+    utarray_new(paths, &ut_ptr_icd);
+    utstring_new(em);
+
+    snprintf(dir, sizeof(dir), "%s/conf.d/", g_test_tmpdir);
+    TEST_ASSERT_EQ(0, mkdir(dir, 0755));
+    create_temp_file("conf.d/a", "job {\n  name a\n  cmd /bin/true\n}\n");
+    create_temp_config("include conf.d\n");
+    TEST_ASSERT_EQ(0, parse_jobs(&cfg, em));
+    watch_sync(&cfg);
+    TEST_ASSERT(slot_wd(&cfg, dir) >= 0);
+
+    snprintf(path, sizeof(path), "%sb", dir);
+    touch(path, "job {\n  name b\n  cmd /bin/true\n}\n");
+    watch_read(&cfg);
+    sleep_ms(WATCH_DELAY_MIN + 20);
+    TEST_ASSERT_EQ(1, watch_timer(&cfg, paths));
+    TEST_ASSERT_EQ(1, has_path(paths, dir));
+    TEST_ASSERT(is_config(&cfg, dir));
+
+    /* and one that is there already is watched by its own path */
+    snprintf(path, sizeof(path), "%sa", dir);
+    touch(path, "job {\n  name a\n  cmd /bin/false\n}\n");
+    watch_read(&cfg);
+    sleep_ms(WATCH_DELAY_MIN + 20);
+    utarray_clear(paths);
+    TEST_ASSERT_EQ(1, watch_timer(&cfg, paths));
+    TEST_ASSERT_EQ(1, has_path(paths, path));
+
+    utstring_free(em);
+    utarray_free(paths);
+    teardown(&cfg);
+}
+
+TEST_CASE(watch_follows_symlink_swap) {
+    pmtr_t cfg;
+    UT_array *paths;
+    char link[512], tmp[512];
+    TEST_ASSERT_EQ(0, setup(&cfg));
+    utarray_new(paths, &ut_ptr_icd);
+
+    char *v1 = strdup(create_temp_file("v1.conf", "1"));
+    char *v2 = strdup(create_temp_file("v2.conf", "2"));
+    snprintf(link, sizeof(link), "%s/current.conf", g_test_tmpdir);
+    snprintf(tmp, sizeof(tmp), "%s/current.conf.tmp", g_test_tmpdir);
+    TEST_ASSERT_EQ(0, symlink(v1, link));
+    push_dep_job(&cfg, "one", link);
+    watch_sync(&cfg);
+
+    /* as with ln -sfn, a new link renamed over the old */
+    TEST_ASSERT_EQ(0, symlink(v2, tmp));
+    TEST_ASSERT_EQ(0, rename(tmp, link));
+    watch_read(&cfg);
+    sleep_ms(WATCH_DELAY_MIN + 20);
+    TEST_ASSERT_EQ(1, watch_timer(&cfg, paths));
+    TEST_ASSERT_EQ(1, has_path(paths, link));
+
+    free(v1); free(v2);
+    utarray_free(paths);
+    teardown(&cfg);
+}
+
+TEST_CASE(watch_directory_removed) {
+    pmtr_t cfg;
+    UT_array *paths;
+    char dir[512], path[600];
+    TEST_ASSERT_EQ(0, setup(&cfg));
+    utarray_new(paths, &ut_ptr_icd);
+
+    snprintf(dir, sizeof(dir), "%s/sub", g_test_tmpdir);
+    snprintf(path, sizeof(path), "%s/dep.conf", dir);
+    TEST_ASSERT_EQ(0, mkdir(dir, 0755));
+    touch(path, "x");
+    push_dep_job(&cfg, "one", path);
+    watch_sync(&cfg);
+    TEST_ASSERT_EQ(2, (int)cfg.wt.n);
+
+    unlink(path);
+    rmdir(dir);
+    watch_read(&cfg);
+    sleep_ms(WATCH_DELAY_MIN + 20);
+    TEST_ASSERT_EQ(1, watch_timer(&cfg, paths));
+    TEST_ASSERT_EQ(1, has_path(paths, path));
+    TEST_ASSERT_EQ(-1, slot_wd(&cfg, path));   /* nothing there to watch */
+
+    /* back again, picked up by the next sync */
+    TEST_ASSERT_EQ(0, mkdir(dir, 0755));
+    touch(path, "y");
+    watch_sync(&cfg);
+    TEST_ASSERT(slot_wd(&cfg, path) != -1);
+
+    utarray_free(paths);
+    teardown(&cfg);
+}
+
+TEST_CASE(watch_without_inotify) {
+    pmtr_t cfg;
+    UT_array *paths;
+    TEST_ASSERT_EQ(0, test_init());
+    init_test_cfg(&cfg);
+    utarray_new(paths, &ut_ptr_icd);
+
+    char *a = strdup(create_temp_file("a.conf", "a"));
+    push_dep_job(&cfg, "one", a);
+    watch_sync(&cfg);                     /* only logs */
+    TEST_ASSERT_EQ(0, (int)cfg.wt.n);
+    TEST_ASSERT_EQ(0, watch_timer(&cfg, paths));
+
+    free(a);
+    utarray_free(paths);
+    free_test_cfg(&cfg);
+    test_cleanup();
+}
+
+/* a change is handed back on time while a retry is pending for later */
+TEST_CASE(watch_flush_moves_retry_up) {
+    pmtr_t cfg;
+    TEST_ASSERT_EQ(0, setup(&cfg));
+
+    free(cfg.file);
+    cfg.file = strdup("/nonexistent-pmtr-dir/pmtr.conf");
+    char *a = strdup(create_temp_file("a.conf", "a"));
+    push_dep_job(&cfg, "one", a);
+    watch_sync(&cfg);
+    TEST_ASSERT_EQ(1, cfg.wt.retry);
+    TEST_ASSERT_EQ(1, cfg.wt.armed);
+
+    uint64_t now = tw_clock();
+    touch(a, "a2");
+    watch_read(&cfg);
+    TEST_ASSERT_EQ(1, cfg.wt.armed);
+    TEST_ASSERT_EQ_SIZE(1, cfg.tw.n);
+    TEST_ASSERT(tw_next(&cfg.tw) <= now + WATCH_DELAY_MIN + 100);
+
+    free(a);
+    teardown(&cfg);
+}
+
+/*
+ * Polling Tests (as without inotify)
+ */
+static void setup_poll(pmtr_t *cfg) {
+    test_init();
+    init_test_cfg(cfg);
+    cfg->file = strdup(create_temp_file("pmtr.conf", "job {}\n"));
+    cfg->wt.poll = 1;
+}
+
+/* make every path due to be looked at */
+static void all_due(pmtr_t *cfg) {
+    unsigned i;
+    for(i = 0; i < cfg->wt.size; i++) cfg->wt.tab[i].poll.next_ms = 0;
+}
+
+TEST_CASE(poll_sees_changes) {
+    pmtr_t cfg;
+    UT_array *paths;
+    setup_poll(&cfg);
+    utarray_new(paths, &ut_ptr_icd);
+
+    char *a = strdup(create_temp_file("a.conf", "a"));
+    char *b = strdup(create_temp_file("b.conf", "b"));
+    push_dep_job(&cfg, "one", a);
+    push_dep_job(&cfg, "two", b);
+    watch_sync(&cfg);
+    TEST_ASSERT_EQ(3, (int)cfg.wt.n);
+    TEST_ASSERT_EQ(1, cfg.wt.armed);
+
+    all_due(&cfg);
+    TEST_ASSERT_EQ(0, watch_timer(&cfg, paths));
+
+    touch(a, "a2");
+    all_due(&cfg);
+    TEST_ASSERT_EQ(1, watch_timer(&cfg, paths));
+    TEST_ASSERT_EQ(1, has_path(paths, a));
+    TEST_ASSERT_EQ(1, cfg.wt.armed);
+
+    /* renamed over, same size */
+    char tmp[512];
+    snprintf(tmp, sizeof(tmp), "%s.new", b);
+    touch(tmp, "c");
+    TEST_ASSERT_EQ(0, rename(tmp, b));
+    all_due(&cfg);
+    utarray_clear(paths);
+    TEST_ASSERT_EQ(1, watch_timer(&cfg, paths));
+    TEST_ASSERT_EQ(1, has_path(paths, b));
+
+    /* gone */
+    unlink(b);
+    all_due(&cfg);
+    utarray_clear(paths);
+    TEST_ASSERT_EQ(1, watch_timer(&cfg, paths));
+    TEST_ASSERT_EQ(1, has_path(paths, b));
+
+    free(a); free(b);
+    utarray_free(paths);
+    free_test_cfg(&cfg);
+    test_cleanup();
+}
+
+TEST_CASE(poll_backs_off) {
+    pmtr_t cfg;
+    UT_array *paths;
+    unsigned i, every = 0;
+    setup_poll(&cfg);
+    utarray_new(paths, &ut_ptr_icd);
+
+    char *a = strdup(create_temp_file("a.conf", "a"));
+    push_dep_job(&cfg, "one", a);
+    watch_sync(&cfg);
+
+    /* not due yet: not looked at, even if changed */
+    touch(a, "a2");
+    TEST_ASSERT_EQ(0, watch_timer(&cfg, paths));
+
+    /* each unchanged look doubles the interval, up to the limit */
+    all_due(&cfg);
+    TEST_ASSERT_EQ(1, watch_timer(&cfg, paths));
+    for(i = 0; i < 10; i++) {
+        all_due(&cfg);
+        watch_timer(&cfg, paths);
+    }
+    for(i = 0; i < cfg.wt.size; i++) {
+        if (cfg.wt.tab[i].path) every = cfg.wt.tab[i].poll.every_ms;
+    }
+    TEST_ASSERT_EQ(WATCH_POLL_MAX, (int)every);
+
+    /* a change brings it back to the shortest */
+    touch(a, "a33");
+    all_due(&cfg);
+    utarray_clear(paths);
+    TEST_ASSERT_EQ(1, watch_timer(&cfg, paths));
+    for(i = 0; i < cfg.wt.size; i++) {
+        if (cfg.wt.tab[i].path && !strcmp(cfg.wt.tab[i].path, a)) {
+            TEST_ASSERT_EQ(WATCH_POLL_MIN, (int)cfg.wt.tab[i].poll.every_ms);
+        }
+    }
+
+    free(a);
+    utarray_free(paths);
+    free_test_cfg(&cfg);
+    test_cleanup();
+}
+
+int main(int argc, char *argv[]) {
+    (void)argc; (void)argv;
+    printf("pmtr File Watching Tests\n");
+
+    TEST_SUITE_BEGIN("watch_sync");
+    RUN_TEST(watch_sync_follows_jobs);
+    RUN_TEST(watch_jobs_by_path);
+    RUN_TEST(watch_sync_shares_directories);
+    RUN_TEST(watch_sync_many_paths);
+    TEST_SUITE_END();
+
+    TEST_SUITE_BEGIN("watch_read / watch_timer");
+    RUN_TEST(watch_change_after_quiet_period);
+    RUN_TEST(watch_flush_moves_retry_up);
+    RUN_TEST(watch_burst_is_coalesced);
+    RUN_TEST(watch_removed_file_rewatched);
+    RUN_TEST(watch_follows_rename_over);
+    RUN_TEST(watch_ignores_other_files);
+    RUN_TEST(watch_included_directory);
+    RUN_TEST(watch_follows_symlink_swap);
+    RUN_TEST(watch_directory_removed);
+    RUN_TEST(watch_without_inotify);
+    TEST_SUITE_END();
+
+    TEST_SUITE_BEGIN("polling");
+    RUN_TEST(poll_sees_changes);
+    RUN_TEST(poll_backs_off);
+    TEST_SUITE_END();
+
+    print_test_results();
+    return get_test_exit_code();
+}